@@ -0,0 +1,464 @@
+#include "synthetic_feed.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace gtfs;
+
+// Benchmarks of parsing, reading, writing and lookups on the synthetic feeds. Besides the google
+// benchmark flags it accepts:
+//   --stop_times_counts=10000,100000  sizes of the generated feeds;
+//   --feeds_directory=<path>          directory with the feeds reused between the runs, e.g.
+//                                     the ones generated by generate_feed.
+namespace
+{
+std::vector<size_t> stop_times_counts = {10000, 100000};
+std::string feeds_directory =
+    (std::filesystem::temp_directory_path() / "just_gtfs_benchmarks").string();
+
+std::string get_feed_path(size_t stop_times_count)
+{
+  static std::map<size_t, std::string> paths;
+  const auto it = paths.find(stop_times_count);
+  if (it != paths.end())
+    return it->second;
+
+  const std::string path =
+      add_trailing_slash(feeds_directory) + "stop_times_" + std::to_string(stop_times_count);
+  Feed feed(path);
+  const bool is_complete = feed.read_feed_info() == ResultCode::OK &&
+                           feed.get_feed_info().feed_version == std::to_string(stop_times_count);
+  if (!is_complete)
+  {
+    const Result res = benchmarks::write_synthetic_feed(path, stop_times_count);
+    if (res != ResultCode::OK)
+      throw std::runtime_error(res.message);
+  }
+  return paths.emplace(stop_times_count, path).first->second;
+}
+
+std::string get_output_path(size_t stop_times_count)
+{
+  return add_trailing_slash(feeds_directory) + "output_" + std::to_string(stop_times_count);
+}
+
+// Feeds are read once and shared by the benchmarks of writing and lookups.
+const Feed & get_feed(size_t stop_times_count, bool with_indexes)
+{
+  static std::map<std::pair<size_t, bool>, std::unique_ptr<Feed>> feeds;
+  auto & feed = feeds[{stop_times_count, with_indexes}];
+  if (feed)
+    return *feed;
+
+  feed = std::make_unique<Feed>(get_feed_path(stop_times_count));
+  const Result res = feed->read_feed();
+  if (res != ResultCode::OK)
+    throw std::runtime_error(res.message);
+
+  if (with_indexes)
+  {
+    feed->build_indexes();
+    feed->build_stop_times_index();
+    feed->build_service_days_index();
+    feed->build_spatial_index();
+  }
+  return *feed;
+}
+
+// Ids of the entities which are looked up in turn, so that the lookups are not cached.
+std::vector<Id> get_ids(char prefix, size_t count)
+{
+  std::vector<Id> ids;
+  for (size_t i = 0; i < std::min<size_t>(count, 1000); ++i)
+    ids.emplace_back(std::string(1, prefix) + std::to_string(benchmarks::get_hash(i) % count));
+  return ids;
+}
+
+void split_record(benchmark::State & state, const std::string & record)
+{
+  CsvRowView fields;
+  CsvTokenStorage storage;
+  for (auto _ : state)
+  {
+    CsvParser::split_record(record, fields, storage);
+    benchmark::DoNotOptimize(fields.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * record.size()));
+}
+
+template <typename Parse>
+void parse_values(benchmark::State & state, const std::vector<std::string> & values, Parse parse)
+{
+  for (auto _ : state)
+  {
+    for (const auto & value : values)
+      benchmark::DoNotOptimize(parse(value));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * values.size()));
+}
+
+std::vector<std::string> get_times()
+{
+  std::vector<std::string> times;
+  for (size_t i = 0; i < 1000; ++i)
+    times.push_back(benchmarks::format_seconds(benchmarks::get_hash(i) % (30 * 3600)));
+  return times;
+}
+
+std::vector<std::string> get_dates()
+{
+  std::vector<std::string> dates;
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    const uint64_t hash = benchmarks::get_hash(i);
+    std::ostringstream date;
+    date << 2000 + hash % 30 << std::setw(2) << std::setfill('0') << 1 + hash / 30 % 12
+         << std::setw(2) << std::setfill('0') << 1 + hash / 360 % 28;
+    dates.push_back(date.str());
+  }
+  return dates;
+}
+
+struct FeedFileBenchmark
+{
+  const std::string & file;
+  Result (Feed::*read)();
+  Result (Feed::*write)(const std::string & gtfs_path) const;
+};
+
+const std::vector<FeedFileBenchmark> & get_file_benchmarks()
+{
+  static const std::vector<FeedFileBenchmark> benchmarks = {
+      {file_agency, &Feed::read_agencies, &Feed::write_agencies},
+      {file_stops, &Feed::read_stops, &Feed::write_stops},
+      {file_routes, &Feed::read_routes, &Feed::write_routes},
+      {file_trips, &Feed::read_trips, &Feed::write_trips},
+      {file_stop_times, &Feed::read_stop_times, &Feed::write_stop_times},
+      {file_calendar, &Feed::read_calendar, &Feed::write_calendar},
+      {file_calendar_dates, &Feed::read_calendar_dates, &Feed::write_calendar_dates},
+      {file_fare_attributes, &Feed::read_fare_attributes, &Feed::write_fare_attributes},
+      {file_fare_rules, &Feed::read_fare_rules, &Feed::write_fare_rules},
+      {file_shapes, &Feed::read_shapes, &Feed::write_shapes},
+      {file_frequencies, &Feed::read_frequencies, &Feed::write_frequencies},
+      {file_transfers, &Feed::read_transfers, &Feed::write_transfers},
+      {file_pathways, &Feed::read_pathways, &Feed::write_pathways},
+      {file_levels, &Feed::read_levels, &Feed::write_levels},
+      {file_feed_info, &Feed::read_feed_info, &Feed::write_feed_info},
+      {file_translations, &Feed::read_translations, &Feed::write_translations},
+      {file_attributions, &Feed::read_attributions, &Feed::write_attributions}};
+  return benchmarks;
+}
+
+// The feed is created and destroyed outside of the measured time.
+template <typename Read>
+void read_feed_files(benchmark::State & state, size_t stop_times_count, uint64_t bytes, Read read)
+{
+  const std::string path = get_feed_path(stop_times_count);
+  std::optional<Feed> feed;
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    feed.emplace(path);
+    state.ResumeTiming();
+
+    const Result res = read(*feed);
+    if (res != ResultCode::OK)
+    {
+      state.SkipWithError(res.message.c_str());
+      break;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+
+template <typename Write>
+void write_feed_files(benchmark::State & state, size_t stop_times_count, Write write)
+{
+  const Feed & feed = get_feed(stop_times_count, false);
+  const std::string path = get_output_path(stop_times_count);
+  std::filesystem::create_directories(path);
+  for (auto _ : state)
+  {
+    const Result res = write(feed, path);
+    if (res != ResultCode::OK)
+    {
+      state.SkipWithError(res.message.c_str());
+      break;
+    }
+  }
+}
+
+template <typename Lookup>
+void lookup_ids(benchmark::State & state, const std::vector<Id> & ids, Lookup lookup)
+{
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(lookup(ids[i]));
+    i = i + 1 == ids.size() ? 0 : i + 1;
+  }
+}
+
+uint64_t get_feed_size(const std::string & path)
+{
+  uint64_t size = 0;
+  for (const auto & entry : std::filesystem::directory_iterator(path))
+    size += entry.file_size();
+  return size;
+}
+
+void register_parsing_benchmarks()
+{
+  const std::string stop_time = "T12345,08:15:00,08:15:30,S678,12,,0,0,,,6000,1";
+  const std::string quoted = "R12,A1,12,\"Route 12, \"\"express\"\" line\",,3,,FF0000,FFFFFF,,,";
+  const std::string long_record = "stops,stop_name,en,\"" + std::string(500, 'x') + ", " +
+                                  std::string(500, 'y') + "\",S1,,";
+  benchmark::RegisterBenchmark("split_record/stop_time", split_record, stop_time);
+  benchmark::RegisterBenchmark("split_record/quoted", split_record, quoted);
+  benchmark::RegisterBenchmark("split_record/long", split_record, long_record);
+
+  const auto times = get_times();
+  const auto dates = get_dates();
+  benchmark::RegisterBenchmark("parse_time/constructor", [times](benchmark::State & state) {
+    parse_values(state, times, [](const std::string & value) { return Time(value); });
+  });
+  benchmark::RegisterBenchmark("parse_time/result", [times](benchmark::State & state) {
+    Time time;
+    parse_values(state, times, [&](const std::string & value) { return time.parse(value); });
+  });
+  benchmark::RegisterBenchmark("parse_date/constructor", [dates](benchmark::State & state) {
+    parse_values(state, dates, [](const std::string & value) { return Date(value); });
+  });
+  benchmark::RegisterBenchmark("parse_date/result", [dates](benchmark::State & state) {
+    Date date;
+    parse_values(state, dates, [&](const std::string & value) { return date.parse(value); });
+  });
+}
+
+// Lookups are measured without and with the indexes.
+template <typename Register>
+void register_lookup_benchmarks(size_t n, Register register_benchmark)
+{
+  auto register_lookup = [&](const std::string & name, auto fn) {
+    register_benchmark(name, fn)->Unit(benchmark::kMicrosecond);
+  };
+  const benchmarks::SyntheticFeedSizes sizes(n);
+  const auto stop_ids = get_ids('S', sizes.stops_count);
+  const auto route_ids = get_ids('R', sizes.routes_count);
+  const auto trip_ids = get_ids('T', sizes.trips_count);
+  std::vector<Id> shape_ids;
+  for (const auto & route_id : route_ids)
+    shape_ids.emplace_back("SH" + std::string(route_id).substr(1));
+
+  for (const bool with_indexes : {false, true})
+  {
+    const std::string suffix = with_indexes ? "_indexed" : "";
+    auto feed = [n, with_indexes]() -> const Feed & { return get_feed(n, with_indexes); };
+    register_lookup("get_stop" + suffix, [=](benchmark::State & state) {
+      const Feed & loaded = feed();
+      lookup_ids(state, stop_ids, [&](const Id & id) { return loaded.get_stop(id); });
+    });
+    register_lookup("find_stop" + suffix, [=](benchmark::State & state) {
+      const Feed & loaded = feed();
+      lookup_ids(state, stop_ids, [&](const Id & id) { return loaded.find_stop(id); });
+    });
+    register_lookup("get_route" + suffix, [=](benchmark::State & state) {
+      const Feed & loaded = feed();
+      lookup_ids(state, route_ids, [&](const Id & id) { return loaded.get_route(id); });
+    });
+    register_lookup("get_trip" + suffix, [=](benchmark::State & state) {
+      const Feed & loaded = feed();
+      lookup_ids(state, trip_ids, [&](const Id & id) { return loaded.get_trip(id); });
+    });
+    register_lookup("get_stop_times_for_trip" + suffix, [=](benchmark::State & state) {
+      const Feed & loaded = feed();
+      lookup_ids(state, trip_ids,
+                 [&](const Id & id) { return loaded.get_stop_times_for_trip(id).size(); });
+    });
+    register_lookup("get_stop_times_for_stop" + suffix, [=](benchmark::State & state) {
+      const Feed & loaded = feed();
+      lookup_ids(state, stop_ids,
+                 [&](const Id & id) { return loaded.get_stop_times_for_stop(id).size(); });
+    });
+    register_lookup("get_shape" + suffix, [=](benchmark::State & state) {
+      const Feed & loaded = feed();
+      lookup_ids(state, shape_ids, [&](const Id & id) { return loaded.get_shape(id).size(); });
+    });
+  }
+
+  auto indexed_feed = [n]() -> const Feed & { return get_feed(n, true); };
+  register_lookup("get_stop_times_range_for_trip", [=](benchmark::State & state) {
+    const Feed & loaded = indexed_feed();
+    lookup_ids(state, trip_ids, [&](const Id & id) {
+      return loaded.get_stop_times_range_for_trip(id).size();
+    });
+  });
+  register_lookup("get_stop_times_range_for_stop", [=](benchmark::State & state) {
+    const Feed & loaded = indexed_feed();
+    lookup_ids(state, stop_ids, [&](const Id & id) {
+      return loaded.get_stop_times_range_for_stop(id).size();
+    });
+  });
+  register_lookup("get_trip_instances", [=](benchmark::State & state) {
+    const Feed & loaded = indexed_feed();
+    lookup_ids(state, trip_ids, [&](const Id & id) {
+      return loaded.get_trip_instances(id, Time(6, 0, 0), Time(9, 0, 0)).size();
+    });
+  });
+  register_lookup("get_shape_polyline", [=](benchmark::State & state) {
+    const Feed & loaded = indexed_feed();
+    lookup_ids(state, shape_ids,
+               [&](const Id & id) { return loaded.get_shape_polyline(id).size; });
+  });
+  register_lookup("is_service_active", [=](benchmark::State & state) {
+    const Date date(2020, 6, 1);
+    const Feed & loaded = indexed_feed();
+    lookup_ids(state, {"WD", "WE", "ALL"},
+               [&](const Id & id) { return loaded.is_service_active(id, date); });
+  });
+  register_lookup("get_nearest_stop", [=](benchmark::State & state) {
+    const Feed & loaded = indexed_feed();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+      const double lat = 55.0 + benchmarks::get_random(7, i);
+      const double lon = 37.0 + benchmarks::get_random(8, i++);
+      benchmark::DoNotOptimize(loaded.get_nearest_stop(lat, lon));
+    }
+  });
+  register_lookup("get_stops_in_box", [=](benchmark::State & state) {
+    const Feed & loaded = indexed_feed();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+      const double lat = 55.0 + benchmarks::get_random(7, i);
+      const double lon = 37.0 + benchmarks::get_random(8, i++);
+      const BoundingBox box{lat, lon, lat + 0.05, lon + 0.05};
+      benchmark::DoNotOptimize(loaded.get_stops_in_box(box).size());
+    }
+  });
+}
+
+void register_feed_benchmarks(size_t n)
+{
+  const std::string suffix = "/" + std::to_string(n);
+  auto register_benchmark = [&](const std::string & name, auto fn) {
+    return benchmark::RegisterBenchmark((name + suffix).c_str(), fn)
+        ->Unit(benchmark::kMillisecond);
+  };
+
+  for (const auto & file : get_file_benchmarks())
+  {
+    const std::string name = file.file.substr(0, file.file.find('.'));
+    register_benchmark("read_" + name, [n, file](benchmark::State & state) {
+      const uint64_t bytes = std::filesystem::file_size(get_feed_path(n) + "/" + file.file);
+      read_feed_files(state, n, bytes, [&](Feed & feed) { return (feed.*file.read)(); });
+    });
+    register_benchmark("write_" + name, [n, file](benchmark::State & state) {
+      write_feed_files(state, n, [&](const Feed & feed, const std::string & path) {
+        return (feed.*file.write)(path);
+      });
+    });
+  }
+
+  register_benchmark("read_feed", [n](benchmark::State & state) {
+    read_feed_files(state, n, get_feed_size(get_feed_path(n)),
+                    [](Feed & feed) { return feed.read_feed(); });
+  });
+  register_benchmark("read_feed_parallel", [n](benchmark::State & state) {
+    read_feed_files(state, n, get_feed_size(get_feed_path(n)),
+                    [](Feed & feed) { return feed.read_feed(ReadFeedOptions(0)); });
+  });
+  register_benchmark("write_feed", [n](benchmark::State & state) {
+    write_feed_files(state, n, [](const Feed & feed, const std::string & path) {
+      return feed.write_feed(path);
+    });
+  });
+  register_benchmark("write_feed_parallel", [n](benchmark::State & state) {
+    write_feed_files(state, n, [](const Feed & feed, const std::string & path) {
+      return feed.write_feed(path, WriteFeedOptions{0});
+    });
+  });
+  register_benchmark("save_snapshot", [n](benchmark::State & state) {
+    write_feed_files(state, n, [](const Feed & feed, const std::string & path) {
+      return feed.save_snapshot(path + "/feed.snapshot");
+    });
+  });
+  register_benchmark("load_snapshot", [n](benchmark::State & state) {
+    const std::string path = get_output_path(n) + "/feed.snapshot";
+    std::filesystem::create_directories(get_output_path(n));
+    get_feed(n, false).save_snapshot(path);
+    read_feed_files(state, n, std::filesystem::file_size(path),
+                    [&](Feed & feed) { return feed.load_snapshot(path); });
+  });
+
+  register_benchmark("validate", [n](benchmark::State & state) {
+    const Feed & feed = get_feed(n, false);
+    for (auto _ : state)
+      benchmark::DoNotOptimize(feed.validate().code);
+  });
+
+  register_benchmark("build_timetable", [n](benchmark::State & state) {
+    const Feed & feed = get_feed(n, false);
+    Timetable timetable;
+    for (auto _ : state)
+      benchmark::DoNotOptimize(feed.build_timetable(timetable).code);
+  });
+
+  // Merging into the empty feed copies all entities without changing ids.
+  register_benchmark("merge", [n](benchmark::State & state) {
+    const Feed & feed = get_feed(n, false);
+    for (auto _ : state)
+    {
+      Feed merged;
+      benchmark::DoNotOptimize(merged.merge(feed).code);
+    }
+  });
+
+  register_lookup_benchmarks(n, register_benchmark);
+}
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  benchmark::Initialize(&argc, argv);
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg.rfind("--stop_times_counts=", 0) == 0)
+    {
+      stop_times_counts.clear();
+      std::istringstream counts(std::string(arg.substr(arg.find('=') + 1)));
+      for (std::string count; std::getline(counts, count, ',');)
+        stop_times_counts.push_back(std::stoul(count));
+    }
+    else if (arg.rfind("--feeds_directory=", 0) == 0)
+    {
+      feeds_directory = arg.substr(arg.find('=') + 1);
+    }
+    else
+    {
+      std::cerr << "Unknown argument " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  register_parsing_benchmarks();
+  for (const size_t n : stop_times_counts)
+    register_feed_benchmarks(n);
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
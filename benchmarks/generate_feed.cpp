@@ -0,0 +1,32 @@
+#include "synthetic_feed.h"
+
+#include <iostream>
+
+// Generates the synthetic feed for the benchmarks, e.g. 10^8 stop times which are too slow to
+// generate on each run: generate_feed /tmp/feed_1e8 100000000
+int main(int argc, char ** argv)
+{
+  if (argc != 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " <output directory> <stop times count>" << std::endl;
+    return 1;
+  }
+
+  size_t stop_times_count = 0;
+  const std::string_view count = argv[2];
+  const auto [end, error] =
+      std::from_chars(count.data(), count.data() + count.size(), stop_times_count);
+  if (error != std::errc() || end != count.data() + count.size())
+  {
+    std::cerr << "Invalid stop times count " << count << std::endl;
+    return 1;
+  }
+
+  const gtfs::Result res = gtfs::benchmarks::write_synthetic_feed(argv[1], stop_times_count);
+  if (res != gtfs::ResultCode::OK)
+  {
+    std::cerr << res.message << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "just_gtfs/just_gtfs.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace gtfs
+{
+namespace benchmarks
+{
+// Sizes of the synthetic feed derived from the count of stop times. Trips have 20 stops, each
+// route has 100 trips and its own shape of 100 points.
+struct SyntheticFeedSizes
+{
+  inline explicit SyntheticFeedSizes(size_t stop_times_count);
+
+  size_t stop_times_count = 0;
+  size_t stops_per_trip = 20;
+  size_t trips_count = 0;
+  size_t routes_count = 0;
+  size_t stops_count = 0;
+  size_t points_per_shape = 100;
+};
+
+inline SyntheticFeedSizes::SyntheticFeedSizes(size_t stop_times_count)
+    : stop_times_count(stop_times_count)
+{
+  stops_per_trip = std::max<size_t>(std::min(stops_per_trip, stop_times_count), 1);
+  trips_count = (stop_times_count + stops_per_trip - 1) / stops_per_trip;
+  routes_count = std::max<size_t>(trips_count / 100, 1);
+  stops_count = std::max<size_t>(stop_times_count / 200, 50);
+}
+
+// Pseudorandom numbers are the hashes of the counters (splitmix64), so the feed is the same on
+// every platform and does not depend on the generation order.
+inline uint64_t get_hash(uint64_t value)
+{
+  value += 0x9e3779b97f4a7c15;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+
+// Uniform number in [0, 1) for the counter in the stream. Streams are independent sequences.
+inline double get_random(uint64_t stream, uint64_t counter)
+{
+  return static_cast<double>(get_hash(get_hash(stream) ^ counter) >> 11) / 9007199254740992.0;
+}
+
+inline std::string format_seconds(size_t total_seconds)
+{
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%02zu:%02zu:%02zu", total_seconds / 3600,
+                total_seconds / 60 % 60, total_seconds % 60);
+  return buffer;
+}
+
+inline std::string format_coordinate(double coordinate)
+{
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.6f", coordinate);
+  return buffer;
+}
+
+inline std::string format_color(uint64_t color)
+{
+  char buffer[16];
+  std::snprintf(buffer, sizeof(buffer), "%06X", static_cast<unsigned>(color));
+  return buffer;
+}
+
+// Stops are placed in the 1x1 degree square. Stops of each route follow each other with the
+// route's step, so the trips of the route share the stops.
+inline size_t get_route_stop(const SyntheticFeedSizes & sizes, size_t route, size_t stop_index)
+{
+  const size_t first = get_hash(route) % sizes.stops_count;
+  const size_t step = 1 + get_hash(route + sizes.routes_count) % 7;
+  return (first + stop_index * step) % sizes.stops_count;
+}
+
+// Writes all 17 GTFS files of the feed with stop_times_count stop times into the directory. Files
+// are written row by row, so feeds larger than the memory can be generated.
+inline Result write_synthetic_feed(const std::string & gtfs_path, size_t stop_times_count)
+{
+  std::error_code error;
+  std::filesystem::create_directories(gtfs_path, error);
+  if (error)
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not create directory " + gtfs_path};
+
+  const std::string path = add_trailing_slash(gtfs_path);
+  const SyntheticFeedSizes sizes(stop_times_count);
+  std::ofstream out;
+  std::string file_path;
+  std::string failed_path;
+  // Failure of the previous file is checked after flushing it on close.
+  auto close = [&]() {
+    out.close();
+    if (!out && failed_path.empty() && !file_path.empty())
+      failed_path = file_path;
+  };
+  auto open = [&](const std::string & file, const std::string & header) {
+    close();
+    file_path = path + file;
+    out.clear();
+    out.open(file_path);
+    out << header << '\n';
+  };
+
+  open(file_agency, "agency_id,agency_name,agency_url,agency_timezone,agency_lang");
+  out << "A0,Agency 0,https://example.com/a0,Europe/Moscow,ru\n";
+  out << "A1,\"Agency 1, suburban\",https://example.com/a1,Europe/Moscow,ru\n";
+
+  open(file_stops, "stop_id,stop_code,stop_name,stop_desc,stop_lat,stop_lon,location_type");
+  for (size_t i = 0; i < sizes.stops_count; ++i)
+  {
+    out << 'S' << i << ',' << i << ",Stop " << i << ",,"
+        << format_coordinate(55.0 + get_random(1, i)) << ','
+        << format_coordinate(37.0 + get_random(2, i)) << ",0\n";
+  }
+
+  open(file_routes, "route_id,agency_id,route_short_name,route_long_name,route_type,route_color");
+  for (size_t i = 0; i < sizes.routes_count; ++i)
+  {
+    out << 'R' << i << ",A" << i % 2 << ',' << i << ",\"Route " << i << ", line\"," << i % 4
+        << ',' << format_color(get_hash(i) % 0x1000000) << '\n';
+  }
+
+  open(file_trips, "route_id,service_id,trip_id,trip_headsign,direction_id,shape_id");
+  static const char * services[] = {"WD", "WE", "ALL"};
+  for (size_t i = 0; i < sizes.trips_count; ++i)
+  {
+    const size_t route = i % sizes.routes_count;
+    out << 'R' << route << ',' << services[i % 3] << ",T" << i << ",Headsign " << route << ','
+        << i % 2 << ",SH" << route << '\n';
+  }
+
+  // Trips of the route depart every 10 minutes from 5:00, stops are 2 minutes apart.
+  open(file_stop_times, "trip_id,arrival_time,departure_time,stop_id,stop_sequence,pickup_type,"
+                        "drop_off_type,shape_dist_traveled");
+  for (size_t i = 0; i < sizes.stop_times_count; ++i)
+  {
+    const size_t trip = i / sizes.stops_per_trip;
+    const size_t stop_index = i % sizes.stops_per_trip;
+    const size_t route = trip % sizes.routes_count;
+    const size_t arrival = 5 * 3600 + (trip / sizes.routes_count) * 600 + stop_index * 120;
+    out << 'T' << trip << ',' << format_seconds(arrival) << ',' << format_seconds(arrival + 30)
+        << ",S" << get_route_stop(sizes, route, stop_index) << ',' << stop_index + 1 << ",0,0,"
+        << stop_index * 500 << '\n';
+  }
+
+  open(file_calendar,
+       "service_id,monday,tuesday,wednesday,thursday,friday,saturday,sunday,start_date,end_date");
+  out << "WD,1,1,1,1,1,0,0,20200101,20201231\n";
+  out << "WE,0,0,0,0,0,1,1,20200101,20201231\n";
+  out << "ALL,1,1,1,1,1,1,1,20200101,20201231\n";
+
+  open(file_calendar_dates, "service_id,date,exception_type");
+  for (size_t month = 1; month <= 12; ++month)
+  {
+    out << "WD,2020" << (month < 10 ? "0" : "") << month << "01,2\n";
+    out << "WE,2020" << (month < 10 ? "0" : "") << month << "01,1\n";
+  }
+
+  open(file_fare_attributes, "fare_id,price,currency_type,payment_method,transfers,agency_id");
+  out << "F0,1.50,EUR,0,0,A0\n";
+  out << "F1,2.75,EUR,1,,A1\n";
+
+  open(file_fare_rules, "fare_id,route_id,origin_id,destination_id,contains_id");
+  for (size_t i = 0; i < sizes.routes_count; ++i)
+    out << 'F' << i % 2 << ",R" << i << ",,,\n";
+
+  open(file_shapes, "shape_id,shape_pt_lat,shape_pt_lon,shape_pt_sequence,shape_dist_traveled");
+  for (size_t route = 0; route < sizes.routes_count; ++route)
+  {
+    double lat = 55.0 + get_random(3, route);
+    double lon = 37.0 + get_random(4, route);
+    for (size_t i = 0; i < sizes.points_per_shape; ++i)
+    {
+      const uint64_t counter = route * sizes.points_per_shape + i;
+      lat = std::clamp(lat + (get_random(5, counter) - 0.5) * 0.01, 55.0, 56.0);
+      lon = std::clamp(lon + (get_random(6, counter) - 0.5) * 0.01, 37.0, 38.0);
+      out << "SH" << route << ',' << format_coordinate(lat) << ',' << format_coordinate(lon) << ','
+          << i + 1 << ',' << i * 100 << '\n';
+    }
+  }
+
+  open(file_frequencies, "trip_id,start_time,end_time,headway_secs,exact_times");
+  for (size_t i = 0; i < sizes.trips_count; i += 1000)
+    out << 'T' << i << ",06:00:00,09:00:00,600,0\n";
+
+  open(file_transfers, "from_stop_id,to_stop_id,transfer_type,min_transfer_time");
+  for (size_t i = 0; i + 1 < sizes.stops_count; i += 10)
+    out << 'S' << i << ",S" << i + 1 << ",2,120\n";
+
+  open(file_pathways,
+       "pathway_id,from_stop_id,to_stop_id,pathway_mode,is_bidirectional,traversal_time");
+  for (size_t i = 0; i + 1 < sizes.stops_count; i += 100)
+    out << 'P' << i << ",S" << i << ",S" << i + 1 << ",1,1,60\n";
+
+  open(file_levels, "level_id,level_index,level_name");
+  out << "L0,0,Ground\n";
+  out << "L1,-1,Underground\n";
+
+  open(file_translations, "table_name,field_name,language,translation,record_id");
+  for (size_t i = 0; i < std::min<size_t>(sizes.stops_count, 100); ++i)
+    out << "stops,stop_name,en,Stop " << i << " (en),S" << i << '\n';
+
+  open(file_attributions, "attribution_id,agency_id,organization_name,is_producer");
+  out << "AT0,A0,Synthetic organization,1\n";
+
+  // Feed info is written last: the feed with feed_version equal to the stop times count is
+  // complete and may be reused.
+  open(file_feed_info, "feed_publisher_name,feed_publisher_url,feed_lang,feed_version");
+  out << "Synthetic feed,https://example.com,ru," << stop_times_count << '\n';
+
+  close();
+  if (!failed_path.empty())
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not write " + failed_path};
+  return ResultCode::OK;
+}
+}  // namespace benchmarks
+}  // namespace gtfs
@@ -1,19 +1,34 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <exception>
+#include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <istream>
 #include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
@@ -21,6 +36,52 @@
 #include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JUST_GTFS_USE_MMAP
+#endif
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+// Compact stop times keep their ids and headsigns in the shared string pool.
+#if defined(JUST_GTFS_COMPACT_STOP_TIMES) && !defined(JUST_GTFS_INTERNED_IDS)
+#define JUST_GTFS_INTERNED_IDS
+#endif
+
+// Csv records are scanned with the vector instructions enabled for the target. Define
+// JUST_GTFS_NO_SIMD to scan them byte by byte.
+#if !defined(JUST_GTFS_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define JUST_GTFS_USE_AVX2
+#define JUST_GTFS_USE_SSE2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define JUST_GTFS_USE_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define JUST_GTFS_USE_NEON
+#endif
+#endif
+
+// Containers of the feed are allocated from the std::pmr::memory_resource passed to the Feed if
+// JUST_GTFS_PMR is defined, e.g. from the arena freeing the whole feed at once.
+#ifdef JUST_GTFS_PMR
+#include <memory_resource>
+#endif
+
+// Zip entries and files compressed with zstd are decoded by libzstd if JUST_GTFS_USE_ZSTD is
+// defined.
+#ifdef JUST_GTFS_USE_ZSTD
+#include <zstd.h>
+#endif
+
 namespace gtfs
 {
 // File names and other entities defined in GTFS----------------------------------------------------
@@ -65,7 +126,11 @@ enum ResultCode
   ERROR_INVALID_GTFS_PATH,
   ERROR_FILE_ABSENT,
   ERROR_REQUIRED_FIELD_ABSENT,
-  ERROR_INVALID_FIELD_FORMAT
+  ERROR_INVALID_FIELD_FORMAT,
+  ERROR_INVALID_SNAPSHOT,
+  ERROR_INVALID_ARCHIVE,
+  ERROR_INVALID_REFERENCE,
+  ERROR_DUPLICATE_ID
 };
 
 using Message = std::string;
@@ -82,6 +147,12 @@ struct Result
   Message message;
 };
 
+// Result with the same message as of the InvalidFieldFormat exception.
+inline Result invalid_field_format(const std::string & msg)
+{
+  return {ResultCode::ERROR_INVALID_FIELD_FORMAT, InvalidFieldFormat(msg).what()};
+}
+
 inline std::string add_trailing_slash(const std::string & path)
 {
   auto extended_path = path;
@@ -90,7 +161,63 @@ inline std::string add_trailing_slash(const std::string & path)
   return extended_path;
 }
 
-inline void write_joined(std::ofstream & out, std::vector<std::string> && elements)
+// Returns threads_count or the number of hardware threads if threads_count is 0.
+inline size_t get_threads_count(size_t threads_count)
+{
+  if (threads_count != 0)
+    return threads_count;
+  return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Runs task(i) for each i in [0, tasks_count) on up to threads_count threads. Tasks are started in
+// the order of their indexes. The first exception thrown by a task is rethrown after all threads
+// are joined.
+inline void run_in_parallel(size_t tasks_count, size_t threads_count,
+                            const std::function<void(size_t)> & task)
+{
+  threads_count = std::min(get_threads_count(threads_count), tasks_count);
+  if (threads_count <= 1)
+  {
+    for (size_t i = 0; i < tasks_count; ++i)
+      task(i);
+    return;
+  }
+
+  std::atomic<size_t> next_task{0};
+  std::exception_ptr exception;
+  std::mutex exception_mutex;
+
+  auto worker = [&]() {
+    for (size_t i = next_task++; i < tasks_count; i = next_task++)
+    {
+      try
+      {
+        task(i);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(exception_mutex);
+        if (!exception)
+          exception = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(threads_count - 1);
+  for (size_t i = 0; i + 1 < threads_count; ++i)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (auto & thread : threads)
+    thread.join();
+
+  if (exception)
+    std::rethrow_exception(exception);
+}
+
+inline void write_joined(std::ofstream & out, const std::vector<std::string> & elements)
 {
   for (size_t i = 0; i < elements.size(); ++i)
   {
@@ -108,9 +235,9 @@ inline std::string quote_text(const std::string & text)
   return stream.str();
 }
 
-inline std::string unquote_text(const std::string & text)
+inline void unquote_text(std::string_view text, std::string & res)
 {
-  std::string res;
+  res.clear();
   bool prev_is_quote = false;
   bool prev_is_skipped = false;
 
@@ -148,7 +275,12 @@ inline std::string unquote_text(const std::string & text)
       res += text[i];
     }
   }
+}
 
+inline std::string unquote_text(const std::string & text)
+{
+  std::string res;
+  unquote_text(text, res);
   return res;
 }
 
@@ -180,740 +312,3262 @@ inline std::string wrap(double val)
   return stream.str();
 }
 
-inline void write_agency_header(std::ofstream & out)
+// Columns of the GTFS files. Csv headers are written in the same order.
+enum class AgencyColumn
 {
-  std::vector<std::string> fields = {"agency_id",       "agency_name", "agency_url",
-                                     "agency_timezone", "agency_lang", "agency_phone",
-                                     "agency_fare_url", "agency_email"};
-  write_joined(out, std::move(fields));
-}
+  agency_id,
+  agency_name,
+  agency_url,
+  agency_timezone,
+  agency_lang,
+  agency_phone,
+  agency_fare_url,
+  agency_email
+};
 
-inline void write_routes_header(std::ofstream & out)
-{
-  std::vector<std::string> fields = {
-      "route_id",         "agency_id",        "route_short_name",  "route_long_name",
-      "route_desc",       "route_type",       "route_url",         "route_color",
-      "route_text_color", "route_sort_order", "continuous_pickup", "continuous_drop_off"};
-  write_joined(out, std::move(fields));
-}
+inline const std::vector<std::string> agency_columns = {
+    "agency_id", "agency_name", "agency_url", "agency_timezone", "agency_lang", "agency_phone",
+    "agency_fare_url", "agency_email"};
+
+inline void write_agency_header(std::ofstream & out) { write_joined(out, agency_columns); }
+
+enum class RouteColumn
+{
+  route_id,
+  agency_id,
+  route_short_name,
+  route_long_name,
+  route_desc,
+  route_type,
+  route_url,
+  route_color,
+  route_text_color,
+  route_sort_order,
+  continuous_pickup,
+  continuous_drop_off
+};
 
-inline void write_shapes_header(std::ofstream & out)
-{
-  std::vector<std::string> fields = {"shape_id", "shape_pt_lat", "shape_pt_lon",
-                                     "shape_pt_sequence"};
-  write_joined(out, std::move(fields));
-}
+inline const std::vector<std::string> routes_columns = {
+    "route_id", "agency_id", "route_short_name", "route_long_name", "route_desc", "route_type",
+    "route_url", "route_color", "route_text_color", "route_sort_order", "continuous_pickup",
+    "continuous_drop_off"};
 
-inline void write_trips_header(std::ofstream & out)
-{
-  std::vector<std::string> fields = {
-      "route_id",     "service_id", "trip_id",  "trip_headsign",         "trip_short_name",
-      "direction_id", "block_id",   "shape_id", "wheelchair_accessible", "bikes_allowed"};
-  write_joined(out, std::move(fields));
-}
+inline void write_routes_header(std::ofstream & out) { write_joined(out, routes_columns); }
 
-inline void write_stops_header(std::ofstream & out)
+enum class ShapeColumn
 {
-  std::vector<std::string> fields = {"stop_id",        "stop_code",     "stop_name",
-                                     "stop_desc",      "stop_lat",      "stop_lon",
-                                     "zone_id",        "stop_url",      "location_type",
-                                     "parent_station", "stop_timezone", "wheelchair_boarding",
-                                     "level_id",       "platform_code"};
-  write_joined(out, std::move(fields));
-}
+  shape_id,
+  shape_pt_lat,
+  shape_pt_lon,
+  shape_pt_sequence,
+  shape_dist_traveled
+};
+
+inline const std::vector<std::string> shapes_columns = {
+    "shape_id", "shape_pt_lat", "shape_pt_lon", "shape_pt_sequence", "shape_dist_traveled"};
+
+inline void write_shapes_header(std::ofstream & out) { write_joined(out, shapes_columns); }
 
-inline void write_stop_times_header(std::ofstream & out)
+enum class TripColumn
 {
-  std::vector<std::string> fields = {
-      "trip_id",           "arrival_time",        "departure_time",      "stop_id",
-      "stop_sequence",     "stop_headsign",       "pickup_type",         "drop_off_type",
-      "continuous_pickup", "continuous_drop_off", "shape_dist_traveled", "timepoint"};
-  write_joined(out, std::move(fields));
-}
+  route_id,
+  service_id,
+  trip_id,
+  trip_headsign,
+  trip_short_name,
+  direction_id,
+  block_id,
+  shape_id,
+  wheelchair_accessible,
+  bikes_allowed
+};
+
+inline const std::vector<std::string> trips_columns = {
+    "route_id", "service_id", "trip_id", "trip_headsign", "trip_short_name", "direction_id",
+    "block_id", "shape_id", "wheelchair_accessible", "bikes_allowed"};
+
+inline void write_trips_header(std::ofstream & out) { write_joined(out, trips_columns); }
+
+enum class StopColumn
+{
+  stop_id,
+  stop_code,
+  stop_name,
+  stop_desc,
+  stop_lat,
+  stop_lon,
+  zone_id,
+  stop_url,
+  location_type,
+  parent_station,
+  stop_timezone,
+  wheelchair_boarding,
+  level_id,
+  platform_code
+};
 
-inline void write_calendar_header(std::ofstream & out)
+inline const std::vector<std::string> stops_columns = {
+    "stop_id", "stop_code", "stop_name", "stop_desc", "stop_lat", "stop_lon", "zone_id", "stop_url",
+    "location_type", "parent_station", "stop_timezone", "wheelchair_boarding", "level_id",
+    "platform_code"};
+
+inline void write_stops_header(std::ofstream & out) { write_joined(out, stops_columns); }
+
+enum class StopTimeColumn
+{
+  trip_id,
+  arrival_time,
+  departure_time,
+  stop_id,
+  stop_sequence,
+  stop_headsign,
+  pickup_type,
+  drop_off_type,
+  continuous_pickup,
+  continuous_drop_off,
+  shape_dist_traveled,
+  timepoint
+};
+
+inline const std::vector<std::string> stop_times_columns = {
+    "trip_id", "arrival_time", "departure_time", "stop_id", "stop_sequence", "stop_headsign",
+    "pickup_type", "drop_off_type", "continuous_pickup", "continuous_drop_off",
+    "shape_dist_traveled", "timepoint"};
+
+inline void write_stop_times_header(std::ofstream & out) { write_joined(out, stop_times_columns); }
+
+enum class CalendarColumn
+{
+  service_id,
+  monday,
+  tuesday,
+  wednesday,
+  thursday,
+  friday,
+  saturday,
+  sunday,
+  start_date,
+  end_date
+};
+
+inline const std::vector<std::string> calendar_columns = {
+    "service_id", "monday", "tuesday", "wednesday", "thursday", "friday", "saturday", "sunday",
+    "start_date", "end_date"};
+
+inline void write_calendar_header(std::ofstream & out) { write_joined(out, calendar_columns); }
+
+enum class CalendarDateColumn
 {
-  std::vector<std::string> fields = {"service_id", "monday",   "tuesday", "wednesday",  "thursday",
-                                     "friday",     "saturday", "sunday",  "start_date", "end_date"};
-  write_joined(out, std::move(fields));
-}
+  service_id,
+  date,
+  exception_type
+};
+
+inline const std::vector<std::string> calendar_dates_columns = {
+    "service_id", "date", "exception_type"};
 
 inline void write_calendar_dates_header(std::ofstream & out)
 {
-  std::vector<std::string> fields = {"service_id", "date", "exception_type"};
-  write_joined(out, std::move(fields));
+  write_joined(out, calendar_dates_columns);
 }
 
-inline void write_transfers_header(std::ofstream & out)
+enum class TransferColumn
 {
-  std::vector<std::string> fields = {"from_stop_id", "to_stop_id", "transfer_type",
-                                     "min_transfer_time"};
-  write_joined(out, std::move(fields));
-}
+  from_stop_id,
+  to_stop_id,
+  transfer_type,
+  min_transfer_time
+};
+
+inline const std::vector<std::string> transfers_columns = {
+    "from_stop_id", "to_stop_id", "transfer_type", "min_transfer_time"};
+
+inline void write_transfers_header(std::ofstream & out) { write_joined(out, transfers_columns); }
+
+enum class FrequencyColumn
+{
+  trip_id,
+  start_time,
+  end_time,
+  headway_secs,
+  exact_times
+};
+
+inline const std::vector<std::string> frequencies_columns = {
+    "trip_id", "start_time", "end_time", "headway_secs", "exact_times"};
 
 inline void write_frequencies_header(std::ofstream & out)
 {
-  std::vector<std::string> fields = {"trip_id", "start_time", "end_time", "headway_secs",
-                                     "exact_times"};
-  write_joined(out, std::move(fields));
+  write_joined(out, frequencies_columns);
 }
 
+enum class FareAttributesColumn
+{
+  fare_id,
+  price,
+  currency_type,
+  payment_method,
+  transfers,
+  agency_id,
+  transfer_duration
+};
+
+inline const std::vector<std::string> fare_attributes_columns = {
+    "fare_id", "price", "currency_type", "payment_method", "transfers", "agency_id",
+    "transfer_duration"};
+
 inline void write_fare_attributes_header(std::ofstream & out)
 {
-  std::vector<std::string> fields = {"fare_id",   "price",     "currency_type",    "payment_method",
-                                     "transfers", "agency_id", "transfer_duration"};
-  write_joined(out, std::move(fields));
+  write_joined(out, fare_attributes_columns);
 }
 
-inline void write_fare_rules_header(std::ofstream & out)
+enum class FareRuleColumn
 {
-  std::vector<std::string> fields = {"fare_id", "route_id", "origin_id", "destination_id",
-                                     "contains_id"};
-  write_joined(out, std::move(fields));
-}
+  fare_id,
+  route_id,
+  origin_id,
+  destination_id,
+  contains_id
+};
+
+inline const std::vector<std::string> fare_rules_columns = {
+    "fare_id", "route_id", "origin_id", "destination_id", "contains_id"};
+
+inline void write_fare_rules_header(std::ofstream & out) { write_joined(out, fare_rules_columns); }
+
+enum class PathwayColumn
+{
+  pathway_id,
+  from_stop_id,
+  to_stop_id,
+  pathway_mode,
+  is_bidirectional,
+  length,
+  traversal_time,
+  stair_count,
+  max_slope,
+  min_width,
+  signposted_as,
+  reversed_signposted_as
+};
+
+inline const std::vector<std::string> pathways_columns = {
+    "pathway_id", "from_stop_id", "to_stop_id", "pathway_mode", "is_bidirectional", "length",
+    "traversal_time", "stair_count", "max_slope", "min_width", "signposted_as",
+    "reversed_signposted_as"};
 
-inline void write_pathways_header(std::ofstream & out)
+inline void write_pathways_header(std::ofstream & out) { write_joined(out, pathways_columns); }
+
+enum class LevelColumn
 {
-  std::vector<std::string> fields = {
-      "pathway_id",       "from_stop_id", "to_stop_id",     "pathway_mode",
-      "is_bidirectional", "length",       "traversal_time", "stair_count",
-      "max_slope",        "min_width",    "signposted_as",  "reversed_signposted_as"};
-  write_joined(out, std::move(fields));
-}
+  level_id,
+  level_index,
+  level_name
+};
+
+inline const std::vector<std::string> levels_columns = {"level_id", "level_index", "level_name"};
 
-inline void write_levels_header(std::ofstream & out)
+inline void write_levels_header(std::ofstream & out) { write_joined(out, levels_columns); }
+
+enum class FeedInfoColumn
 {
-  std::vector<std::string> fields = {"level_id", "level_index", "level_name"};
-  write_joined(out, std::move(fields));
-}
+  feed_publisher_name,
+  feed_publisher_url,
+  feed_lang,
+  default_lang,
+  feed_start_date,
+  feed_end_date,
+  feed_version,
+  feed_contact_email,
+  feed_contact_url
+};
+
+inline const std::vector<std::string> feed_info_columns = {
+    "feed_publisher_name", "feed_publisher_url", "feed_lang", "default_lang", "feed_start_date",
+    "feed_end_date", "feed_version", "feed_contact_email", "feed_contact_url"};
 
-inline void write_feed_info_header(std::ofstream & out)
+inline void write_feed_info_header(std::ofstream & out) { write_joined(out, feed_info_columns); }
+
+enum class TranslationColumn
 {
-  std::vector<std::string> fields = {
-      "feed_publisher_name", "feed_publisher_url", "feed_lang",
-      "default_lang",        "feed_start_date",    "feed_end_date",
-      "feed_version",        "feed_contact_email", "feed_contact_url"};
-  write_joined(out, std::move(fields));
-}
+  table_name,
+  field_name,
+  language,
+  translation,
+  record_id,
+  record_sub_id,
+  field_value
+};
+
+inline const std::vector<std::string> translations_columns = {
+    "table_name", "field_name", "language", "translation", "record_id", "record_sub_id",
+    "field_value"};
 
 inline void write_translations_header(std::ofstream & out)
 {
-  std::vector<std::string> fields = {"table_name", "field_name",    "language",   "translation",
-                                     "record_id",  "record_sub_id", "field_value"};
-  write_joined(out, std::move(fields));
+  write_joined(out, translations_columns);
 }
 
+enum class AttributionColumn
+{
+  attribution_id,
+  agency_id,
+  route_id,
+  trip_id,
+  organization_name,
+  is_producer,
+  is_operator,
+  is_authority,
+  attribution_url,
+  attribution_email,
+  attribution_phone
+};
+
+inline const std::vector<std::string> attributions_columns = {
+    "attribution_id", "agency_id", "route_id", "trip_id", "organization_name", "is_producer",
+    "is_operator", "is_authority", "attribution_url", "attribution_email", "attribution_phone"};
+
 inline void write_attributions_header(std::ofstream & out)
 {
-  std::vector<std::string> fields = {"attribution_id",    "agency_id",         "route_id",
-                                     "trip_id",           "organization_name", "is_producer",
-                                     "is_operator",       "is_authority",      "attribution_url",
-                                     "attribution_email", "attribution_phone"};
-  write_joined(out, std::move(fields));
+  write_joined(out, attributions_columns);
 }
 
-// Csv parser  -------------------------------------------------------------------------------------
-class CsvParser
+// Splits the csv data into about chunks_count parts of the similar size. Records are not split
+// between the parts: each of them ends with a newline except for the last one.
+inline std::vector<std::string_view> split_into_chunks(std::string_view data, size_t chunks_count)
 {
-public:
-  CsvParser() = default;
-  inline explicit CsvParser(const std::string & gtfs_directory);
+  std::vector<std::string_view> chunks;
+  const size_t chunk_size = data.size() / std::max<size_t>(chunks_count, 1) + 1;
 
-  inline Result read_header(const std::string & csv_filename);
-  inline Result read_row(std::map<std::string, std::string> & obj);
+  size_t start = 0;
+  while (start < data.size())
+  {
+    size_t end = std::min(start + chunk_size, data.size());
+    // Records are separated by newlines in the same way as while reading them one by one.
+    end = data.find('\n', end - 1);
+    end = end == std::string_view::npos ? data.size() : end + 1;
 
-  inline static std::vector<std::string> split_record(const std::string & record,
-                                                      bool is_header = false);
+    chunks.emplace_back(data.substr(start, end - start));
+    start = end;
+  }
+  return chunks;
+}
 
-private:
-  std::vector<std::string> field_sequence;
-  std::string gtfs_path;
-  std::ifstream csv_stream;
-};
+// Estimates count of records in the csv data by the average length of lines in several samples
+// across the data. The estimate is a bit increased, so containers rarely grow after reserving it.
+inline size_t estimate_rows_count(std::string_view data)
+{
+  static constexpr size_t samples_count = 4;
+  static constexpr size_t sample_size = 1 << 12;
+  if (data.size() <= samples_count * sample_size)
+    return static_cast<size_t>(std::count(data.begin(), data.end(), '\n')) + 1;
 
-inline CsvParser::CsvParser(const std::string & gtfs_directory) : gtfs_path(gtfs_directory) {}
+  size_t lines_count = 0;
+  for (size_t i = 0; i < samples_count; ++i)
+  {
+    const size_t offset = (data.size() - sample_size) * i / (samples_count - 1);
+    const std::string_view sample = data.substr(offset, sample_size);
+    lines_count += static_cast<size_t>(std::count(sample.begin(), sample.end(), '\n'));
+  }
 
-inline std::string trim_spaces(const std::string & token)
-{
-  static const std::string delimiters = " \t";
-  std::string res = token;
-  res.erase(0, res.find_first_not_of(delimiters));
-  res.erase(res.find_last_not_of(delimiters) + 1);
-  return res;
+  const size_t estimate = data.size() * lines_count / (samples_count * sample_size) + 1;
+  return estimate + estimate / 16;
 }
 
-inline std::string normalize(std::string & token, bool has_quotes)
+template <typename Container>
+void reserve_rows(Container & container, size_t rows_count)
 {
-  std::string res = trim_spaces(token);
-  if (has_quotes)
-    return unquote_text(res);
-  return res;
+  container.reserve(container.size() + rows_count);
 }
 
-inline std::vector<std::string> CsvParser::split_record(const std::string & record, bool is_header)
+// Returns the current resident memory of the process in bytes or 0 if it is unknown.
+inline size_t get_memory_usage()
 {
-  size_t start_index = 0;
-  if (is_header)
+#if defined(__linux__)
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  if (!(statm >> total_pages >> resident_pages))
+    return 0;
+  return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#elif defined(__APPLE__)
+  mach_task_basic_info info{};
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info),
+                &count) != KERN_SUCCESS)
   {
-    // ignore UTF-8 BOM prefix:
-    if (record.size() > 2 && record[0] == '\xef' && record[1] == '\xbb' && record[2] == '\xbf')
-      start_index = 3;
+    return 0;
   }
+  return static_cast<size_t>(info.resident_size);
+#else
+  return 0;
+#endif
+}
 
-  std::vector<std::string> fields;
-  fields.reserve(20);
+// Returns the peak resident memory of the process since its start in bytes or 0 if it is unknown.
+// It doesn't decrease, so use get_memory_usage() to measure the memory of the single load.
+inline size_t get_peak_memory_usage()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
 
-  std::string token;
-  token.reserve(record.size());
+// Compressed input --------------------------------------------------------------------------------
+// Decompressed data is passed between the stages of reading in blocks of about this size.
+inline constexpr size_t input_block_size = size_t(1) << 20;
 
-  bool is_inside_quotes = false;
-  bool quotes_in_token = false;
+// Sequential reader of the contents of the file, e.g. of the decompressed archive entry.
+class InputStream
+{
+public:
+  virtual ~InputStream() = default;
+  // Replaces the block with the next part of the contents. The empty block means the end.
+  virtual Result read(std::string & block) = 0;
+};
 
-  for (size_t i = start_index; i < record.size(); ++i)
+// Source of the feed files other than the directory, e.g. the zip archive.
+class FeedSource
+{
+public:
+  virtual ~FeedSource() = default;
+  // Opens the file or returns ERROR_FILE_ABSENT if there is no such file.
+  virtual Result open(const std::string & filename,
+                      std::unique_ptr<InputStream> & stream) const = 0;
+  // Size of the contents of the file or 0 if it is unknown.
+  virtual uintmax_t get_file_size(const std::string & /* filename */) const { return 0; }
+  // CRC-32 of the contents of the file or nullopt if it is unknown. Feed::refresh() reads the
+  // files with unknown checksums to compute them.
+  virtual std::optional<uint32_t> get_file_crc32(const std::string & /* filename */) const
   {
-    if (record[i] == quote)
-    {
-      is_inside_quotes = !is_inside_quotes;
-      quotes_in_token = true;
-      token += record[i];
-      continue;
-    }
-
-    if (record[i] == csv_separator)
-    {
-      if (is_inside_quotes)
-      {
-        token += record[i];
-        continue;
-      }
-
-      fields.emplace_back(normalize(token, quotes_in_token));
-      token.clear();
-      quotes_in_token = false;
-      continue;
-    }
-
-    // Skip delimiters:
-    if (record[i] != '\t' && record[i] != '\r')
-      token += record[i];
+    return std::nullopt;
   }
+};
 
-  fields.emplace_back(normalize(token, quotes_in_token));
-  return fields;
+inline Result invalid_archive(const std::string & msg)
+{
+  return {ResultCode::ERROR_INVALID_ARCHIVE, msg};
 }
 
-inline Result CsvParser::read_header(const std::string & csv_filename)
+inline uint32_t get_crc32(uint32_t crc, std::string_view data)
 {
-  if (csv_stream.is_open())
-    csv_stream.close();
-
-  csv_stream.open(gtfs_path + csv_filename);
-  if (!csv_stream.is_open())
-    return {ResultCode::ERROR_FILE_ABSENT, "File " + csv_filename + " could not be opened"};
+  static const auto table = []() {
+    std::array<uint32_t, 256> res{};
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      uint32_t value = i;
+      for (int bit = 0; bit < 8; ++bit)
+        value = (value & 1) ? 0xedb88320 ^ (value >> 1) : value >> 1;
+      res[i] = value;
+    }
+    return res;
+  }();
 
-  std::string header;
-  if (!getline(csv_stream, header) || header.empty())
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, "Empty header in file " + csv_filename};
+  crc = ~crc;
+  for (const char c : data)
+    crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
 
-  field_sequence = split_record(header, true);
-  return ResultCode::OK;
+// CRC-32 of the rest of the stream or nullopt if it could not be read.
+inline std::optional<uint32_t> get_stream_crc32(InputStream & stream)
+{
+  uint32_t crc = 0;
+  std::string block;
+  while (true)
+  {
+    if (stream.read(block) != ResultCode::OK)
+      return std::nullopt;
+    if (block.empty())
+      return crc;
+    crc = get_crc32(crc, block);
+  }
 }
 
-inline Result CsvParser::read_row(std::map<std::string, std::string> & obj)
+// Bytes [offset, offset + size) of the file. The whole rest of the file is read by default.
+class FileStream : public InputStream
 {
-  obj = {};
-  std::string row;
-  if (!getline(csv_stream, row))
-    return {ResultCode::END_OF_FILE, {}};
+public:
+  inline bool open(const std::string & path, uintmax_t offset = 0,
+                   uintmax_t size = std::numeric_limits<uintmax_t>::max());
+  inline Result read(std::string & block) override;
 
-  if (row == "\r")
-    return ResultCode::OK;
+private:
+  std::ifstream stream;
+  std::string path;
+  uintmax_t remaining_size = 0;
+  bool is_size_known = false;
+};
 
-  const std::vector<std::string> fields_values = split_record(row);
+inline bool FileStream::open(const std::string & file_path, uintmax_t offset, uintmax_t size)
+{
+  path = file_path;
+  stream.open(path, std::ios::binary);
+  if (!stream.is_open())
+    return false;
 
-  // Different count of fields in the row and in the header of csv.
-  // Typical approach is to skip not required fields.
-  const size_t fields_count = std::min(field_sequence.size(), fields_values.size());
+  stream.seekg(static_cast<std::streamoff>(offset));
+  is_size_known = size != std::numeric_limits<uintmax_t>::max();
+  remaining_size = size;
+  return static_cast<bool>(stream);
+}
 
-  for (size_t i = 0; i < fields_count; ++i)
-    obj[field_sequence[i]] = fields_values[i];
+inline Result FileStream::read(std::string & block)
+{
+  block.resize(static_cast<size_t>(std::min<uintmax_t>(input_block_size, remaining_size)));
+  stream.read(block.data(), static_cast<std::streamsize>(block.size()));
+  const auto count = static_cast<size_t>(stream.gcount());
+  if (count < block.size() && is_size_known)
+    return invalid_archive("Unexpected end of file " + path);
 
+  block.resize(count);
+  remaining_size -= count;
   return ResultCode::OK;
 }
 
-// Custom types for GTFS fields --------------------------------------------------------------------
-// Id of GTFS entity, a sequence of any UTF-8 characters. Used as type for ID GTFS fields.
-using Id = std::string;
-// A string of UTF-8 characters. Used as type for Text GTFS fields.
-using Text = std::string;
-
-// Time in GTFS is in the HH:MM:SS format (H:MM:SS is also accepted)
-// Time within a service day can be above 24:00:00, e.g. 28:41:30
-class Time
+// Decoder of the raw DEFLATE stream (RFC 1951) which pulls the compressed data from the input.
+class Inflater
 {
 public:
-  inline Time() = default;
-  inline explicit Time(const std::string & raw_time_str);
-  inline Time(uint16_t hours, uint16_t minutes, uint16_t seconds);
-  inline Time(size_t seconds);
-  inline bool is_provided() const;
-  inline size_t get_total_seconds() const;
-  inline std::tuple<uint16_t, uint16_t, uint16_t> get_hh_mm_ss() const;
-  inline std::string get_raw_time() const;
-  inline bool limit_hours_to_24max();
+  explicit Inflater(InputStream & input) : input(input) {}
+
+  // Replaces the output with the next decoded bytes: min_size bytes or more unless the deflate
+  // stream ends earlier.
+  inline Result inflate(std::string & output, size_t min_size);
+  bool is_finished() const { return finished; }
+  // Starts the next deflate stream, e.g. of the next gzip member.
+  inline void restart();
+
+  // Access to the bytes of the input following the deflate stream.
+  inline bool read_byte(uint8_t & byte);
+  inline bool is_input_ended();
+  const Result & get_input_result() const { return input_result; }
 
 private:
-  inline void set_total_seconds();
-  inline void set_raw_time();
-  bool time_is_provided = false;
-  std::string raw_time;
-  size_t total_seconds = 0;
-  uint16_t hh = 0;
-  uint16_t mm = 0;
-  uint16_t ss = 0;
+  static constexpr size_t max_code_length = 15;
+  static constexpr size_t fast_bits = 9;
+  // Back references of deflate reach up to 32 KB of the previous output.
+  static constexpr size_t max_distance = size_t(1) << 15;
+
+  struct Huffman
+  {
+    std::array<uint16_t, max_code_length + 1> counts{};
+    std::array<uint16_t, 288> symbols{};
+    // Symbols of the codes up to fast_bits long by their next bits: symbol | length << 9.
+    std::array<uint16_t, size_t(1) << fast_bits> fast{};
+  };
+
+  inline static bool build(Huffman & code, const uint8_t * lengths, size_t count);
+  inline int decode(const Huffman & code);
+  inline void refill();
+  inline uint32_t get_bits(size_t count);
+  inline Result inflate_stored();
+  inline Result inflate_dynamic();
+  inline Result inflate_codes(const Huffman & lengths_code, const Huffman & distances_code);
+
+  InputStream & input;
+  std::string input_block;
+  size_t input_position = 0;
+  bool is_input_read = false;
+  Result input_result;
+
+  uint64_t bit_buffer = 0;
+  size_t bit_count = 0;
+  // More bits are requested than the input has.
+  bool overrun = false;
+
+  // Last 32 KB of the previous output followed by the output of the current call.
+  std::string window;
+  bool finished = false;
+
+  bool has_fixed_codes = false;
+  Huffman fixed_lengths;
+  Huffman fixed_distances;
+  Huffman dynamic_lengths;
+  Huffman dynamic_distances;
 };
 
-inline bool operator==(const Time & lhs, const Time & rhs)
+inline bool Inflater::build(Huffman & code, const uint8_t * lengths, size_t count)
 {
-  return lhs.get_hh_mm_ss() == rhs.get_hh_mm_ss() && lhs.is_provided() == rhs.is_provided();
-}
+  code.counts.fill(0);
+  for (size_t i = 0; i < count; ++i)
+    ++code.counts[lengths[i]];
+  code.counts[0] = 0;
 
-inline bool Time::limit_hours_to_24max()
-{
-  if (hh < 24)
-    return false;
+  // Over-subscribed codes are invalid. Incomplete ones fail on decoding of the missing codes.
+  int left = 1;
+  for (size_t length = 1; length <= max_code_length; ++length)
+  {
+    left = (left << 1) - code.counts[length];
+    if (left < 0)
+      return false;
+  }
 
-  hh = hh % 24;
-  set_total_seconds();
-  set_raw_time();
-  return true;
-}
+  std::array<uint16_t, max_code_length + 2> offsets{};
+  std::array<uint16_t, max_code_length + 1> next_code{};
+  for (size_t length = 1; length <= max_code_length; ++length)
+  {
+    offsets[length + 1] = offsets[length] + code.counts[length];
+    next_code[length] =
+        static_cast<uint16_t>((next_code[length - 1] + code.counts[length - 1]) << 1);
+  }
 
-inline void Time::set_total_seconds() { total_seconds = hh * 60 * 60 + mm * 60 + ss; }
+  code.fast.fill(0);
+  for (size_t symbol = 0; symbol < count; ++symbol)
+  {
+    const size_t length = lengths[symbol];
+    if (length == 0)
+      continue;
 
-inline std::string append_leading_zero(const std::string & s, bool check = true)
-{
-  if (check && s.size() > 2)
-    throw InvalidFieldFormat("The string for appending zero is too long: " + s);
+    code.symbols[offsets[length]++] = static_cast<uint16_t>(symbol);
+    const uint32_t canonical = next_code[length]++;
+    if (length > fast_bits)
+      continue;
 
-  if (s.size() == 2)
-    return s;
-  return "0" + s;
+    // Codes are packed starting from the most significant bit.
+    uint32_t reversed = 0;
+    for (size_t bit = 0; bit < length; ++bit)
+      reversed |= ((canonical >> bit) & 1) << (length - 1 - bit);
+    for (size_t i = reversed; i < code.fast.size(); i += size_t(1) << length)
+      code.fast[i] = static_cast<uint16_t>(symbol | length << fast_bits);
+  }
+  return true;
 }
 
-inline void Time::set_raw_time()
+inline void Inflater::refill()
 {
-  const std::string hh_str = append_leading_zero(std::to_string(hh), false);
-  const std::string mm_str = append_leading_zero(std::to_string(mm));
-  const std::string ss_str = append_leading_zero(std::to_string(ss));
+  while (bit_count <= 56)
+  {
+    if (input_position == input_block.size())
+    {
+      if (is_input_read)
+        return;
 
-  raw_time = hh_str + ":" + mm_str + ":" + ss_str;
+      input_result = input.read(input_block);
+      input_position = 0;
+      if (input_result != ResultCode::OK || input_block.empty())
+      {
+        input_block.clear();
+        is_input_read = true;
+        return;
+      }
+    }
+    bit_buffer |= uint64_t(static_cast<uint8_t>(input_block[input_position++])) << bit_count;
+    bit_count += 8;
+  }
 }
 
-// Time in the HH:MM:SS format (H:MM:SS is also accepted). Used as type for Time GTFS fields.
-inline Time::Time(const std::string & raw_time_str) : raw_time(raw_time_str)
+inline uint32_t Inflater::get_bits(size_t count)
 {
-  if (raw_time_str.empty())
-    return;
-
-  const size_t len = raw_time.size();
-  if (!(len >= 7 && len <= 9) || raw_time[len - 3] != ':' || raw_time[len - 6] != ':')
-    throw InvalidFieldFormat("Time is not in [[H]H]H:MM:SS format: " + raw_time_str);
+  if (bit_count < count)
+    refill();
+  if (bit_count < count)
+  {
+    overrun = true;
+    return 0;
+  }
 
-  hh = static_cast<uint16_t>(std::stoi(raw_time.substr(0, len - 6)));
-  mm = static_cast<uint16_t>(std::stoi(raw_time.substr(len - 5, 2)));
-  ss = static_cast<uint16_t>(std::stoi(raw_time.substr(len - 2)));
+  const auto res = static_cast<uint32_t>(bit_buffer & ((uint64_t(1) << count) - 1));
+  bit_buffer >>= count;
+  bit_count -= count;
+  return res;
+}
 
-  if (mm > 60 || ss > 60)
-    throw InvalidFieldFormat("Time minutes/seconds wrong value: " + std::to_string(mm) +
-                             " minutes, " + std::to_string(ss) + " seconds");
+inline int Inflater::decode(const Huffman & code)
+{
+  if (bit_count < max_code_length)
+    refill();
 
-  set_total_seconds();
-  time_is_provided = true;
+  size_t length = code.fast[bit_buffer & (code.fast.size() - 1)] >> fast_bits;
+  int symbol = -1;
+  if (length != 0)
+  {
+    symbol = code.fast[bit_buffer & (code.fast.size() - 1)] & ((1 << fast_bits) - 1);
+  }
+  else
+  {
+    // Canonical decoding of the longer codes bit by bit.
+    int first = 0;
+    int index = 0;
+    int value = 0;
+    for (length = 1; length <= max_code_length; ++length)
+    {
+      value |= static_cast<int>((bit_buffer >> (length - 1)) & 1);
+      const int count = code.counts[length];
+      if (value < first + count)
+      {
+        symbol = code.symbols[static_cast<size_t>(index + value - first)];
+        break;
+      }
+      index += count;
+      first = (first + count) << 1;
+      value <<= 1;
+    }
+  }
+
+  if (symbol < 0 || length > bit_count)
+  {
+    overrun = overrun || length > bit_count;
+    return -1;
+  }
+  bit_buffer >>= length;
+  bit_count -= length;
+  return symbol;
 }
 
-inline Time::Time(uint16_t hours, uint16_t minutes, uint16_t seconds)
-    : hh(hours), mm(minutes), ss(seconds)
+inline Result Inflater::inflate_stored()
 {
-  if (mm > 60 || ss > 60)
-    throw InvalidFieldFormat("Time is out of range: " + std::to_string(mm) + "minutes " +
-                             std::to_string(ss) + "seconds");
+  get_bits(bit_count % 8);
+  const uint32_t length = get_bits(16);
+  if ((length ^ 0xffff) != get_bits(16))
+    return invalid_archive("Invalid length of stored deflate block");
 
-  set_total_seconds();
-  set_raw_time();
-  time_is_provided = true;
+  for (uint32_t i = 0; i < length && !overrun; ++i)
+    window.push_back(static_cast<char>(get_bits(8)));
+  return ResultCode::OK;
 }
 
-inline Time::Time(size_t seconds)
-  : time_is_provided(true), total_seconds(seconds),
-    hh(seconds / 3600), mm((seconds % 3600) / 60), ss(seconds % 3600)
+inline Result Inflater::inflate_codes(const Huffman & lengths_code,
+                                      const Huffman & distances_code)
 {
-  set_raw_time();
+  static constexpr uint16_t length_bases[] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                              15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                              67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static constexpr uint8_t length_extra_bits[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                  2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static constexpr uint16_t distance_bases[] = {
+      1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+      193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+  static constexpr uint8_t distance_extra_bits[] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                                    4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                                    9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+  while (true)
+  {
+    int symbol = decode(lengths_code);
+    if (symbol < 0)
+      return invalid_archive("Invalid deflate code");
+    if (symbol < 256)
+    {
+      window.push_back(static_cast<char>(symbol));
+      continue;
+    }
+    if (symbol == 256)
+      return ResultCode::OK;
+
+    symbol -= 257;
+    if (symbol >= 29)
+      return invalid_archive("Invalid deflate length code");
+    const size_t length = length_bases[symbol] + get_bits(length_extra_bits[symbol]);
+
+    symbol = decode(distances_code);
+    if (symbol < 0 || symbol >= 30)
+      return invalid_archive("Invalid deflate distance code");
+    const size_t distance = distance_bases[symbol] + get_bits(distance_extra_bits[symbol]);
+    if (distance > window.size() || overrun)
+      return invalid_archive("Invalid deflate distance");
+
+    // Copied bytes may overlap with the ones being written.
+    const size_t from = window.size() - distance;
+    window.resize(window.size() + length);
+    char * data = window.data();
+    for (size_t i = 0; i < length; ++i)
+      data[window.size() - length + i] = data[from + i];
+  }
 }
 
-inline bool Time::is_provided() const { return time_is_provided; }
+inline Result Inflater::inflate_dynamic()
+{
+  static constexpr uint8_t code_lengths_order[] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                                   11, 4,  12, 3, 13, 2, 14, 1, 15};
 
-inline size_t Time::get_total_seconds() const { return total_seconds; }
+  const size_t lengths_count = get_bits(5) + 257;
+  const size_t distances_count = get_bits(5) + 1;
+  const size_t code_lengths_count = get_bits(4) + 4;
+  if (lengths_count > 286 || distances_count > 30)
+    return invalid_archive("Invalid counts of deflate codes");
 
-inline std::tuple<uint16_t, uint16_t, uint16_t> Time::get_hh_mm_ss() const { return {hh, mm, ss}; }
+  std::array<uint8_t, 320> lengths{};
+  for (size_t i = 0; i < code_lengths_count; ++i)
+    lengths[code_lengths_order[i]] = static_cast<uint8_t>(get_bits(3));
 
-inline std::string Time::get_raw_time() const { return raw_time; }
+  Huffman code_lengths_code;
+  if (!build(code_lengths_code, lengths.data(), 19))
+    return invalid_archive("Invalid deflate code lengths code");
 
-// Service day in the YYYYMMDD format.
-class Date
+  lengths.fill(0);
+  for (size_t i = 0; i < lengths_count + distances_count;)
+  {
+    const int symbol = decode(code_lengths_code);
+    if (symbol < 0)
+      return invalid_archive("Invalid deflate code length");
+    if (symbol < 16)
+    {
+      lengths[i++] = static_cast<uint8_t>(symbol);
+      continue;
+    }
+
+    uint8_t length = 0;
+    size_t repeat = 0;
+    if (symbol == 16)
+    {
+      if (i == 0)
+        return invalid_archive("Repeated deflate code length without previous one");
+      length = lengths[i - 1];
+      repeat = 3 + get_bits(2);
+    }
+    else
+    {
+      repeat = symbol == 17 ? 3 + get_bits(3) : 11 + get_bits(7);
+    }
+    if (i + repeat > lengths_count + distances_count)
+      return invalid_archive("Too many deflate code lengths");
+    for (; repeat > 0; --repeat)
+      lengths[i++] = length;
+  }
+
+  if (lengths[256] == 0)
+    return invalid_archive("Deflate block without end code");
+  if (!build(dynamic_lengths, lengths.data(), lengths_count) ||
+      !build(dynamic_distances, lengths.data() + lengths_count, distances_count))
+  {
+    return invalid_archive("Invalid deflate codes");
+  }
+  return inflate_codes(dynamic_lengths, dynamic_distances);
+}
+
+inline Result Inflater::inflate(std::string & output, size_t min_size)
+{
+  const size_t start = window.size();
+  while (!finished && window.size() - start < min_size)
+  {
+    const bool is_final = get_bits(1) == 1;
+    const uint32_t type = get_bits(2);
+
+    Result res;
+    if (type == 0)
+    {
+      res = inflate_stored();
+    }
+    else if (type == 1)
+    {
+      if (!has_fixed_codes)
+      {
+        std::array<uint8_t, 288> lengths{};
+        std::fill(lengths.begin(), lengths.begin() + 144, 8);
+        std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+        std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+        std::fill(lengths.begin() + 280, lengths.end(), 8);
+        build(fixed_lengths, lengths.data(), 288);
+        lengths.fill(5);
+        build(fixed_distances, lengths.data(), 30);
+        has_fixed_codes = true;
+      }
+      res = inflate_codes(fixed_lengths, fixed_distances);
+    }
+    else
+    {
+      res = type == 2 ? inflate_dynamic() : invalid_archive("Invalid deflate block type");
+    }
+
+    if (overrun)
+    {
+      return input_result != ResultCode::OK ? input_result
+                                            : invalid_archive("Unexpected end of deflate data");
+    }
+    if (res != ResultCode::OK)
+      return res;
+    finished = is_final;
+  }
+
+  output.assign(window, start, std::string::npos);
+  if (window.size() > max_distance)
+    window.erase(0, window.size() - max_distance);
+  return ResultCode::OK;
+}
+
+inline void Inflater::restart()
+{
+  finished = false;
+  window.clear();
+}
+
+inline bool Inflater::read_byte(uint8_t & byte)
+{
+  get_bits(bit_count % 8);
+  byte = static_cast<uint8_t>(get_bits(8));
+  return !overrun;
+}
+
+inline bool Inflater::is_input_ended()
+{
+  get_bits(bit_count % 8);
+  refill();
+  return bit_count == 0;
+}
+
+// Raw deflate data, e.g. of the zip archive entry.
+class InflateStream : public InputStream
 {
 public:
-  inline Date() = default;
-  inline Date(uint16_t year, uint16_t month, uint16_t day);
-  inline explicit Date(const std::string & raw_date_str);
-  inline bool is_provided() const;
-  inline std::tuple<uint16_t, uint16_t, uint16_t> get_yyyy_mm_dd() const;
-  inline std::string get_raw_date() const;
+  explicit InflateStream(std::unique_ptr<InputStream> compressed)
+      : compressed(std::move(compressed)), inflater(*this->compressed)
+  {
+  }
+
+  Result read(std::string & block) override
+  {
+    if (inflater.is_finished())
+    {
+      block.clear();
+      return ResultCode::OK;
+    }
+    return inflater.inflate(block, input_block_size);
+  }
 
 private:
-  inline void check_valid() const;
+  std::unique_ptr<InputStream> compressed;
+  Inflater inflater;
+};
 
-  std::string raw_date;
-  uint16_t yyyy = 0;
-  uint16_t mm = 0;
-  uint16_t dd = 0;
-  bool date_is_provided = false;
+// Gzip file (RFC 1952) consisting of one or more members.
+class GzipStream : public InputStream
+{
+public:
+  explicit GzipStream(std::unique_ptr<InputStream> compressed)
+      : compressed(std::move(compressed)), inflater(*this->compressed)
+  {
+  }
+
+  inline Result read(std::string & block) override;
+
+private:
+  inline Result read_header();
+  inline Result read_trailer();
+
+  std::unique_ptr<InputStream> compressed;
+  Inflater inflater;
+  bool is_member_started = false;
+  size_t members_count = 0;
+  uint32_t crc = 0;
+  uint32_t size = 0;
 };
 
-inline bool operator==(const Date & lhs, const Date & rhs)
+inline Result GzipStream::read_header()
 {
-  return lhs.get_yyyy_mm_dd() == rhs.get_yyyy_mm_dd() && lhs.is_provided() == rhs.is_provided();
+  uint8_t header[10];
+  for (auto & byte : header)
+  {
+    if (!inflater.read_byte(byte))
+      return invalid_archive("Truncated gzip header");
+  }
+  if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8)
+    return invalid_archive("Invalid gzip header");
+
+  const uint8_t flags = header[3];
+  uint8_t byte = 0;
+  bool is_read = true;
+  if (flags & 4)
+  {
+    uint8_t extra_size[2] = {};
+    is_read = inflater.read_byte(extra_size[0]) && inflater.read_byte(extra_size[1]);
+    for (size_t i = 0; is_read && i < size_t(extra_size[0] | extra_size[1] << 8); ++i)
+      is_read = inflater.read_byte(byte);
+  }
+  // File name and comment are zero-terminated.
+  for (const uint8_t flag : {8, 16})
+  {
+    if (flags & flag)
+    {
+      while ((is_read = is_read && inflater.read_byte(byte)) && byte != 0)
+        ;
+    }
+  }
+  if (flags & 2)
+    is_read = is_read && inflater.read_byte(byte) && inflater.read_byte(byte);
+
+  if (!is_read)
+    return invalid_archive("Truncated gzip header");
+  return ResultCode::OK;
 }
 
-inline void Date::check_valid() const
+inline Result GzipStream::read_trailer()
 {
-  if (yyyy < 1000 || yyyy > 9999 || mm < 1 || mm > 12 || dd < 1 || dd > 31)
-    throw InvalidFieldFormat("Date check failed: out of range. " + std::to_string(yyyy) +
-                             " year, " + std::to_string(mm) + " month, " + std::to_string(dd) +
-                             " day");
+  uint32_t values[2] = {};
+  for (auto & value : values)
+  {
+    for (size_t i = 0; i < 4; ++i)
+    {
+      uint8_t byte = 0;
+      if (!inflater.read_byte(byte))
+        return invalid_archive("Truncated gzip trailer");
+      value |= uint32_t(byte) << (8 * i);
+    }
+  }
+  if (values[0] != crc || values[1] != size)
+    return invalid_archive("Gzip data does not match its checksum");
+  return ResultCode::OK;
+}
 
-  if (mm == 2 && dd > 28)
+inline Result GzipStream::read(std::string & block)
+{
+  block.clear();
+  while (block.empty())
   {
-    // The year is not leap. Days count should be 28.
-    if (yyyy % 4 != 0 || (yyyy % 100 == 0 && yyyy % 400 != 0))
-      throw InvalidFieldFormat("Invalid days count in February of non-leap year: " +
-                               std::to_string(dd) + " year" + std::to_string(yyyy));
+    if (!is_member_started)
+    {
+      // Members follow each other up to the end of the file.
+      if (members_count > 0 && inflater.is_input_ended())
+        return inflater.get_input_result();
+
+      Result res = read_header();
+      if (res != ResultCode::OK)
+        return res;
+
+      inflater.restart();
+      is_member_started = true;
+      ++members_count;
+      crc = 0;
+      size = 0;
+    }
 
-    // The year is leap. Days count should be 29.
-    if (dd > 29)
-      throw InvalidFieldFormat("Invalid days count in February of leap year: " +
-                               std::to_string(dd) + " year" + std::to_string(yyyy));
-  }
+    Result res = inflater.inflate(block, input_block_size);
+    if (res != ResultCode::OK)
+      return res;
 
-  if (dd > 30 && (mm == 4 || mm == 6 || mm == 9 || mm == 11))
-    throw InvalidFieldFormat("Invalid days count in month: " + std::to_string(dd) + " days in " +
-                             std::to_string(mm));
+    crc = get_crc32(crc, block);
+    size += static_cast<uint32_t>(block.size());
+    if (inflater.is_finished())
+    {
+      res = read_trailer();
+      if (res != ResultCode::OK)
+        return res;
+      is_member_started = false;
+    }
+  }
+  return ResultCode::OK;
 }
 
-inline Date::Date(uint16_t year, uint16_t month, uint16_t day) : yyyy(year), mm(month), dd(day)
+#ifdef JUST_GTFS_USE_ZSTD
+// Zstandard frames decoded by libzstd.
+class ZstdStream : public InputStream
 {
-  check_valid();
-  const std::string mm_str = append_leading_zero(std::to_string(mm));
-  const std::string dd_str = append_leading_zero(std::to_string(dd));
+public:
+  explicit ZstdStream(std::unique_ptr<InputStream> compressed)
+      : compressed(std::move(compressed)), stream(ZSTD_createDStream())
+  {
+    ZSTD_initDStream(stream);
+  }
+  ~ZstdStream() override { ZSTD_freeDStream(stream); }
 
-  raw_date = std::to_string(yyyy) + mm_str + dd_str;
-  date_is_provided = true;
+  inline Result read(std::string & block) override;
+
+private:
+  std::unique_ptr<InputStream> compressed;
+  ZSTD_DStream * stream = nullptr;
+  std::string input_block;
+  ZSTD_inBuffer input = {nullptr, 0, 0};
+  // Zero after the complete frame.
+  size_t last_result = 0;
+};
+
+inline Result ZstdStream::read(std::string & block)
+{
+  block.resize(input_block_size);
+  ZSTD_outBuffer output = {block.data(), block.size(), 0};
+  while (output.pos == 0)
+  {
+    if (input.pos == input.size)
+    {
+      Result res = compressed->read(input_block);
+      if (res != ResultCode::OK)
+        return res;
+      if (input_block.empty())
+      {
+        block.clear();
+        return last_result == 0 ? ResultCode::OK : invalid_archive("Truncated zstd data");
+      }
+      input = {input_block.data(), input_block.size(), 0};
+    }
+
+    last_result = ZSTD_decompressStream(stream, &output, &input);
+    if (ZSTD_isError(last_result))
+      return invalid_archive(std::string("Invalid zstd data: ") + ZSTD_getErrorName(last_result));
+  }
+  block.resize(output.pos);
+  return ResultCode::OK;
 }
+#endif
 
-inline Date::Date(const std::string & raw_date_str) : raw_date(raw_date_str)
+// Checks the size and CRC-32 of the contents at the end, e.g. of the zip archive entry.
+class CheckedStream : public InputStream
 {
-  if (raw_date.empty())
-    return;
+public:
+  CheckedStream(std::unique_ptr<InputStream> input, uint32_t crc, uintmax_t size,
+                const std::string & name)
+      : input(std::move(input)), expected_crc(crc), expected_size(size), name(name)
+  {
+  }
+
+  Result read(std::string & block) override
+  {
+    Result res = input->read(block);
+    if (res != ResultCode::OK)
+      return res;
+
+    crc = get_crc32(crc, block);
+    size += block.size();
+    if (block.empty() && (crc != expected_crc || size != expected_size))
+      return invalid_archive("Contents of " + name + " do not match its checksum");
+    return ResultCode::OK;
+  }
 
-  if (raw_date.size() != 8)
-    throw InvalidFieldFormat("Date is not in YYYY:MM::DD format: " + raw_date_str);
+private:
+  std::unique_ptr<InputStream> input;
+  uint32_t crc = 0;
+  uintmax_t size = 0;
+  uint32_t expected_crc = 0;
+  uintmax_t expected_size = 0;
+  std::string name;
+};
 
-  yyyy = static_cast<uint16_t>(std::stoi(raw_date.substr(0, 4)));
-  mm = static_cast<uint16_t>(std::stoi(raw_date.substr(4, 2)));
-  dd = static_cast<uint16_t>(std::stoi(raw_date.substr(6, 2)));
+// Reads the blocks of the wrapped stream ahead on a separate thread, so that the decompression
+// runs in parallel with the parsing.
+class PipelinedStream : public InputStream
+{
+public:
+  inline explicit PipelinedStream(std::unique_ptr<InputStream> input, size_t max_blocks = 4);
+  inline ~PipelinedStream() override;
 
-  check_valid();
+  inline Result read(std::string & block) override;
 
-  date_is_provided = true;
+private:
+  inline void run();
+
+  std::unique_ptr<InputStream> input;
+  size_t max_blocks = 0;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<std::string> blocks;
+  Result result;
+  bool is_finished = false;
+  bool is_stopped = false;
+  std::thread thread;
+};
+
+inline PipelinedStream::PipelinedStream(std::unique_ptr<InputStream> input, size_t max_blocks)
+    : input(std::move(input)), max_blocks(std::max<size_t>(max_blocks, 1))
+{
+  thread = std::thread([this]() { run(); });
 }
 
-inline bool Date::is_provided() const { return date_is_provided; }
+inline PipelinedStream::~PipelinedStream()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    is_stopped = true;
+  }
+  condition.notify_all();
+  thread.join();
+}
 
-inline std::tuple<uint16_t, uint16_t, uint16_t> Date::get_yyyy_mm_dd() const
+inline void PipelinedStream::run()
 {
-  return {yyyy, mm, dd};
+  while (true)
+  {
+    std::string block;
+    Result res = input->read(block);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this]() { return is_stopped || blocks.size() < max_blocks; });
+    if (is_stopped)
+      return;
+
+    if (res != ResultCode::OK || block.empty())
+    {
+      result = res;
+      is_finished = true;
+      condition.notify_all();
+      return;
+    }
+    blocks.push_back(std::move(block));
+    condition.notify_all();
+  }
 }
 
-inline std::string Date::get_raw_date() const { return raw_date; }
+inline Result PipelinedStream::read(std::string & block)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [this]() { return is_finished || !blocks.empty(); });
+  if (blocks.empty())
+  {
+    block.clear();
+    return result;
+  }
 
-// An ISO 4217 alphabetical currency code. Used as type for Currency Code GTFS fields.
-using CurrencyCode = std::string;
-// An IETF BCP 47 language code. Used as type for Language Code GTFS fields.
-using LanguageCode = std::string;
+  block = std::move(blocks.front());
+  blocks.pop_front();
+  condition.notify_all();
+  return ResultCode::OK;
+}
 
-// Helper enums for some GTFS fields ---------------------------------------------------------------
-enum class StopLocationType : int8_t
+// Opens the file compressed with gzip (path.gz) or zstd (path.zst, if JUST_GTFS_USE_ZSTD is
+// defined). Returns nullptr if there are no such files.
+inline std::unique_ptr<InputStream> open_compressed_file(const std::string & path)
 {
-  StopOrPlatform = 0,
-  Station = 1,
-  EntranceExit = 2,
-  GenericNode = 3,
-  BoardingArea = 4
-};
+  auto file = std::make_unique<FileStream>();
+  if (file->open(path + ".gz"))
+    return std::make_unique<GzipStream>(std::move(file));
+#ifdef JUST_GTFS_USE_ZSTD
+  file = std::make_unique<FileStream>();
+  if (file->open(path + ".zst"))
+    return std::make_unique<ZstdStream>(std::move(file));
+#endif
+  return nullptr;
+}
 
-// The type of transportation used on a route.
-enum class RouteType : int16_t
+// Feed files in the zip archive. Entries are decompressed while reading them without extracting
+// the archive. They may be stored or compressed with deflate or with zstd (if JUST_GTFS_USE_ZSTD
+// is defined). Files are also found in a directory of the archive, e.g. gtfs/stops.txt.
+class ZipArchive : public FeedSource
 {
-  // GTFS route types
-  Tram = 0,         // Tram, Streetcar, Light rail
-  Subway = 1,       // Any underground rail system within a metropolitan area
-  Rail = 2,         // Intercity or long-distance travel
-  Bus = 3,          // Short- and long-distance bus routes
-  Ferry = 4,        // Boat service
-  CableTram = 5,    // Street-level rail cars where the cable runs beneath the vehicle
-  AerialLift = 6,   // Aerial lift, suspended cable car (gondola lift, aerial tramway)
-  Funicular = 7,    // Any rail system designed for steep inclines
-  Trolleybus = 11,  // Electric buses that draw power from overhead wires using poles
-  Monorail = 12,    // Railway in which the track consists of a single rail or a beam
+public:
+  explicit ZipArchive(const std::string & path) : path(path) {}
 
-  // Extended route types
-  // https://developers.google.com/transit/gtfs/reference/extended-route-types
-  RailwayService = 100,
-  HighSpeedRailService = 101,
-  LongDistanceTrains = 102,
-  InterRegionalRailService = 103,
-  CarTransportRailService = 104,
-  SleeperRailService = 105,
-  RegionalRailService = 106,
-  TouristRailwayService = 107,
-  RailShuttleWithinComplex = 108,
-  SuburbanRailway = 109,
-  ReplacementRailService = 110,
-  SpecialRailService = 111,
-  LorryTransportRailService = 112,
-  AllRailServices = 113,
-  CrossCountryRailService = 114,
-  VehicleTransportRailService = 115,
-  RackAndPinionRailway = 116,
-  AdditionalRailService = 117,
+  inline Result open(const std::string & filename,
+                     std::unique_ptr<InputStream> & stream) const override;
+  inline uintmax_t get_file_size(const std::string & filename) const override;
+  inline std::optional<uint32_t> get_file_crc32(const std::string & filename) const override;
+  // Reads the central directory of the archive. It is read once on the first access.
+  inline Result read_directory() const;
 
-  CoachService = 200,
-  InternationalCoachService = 201,
-  NationalCoachService = 202,
-  ShuttleCoachService = 203,
-  RegionalCoachService = 204,
-  SpecialCoachService = 205,
-  SightseeingCoachService = 206,
-  TouristCoachService = 207,
-  CommuterCoachService = 208,
-  AllCoachServices = 209,
+private:
+  struct Entry
+  {
+    std::string name;
+    uint16_t flags = 0;
+    uint16_t method = 0;
+    uint32_t crc = 0;
+    uint64_t compressed_size = 0;
+    uint64_t size = 0;
+    uint64_t header_offset = 0;
+  };
+
+  inline Result parse_directory();
+  inline const Entry * find_entry(const std::string & filename) const;
+
+  std::string path;
+  mutable std::once_flag directory_flag;
+  mutable Result directory_result;
+  std::vector<Entry> entries;
+};
 
-  UrbanRailwayService400 = 400,
-  MetroService = 401,
-  UndergroundService = 402,
-  UrbanRailwayService403 = 403,
-  AllUrbanRailwayServices = 404,
-  Monorail405 = 405,
+template <typename T>
+T read_little_endian(const char * data)
+{
+  T res = 0;
+  for (size_t i = 0; i < sizeof(T); ++i)
+    res |= static_cast<T>(static_cast<uint8_t>(data[i])) << (8 * i);
+  return res;
+}
 
-  BusService = 700,
-  RegionalBusService = 701,
-  ExpressBusService = 702,
-  StoppingBusService = 703,
-  LocalBusService = 704,
-  NightBusService = 705,
-  PostBusService = 706,
-  SpecialNeedsBus = 707,
-  MobilityBusService = 708,
-  MobilityBusForRegisteredDisabled = 709,
-  SightseeingBus = 710,
-  ShuttleBus = 711,
-  SchoolBus = 712,
-  SchoolAndPublicServiceBus = 713,
-  RailReplacementBusService = 714,
-  DemandAndResponseBusService = 715,
-  AllBusServices = 716,
+inline Result ZipArchive::read_directory() const
+{
+  // The directory is parsed once regardless of the constness of the archive.
+  std::call_once(directory_flag, [this]() {
+    directory_result = const_cast<ZipArchive *>(this)->parse_directory();
+  });
+  return directory_result;
+}
+
+inline Result ZipArchive::parse_directory()
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not open archive " + path};
+
+  auto read_at = [&file](uint64_t offset, size_t size, std::string & data) {
+    data.resize(size);
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(data.data(), static_cast<std::streamsize>(size));
+    return file.gcount() == static_cast<std::streamsize>(size);
+  };
+
+  // End of central directory record is followed by the comment up to 64 KB long.
+  file.seekg(0, std::ios::end);
+  const auto file_size = static_cast<uint64_t>(file.tellg());
+  static constexpr size_t end_record_size = 22;
+  const auto tail_size =
+      static_cast<size_t>(std::min<uint64_t>(file_size, 0xffff + end_record_size));
+  std::string tail;
+  if (tail_size < end_record_size || !read_at(file_size - tail_size, tail_size, tail))
+    return invalid_archive("File is not a zip archive " + path);
+
+  size_t end_record = tail_size - end_record_size + 1;
+  do
+  {
+    --end_record;
+  } while (end_record > 0 && read_little_endian<uint32_t>(&tail[end_record]) != 0x06054b50);
+  if (read_little_endian<uint32_t>(&tail[end_record]) != 0x06054b50)
+    return invalid_archive("File is not a zip archive " + path);
+
+  uint64_t entries_count = read_little_endian<uint16_t>(&tail[end_record + 10]);
+  uint64_t directory_size = read_little_endian<uint32_t>(&tail[end_record + 12]);
+  uint64_t directory_offset = read_little_endian<uint32_t>(&tail[end_record + 16]);
+
+  // Zip64 end of central directory record is pointed by the locator preceding the record.
+  const uint64_t end_record_offset = file_size - tail_size + end_record;
+  std::string zip64;
+  if (end_record_offset >= 20 && read_at(end_record_offset - 20, 20, zip64) &&
+      read_little_endian<uint32_t>(&zip64[0]) == 0x07064b50)
+  {
+    const auto zip64_offset = read_little_endian<uint64_t>(&zip64[8]);
+    if (!read_at(zip64_offset, 56, zip64) || read_little_endian<uint32_t>(&zip64[0]) != 0x06064b50)
+      return invalid_archive("Invalid zip64 end of central directory in " + path);
 
-  TrolleybusService = 800,
+    entries_count = read_little_endian<uint64_t>(&zip64[32]);
+    directory_size = read_little_endian<uint64_t>(&zip64[40]);
+    directory_offset = read_little_endian<uint64_t>(&zip64[48]);
+  }
 
-  TramService = 900,
-  CityTramService = 901,
-  LocalTramService = 902,
-  RegionalTramService = 903,
-  SightseeingTramService = 904,
-  ShuttleTramService = 905,
-  AllTramServices = 906,
+  std::string directory;
+  if (directory_offset + directory_size > file_size ||
+      !read_at(directory_offset, static_cast<size_t>(directory_size), directory))
+  {
+    return invalid_archive("Invalid central directory of " + path);
+  }
 
-  WaterTransportService = 1000,
-  AirService = 1100,
-  FerryService = 1200,
-  AerialLiftService = 1300,
-  FunicularService = 1400,
-  TaxiService = 1500,
-  CommunalTaxiService = 1501,
-  WaterTaxiService = 1502,
-  RailTaxiService = 1503,
-  BikeTaxiService = 1504,
-  LicensedTaxiService = 1505,
-  PrivateHireServiceVehicle = 1506,
-  AllTaxiServices = 1507,
-  MiscellaneousService = 1700,
-  HorseDrawnCarriage = 1702
-};
+  static constexpr size_t entry_header_size = 46;
+  size_t position = 0;
+  for (uint64_t i = 0; i < entries_count; ++i)
+  {
+    if (position + entry_header_size > directory.size() ||
+        read_little_endian<uint32_t>(&directory[position]) != 0x02014b50)
+    {
+      return invalid_archive("Invalid central directory of " + path);
+    }
 
-enum class TripDirectionId : bool
-{
-  DefaultDirection = 0,  // e.g. outbound
-  OppositeDirection = 1  // e.g. inbound
-};
+    const char * header = &directory[position];
+    Entry entry;
+    entry.flags = read_little_endian<uint16_t>(header + 8);
+    entry.method = read_little_endian<uint16_t>(header + 10);
+    entry.crc = read_little_endian<uint32_t>(header + 16);
+    entry.compressed_size = read_little_endian<uint32_t>(header + 20);
+    entry.size = read_little_endian<uint32_t>(header + 24);
+    const size_t name_size = read_little_endian<uint16_t>(header + 28);
+    const size_t extra_size = read_little_endian<uint16_t>(header + 30);
+    const size_t comment_size = read_little_endian<uint16_t>(header + 32);
+    entry.header_offset = read_little_endian<uint32_t>(header + 42);
+    if (position + entry_header_size + name_size + extra_size + comment_size > directory.size())
+      return invalid_archive("Invalid central directory of " + path);
+    entry.name.assign(header + entry_header_size, name_size);
+
+    // Zip64 extra field contains the 64-bit values of the fields which don't fit into 32 bits.
+    const char * extra = header + entry_header_size + name_size;
+    for (size_t offset = 0; offset + 4 <= extra_size;)
+    {
+      const auto id = read_little_endian<uint16_t>(extra + offset);
+      const size_t size = read_little_endian<uint16_t>(extra + offset + 2);
+      size_t value_offset = offset + 4;
+      auto read_value = [&](uint64_t & value) {
+        if (value != 0xffffffff || value_offset + 8 > offset + 4 + size)
+          return;
+        value = read_little_endian<uint64_t>(extra + value_offset);
+        value_offset += 8;
+      };
+      if (id == 1 && offset + 4 + size <= extra_size)
+      {
+        read_value(entry.size);
+        read_value(entry.compressed_size);
+        read_value(entry.header_offset);
+      }
+      offset += 4 + size;
+    }
 
-enum class TripAccess : int8_t
-{
-  NoInfo = 0,
-  Yes = 1,
-  No = 2
-};
+    entries.push_back(std::move(entry));
+    position += entry_header_size + name_size + extra_size + comment_size;
+  }
+  return ResultCode::OK;
+}
 
-enum class StopTimeBoarding : int8_t
+inline const ZipArchive::Entry * ZipArchive::find_entry(const std::string & filename) const
 {
-  RegularlyScheduled = 0,
-  No = 1,                   // Not available
-  Phone = 2,                // Must phone agency to arrange
-  CoordinateWithDriver = 3  // Must coordinate with driver to arrange
-};
+  const Entry * res = nullptr;
+  for (const auto & entry : entries)
+  {
+    if (entry.name == filename)
+      return &entry;
+
+    const bool is_nested = entry.name.size() > filename.size() &&
+                           entry.name[entry.name.size() - filename.size() - 1] == '/' &&
+                           entry.name.compare(entry.name.size() - filename.size(),
+                                              filename.size(), filename) == 0;
+    if (is_nested && res == nullptr)
+      res = &entry;
+  }
+  return res;
+}
 
-enum class StopTimePoint : bool
+inline uintmax_t ZipArchive::get_file_size(const std::string & filename) const
 {
-  Approximate = 0,
-  Exact = 1
-};
+  if (read_directory() != ResultCode::OK)
+    return 0;
 
-enum class CalendarAvailability : bool
-{
-  NotAvailable = 0,
-  Available = 1
-};
+  const Entry * entry = find_entry(filename);
+  return entry ? entry->size : 0;
+}
 
-enum class CalendarDateException : int8_t
+inline std::optional<uint32_t> ZipArchive::get_file_crc32(const std::string & filename) const
 {
-  Added = 1,  // Service has been added for the specified date
-  Removed = 2
-};
+  if (read_directory() != ResultCode::OK)
+    return std::nullopt;
 
-enum class FarePayment : bool
+  const Entry * entry = find_entry(filename);
+  return entry ? std::optional<uint32_t>(entry->crc) : std::nullopt;
+}
+
+inline Result ZipArchive::open(const std::string & filename,
+                               std::unique_ptr<InputStream> & stream) const
 {
-  OnBoard = 0,
-  BeforeBoarding = 1  // Fare must be paid before boarding
-};
+  Result res = read_directory();
+  if (res != ResultCode::OK)
+    return res;
 
-enum class FareTransfers : int8_t
+  const Entry * entry = find_entry(filename);
+  if (entry == nullptr)
+    return {ResultCode::ERROR_FILE_ABSENT, "File " + filename + " could not be opened"};
+  if (entry->flags & 1)
+    return invalid_archive("Encrypted entry " + entry->name + " is not supported");
+
+  // Local header has its own sizes of the name and of the extra field.
+  static constexpr size_t local_header_size = 30;
+  std::ifstream file(path, std::ios::binary);
+  char header[local_header_size];
+  file.seekg(static_cast<std::streamoff>(entry->header_offset));
+  file.read(header, local_header_size);
+  if (file.gcount() != local_header_size || read_little_endian<uint32_t>(header) != 0x04034b50)
+    return invalid_archive("Invalid local header of " + entry->name);
+
+  const uint64_t data_offset = entry->header_offset + local_header_size +
+                               read_little_endian<uint16_t>(header + 26) +
+                               read_little_endian<uint16_t>(header + 28);
+  auto data = std::make_unique<FileStream>();
+  if (!data->open(path, data_offset, entry->compressed_size))
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not open archive " + path};
+
+  std::unique_ptr<InputStream> contents;
+  if (entry->method == 0)
+    contents = std::move(data);
+  else if (entry->method == 8)
+    contents = std::make_unique<InflateStream>(std::move(data));
+#ifdef JUST_GTFS_USE_ZSTD
+  else if (entry->method == 93)
+    contents = std::make_unique<ZstdStream>(std::move(data));
+#endif
+  else
+    return invalid_archive("Unsupported compression method of " + entry->name);
+
+  stream = std::make_unique<CheckedStream>(std::move(contents), entry->crc, entry->size,
+                                           entry->name);
+  return ResultCode::OK;
+}
+
+// Csv parser  -------------------------------------------------------------------------------------
+// Read-only contents of the whole file. The file is memory-mapped on the platforms supporting it
+// and read into the memory buffer otherwise.
+class MappedFile
 {
-  No = 0,  // No transfers permitted on this fare
-  Once = 1,
-  Twice = 2,
-  Unlimited = 3
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+  inline ~MappedFile();
+
+  inline bool open(const std::string & path);
+  inline void close();
+  inline bool is_open() const;
+  inline std::string_view get_data() const;
+
+private:
+  bool opened = false;
+  std::string_view data;
+#ifdef JUST_GTFS_USE_MMAP
+  void * mapping = nullptr;
+  size_t mapping_size = 0;
+#else
+  std::string buffer;
+#endif
 };
 
-enum class FrequencyTripService : bool
+inline MappedFile::~MappedFile() { close(); }
+
+inline bool MappedFile::open(const std::string & path)
 {
-  FrequencyBased = 0,  // Frequency-based trips
-  ScheduleBased = 1    // Schedule-based trips with the exact same headway throughout the day
-};
+  close();
+#ifdef JUST_GTFS_USE_MMAP
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
 
-enum class TransferType : int8_t
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  const size_t size = static_cast<size_t>(file_stat.st_size);
+  if (size > 0)
+  {
+    void * addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+      ::close(fd);
+      return false;
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+    mapping = addr;
+    mapping_size = size;
+    data = std::string_view(static_cast<const char *>(addr), size);
+  }
+  ::close(fd);
+#else
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+    return false;
+
+  buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  data = buffer;
+#endif
+  opened = true;
+  return true;
+}
+
+inline void MappedFile::close()
 {
-  Recommended = 0,
-  Timed = 1,
-  MinimumTime = 2,
-  NotPossible = 3
-};
+#ifdef JUST_GTFS_USE_MMAP
+  if (mapping != nullptr)
+    munmap(mapping, mapping_size);
+  mapping = nullptr;
+  mapping_size = 0;
+#else
+  buffer.clear();
+#endif
+  data = {};
+  opened = false;
+}
 
-enum class PathwayMode : int8_t
+inline bool MappedFile::is_open() const { return opened; }
+
+inline std::string_view MappedFile::get_data() const { return data; }
+
+// Storage for the csv field values which can't be referenced directly in the record, e.g. values
+// with escaped quotation marks. Strings are reused between records, so they keep their capacity.
+class CsvTokenStorage
 {
-  Walkway = 1,
-  Stairs = 2,
-  MovingSidewalk = 3,  // Moving sidewalk/travelator
-  Escalator = 4,
-  Elevator = 5,
-  FareGate = 6,  // Payment gate
-  ExitGate = 7
+public:
+  inline void clear();
+  inline std::string & next();
+
+private:
+  // std::deque doesn't invalidate the references to its elements on push_back().
+  std::deque<std::string> tokens;
+  size_t used = 0;
 };
 
-enum class PathwayDirection : bool
+inline void CsvTokenStorage::clear() { used = 0; }
+
+inline std::string & CsvTokenStorage::next()
 {
-  Unidirectional = 0,
-  Bidirectional = 1
-};
+  if (used == tokens.size())
+    tokens.emplace_back();
+  return tokens[used++];
+}
 
-enum class AttributionRole : bool
+// Field values of the csv record. Values are valid until the next record is read.
+using CsvRowView = std::vector<std::string_view>;
+
+enum class CsvParserMode
 {
-  No = 0,  // Organization doesn’t have this role
-  Yes = 1  // Organization does have this role
+  Stream,       // File is read line by line
+  MemoryMapped  // File is mapped to memory and records refer to its contents without copying
 };
 
-// Structures representing GTFS entities -----------------------------------------------------------
-// Required dataset file
-struct Agency
+class CsvParser
 {
-  // Conditionally optional:
-  Id agency_id;
+public:
+  CsvParser() = default;
+  inline explicit CsvParser(const std::string & gtfs_directory,
+                            CsvParserMode parser_mode = CsvParserMode::Stream);
 
-  // Required:
-  Text agency_name;
-  Text agency_url;
-  Text agency_timezone;
+  inline Result read_header(const std::string & csv_filename);
+  inline Result read_row(std::map<std::string, std::string> & obj);
+  inline Result read_row(CsvRowView & fields);
+  // Steps of read_row(): getting the next line and splitting it into fields. Line consisting of
+  // "\r" has no fields.
+  inline bool read_line(std::string_view & line);
+  inline void split_row(std::string_view line, CsvRowView & fields);
+
+  inline const std::vector<std::string> & get_field_sequence() const;
+
+  // Records from the data in memory are read instead of the file, e.g. a part of the file which
+  // is parsed in parallel with the others.
+  inline void assign_data(std::string_view csv_data);
+  // Returns not yet read part of the memory-mapped file or the assigned data.
+  inline std::string_view get_unread_data() const;
+  // Records are read from the stream instead of the file, e.g. from the zip archive entry. The
+  // stream is used by the following read_header().
+  inline void assign_input(std::unique_ptr<InputStream> input_stream);
+  bool has_input() const { return input != nullptr; }
+  // Error of reading the assigned stream, e.g. of its decompression.
+  const Result & get_input_result() const { return input_result; }
 
-  // Optional:
-  Text agency_lang;
-  Text agency_phone;
-  Text agency_fare_url;
-  Text agency_email;
-};
+  inline static std::vector<std::string> split_record(const std::string & record,
+                                                      bool is_header = false);
+  inline static void split_record(std::string_view record, CsvRowView & fields,
+                                  CsvTokenStorage & storage, bool is_header = false);
 
-inline bool operator==(const Agency & lhs, const Agency & rhs)
-{
-  return std::tie(lhs.agency_id, lhs.agency_name, lhs.agency_url, lhs.agency_timezone,
-                  lhs.agency_lang, lhs.agency_phone, lhs.agency_fare_url, lhs.agency_email) ==
-         std::tie(rhs.agency_id, rhs.agency_name, rhs.agency_url, rhs.agency_timezone,
-                  rhs.agency_lang, rhs.agency_phone, rhs.agency_fare_url, rhs.agency_email);
-}
+private:
+  std::vector<std::string> field_sequence;
+  std::string gtfs_path;
+  CsvParserMode mode = CsvParserMode::Stream;
 
-// Required dataset file
-struct Stop
-{
-  // Required:
-  Id stop_id;
+  std::ifstream csv_stream;
+  std::string line_buffer;
 
-  // Conditionally required:
-  Text stop_name;
+  MappedFile csv_file;
+  std::string_view data;
+  size_t position = 0;
 
-  bool coordinates_present = true;
-  double stop_lat = 0.0;
-  double stop_lon = 0.0;
-  Id zone_id;
-  Id parent_station;
+  std::unique_ptr<InputStream> input;
+  std::string input_block;
+  size_t input_position = 0;
+  bool is_input_ended = false;
+  Result input_result;
 
-  // Optional:
-  Text stop_code;
-  Text stop_desc;
-  Text stop_url;
-  StopLocationType location_type = StopLocationType::StopOrPlatform;
-  Text stop_timezone;
-  Text wheelchair_boarding;
-  Id level_id;
-  Text platform_code;
+  CsvRowView row_fields;
+  CsvTokenStorage row_storage;
 };
 
-// Required dataset file
-struct Route
+inline CsvParser::CsvParser(const std::string & gtfs_directory, CsvParserMode parser_mode)
+    : gtfs_path(gtfs_directory), mode(parser_mode)
 {
-  // Required:
-  Id route_id;
-  RouteType route_type = RouteType::Tram;
+}
 
-  // Conditionally required:
-  Id agency_id;
-  Text route_short_name;
-  Text route_long_name;
+inline std::string trim_spaces(const std::string & token)
+{
+  static const std::string delimiters = " \t";
+  std::string res = token;
+  res.erase(0, res.find_first_not_of(delimiters));
+  res.erase(res.find_last_not_of(delimiters) + 1);
+  return res;
+}
+
+inline std::string normalize(std::string & token, bool has_quotes)
+{
+  std::string res = trim_spaces(token);
+  if (has_quotes)
+    return unquote_text(res);
+  return res;
+}
+
+// Returns the normalized token. It refers to the record if possible, otherwise the token is
+// copied to the storage.
+inline std::string_view normalize(std::string_view token, bool has_quotes, bool has_skipped,
+                                  CsvTokenStorage & storage)
+{
+  // Tabs and carriage returns are skipped and spaces are trimmed. While tabs and carriage returns
+  // are only around the token, it is the same as trimming them all.
+  static constexpr std::string_view delimiters = " \t\r";
+  const size_t begin = token.find_first_not_of(delimiters);
+  if (begin == std::string_view::npos)
+    return {};
+
+  token = token.substr(begin, token.find_last_not_of(delimiters) + 1 - begin);
+
+  if (has_skipped && token.find_first_of("\t\r") != std::string_view::npos)
+  {
+    std::string raw;
+    std::copy_if(token.begin(), token.end(), std::back_inserter(raw),
+                 [](char c) { return c != '\t' && c != '\r'; });
+    std::string & res = storage.next();
+    res = normalize(raw, has_quotes);
+    return res;
+  }
+
+  if (!has_quotes)
+    return token;
+
+  if (token.size() > 1 && token.front() == quote && token.back() == quote)
+  {
+    std::string_view unquoted = token.substr(1, token.size() - 2);
+    if (unquoted.find(quote) == std::string_view::npos)
+      return unquoted;
+  }
+
+  std::string & res = storage.next();
+  unquote_text(token, res);
+  return res;
+}
+
+#if defined(JUST_GTFS_USE_AVX2)
+inline constexpr size_t special_chars_block_size = 32;
+#else
+inline constexpr size_t special_chars_block_size = 16;
+#endif
+
+// Returns the mask of quotes, separators, tabs and carriage returns in the block of up to
+// special_chars_block_size characters. Bit i is set for the special character data[i].
+inline uint32_t get_special_chars_mask(const char * data, size_t count)
+{
+#if defined(JUST_GTFS_USE_AVX2)
+  if (count == 32)
+  {
+    const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+    const __m256i matches = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(quote)),
+                        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(csv_separator))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t')),
+                        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'))));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+  }
+#elif defined(JUST_GTFS_USE_SSE2)
+  if (count == 16)
+  {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    const __m128i matches =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(quote)),
+                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8(csv_separator))),
+                     _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')),
+                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))));
+    return static_cast<uint32_t>(_mm_movemask_epi8(matches));
+  }
+#elif defined(JUST_GTFS_USE_NEON)
+  if (count == 16)
+  {
+    const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(data));
+    const uint8x16_t matches =
+        vorrq_u8(vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(static_cast<uint8_t>(quote))),
+                          vceqq_u8(chunk, vdupq_n_u8(static_cast<uint8_t>(csv_separator)))),
+                 vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('\t')), vceqq_u8(chunk, vdupq_n_u8('\r'))));
+    // There is no movemask in NEON: matches are weighted by their bits and summed in halves.
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                        1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t bits = vandq_u8(matches, vld1q_u8(weights));
+    return static_cast<uint32_t>(vaddv_u8(vget_low_u8(bits))) |
+           (static_cast<uint32_t>(vaddv_u8(vget_high_u8(bits))) << 8);
+  }
+#endif
+
+  uint32_t mask = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const char c = data[i];
+    if (c == quote || c == csv_separator || c == '\t' || c == '\r')
+      mask |= uint32_t(1) << i;
+  }
+  return mask;
+}
+
+inline size_t count_trailing_zeros(uint32_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<size_t>(__builtin_ctz(mask));
+#else
+  size_t count = 0;
+  for (; (mask & 1) == 0; mask >>= 1)
+    ++count;
+  return count;
+#endif
+}
+
+inline void CsvParser::split_record(std::string_view record, CsvRowView & fields,
+                                    CsvTokenStorage & storage, bool is_header)
+{
+  fields.clear();
+  storage.clear();
+
+  size_t start_index = 0;
+  if (is_header)
+  {
+    // ignore UTF-8 BOM prefix:
+    if (record.size() > 2 && record[0] == '\xef' && record[1] == '\xbb' && record[2] == '\xbf')
+      start_index = 3;
+  }
+
+  size_t token_start = start_index;
+  bool is_inside_quotes = false;
+  bool quotes_in_token = false;
+  bool skipped_in_token = false;
+
+  auto handle_special_char = [&](size_t i) {
+    const char c = record[i];
+    if (c == quote)
+    {
+      is_inside_quotes = !is_inside_quotes;
+      quotes_in_token = true;
+      return;
+    }
+
+    if (c == csv_separator)
+    {
+      if (is_inside_quotes)
+        return;
+
+      fields.emplace_back(normalize(record.substr(token_start, i - token_start), quotes_in_token,
+                                    skipped_in_token, storage));
+      token_start = i + 1;
+      quotes_in_token = false;
+      skipped_in_token = false;
+      return;
+    }
+
+    // Delimiters are skipped while normalizing the token:
+    skipped_in_token = true;
+  };
+
+  // Only the special characters change the state. They are found in blocks of characters and
+  // handled in their order.
+  for (size_t block = start_index; block < record.size(); block += special_chars_block_size)
+  {
+    uint32_t mask = get_special_chars_mask(
+        record.data() + block, std::min(special_chars_block_size, record.size() - block));
+    for (; mask != 0; mask &= mask - 1)
+      handle_special_char(block + count_trailing_zeros(mask));
+  }
+
+  fields.emplace_back(
+      normalize(record.substr(token_start), quotes_in_token, skipped_in_token, storage));
+}
+
+inline std::vector<std::string> CsvParser::split_record(const std::string & record, bool is_header)
+{
+  CsvRowView fields;
+  CsvTokenStorage storage;
+  split_record(record, fields, storage, is_header);
+  return {fields.begin(), fields.end()};
+}
+
+inline bool CsvParser::read_line(std::string_view & line)
+{
+  if (input)
+  {
+    // Lines within the block refer to it. Lines crossing the blocks are collected in the buffer.
+    bool is_split = false;
+    line_buffer.clear();
+    while (true)
+    {
+      if (input_position == input_block.size())
+      {
+        if (!is_input_ended)
+        {
+          input_result = input->read(input_block);
+          input_position = 0;
+          is_input_ended = input_result != ResultCode::OK || input_block.empty();
+        }
+        if (is_input_ended)
+        {
+          input_block.clear();
+          input_position = 0;
+          line = line_buffer;
+          return is_split && input_result == ResultCode::OK;
+        }
+      }
+
+      const size_t line_end = input_block.find('\n', input_position);
+      const size_t end = line_end == std::string::npos ? input_block.size() : line_end;
+      if (line_end != std::string::npos && !is_split)
+      {
+        line = std::string_view(input_block).substr(input_position, end - input_position);
+        input_position = end + 1;
+        return true;
+      }
+
+      line_buffer.append(input_block, input_position, end - input_position);
+      is_split = true;
+      input_position = std::min(end + 1, input_block.size());
+      if (line_end != std::string::npos)
+      {
+        line = line_buffer;
+        return true;
+      }
+    }
+  }
+
+  if (mode == CsvParserMode::Stream)
+  {
+    if (!getline(csv_stream, line_buffer))
+      return false;
+
+    line = line_buffer;
+    return true;
+  }
+
+  if (position >= data.size())
+    return false;
+
+  size_t line_end = data.find('\n', position);
+  if (line_end == std::string_view::npos)
+    line_end = data.size();
+
+  line = data.substr(position, line_end - position);
+  position = line_end + 1;
+  return true;
+}
+
+inline Result CsvParser::read_header(const std::string & csv_filename)
+{
+  const std::string path = gtfs_path + csv_filename;
+  bool opened = false;
+
+  if (input)
+  {
+    opened = true;
+  }
+  else if (mode == CsvParserMode::Stream)
+  {
+    if (csv_stream.is_open())
+      csv_stream.close();
+
+    csv_stream.open(path);
+    opened = csv_stream.is_open();
+  }
+  else
+  {
+    position = 0;
+    opened = csv_file.open(path);
+    data = csv_file.get_data();
+  }
+
+  if (!opened)
+    return {ResultCode::ERROR_FILE_ABSENT, "File " + csv_filename + " could not be opened"};
+
+  std::string_view header;
+  const bool has_header = read_line(header);
+  if (input_result != ResultCode::OK)
+    return input_result;
+  if (!has_header || header.empty())
+    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, "Empty header in file " + csv_filename};
+
+  CsvTokenStorage storage;
+  split_record(header, row_fields, storage, true);
+  field_sequence.assign(row_fields.begin(), row_fields.end());
+  return ResultCode::OK;
+}
+
+inline Result CsvParser::read_row(CsvRowView & fields)
+{
+  fields.clear();
+  std::string_view row;
+  if (!read_line(row))
+  {
+    if (input_result != ResultCode::OK)
+      return input_result;
+    return {ResultCode::END_OF_FILE, {}};
+  }
+
+  split_row(row, fields);
+  return ResultCode::OK;
+}
+
+inline void CsvParser::split_row(std::string_view line, CsvRowView & fields)
+{
+  if (line == "\r")
+    fields.clear();
+  else
+    split_record(line, fields, row_storage);
+}
+
+inline Result CsvParser::read_row(std::map<std::string, std::string> & obj)
+{
+  obj = {};
+  Result res = read_row(row_fields);
+  if (res != ResultCode::OK)
+    return res;
+
+  // Different count of fields in the row and in the header of csv.
+  // Typical approach is to skip not required fields.
+  const size_t fields_count = std::min(field_sequence.size(), row_fields.size());
+
+  for (size_t i = 0; i < fields_count; ++i)
+    obj[field_sequence[i]] = row_fields[i];
+
+  return ResultCode::OK;
+}
+
+inline const std::vector<std::string> & CsvParser::get_field_sequence() const
+{
+  return field_sequence;
+}
+
+inline void CsvParser::assign_data(std::string_view csv_data)
+{
+  mode = CsvParserMode::MemoryMapped;
+  csv_file.close();
+  input.reset();
+  data = csv_data;
+  position = 0;
+}
+
+inline void CsvParser::assign_input(std::unique_ptr<InputStream> input_stream)
+{
+  input = std::move(input_stream);
+  input_block.clear();
+  input_position = 0;
+  is_input_ended = false;
+  input_result = {};
+}
+
+inline std::string_view CsvParser::get_unread_data() const
+{
+  return data.substr(std::min(position, data.size()));
+}
+
+// Positions of the entity columns in the csv file header. Resolved once per file.
+class ColumnIndex
+{
+public:
+  ColumnIndex() = default;
+  inline ColumnIndex(const std::vector<std::string> & columns,
+                     const std::vector<std::string> & header);
+
+  inline size_t get_position(size_t column) const;
+  inline const std::string & get_name(size_t column) const;
+
+  // Marks the columns as absent, so their values are not parsed.
+  inline void skip_columns(const std::vector<std::string> & skipped_columns);
+
+  static constexpr size_t absent = std::numeric_limits<size_t>::max();
+
+private:
+  const std::vector<std::string> * column_names = nullptr;
+  std::vector<size_t> positions;
+};
+
+inline ColumnIndex::ColumnIndex(const std::vector<std::string> & columns,
+                                const std::vector<std::string> & header)
+    : column_names(&columns), positions(columns.size(), absent)
+{
+  for (size_t i = 0; i < columns.size(); ++i)
+  {
+    // If the column is duplicated in the header its last position is used.
+    const auto it = std::find(header.rbegin(), header.rend(), columns[i]);
+    if (it != header.rend())
+      positions[i] = static_cast<size_t>(std::distance(it, header.rend()) - 1);
+  }
+}
+
+inline size_t ColumnIndex::get_position(size_t column) const { return positions[column]; }
+
+inline void ColumnIndex::skip_columns(const std::vector<std::string> & skipped_columns)
+{
+  for (size_t i = 0; i < positions.size(); ++i)
+  {
+    if (std::find(skipped_columns.begin(), skipped_columns.end(), (*column_names)[i]) !=
+        skipped_columns.end())
+    {
+      positions[i] = absent;
+    }
+  }
+}
+
+inline const std::string & ColumnIndex::get_name(size_t column) const
+{
+  return (*column_names)[column];
+}
+
+// Csv record with values accessed by the entity columns.
+class ParsedCsvRow
+{
+public:
+  inline ParsedCsvRow(const ColumnIndex & column_index, const CsvRowView & row_values);
+
+  inline bool empty() const;
+
+  // Returns value of the column or empty string if the column is absent in the record.
+  template <typename Column>
+  std::string_view get(Column column) const;
+
+  // Returns value of the column. Throws std::out_of_range if the column is absent in the record.
+  template <typename Column>
+  std::string_view at(Column column) const;
+
+  // Sets value of the column. Returns ERROR_REQUIRED_FIELD_ABSENT with the same message as of the
+  // exception thrown by at() if the column is absent in the record.
+  template <typename Column>
+  Result get_required(Column column, std::string_view & value) const;
+
+  template <typename Column>
+  bool has(Column column) const;
+
+private:
+  const ColumnIndex & index;
+  const CsvRowView & values;
+};
+
+inline ParsedCsvRow::ParsedCsvRow(const ColumnIndex & column_index, const CsvRowView & row_values)
+    : index(column_index), values(row_values)
+{
+}
+
+inline bool ParsedCsvRow::empty() const { return values.empty(); }
+
+template <typename Column>
+bool ParsedCsvRow::has(Column column) const
+{
+  // Position is absent for columns missing in the header. Also the record may contain fewer
+  // fields than the header.
+  const size_t position = index.get_position(static_cast<size_t>(column));
+  return position < values.size();
+}
+
+template <typename Column>
+std::string_view ParsedCsvRow::get(Column column) const
+{
+  if (!has(column))
+    return {};
+  return values[index.get_position(static_cast<size_t>(column))];
+}
+
+template <typename Column>
+std::string_view ParsedCsvRow::at(Column column) const
+{
+  std::string_view value;
+  const Result res = get_required(column, value);
+  if (res != ResultCode::OK)
+    throw std::out_of_range(res.message);
+  return value;
+}
+
+template <typename Column>
+Result ParsedCsvRow::get_required(Column column, std::string_view & value) const
+{
+  if (!has(column))
+  {
+    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT,
+            "Required field " + index.get_name(static_cast<size_t>(column)) + " is absent"};
+  }
+  value = values[index.get_position(static_cast<size_t>(column))];
+  return ResultCode::OK;
+}
+
+// Csv writer --------------------------------------------------------------------------------------
+// Formats csv records into the reusable buffer and writes it to the stream by big blocks. Fields
+// are formatted the same way as by the wrap() functions.
+class CsvWriter
+{
+public:
+  inline explicit CsvWriter(std::ostream & out);
+  // Formats records into the buffer without writing them anywhere.
+  inline CsvWriter();
+  CsvWriter(const CsvWriter &) = delete;
+  CsvWriter & operator=(const CsvWriter &) = delete;
+  inline ~CsvWriter();
+
+  // Writes text enclosed within quotation marks if it contains quotation marks or commas.
+  inline void write(std::string_view text);
+  inline void write(const std::string & text) { write(std::string_view(text)); }
+  // Writes number with 6 digits after the decimal point.
+  inline void write(double value);
+  // Writes enum value or integer as int.
+  template <typename T>
+  std::enable_if_t<std::is_integral<T>::value || std::is_enum<T>::value> write(const T & value);
+  // Writes text as is.
+  inline void write_raw(std::string_view text);
+  inline void write_all(const std::vector<std::string> & texts);
+  // Writes already formatted records.
+  inline void write_block(std::string_view records);
+
+  inline void end_record();
+  inline void flush();
+  inline const std::string & get_buffer() const;
+
+private:
+  inline void start_field();
+
+  static constexpr size_t buffer_size = 1 << 20;
+
+  std::ostream * out = nullptr;
+  std::string buffer;
+  bool is_first_field = true;
+};
+
+inline CsvWriter::CsvWriter(std::ostream & out) : out(&out) { buffer.reserve(buffer_size); }
+
+inline CsvWriter::CsvWriter() = default;
+
+inline CsvWriter::~CsvWriter() { flush(); }
+
+inline void CsvWriter::start_field()
+{
+  if (!is_first_field)
+    buffer += csv_separator;
+  is_first_field = false;
+}
+
+inline void CsvWriter::write(std::string_view text)
+{
+  start_field();
+  const size_t first_quote = text.find(quote);
+  if (first_quote == std::string_view::npos && text.find(csv_separator) == std::string_view::npos)
+  {
+    buffer += text;
+    return;
+  }
+
+  buffer += quote;
+  size_t begin = 0;
+  for (size_t i = first_quote; i != std::string_view::npos; i = text.find(quote, i + 1))
+  {
+    buffer.append(text.data() + begin, i + 1 - begin);
+    buffer += quote;
+    begin = i + 1;
+  }
+  buffer.append(text.data() + begin, text.size() - begin);
+  buffer += quote;
+}
+
+inline void CsvWriter::write(double value)
+{
+  start_field();
+  char chars[512];
+#if defined(__cpp_lib_to_chars)
+  const auto res = std::to_chars(chars, chars + sizeof(chars), value, std::chars_format::fixed, 6);
+  buffer.append(chars, res.ptr);
+#else
+  const int size = std::snprintf(chars, sizeof(chars), "%.6f", value);
+  buffer.append(chars, static_cast<size_t>(size));
+#endif
+}
+
+template <typename T>
+std::enable_if_t<std::is_integral<T>::value || std::is_enum<T>::value> CsvWriter::write(
+    const T & value)
+{
+  start_field();
+  char chars[16];
+  const auto res = std::to_chars(chars, chars + sizeof(chars), static_cast<int>(value));
+  buffer.append(chars, res.ptr);
+}
+
+inline void CsvWriter::write_raw(std::string_view text)
+{
+  start_field();
+  buffer += text;
+}
+
+inline void CsvWriter::write_all(const std::vector<std::string> & texts)
+{
+  for (const auto & text : texts)
+    write_raw(text);
+}
+
+inline void CsvWriter::write_block(std::string_view records)
+{
+  flush();
+  if (out != nullptr)
+    out->write(records.data(), static_cast<std::streamsize>(records.size()));
+  else
+    buffer += records;
+}
+
+inline void CsvWriter::end_record()
+{
+  buffer += '\n';
+  is_first_field = true;
+  if (out != nullptr && buffer.size() >= buffer_size)
+    flush();
+}
+
+inline void CsvWriter::flush()
+{
+  if (out == nullptr)
+    return;
+
+  out->write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  buffer.clear();
+}
+
+inline const std::string & CsvWriter::get_buffer() const { return buffer; }
+
+// Custom types for GTFS fields --------------------------------------------------------------------
+#if defined(JUST_GTFS_INTERNED_IDS)
+// Thread-safe pool of unique strings referred to by 32-bit handles. The pool is shared by all the
+// feeds and lives during the whole program run, so the handles of equal strings stay equal across
+// feeds. Only distinct strings are stored: re-reading the same feed by refresh() or by the next
+// streaming pass reuses the pooled ids, so the pool grows only with the ids not seen before and is
+// bounded by the 2^26 strings in each shard. The pool is split into shards with separate locks to
+// let parallel parsers intern ids at the same time.
+class StringPool
+{
+public:
+  inline static StringPool & instance();
+
+  // Returns the handle of the pooled copy of the string, the same for equal strings. The handle of
+  // the empty string is 0. Throws std::length_error if the shard of the string is full.
+  inline uint32_t intern(std::string_view str);
+  // Returns the pooled string by its handle. Doesn't lock the pool.
+  inline const std::string & get(uint32_t handle) const;
+  inline size_t size() const;
+
+private:
+  inline StringPool();
+
+  // The handle keeps the shard in the low bits and the index of the string in the shard in the
+  // high bits.
+  static constexpr uint32_t shard_bits = 6;
+  static constexpr uint32_t shards_count = uint32_t(1) << shard_bits;
+  static constexpr uint32_t max_shard_size = uint32_t(1) << (32 - shard_bits);
+  // Strings of the shard are stored in chunks of doubling sizes, so they are never moved and are
+  // found by the handle without the lock.
+  static constexpr uint32_t first_chunk_bits = 8;
+  static constexpr uint32_t chunks_count = 32 - shard_bits - first_chunk_bits + 1;
+
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    uint32_t size = 0;
+    std::unique_ptr<std::string[]> chunks[chunks_count];
+    std::unordered_map<std::string_view, uint32_t> lookup;
+  };
+
+  inline static uint32_t floor_log2(uint32_t value);
+  inline static std::string & get_string(const Shard & shard, uint32_t index);
+
+  Shard shards[shards_count];
+};
+
+inline StringPool & StringPool::instance()
+{
+  static StringPool pool;
+  return pool;
+}
+
+inline StringPool::StringPool()
+{
+  // The empty string is the first string of the first shard, so its handle is 0.
+  Shard & shard = shards[0];
+  shard.chunks[0] = std::make_unique<std::string[]>(size_t(1) << first_chunk_bits);
+  shard.lookup.emplace(get_string(shard, 0), 0);
+  shard.size = 1;
+}
+
+inline uint32_t StringPool::floor_log2(uint32_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return 31 - static_cast<uint32_t>(__builtin_clz(value));
+#else
+  uint32_t res = 0;
+  while (value >>= 1)
+    ++res;
+  return res;
+#endif
+}
+
+inline std::string & StringPool::get_string(const Shard & shard, uint32_t index)
+{
+  const uint32_t position = index + (uint32_t(1) << first_chunk_bits);
+  const uint32_t chunk_bits = floor_log2(position);
+  return shard.chunks[chunk_bits - first_chunk_bits][position - (uint32_t(1) << chunk_bits)];
+}
+
+inline uint32_t StringPool::intern(std::string_view str)
+{
+  if (str.empty())
+    return 0;
+
+  const auto shard_index =
+      static_cast<uint32_t>(std::hash<std::string_view>()(str) % shards_count);
+  Shard & shard = shards[shard_index];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const auto it = shard.lookup.find(str);
+  if (it != shard.lookup.end())
+    return it->second;
+
+  if (shard.size == max_shard_size)
+    throw std::length_error("String pool shard is full");
+
+  const uint32_t index = shard.size;
+  const uint32_t position = index + (uint32_t(1) << first_chunk_bits);
+  const uint32_t chunk_bits = floor_log2(position);
+  auto & chunk = shard.chunks[chunk_bits - first_chunk_bits];
+  if (!chunk)
+    chunk = std::make_unique<std::string[]>(size_t(1) << chunk_bits);
+
+  std::string & pooled = get_string(shard, index);
+  pooled = str;
+  ++shard.size;
+  const uint32_t handle = (index << shard_bits) | shard_index;
+  shard.lookup.emplace(pooled, handle);
+  return handle;
+}
+
+inline const std::string & StringPool::get(uint32_t handle) const
+{
+  return get_string(shards[handle & (shards_count - 1)], handle >> shard_bits);
+}
+
+inline size_t StringPool::size() const
+{
+  size_t res = 0;
+  for (const auto & shard : shards)
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    res += shard.size;
+  }
+  return res;
+}
+
+// Handle of the string interned in the StringPool. Equal strings share the same handle so copying
+// and comparison for equality do not touch the characters.
+class InternedString
+{
+public:
+  InternedString() = default;
+  InternedString(std::string_view str) : handle(StringPool::instance().intern(str)) {}
+  InternedString(const std::string & str) : InternedString(std::string_view(str)) {}
+  InternedString(const char * str) : InternedString(std::string_view(str)) {}
+
+  const std::string & str() const { return StringPool::instance().get(handle); }
+  operator const std::string &() const { return str(); }
+
+  bool empty() const { return handle == 0; }
+  size_t size() const { return str().size(); }
+  const char * c_str() const { return str().c_str(); }
+
+  friend bool operator==(const InternedString & lhs, const InternedString & rhs)
+  {
+    return lhs.handle == rhs.handle;
+  }
+  friend bool operator!=(const InternedString & lhs, const InternedString & rhs)
+  {
+    return lhs.handle != rhs.handle;
+  }
+  friend bool operator==(const InternedString & lhs, const std::string & rhs)
+  {
+    return lhs.str() == rhs;
+  }
+  friend bool operator==(const std::string & lhs, const InternedString & rhs) { return rhs == lhs; }
+  friend bool operator!=(const InternedString & lhs, const std::string & rhs) { return !(lhs == rhs); }
+  friend bool operator!=(const std::string & lhs, const InternedString & rhs) { return !(rhs == lhs); }
+  friend bool operator==(const InternedString & lhs, const char * rhs) { return lhs.str() == rhs; }
+  friend bool operator==(const char * lhs, const InternedString & rhs) { return rhs == lhs; }
+  friend bool operator!=(const InternedString & lhs, const char * rhs) { return !(lhs == rhs); }
+  friend bool operator!=(const char * lhs, const InternedString & rhs) { return !(rhs == lhs); }
+  // Lexicographical order as for std::string.
+  friend bool operator<(const InternedString & lhs, const InternedString & rhs)
+  {
+    return lhs.handle != rhs.handle && lhs.str() < rhs.str();
+  }
+
+  friend std::ostream & operator<<(std::ostream & out, const InternedString & str)
+  {
+    return out << str.str();
+  }
+
+private:
+  friend struct std::hash<InternedString>;
+  uint32_t handle = 0;
+};
+}  // namespace gtfs
+
+template <>
+struct std::hash<gtfs::InternedString>
+{
+  size_t operator()(const gtfs::InternedString & str) const
+  {
+    return std::hash<uint32_t>()(str.handle);
+  }
+};
+
+namespace gtfs
+{
+
+// Id of GTFS entity, a sequence of any UTF-8 characters. Used as type for ID GTFS fields.
+using Id = InternedString;
+#else
+// Id of GTFS entity, a sequence of any UTF-8 characters. Used as type for ID GTFS fields.
+using Id = std::string;
+#endif
+// A string of UTF-8 characters. Used as type for Text GTFS fields.
+using Text = std::string;
+
+#if defined(JUST_GTFS_COMPACT_STOP_TIMES)
+// Text repeated in many records, stored once in the shared string pool.
+using PooledText = InternedString;
+#else
+using PooledText = Text;
+#endif
+
+// Time in GTFS is in the HH:MM:SS format (H:MM:SS is also accepted)
+// Time within a service day can be above 24:00:00, e.g. 28:41:30
+class Time
+{
+public:
+#if defined(JUST_GTFS_COMPACT_STOP_TIMES)
+  // Max hours count of the compact time.
+  static constexpr uint16_t max_hours = 1023;
+
+  inline Time() : hh(0), mm(0), ss(0), hours_width(0), time_is_provided(false) {}
+#else
+  inline Time() = default;
+#endif
+  inline explicit Time(std::string_view raw_time_str);
+  inline Time(uint16_t hours, uint16_t minutes, uint16_t seconds);
+  inline Time(size_t seconds);
+  // Replaces the time with the parsed one. Returns the error instead of throwing it.
+  inline Result parse(std::string_view raw_time_str);
+  inline bool is_provided() const;
+  inline size_t get_total_seconds() const;
+  inline std::tuple<uint16_t, uint16_t, uint16_t> get_hh_mm_ss() const;
+  inline std::string get_raw_time() const;
+  inline bool limit_hours_to_24max();
+
+private:
+  // Returns false with the error message if the time is invalid.
+  inline bool assign(std::string_view raw_time_str, std::string & error);
+  inline void set_total_seconds();
+  inline void set_raw_time();
+#if defined(JUST_GTFS_COMPACT_STOP_TIMES)
+  // Time fits into 32 bits. Instead of the raw time string the count of hours digits is kept,
+  // so get_raw_time() restores it on demand.
+  inline void set_hh_mm_ss(uint16_t hours, uint16_t minutes, uint16_t seconds);
+  uint32_t hh : 10;
+  uint32_t mm : 6;
+  uint32_t ss : 6;
+  uint32_t hours_width : 2;
+  uint32_t time_is_provided : 1;
+#else
+  bool time_is_provided = false;
+  std::string raw_time;
+  size_t total_seconds = 0;
+  uint16_t hh = 0;
+  uint16_t mm = 0;
+  uint16_t ss = 0;
+#endif
+};
+
+inline bool operator==(const Time & lhs, const Time & rhs)
+{
+  return lhs.get_hh_mm_ss() == rhs.get_hh_mm_ss() && lhs.is_provided() == rhs.is_provided();
+}
+
+inline std::string append_leading_zero(const std::string & s, bool check = true)
+{
+  if (check && s.size() > 2)
+    throw InvalidFieldFormat("The string for appending zero is too long: " + s);
+
+  if (s.size() == 2)
+    return s;
+  return "0" + s;
+}
+
+// Returns up to 8 first characters packed into the word in the little-endian order. Compilers
+// turn the loop into the single load.
+inline uint64_t pack_chars(std::string_view s)
+{
+  uint64_t word = 0;
+  for (size_t i = 0; i < std::min<size_t>(s.size(), 8); ++i)
+    word |= uint64_t(static_cast<unsigned char>(s[i])) << (8 * i);
+  return word;
+}
+
+// Checks all bytes of the word to be '0'-'9': their high half is 3 and adding 6 doesn't change it.
+inline bool contains_only_digits(uint64_t word)
+{
+  constexpr uint64_t high_halves = 0xF0F0F0F0F0F0F0F0;
+  constexpr uint64_t threes = 0x3030303030303030;
+  constexpr uint64_t sixes = 0x0606060606060606;
+  return (word & high_halves) == threes && ((word + sixes) & high_halves) == threes;
+}
+
+// Returns the value of the two digits in the i-th and the next bytes of the word.
+inline uint16_t get_two_digits(uint64_t word, size_t i)
+{
+  return static_cast<uint16_t>(((word >> (8 * i)) & 0xF) * 10 + ((word >> (8 * i + 8)) & 0xF));
+}
+
+// Parses time in the HH:MM:SS, H:MM:SS or HHH:MM:SS format without allocations. Returns false if
+// the format is wrong.
+inline bool parse_time(std::string_view s, uint16_t & hours, uint16_t & minutes,
+                       uint16_t & seconds)
+{
+  const size_t len = s.size();
+  if (len < 7 || len > 9 || s[len - 3] != ':' || s[len - 6] != ':')
+    return false;
+
+  // Hours are padded to 2 digits for H:MM:SS, the third digit of HHH:MM:SS is parsed separately.
+  uint16_t hundreds = 0;
+  if (len == 9)
+  {
+    if (s[0] < '0' || s[0] > '9')
+      return false;
+    hundreds = static_cast<uint16_t>(s[0] - '0');
+    s.remove_prefix(1);
+  }
+  uint64_t word = len == 7 ? (pack_chars(s) << 8) | '0' : pack_chars(s);
+
+  // Separators are replaced with zeros to check all bytes at once.
+  constexpr uint64_t separators = 0x0000FF0000FF0000;
+  constexpr uint64_t zeros = 0x0000300000300000;
+  word = (word & ~separators) | zeros;
+  if (!contains_only_digits(word))
+    return false;
+
+  hours = static_cast<uint16_t>(hundreds * 100 + get_two_digits(word, 0));
+  minutes = get_two_digits(word, 3);
+  seconds = get_two_digits(word, 6);
+  return true;
+}
+
+// Parses date in the YYYYMMDD format without allocations. Returns false if the format is wrong.
+inline bool parse_date(std::string_view s, uint16_t & year, uint16_t & month, uint16_t & day)
+{
+  if (s.size() != 8)
+    return false;
+
+  const uint64_t word = pack_chars(s);
+  if (!contains_only_digits(word))
+    return false;
+
+  year = static_cast<uint16_t>(get_two_digits(word, 0) * 100 + get_two_digits(word, 2));
+  month = get_two_digits(word, 4);
+  day = get_two_digits(word, 6);
+  return true;
+}
+
+// Returns time in the HH:MM:SS format with hours padded by zeros to hours_width digits.
+inline std::string format_time(uint32_t hours, uint32_t minutes, uint32_t seconds,
+                               size_t hours_width)
+{
+  char hours_digits[10];
+  const char * hours_end =
+      std::to_chars(hours_digits, hours_digits + sizeof(hours_digits), hours).ptr;
+  const auto hours_len = static_cast<size_t>(hours_end - hours_digits);
+
+  std::string res(std::max(hours_len, hours_width) - hours_len, '0');
+  res.append(hours_digits, hours_len);
+  const char tail[] = {':',
+                       static_cast<char>('0' + minutes / 10),
+                       static_cast<char>('0' + minutes % 10),
+                       ':',
+                       static_cast<char>('0' + seconds / 10),
+                       static_cast<char>('0' + seconds % 10)};
+  res.append(tail, sizeof(tail));
+  return res;
+}
+
+#if defined(JUST_GTFS_COMPACT_STOP_TIMES)
+inline void Time::set_hh_mm_ss(uint16_t hours, uint16_t minutes, uint16_t seconds)
+{
+  if (hours > max_hours)
+    throw InvalidFieldFormat("Time hours are out of range: " + std::to_string(hours));
+
+  hh = hours;
+  mm = minutes;
+  ss = seconds;
+}
+
+inline bool Time::limit_hours_to_24max()
+{
+  if (hh < 24)
+    return false;
+
+  hh = hh % 24;
+  set_raw_time();
+  return true;
+}
+
+inline void Time::set_total_seconds() {}
+
+inline void Time::set_raw_time() { hours_width = 2; }
+
+inline bool Time::assign(std::string_view raw_time_str, std::string & error)
+{
+  *this = Time();
+  if (raw_time_str.empty())
+    return true;
+
+  uint16_t hours = 0;
+  uint16_t minutes = 0;
+  uint16_t seconds = 0;
+  if (!parse_time(raw_time_str, hours, minutes, seconds))
+  {
+    error = "Time is not in [[H]H]H:MM:SS format: " + std::string(raw_time_str);
+    return false;
+  }
+
+  if (minutes > 60 || seconds > 60)
+  {
+    error = "Time minutes/seconds wrong value: " + std::to_string(minutes) + " minutes, " +
+            std::to_string(seconds) + " seconds";
+    return false;
+  }
+
+  if (hours > max_hours)
+  {
+    error = "Time hours are out of range: " + std::to_string(hours);
+    return false;
+  }
+
+  set_hh_mm_ss(hours, minutes, seconds);
+  hours_width = static_cast<uint32_t>(raw_time_str.size() - 6);
+  time_is_provided = true;
+  return true;
+}
+
+inline Time::Time(uint16_t hours, uint16_t minutes, uint16_t seconds) : Time()
+{
+  if (minutes > 60 || seconds > 60)
+    throw InvalidFieldFormat("Time is out of range: " + std::to_string(minutes) + "minutes " +
+                             std::to_string(seconds) + "seconds");
+
+  set_hh_mm_ss(hours, minutes, seconds);
+  set_raw_time();
+  time_is_provided = true;
+}
+
+inline Time::Time(size_t seconds) : Time()
+{
+  if (seconds / 3600 > max_hours)
+    throw InvalidFieldFormat("Time hours are out of range: " + std::to_string(seconds / 3600));
+
+  set_hh_mm_ss(static_cast<uint16_t>(seconds / 3600), static_cast<uint16_t>((seconds % 3600) / 60),
+               static_cast<uint16_t>(seconds % 60));
+  set_raw_time();
+  time_is_provided = true;
+}
+
+inline bool Time::is_provided() const { return time_is_provided; }
+
+inline size_t Time::get_total_seconds() const
+{
+  return static_cast<size_t>(hh) * 60 * 60 + mm * 60 + ss;
+}
+
+inline std::tuple<uint16_t, uint16_t, uint16_t> Time::get_hh_mm_ss() const
+{
+  return {static_cast<uint16_t>(hh), static_cast<uint16_t>(mm), static_cast<uint16_t>(ss)};
+}
+
+inline std::string Time::get_raw_time() const
+{
+  if (!time_is_provided)
+    return {};
+
+  return format_time(hh, mm, ss, hours_width);
+}
+#else
+inline bool Time::limit_hours_to_24max()
+{
+  if (hh < 24)
+    return false;
+
+  hh = hh % 24;
+  set_total_seconds();
+  set_raw_time();
+  return true;
+}
+
+inline void Time::set_total_seconds() { total_seconds = hh * 60 * 60 + mm * 60 + ss; }
+
+inline void Time::set_raw_time() { raw_time = format_time(hh, mm, ss, 2); }
+
+inline bool Time::assign(std::string_view raw_time_str, std::string & error)
+{
+  *this = Time();
+  if (raw_time_str.empty())
+    return true;
+
+  if (!parse_time(raw_time_str, hh, mm, ss))
+  {
+    error = "Time is not in [[H]H]H:MM:SS format: " + std::string(raw_time_str);
+    return false;
+  }
+
+  if (mm > 60 || ss > 60)
+  {
+    error = "Time minutes/seconds wrong value: " + std::to_string(mm) + " minutes, " +
+            std::to_string(ss) + " seconds";
+    return false;
+  }
+
+  raw_time = raw_time_str;
+  set_total_seconds();
+  time_is_provided = true;
+  return true;
+}
+
+inline Time::Time(uint16_t hours, uint16_t minutes, uint16_t seconds)
+    : hh(hours), mm(minutes), ss(seconds)
+{
+  if (mm > 60 || ss > 60)
+    throw InvalidFieldFormat("Time is out of range: " + std::to_string(mm) + "minutes " +
+                             std::to_string(ss) + "seconds");
+
+  set_total_seconds();
+  set_raw_time();
+  time_is_provided = true;
+}
+
+inline Time::Time(size_t seconds)
+  : time_is_provided(true), total_seconds(seconds),
+    hh(seconds / 3600), mm((seconds % 3600) / 60), ss(seconds % 60)
+{
+  set_raw_time();
+}
+
+inline bool Time::is_provided() const { return time_is_provided; }
+
+inline size_t Time::get_total_seconds() const { return total_seconds; }
+
+inline std::tuple<uint16_t, uint16_t, uint16_t> Time::get_hh_mm_ss() const { return {hh, mm, ss}; }
+
+inline std::string Time::get_raw_time() const { return raw_time; }
+#endif
+
+// Time in the HH:MM:SS format (H:MM:SS is also accepted). Used as type for Time GTFS fields.
+inline Time::Time(std::string_view raw_time_str) : Time()
+{
+  std::string error;
+  if (!assign(raw_time_str, error))
+    throw InvalidFieldFormat(error);
+}
+
+inline Result Time::parse(std::string_view raw_time_str)
+{
+  std::string error;
+  if (!assign(raw_time_str, error))
+    return invalid_field_format(error);
+  return ResultCode::OK;
+}
+
+// Service day in the YYYYMMDD format.
+class Date
+{
+public:
+  inline Date() = default;
+  inline Date(uint16_t year, uint16_t month, uint16_t day);
+  inline explicit Date(std::string_view raw_date_str);
+  // Replaces the date with the parsed one. Returns the error instead of throwing it.
+  inline Result parse(std::string_view raw_date_str);
+  inline bool is_provided() const;
+  inline std::tuple<uint16_t, uint16_t, uint16_t> get_yyyy_mm_dd() const;
+  inline std::string get_raw_date() const;
+
+private:
+  // Returns false with the error message if the date is invalid.
+  inline bool is_valid(std::string & error) const;
+  inline void check_valid() const;
+  inline bool assign(std::string_view raw_date_str, std::string & error);
+
+  std::string raw_date;
+  uint16_t yyyy = 0;
+  uint16_t mm = 0;
+  uint16_t dd = 0;
+  bool date_is_provided = false;
+};
+
+inline bool operator==(const Date & lhs, const Date & rhs)
+{
+  return lhs.get_yyyy_mm_dd() == rhs.get_yyyy_mm_dd() && lhs.is_provided() == rhs.is_provided();
+}
+
+inline bool Date::is_valid(std::string & error) const
+{
+  if (yyyy < 1000 || yyyy > 9999 || mm < 1 || mm > 12 || dd < 1 || dd > 31)
+  {
+    error = "Date check failed: out of range. " + std::to_string(yyyy) + " year, " +
+            std::to_string(mm) + " month, " + std::to_string(dd) + " day";
+    return false;
+  }
+
+  if (mm == 2 && dd > 28)
+  {
+    // The year is not leap. Days count should be 28.
+    if (yyyy % 4 != 0 || (yyyy % 100 == 0 && yyyy % 400 != 0))
+    {
+      error = "Invalid days count in February of non-leap year: " + std::to_string(dd) +
+              " year" + std::to_string(yyyy);
+      return false;
+    }
+
+    // The year is leap. Days count should be 29.
+    if (dd > 29)
+    {
+      error = "Invalid days count in February of leap year: " + std::to_string(dd) + " year" +
+              std::to_string(yyyy);
+      return false;
+    }
+  }
+
+  if (dd > 30 && (mm == 4 || mm == 6 || mm == 9 || mm == 11))
+  {
+    error = "Invalid days count in month: " + std::to_string(dd) + " days in " +
+            std::to_string(mm);
+    return false;
+  }
+
+  return true;
+}
+
+inline void Date::check_valid() const
+{
+  std::string error;
+  if (!is_valid(error))
+    throw InvalidFieldFormat(error);
+}
+
+inline Date::Date(uint16_t year, uint16_t month, uint16_t day) : yyyy(year), mm(month), dd(day)
+{
+  check_valid();
+  // Year has 4 digits after the check.
+  const char digits[] = {static_cast<char>('0' + yyyy / 1000),
+                         static_cast<char>('0' + yyyy / 100 % 10),
+                         static_cast<char>('0' + yyyy / 10 % 10),
+                         static_cast<char>('0' + yyyy % 10),
+                         static_cast<char>('0' + mm / 10),
+                         static_cast<char>('0' + mm % 10),
+                         static_cast<char>('0' + dd / 10),
+                         static_cast<char>('0' + dd % 10)};
+  raw_date.assign(digits, sizeof(digits));
+  date_is_provided = true;
+}
+
+inline bool Date::assign(std::string_view raw_date_str, std::string & error)
+{
+  *this = Date();
+  if (raw_date_str.empty())
+    return true;
+
+  if (!parse_date(raw_date_str, yyyy, mm, dd))
+  {
+    error = "Date is not in YYYY:MM::DD format: " + std::string(raw_date_str);
+    return false;
+  }
+
+  if (!is_valid(error))
+    return false;
+
+  raw_date = raw_date_str;
+  date_is_provided = true;
+  return true;
+}
+
+inline Date::Date(std::string_view raw_date_str)
+{
+  std::string error;
+  if (!assign(raw_date_str, error))
+    throw InvalidFieldFormat(error);
+}
+
+inline Result Date::parse(std::string_view raw_date_str)
+{
+  std::string error;
+  if (!assign(raw_date_str, error))
+    return invalid_field_format(error);
+  return ResultCode::OK;
+}
+
+inline bool Date::is_provided() const { return date_is_provided; }
+
+inline std::tuple<uint16_t, uint16_t, uint16_t> Date::get_yyyy_mm_dd() const
+{
+  return {yyyy, mm, dd};
+}
+
+inline std::string Date::get_raw_date() const { return raw_date; }
+
+// Returns count of days since 1970-01-01 in the proleptic Gregorian calendar.
+inline int32_t get_days_since_epoch(const Date & date)
+{
+  const auto [yyyy, mm, dd] = date.get_yyyy_mm_dd();
+  const int32_t year = mm <= 2 ? yyyy - 1 : yyyy;
+  const int32_t era = year / 400;
+  const int32_t year_of_era = year - era * 400;
+  const int32_t day_of_year = (153 * (mm > 2 ? mm - 3 : mm + 9) + 2) / 5 + dd - 1;
+  const int32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+// An ISO 4217 alphabetical currency code. Used as type for Currency Code GTFS fields.
+using CurrencyCode = std::string;
+// An IETF BCP 47 language code. Used as type for Language Code GTFS fields.
+using LanguageCode = std::string;
+
+// Helper enums for some GTFS fields ---------------------------------------------------------------
+enum class StopLocationType : int8_t
+{
+  StopOrPlatform = 0,
+  Station = 1,
+  EntranceExit = 2,
+  GenericNode = 3,
+  BoardingArea = 4
+};
+
+// The type of transportation used on a route.
+enum class RouteType : int16_t
+{
+  // GTFS route types
+  Tram = 0,         // Tram, Streetcar, Light rail
+  Subway = 1,       // Any underground rail system within a metropolitan area
+  Rail = 2,         // Intercity or long-distance travel
+  Bus = 3,          // Short- and long-distance bus routes
+  Ferry = 4,        // Boat service
+  CableTram = 5,    // Street-level rail cars where the cable runs beneath the vehicle
+  AerialLift = 6,   // Aerial lift, suspended cable car (gondola lift, aerial tramway)
+  Funicular = 7,    // Any rail system designed for steep inclines
+  Trolleybus = 11,  // Electric buses that draw power from overhead wires using poles
+  Monorail = 12,    // Railway in which the track consists of a single rail or a beam
+
+  // Extended route types
+  // https://developers.google.com/transit/gtfs/reference/extended-route-types
+  RailwayService = 100,
+  HighSpeedRailService = 101,
+  LongDistanceTrains = 102,
+  InterRegionalRailService = 103,
+  CarTransportRailService = 104,
+  SleeperRailService = 105,
+  RegionalRailService = 106,
+  TouristRailwayService = 107,
+  RailShuttleWithinComplex = 108,
+  SuburbanRailway = 109,
+  ReplacementRailService = 110,
+  SpecialRailService = 111,
+  LorryTransportRailService = 112,
+  AllRailServices = 113,
+  CrossCountryRailService = 114,
+  VehicleTransportRailService = 115,
+  RackAndPinionRailway = 116,
+  AdditionalRailService = 117,
+
+  CoachService = 200,
+  InternationalCoachService = 201,
+  NationalCoachService = 202,
+  ShuttleCoachService = 203,
+  RegionalCoachService = 204,
+  SpecialCoachService = 205,
+  SightseeingCoachService = 206,
+  TouristCoachService = 207,
+  CommuterCoachService = 208,
+  AllCoachServices = 209,
+
+  UrbanRailwayService400 = 400,
+  MetroService = 401,
+  UndergroundService = 402,
+  UrbanRailwayService403 = 403,
+  AllUrbanRailwayServices = 404,
+  Monorail405 = 405,
+
+  BusService = 700,
+  RegionalBusService = 701,
+  ExpressBusService = 702,
+  StoppingBusService = 703,
+  LocalBusService = 704,
+  NightBusService = 705,
+  PostBusService = 706,
+  SpecialNeedsBus = 707,
+  MobilityBusService = 708,
+  MobilityBusForRegisteredDisabled = 709,
+  SightseeingBus = 710,
+  ShuttleBus = 711,
+  SchoolBus = 712,
+  SchoolAndPublicServiceBus = 713,
+  RailReplacementBusService = 714,
+  DemandAndResponseBusService = 715,
+  AllBusServices = 716,
+
+  TrolleybusService = 800,
+
+  TramService = 900,
+  CityTramService = 901,
+  LocalTramService = 902,
+  RegionalTramService = 903,
+  SightseeingTramService = 904,
+  ShuttleTramService = 905,
+  AllTramServices = 906,
+
+  WaterTransportService = 1000,
+  AirService = 1100,
+  FerryService = 1200,
+  AerialLiftService = 1300,
+  FunicularService = 1400,
+  TaxiService = 1500,
+  CommunalTaxiService = 1501,
+  WaterTaxiService = 1502,
+  RailTaxiService = 1503,
+  BikeTaxiService = 1504,
+  LicensedTaxiService = 1505,
+  PrivateHireServiceVehicle = 1506,
+  AllTaxiServices = 1507,
+  MiscellaneousService = 1700,
+  HorseDrawnCarriage = 1702
+};
+
+enum class TripDirectionId : bool
+{
+  DefaultDirection = 0,  // e.g. outbound
+  OppositeDirection = 1  // e.g. inbound
+};
+
+enum class TripAccess : int8_t
+{
+  NoInfo = 0,
+  Yes = 1,
+  No = 2
+};
+
+enum class StopTimeBoarding : int8_t
+{
+  RegularlyScheduled = 0,
+  No = 1,                   // Not available
+  Phone = 2,                // Must phone agency to arrange
+  CoordinateWithDriver = 3  // Must coordinate with driver to arrange
+};
+
+enum class StopTimePoint : bool
+{
+  Approximate = 0,
+  Exact = 1
+};
+
+enum class CalendarAvailability : bool
+{
+  NotAvailable = 0,
+  Available = 1
+};
+
+enum class CalendarDateException : int8_t
+{
+  Added = 1,  // Service has been added for the specified date
+  Removed = 2
+};
+
+enum class FarePayment : bool
+{
+  OnBoard = 0,
+  BeforeBoarding = 1  // Fare must be paid before boarding
+};
+
+enum class FareTransfers : int8_t
+{
+  No = 0,  // No transfers permitted on this fare
+  Once = 1,
+  Twice = 2,
+  Unlimited = 3
+};
+
+enum class FrequencyTripService : bool
+{
+  FrequencyBased = 0,  // Frequency-based trips
+  ScheduleBased = 1    // Schedule-based trips with the exact same headway throughout the day
+};
+
+enum class TransferType : int8_t
+{
+  Recommended = 0,
+  Timed = 1,
+  MinimumTime = 2,
+  NotPossible = 3
+};
+
+enum class PathwayMode : int8_t
+{
+  Walkway = 1,
+  Stairs = 2,
+  MovingSidewalk = 3,  // Moving sidewalk/travelator
+  Escalator = 4,
+  Elevator = 5,
+  FareGate = 6,  // Payment gate
+  ExitGate = 7
+};
+
+enum class PathwayDirection : bool
+{
+  Unidirectional = 0,
+  Bidirectional = 1
+};
+
+enum class AttributionRole : bool
+{
+  No = 0,  // Organization doesn’t have this role
+  Yes = 1  // Organization does have this role
+};
+
+// Structures representing GTFS entities -----------------------------------------------------------
+// Required dataset file
+struct Agency
+{
+  // Conditionally optional:
+  Id agency_id;
+
+  // Required:
+  Text agency_name;
+  Text agency_url;
+  Text agency_timezone;
+
+  // Optional:
+  Text agency_lang;
+  Text agency_phone;
+  Text agency_fare_url;
+  Text agency_email;
+};
+
+inline bool operator==(const Agency & lhs, const Agency & rhs)
+{
+  return std::tie(lhs.agency_id, lhs.agency_name, lhs.agency_url, lhs.agency_timezone,
+                  lhs.agency_lang, lhs.agency_phone, lhs.agency_fare_url, lhs.agency_email) ==
+         std::tie(rhs.agency_id, rhs.agency_name, rhs.agency_url, rhs.agency_timezone,
+                  rhs.agency_lang, rhs.agency_phone, rhs.agency_fare_url, rhs.agency_email);
+}
+
+// Required dataset file
+struct Stop
+{
+  // Required:
+  Id stop_id;
+
+  // Conditionally required:
+  Text stop_name;
+
+  bool coordinates_present = true;
+  double stop_lat = 0.0;
+  double stop_lon = 0.0;
+  Id zone_id;
+  Id parent_station;
+
+  // Optional:
+  Text stop_code;
+  Text stop_desc;
+  Text stop_url;
+  StopLocationType location_type = StopLocationType::StopOrPlatform;
+  Text stop_timezone;
+  Text wheelchair_boarding;
+  Id level_id;
+  Text platform_code;
+};
+
+// Required dataset file
+struct Route
+{
+  // Required:
+  Id route_id;
+  RouteType route_type = RouteType::Tram;
+
+  // Conditionally required:
+  Id agency_id;
+  Text route_short_name;
+  Text route_long_name;
 
   // Optional
   Text route_desc;
@@ -923,575 +3577,5032 @@ struct Route
   size_t route_sort_order = 0;  // Routes with smaller value values should be displayed first
 };
 
-// Required dataset file
-struct Trip
+// Required dataset file
+struct Trip
+{
+  // Required:
+  Id route_id;
+  Id service_id;
+  Id trip_id;
+
+  // Optional:
+  Text trip_headsign;
+  Text trip_short_name;
+  TripDirectionId direction_id = TripDirectionId::DefaultDirection;
+  Id block_id;
+  Id shape_id;
+  TripAccess wheelchair_accessible = TripAccess::NoInfo;
+  TripAccess bikes_allowed = TripAccess::NoInfo;
+};
+
+// Required dataset file
+struct StopTime
+{
+  // Required:
+  Id trip_id;
+  Id stop_id;
+  size_t stop_sequence = 0;
+
+  // Conditionally required:
+  Time arrival_time;
+
+  Time departure_time;
+
+  // Optional:
+  PooledText stop_headsign;
+  StopTimeBoarding pickup_type = StopTimeBoarding::RegularlyScheduled;
+  StopTimeBoarding drop_off_type = StopTimeBoarding::RegularlyScheduled;
+
+  double shape_dist_traveled = 0.0;
+  StopTimePoint timepoint = StopTimePoint::Exact;
+};
+
+#if defined(JUST_GTFS_COMPACT_STOP_TIMES)
+static_assert(sizeof(StopTime) <= 64, "Compact StopTime must fit into a cache line");
+#endif
+
+// Conditionally required dataset file:
+struct CalendarItem
+{
+  // Required:
+  Id service_id;
+
+  CalendarAvailability monday = CalendarAvailability::NotAvailable;
+  CalendarAvailability tuesday = CalendarAvailability::NotAvailable;
+  CalendarAvailability wednesday = CalendarAvailability::NotAvailable;
+  CalendarAvailability thursday = CalendarAvailability::NotAvailable;
+  CalendarAvailability friday = CalendarAvailability::NotAvailable;
+  CalendarAvailability saturday = CalendarAvailability::NotAvailable;
+  CalendarAvailability sunday = CalendarAvailability::NotAvailable;
+
+  Date start_date;
+  Date end_date;
+};
+
+// Conditionally required dataset file
+struct CalendarDate
+{
+  // Required:
+  Id service_id;
+  Date date;
+  CalendarDateException exception_type = CalendarDateException::Added;
+};
+
+// Optional dataset file
+struct FareAttributesItem
+{
+  // Required:
+  Id fare_id;
+  double price = 0.0;
+  CurrencyCode currency_type;
+  FarePayment payment_method = FarePayment::BeforeBoarding;
+  FareTransfers transfers = FareTransfers::Unlimited;
+
+  // Conditionally required:
+  Id agency_id;
+
+  // Optional:
+  size_t transfer_duration = 0;  // Length of time in seconds before a transfer expires
+};
+
+inline bool operator==(const FareAttributesItem & lhs, const FareAttributesItem & rhs)
+{
+  return std::tie(lhs.fare_id, lhs.price, lhs.currency_type, lhs.payment_method, lhs.transfers,
+                  lhs.agency_id, lhs.transfer_duration) ==
+         std::tie(rhs.fare_id, rhs.price, rhs.currency_type, rhs.payment_method, rhs.transfers,
+                  rhs.agency_id, rhs.transfer_duration);
+}
+
+// Optional dataset file
+struct FareRule
+{
+  // Required:
+  Id fare_id;
+
+  // Optional:
+  Id route_id;
+  Id origin_id;
+  Id destination_id;
+  Id contains_id;
+};
+
+// Optional dataset file
+struct ShapePoint
+{
+  // Required:
+  Id shape_id;
+  double shape_pt_lat = 0.0;
+  double shape_pt_lon = 0.0;
+  size_t shape_pt_sequence = 0;
+
+  // Optional:
+  double shape_dist_traveled = 0;
+};
+
+// Optional dataset file
+struct Frequency
+{
+  // Required:
+  Id trip_id;
+  Time start_time;
+  Time end_time;
+  size_t headway_secs = 0;
+
+  // Optional:
+  FrequencyTripService exact_times = FrequencyTripService::FrequencyBased;
+};
+
+// Optional dataset file
+struct Transfer
+{
+  // Required:
+  Id from_stop_id;
+  Id to_stop_id;
+  TransferType transfer_type = TransferType::Recommended;
+
+  // Optional:
+  size_t min_transfer_time = 0;
+};
+
+// Optional dataset file for the GTFS-Pathways extension
+struct Pathway
+{
+  // Required:
+  Id pathway_id;
+  Id from_stop_id;
+  Id to_stop_id;
+  PathwayMode pathway_mode = PathwayMode::Walkway;
+  PathwayDirection is_bidirectional = PathwayDirection::Unidirectional;
+
+  // Optional fields:
+  // Horizontal length in meters of the pathway from the origin location
+  double length = 0.0;
+  // Average time in seconds needed to walk through the pathway from the origin location
+  size_t traversal_time = 0;
+  // Number of stairs of the pathway
+  size_t stair_count = 0;
+  // Maximum slope ratio of the pathway
+  double max_slope = 0.0;
+  // Minimum width of the pathway in meters
+  double min_width = 0.0;
+  // Text from physical signage visible to transit riders
+  Text signposted_as;
+  // Same as signposted_as, but when the pathways is used backward
+  Text reversed_signposted_as;
+};
+
+// Optional dataset file
+struct Level
+{
+  // Required:
+  Id level_id;
+
+  // Numeric index of the level that indicates relative position of this level in relation to other
+  // levels (levels with higher indices are assumed to be located above levels with lower indices).
+  // Ground level should have index 0, with levels above ground indicated by positive indices and
+  // levels below ground by negative indices
+  double level_index = 0.0;
+
+  // Optional:
+  Text level_name;
+};
+
+// Optional dataset file
+struct FeedInfo
+{
+  // Required:
+  Text feed_publisher_name;
+  Text feed_publisher_url;
+  LanguageCode feed_lang;
+
+  // Optional:
+  Date feed_start_date;
+  Date feed_end_date;
+  Text feed_version;
+  Text feed_contact_email;
+  Text feed_contact_url;
+};
+
+// Optional dataset file
+struct Translation
+{
+  // Required:
+  Text table_name;
+  Text field_name;
+  LanguageCode language;
+  Text translation;
+
+  // Conditionally required:
+  Id record_id;
+  Id record_sub_id;
+  Text field_value;
+};
+
+// Optional dataset file
+struct Attribution
+{
+  // Required:
+  Text organization_name;
+
+  // Optional:
+  Id attribution_id;  // Useful for translations
+  Id agency_id;
+  Id route_id;
+  Id trip_id;
+
+  AttributionRole is_producer = AttributionRole::No;
+  AttributionRole is_operator = AttributionRole::No;
+  AttributionRole is_authority = AttributionRole::No;
+
+  Text attribution_url;
+  Text attribution_email;
+  Text attribution_phone;
+};
+
+#if defined(JUST_GTFS_PMR)
+// Containers of entities and their indexes allocated from the memory resource of the feed.
+template <typename T>
+using EntityVector = std::pmr::vector<T>;
+template <typename Key, typename Value>
+using EntityMap = std::pmr::unordered_map<Key, Value>;
+#else
+template <typename T>
+using EntityVector = std::vector<T>;
+template <typename Key, typename Value>
+using EntityMap = std::unordered_map<Key, Value>;
+#endif
+
+// Main classes for working with GTFS feeds
+using Agencies = EntityVector<Agency>;
+using Stops = EntityVector<Stop>;
+using Routes = EntityVector<Route>;
+using Trips = EntityVector<Trip>;
+using StopTimes = EntityVector<StopTime>;
+using Calendar = EntityVector<CalendarItem>;
+using CalendarDates = EntityVector<CalendarDate>;
+
+using FareRules = EntityVector<FareRule>;
+using FareAttributes = EntityVector<FareAttributesItem>;
+using Shapes = EntityVector<ShapePoint>;
+using Shape = EntityVector<ShapePoint>;
+using Frequencies = EntityVector<Frequency>;
+using Transfers = EntityVector<Transfer>;
+using Pathways = EntityVector<Pathway>;
+using Levels = EntityVector<Level>;
+// FeedInfo is a unique object and doesn't need a container.
+using Translations = EntityVector<Translation>;
+using Attributions = EntityVector<Attribution>;
+
+// Iterator over the rows of the container returned by value, e.g. the proxies of the columnar
+// rows.
+template <typename Container>
+class ColumnarIterator
+{
+public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = typename Container::Row;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = typename Container::Row;
+
+  ColumnarIterator() = default;
+  ColumnarIterator(const Container * container, size_t position)
+      : container(container), position(position)
+  {
+  }
+
+  reference operator*() const { return (*container)[position]; }
+  reference operator[](difference_type n) const { return (*container)[position + n]; }
+
+  ColumnarIterator & operator++()
+  {
+    ++position;
+    return *this;
+  }
+  ColumnarIterator operator++(int) { return ColumnarIterator(container, position++); }
+  ColumnarIterator & operator--()
+  {
+    --position;
+    return *this;
+  }
+  ColumnarIterator operator--(int) { return ColumnarIterator(container, position--); }
+  ColumnarIterator & operator+=(difference_type n)
+  {
+    position += n;
+    return *this;
+  }
+  ColumnarIterator & operator-=(difference_type n)
+  {
+    position -= n;
+    return *this;
+  }
+  ColumnarIterator operator+(difference_type n) const
+  {
+    return ColumnarIterator(container, position + n);
+  }
+  ColumnarIterator operator-(difference_type n) const
+  {
+    return ColumnarIterator(container, position - n);
+  }
+  difference_type operator-(const ColumnarIterator & other) const
+  {
+    return static_cast<difference_type>(position) - static_cast<difference_type>(other.position);
+  }
+
+  bool operator==(const ColumnarIterator & other) const { return position == other.position; }
+  bool operator!=(const ColumnarIterator & other) const { return position != other.position; }
+  bool operator<(const ColumnarIterator & other) const { return position < other.position; }
+
+private:
+  const Container * container = nullptr;
+  size_t position = 0;
+};
+
+template <typename T>
+void append_column(EntityVector<T> & to, EntityVector<T> && from)
+{
+  if (to.empty())
+    to = std::move(from);
+  else
+    std::move(from.begin(), from.end(), std::back_inserter(to));
+}
+
+// Stop times stored by columns: each StopTime field is kept in a separate contiguous array so
+// that scans over a single field do not load the others.
+class ColumnarStopTimes
+{
+public:
+  // Proxy of the row with references to its fields in the columns.
+  struct Row
+  {
+    const Id & trip_id;
+    const Id & stop_id;
+    const size_t & stop_sequence;
+    const Time & arrival_time;
+    const Time & departure_time;
+    const PooledText & stop_headsign;
+    const StopTimeBoarding & pickup_type;
+    const StopTimeBoarding & drop_off_type;
+    const double & shape_dist_traveled;
+    const StopTimePoint & timepoint;
+
+    inline StopTime get() const;
+  };
+  using Iterator = ColumnarIterator<ColumnarStopTimes>;
+
+  ColumnarStopTimes() = default;
+#if defined(JUST_GTFS_PMR)
+  inline explicit ColumnarStopTimes(std::pmr::memory_resource * resource);
+#endif
+
+  inline size_t size() const { return trip_ids.size(); }
+  inline bool empty() const { return trip_ids.empty(); }
+  inline void reserve(size_t count);
+  inline void clear();
+  inline void push_back(const StopTime & stop_time);
+  inline void push_back(StopTime && stop_time);
+  inline void append(ColumnarStopTimes && other);
+
+  inline Row operator[](size_t i) const;
+  inline StopTime get(size_t i) const { return (*this)[i].get(); }
+  inline Iterator begin() const { return Iterator(this, 0); }
+  inline Iterator end() const { return Iterator(this, size()); }
+
+  inline const EntityVector<Id> & get_trip_ids() const { return trip_ids; }
+  inline const EntityVector<Id> & get_stop_ids() const { return stop_ids; }
+  inline const EntityVector<size_t> & get_stop_sequences() const { return stop_sequences; }
+  inline const EntityVector<Time> & get_arrival_times() const { return arrival_times; }
+  inline const EntityVector<Time> & get_departure_times() const { return departure_times; }
+  inline const EntityVector<PooledText> & get_stop_headsigns() const { return stop_headsigns; }
+  inline const EntityVector<StopTimeBoarding> & get_pickup_types() const { return pickup_types; }
+  inline const EntityVector<StopTimeBoarding> & get_drop_off_types() const
+  {
+    return drop_off_types;
+  }
+  inline const EntityVector<double> & get_shape_dist_traveled() const
+  {
+    return shape_dist_traveled;
+  }
+  inline const EntityVector<StopTimePoint> & get_timepoints() const { return timepoints; }
+
+private:
+  EntityVector<Id> trip_ids;
+  EntityVector<Id> stop_ids;
+  EntityVector<size_t> stop_sequences;
+  EntityVector<Time> arrival_times;
+  EntityVector<Time> departure_times;
+  EntityVector<PooledText> stop_headsigns;
+  EntityVector<StopTimeBoarding> pickup_types;
+  EntityVector<StopTimeBoarding> drop_off_types;
+  EntityVector<double> shape_dist_traveled;
+  EntityVector<StopTimePoint> timepoints;
+};
+
+#if defined(JUST_GTFS_PMR)
+inline ColumnarStopTimes::ColumnarStopTimes(std::pmr::memory_resource * resource)
+    : trip_ids(resource),
+      stop_ids(resource),
+      stop_sequences(resource),
+      arrival_times(resource),
+      departure_times(resource),
+      stop_headsigns(resource),
+      pickup_types(resource),
+      drop_off_types(resource),
+      shape_dist_traveled(resource),
+      timepoints(resource)
+{
+}
+#endif
+
+inline StopTime ColumnarStopTimes::Row::get() const
+{
+  StopTime res;
+  res.trip_id = trip_id;
+  res.stop_id = stop_id;
+  res.stop_sequence = stop_sequence;
+  res.arrival_time = arrival_time;
+  res.departure_time = departure_time;
+  res.stop_headsign = stop_headsign;
+  res.pickup_type = pickup_type;
+  res.drop_off_type = drop_off_type;
+  res.shape_dist_traveled = shape_dist_traveled;
+  res.timepoint = timepoint;
+  return res;
+}
+
+inline void ColumnarStopTimes::reserve(size_t count)
+{
+  trip_ids.reserve(count);
+  stop_ids.reserve(count);
+  stop_sequences.reserve(count);
+  arrival_times.reserve(count);
+  departure_times.reserve(count);
+  stop_headsigns.reserve(count);
+  pickup_types.reserve(count);
+  drop_off_types.reserve(count);
+  shape_dist_traveled.reserve(count);
+  timepoints.reserve(count);
+}
+
+inline void ColumnarStopTimes::clear()
+{
+#if defined(JUST_GTFS_PMR)
+  *this = ColumnarStopTimes(trip_ids.get_allocator().resource());
+#else
+  *this = ColumnarStopTimes();
+#endif
+}
+
+inline void ColumnarStopTimes::push_back(const StopTime & stop_time)
+{
+  trip_ids.push_back(stop_time.trip_id);
+  stop_ids.push_back(stop_time.stop_id);
+  stop_sequences.push_back(stop_time.stop_sequence);
+  arrival_times.push_back(stop_time.arrival_time);
+  departure_times.push_back(stop_time.departure_time);
+  stop_headsigns.push_back(stop_time.stop_headsign);
+  pickup_types.push_back(stop_time.pickup_type);
+  drop_off_types.push_back(stop_time.drop_off_type);
+  shape_dist_traveled.push_back(stop_time.shape_dist_traveled);
+  timepoints.push_back(stop_time.timepoint);
+}
+
+inline void ColumnarStopTimes::push_back(StopTime && stop_time)
+{
+  trip_ids.push_back(std::move(stop_time.trip_id));
+  stop_ids.push_back(std::move(stop_time.stop_id));
+  stop_sequences.push_back(stop_time.stop_sequence);
+  arrival_times.push_back(std::move(stop_time.arrival_time));
+  departure_times.push_back(std::move(stop_time.departure_time));
+  stop_headsigns.push_back(std::move(stop_time.stop_headsign));
+  pickup_types.push_back(stop_time.pickup_type);
+  drop_off_types.push_back(stop_time.drop_off_type);
+  shape_dist_traveled.push_back(stop_time.shape_dist_traveled);
+  timepoints.push_back(stop_time.timepoint);
+}
+
+inline void ColumnarStopTimes::append(ColumnarStopTimes && other)
+{
+  append_column(trip_ids, std::move(other.trip_ids));
+  append_column(stop_ids, std::move(other.stop_ids));
+  append_column(stop_sequences, std::move(other.stop_sequences));
+  append_column(arrival_times, std::move(other.arrival_times));
+  append_column(departure_times, std::move(other.departure_times));
+  append_column(stop_headsigns, std::move(other.stop_headsigns));
+  append_column(pickup_types, std::move(other.pickup_types));
+  append_column(drop_off_types, std::move(other.drop_off_types));
+  append_column(shape_dist_traveled, std::move(other.shape_dist_traveled));
+  append_column(timepoints, std::move(other.timepoints));
+  other.clear();
+}
+
+inline ColumnarStopTimes::Row ColumnarStopTimes::operator[](size_t i) const
+{
+  return Row{trip_ids[i],        stop_ids[i],       stop_sequences[i],      arrival_times[i],
+             departure_times[i], stop_headsigns[i], pickup_types[i],        drop_off_types[i],
+             shape_dist_traveled[i], timepoints[i]};
+}
+
+// Shape points stored by columns, the same as ColumnarStopTimes.
+class ColumnarShapes
+{
+public:
+  struct Row
+  {
+    const Id & shape_id;
+    const double & shape_pt_lat;
+    const double & shape_pt_lon;
+    const size_t & shape_pt_sequence;
+    const double & shape_dist_traveled;
+
+    inline ShapePoint get() const;
+  };
+  using Iterator = ColumnarIterator<ColumnarShapes>;
+
+  ColumnarShapes() = default;
+#if defined(JUST_GTFS_PMR)
+  inline explicit ColumnarShapes(std::pmr::memory_resource * resource);
+#endif
+
+  inline size_t size() const { return shape_ids.size(); }
+  inline bool empty() const { return shape_ids.empty(); }
+  inline void reserve(size_t count);
+  inline void clear();
+  inline void push_back(const ShapePoint & point);
+  inline void push_back(ShapePoint && point);
+  inline void append(ColumnarShapes && other);
+
+  inline Row operator[](size_t i) const;
+  inline ShapePoint get(size_t i) const { return (*this)[i].get(); }
+  inline Iterator begin() const { return Iterator(this, 0); }
+  inline Iterator end() const { return Iterator(this, size()); }
+
+  inline const EntityVector<Id> & get_shape_ids() const { return shape_ids; }
+  inline const EntityVector<double> & get_shape_pt_lats() const { return shape_pt_lats; }
+  inline const EntityVector<double> & get_shape_pt_lons() const { return shape_pt_lons; }
+  inline const EntityVector<size_t> & get_shape_pt_sequences() const { return shape_pt_sequences; }
+  inline const EntityVector<double> & get_shape_dist_traveled() const
+  {
+    return shape_dist_traveled;
+  }
+
+private:
+  EntityVector<Id> shape_ids;
+  EntityVector<double> shape_pt_lats;
+  EntityVector<double> shape_pt_lons;
+  EntityVector<size_t> shape_pt_sequences;
+  EntityVector<double> shape_dist_traveled;
+};
+
+#if defined(JUST_GTFS_PMR)
+inline ColumnarShapes::ColumnarShapes(std::pmr::memory_resource * resource)
+    : shape_ids(resource),
+      shape_pt_lats(resource),
+      shape_pt_lons(resource),
+      shape_pt_sequences(resource),
+      shape_dist_traveled(resource)
+{
+}
+#endif
+
+inline ShapePoint ColumnarShapes::Row::get() const
+{
+  ShapePoint res;
+  res.shape_id = shape_id;
+  res.shape_pt_lat = shape_pt_lat;
+  res.shape_pt_lon = shape_pt_lon;
+  res.shape_pt_sequence = shape_pt_sequence;
+  res.shape_dist_traveled = shape_dist_traveled;
+  return res;
+}
+
+inline void ColumnarShapes::reserve(size_t count)
+{
+  shape_ids.reserve(count);
+  shape_pt_lats.reserve(count);
+  shape_pt_lons.reserve(count);
+  shape_pt_sequences.reserve(count);
+  shape_dist_traveled.reserve(count);
+}
+
+inline void ColumnarShapes::clear()
+{
+#if defined(JUST_GTFS_PMR)
+  *this = ColumnarShapes(shape_ids.get_allocator().resource());
+#else
+  *this = ColumnarShapes();
+#endif
+}
+
+inline void ColumnarShapes::push_back(const ShapePoint & point)
+{
+  shape_ids.push_back(point.shape_id);
+  shape_pt_lats.push_back(point.shape_pt_lat);
+  shape_pt_lons.push_back(point.shape_pt_lon);
+  shape_pt_sequences.push_back(point.shape_pt_sequence);
+  shape_dist_traveled.push_back(point.shape_dist_traveled);
+}
+
+inline void ColumnarShapes::push_back(ShapePoint && point)
+{
+  shape_ids.push_back(std::move(point.shape_id));
+  shape_pt_lats.push_back(point.shape_pt_lat);
+  shape_pt_lons.push_back(point.shape_pt_lon);
+  shape_pt_sequences.push_back(point.shape_pt_sequence);
+  shape_dist_traveled.push_back(point.shape_dist_traveled);
+}
+
+inline void ColumnarShapes::append(ColumnarShapes && other)
+{
+  append_column(shape_ids, std::move(other.shape_ids));
+  append_column(shape_pt_lats, std::move(other.shape_pt_lats));
+  append_column(shape_pt_lons, std::move(other.shape_pt_lons));
+  append_column(shape_pt_sequences, std::move(other.shape_pt_sequences));
+  append_column(shape_dist_traveled, std::move(other.shape_dist_traveled));
+  other.clear();
+}
+
+inline ColumnarShapes::Row ColumnarShapes::operator[](size_t i) const
+{
+  return Row{shape_ids[i], shape_pt_lats[i], shape_pt_lons[i], shape_pt_sequences[i],
+             shape_dist_traveled[i]};
+}
+
+// Moves the rows to the end of the container and frees the memory of the moved rows.
+template <typename Entity>
+void append_rows(EntityVector<Entity> & to, EntityVector<Entity> && from)
+{
+  if (to.empty())
+    to = std::move(from);
+  else
+    std::move(from.begin(), from.end(), std::back_inserter(to));
+  from.clear();
+  from.shrink_to_fit();
+}
+
+inline void append_rows(ColumnarStopTimes & to, ColumnarStopTimes && from)
+{
+  to.append(std::move(from));
+}
+
+inline void append_rows(ColumnarShapes & to, ColumnarShapes && from) { to.append(std::move(from)); }
+
+// Storage of the stop_times and shapes records in the feed.
+enum class StorageLayout
+{
+  // Vectors of StopTime and ShapePoint returned by get_stop_times() and get_shapes().
+  Rows,
+  // ColumnarStopTimes and ColumnarShapes returned by get_columnar_stop_times() and
+  // get_columnar_shapes(). get_stop_times() and get_shapes() are empty in this layout.
+  Columns
+};
+
+// Options for reading the whole feed.
+struct ReadFeedOptions
+{
+  ReadFeedOptions() = default;
+  explicit ReadFeedOptions(size_t threads) : threads_count(threads) {}
+
+  // Count of threads reading files in parallel. 0 means std::thread::hardware_concurrency().
+  size_t threads_count = 0;
+  // Files which are not read, e.g. {file_shapes, file_translations}.
+  std::vector<std::string> skipped_files;
+  // Files which are read on the first access by the get_*() methods instead of read_feed().
+  std::vector<std::string> lazy_files;
+  // Columns which are not parsed, e.g. {{file_stop_times, {"stop_headsign"}}}. Their fields keep
+  // default values. Skipping of the required column leads to ERROR_REQUIRED_FIELD_ABSENT.
+  std::map<std::string, std::vector<std::string>> skipped_columns;
+};
+
+// Options for writing the whole feed.
+struct WriteFeedOptions
+{
+  // Count of threads writing files in parallel. 0 means std::thread::hardware_concurrency().
+  size_t threads_count = 0;
+};
+
+// Statistics of reading the csv file collected after Feed::enable_load_stats().
+struct FileLoadStats
+{
+  std::string filename;
+  uintmax_t bytes_read = 0;
+  size_t rows_parsed = 0;
+  // Rows without fields, e.g. consisting of "\r", which are skipped.
+  size_t rows_skipped = 0;
+  // Wall time of reading the file in seconds.
+  double total_seconds = 0.0;
+  // Time of opening the file and finding lines in it, of splitting lines into fields and of
+  // converting fields into entities. Times of the chunks parsed in parallel are summed up.
+  double io_seconds = 0.0;
+  double split_seconds = 0.0;
+  double add_seconds = 0.0;
+  // Count of entities in the container of the file after reading, which is its peak size. It is 0
+  // for files passed to the for_each_*() handlers.
+  size_t container_size = 0;
+  // Growth of the resident memory of the process while reading the file in bytes, 0 if it is
+  // unknown or the memory shrank. It includes the memory of the files read at the same time.
+  size_t memory_growth = 0;
+};
+
+using LoadStatsHook = std::function<void(const FileLoadStats & stats)>;
+
+// Version of the feed file compared by Feed::refresh().
+struct FileFingerprint
+{
+  bool exists = false;
+  uintmax_t size = 0;
+  // Modification time of the file in the directory.
+  std::filesystem::file_time_type modification_time;
+  // CRC-32 of the contents. It is known for the entries of zip archives and is computed for the
+  // files in the directory only when their size or modification time changes.
+  std::optional<uint32_t> crc;
+};
+
+// Differences of the records of the file between the old and the new feeds. Records are keyed by
+// the id of the entity they belong to: stop times and frequencies by trip_id, calendar dates by
+// service_id, fare rules by fare_id, shape points by shape_id, transfers by from_stop_id and
+// translations by table_name. The only record of feed_info.txt has the empty key.
+struct FileDiff
+{
+  bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+
+  std::string filename;
+  // Keys present only in the new feed, only in the old feed and in both feeds with different
+  // records, in the order of their first records in the files.
+  std::vector<Id> added;
+  std::vector<Id> removed;
+  std::vector<Id> changed;
+};
+
+// Files with differences in the order of Feed::get_feed_files().
+using FeedDiff = std::vector<FileDiff>;
+
+// Records of the file referring to the ids absent in the referenced file, found by
+// Feed::validate().
+struct ValidationError
+{
+  std::string filename;
+  std::string field;
+  std::string referenced_filename;
+  size_t records_count = 0;
+  // Absent id of the first record with the broken reference in the file order.
+  Id first_absent_id;
+};
+
+// Resolving of the ids of the feed merged by Feed::merge() which exist in the feed.
+enum class IdCollision
+{
+  // All ids of the merged feed get the prefix.
+  Prefix,
+  // Only the ids existing in the feed get the prefix.
+  PrefixColliding,
+  // Existing ids are errors.
+  Fail
+};
+
+// Options for merging the feed into another one.
+struct MergePolicy
+{
+  IdCollision id_collision = IdCollision::PrefixColliding;
+  // Prefix of the ids of the merged feed, e.g. "msk:".
+  std::string prefix;
+  // Agencies and fare attributes of the merged feed which differ from the existing ones only by
+  // their ids are not added, the references to them get the existing ids.
+  bool deduplicate_agencies = true;
+  bool deduplicate_fare_attributes = true;
+  // Stops of the merged feed with the name and the location type of the existing stop and the
+  // coordinates differing by at most stop_tolerance degrees are replaced by it as well. Negative
+  // tolerance disables it.
+  double stop_tolerance = 0.0;
+  // Count of threads merging files in parallel. 0 means std::thread::hardware_concurrency().
+  size_t threads_count = 0;
+};
+
+// Adds the time elapsed since the previous mark to the stage counters. The disabled timer does
+// nothing, so the stats which are not collected do not cost anything per row.
+template <bool enabled>
+class StageTimer
+{
+public:
+  StageTimer()
+  {
+    if constexpr (enabled)
+      last = std::chrono::steady_clock::now();
+  }
+
+  void mark(double & seconds)
+  {
+    if constexpr (enabled)
+    {
+      const auto now = std::chrono::steady_clock::now();
+      seconds += std::chrono::duration<double>(now - last).count();
+      last = now;
+    }
+  }
+
+private:
+  std::chrono::steady_clock::time_point last;
+};
+
+inline double get_seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Reads rows of the parser and passes the rows with fields to add_row.
+template <bool collect_stats, typename AddRow>
+Result read_csv_rows(CsvParser & parser, CsvRowView & values, const ParsedCsvRow & record,
+                     FileLoadStats & stats, AddRow add_row)
+{
+  StageTimer<collect_stats> timer;
+  std::string_view line;
+  while (parser.read_line(line))
+  {
+    timer.mark(stats.io_seconds);
+    parser.split_row(line, values);
+    timer.mark(stats.split_seconds);
+
+    if (record.empty())
+    {
+      ++stats.rows_skipped;
+      continue;
+    }
+
+    Result res = add_row(record);
+    timer.mark(stats.add_seconds);
+    if (res != ResultCode::OK)
+      return res;
+    ++stats.rows_parsed;
+  }
+  timer.mark(stats.io_seconds);
+  return parser.get_input_result();
+}
+
+// Binary snapshots --------------------------------------------------------------------------------
+// Snapshot is the binary cache of the feed entities. Snapshot file consists of the header and
+// the payload. The payload contains sections of entities in the fixed order (count of entities and
+// their fields) followed by the strings blob (count of strings, end offsets of strings and their
+// characters). Strings, times and dates are stored as indexes in the blob, so each unique value is
+// stored and parsed once. Numbers and enums have fixed width and native byte order.
+struct SnapshotHeader
+{
+  char magic[8] = {};
+  uint32_t version = 0;
+  uint32_t byte_order = 0;
+  uint64_t payload_size = 0;
+  uint64_t strings_offset = 0;
+  uint64_t checksum = 0;
+};
+
+inline constexpr char snapshot_magic[8] = {'J', 'G', 'T', 'F', 'S', 'S', 'N', 'P'};
+inline constexpr uint32_t snapshot_version = 1;
+inline constexpr uint32_t snapshot_byte_order = 0x01020304;
+
+// Fields of the entities saved to snapshots, in the order of saving.
+template <typename Entity>
+struct SnapshotFields;
+
+template <>
+struct SnapshotFields<Agency>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Agency::agency_id, &Agency::agency_name, &Agency::agency_url,
+                           &Agency::agency_timezone, &Agency::agency_lang, &Agency::agency_phone,
+                           &Agency::agency_fare_url, &Agency::agency_email);
+  }
+};
+
+template <>
+struct SnapshotFields<Stop>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Stop::stop_id, &Stop::stop_name, &Stop::coordinates_present,
+                           &Stop::stop_lat, &Stop::stop_lon, &Stop::zone_id, &Stop::parent_station,
+                           &Stop::stop_code, &Stop::stop_desc, &Stop::stop_url,
+                           &Stop::location_type, &Stop::stop_timezone, &Stop::wheelchair_boarding,
+                           &Stop::level_id, &Stop::platform_code);
+  }
+};
+
+template <>
+struct SnapshotFields<Route>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Route::route_id, &Route::route_type, &Route::agency_id,
+                           &Route::route_short_name, &Route::route_long_name, &Route::route_desc,
+                           &Route::route_url, &Route::route_color, &Route::route_text_color,
+                           &Route::route_sort_order);
+  }
+};
+
+template <>
+struct SnapshotFields<Trip>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Trip::route_id, &Trip::service_id, &Trip::trip_id,
+                           &Trip::trip_headsign, &Trip::trip_short_name, &Trip::direction_id,
+                           &Trip::block_id, &Trip::shape_id, &Trip::wheelchair_accessible,
+                           &Trip::bikes_allowed);
+  }
+};
+
+template <>
+struct SnapshotFields<StopTime>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&StopTime::trip_id, &StopTime::stop_id, &StopTime::stop_sequence,
+                           &StopTime::arrival_time, &StopTime::departure_time,
+                           &StopTime::stop_headsign, &StopTime::pickup_type,
+                           &StopTime::drop_off_type, &StopTime::shape_dist_traveled,
+                           &StopTime::timepoint);
+  }
+};
+
+template <>
+struct SnapshotFields<CalendarItem>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&CalendarItem::service_id, &CalendarItem::monday,
+                           &CalendarItem::tuesday, &CalendarItem::wednesday,
+                           &CalendarItem::thursday, &CalendarItem::friday, &CalendarItem::saturday,
+                           &CalendarItem::sunday, &CalendarItem::start_date,
+                           &CalendarItem::end_date);
+  }
+};
+
+template <>
+struct SnapshotFields<CalendarDate>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&CalendarDate::service_id, &CalendarDate::date,
+                           &CalendarDate::exception_type);
+  }
+};
+
+template <>
+struct SnapshotFields<FareAttributesItem>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&FareAttributesItem::fare_id, &FareAttributesItem::price,
+                           &FareAttributesItem::currency_type, &FareAttributesItem::payment_method,
+                           &FareAttributesItem::transfers, &FareAttributesItem::agency_id,
+                           &FareAttributesItem::transfer_duration);
+  }
+};
+
+template <>
+struct SnapshotFields<FareRule>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&FareRule::fare_id, &FareRule::route_id, &FareRule::origin_id,
+                           &FareRule::destination_id, &FareRule::contains_id);
+  }
+};
+
+template <>
+struct SnapshotFields<ShapePoint>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&ShapePoint::shape_id, &ShapePoint::shape_pt_lat,
+                           &ShapePoint::shape_pt_lon, &ShapePoint::shape_pt_sequence,
+                           &ShapePoint::shape_dist_traveled);
+  }
+};
+
+template <>
+struct SnapshotFields<Frequency>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Frequency::trip_id, &Frequency::start_time, &Frequency::end_time,
+                           &Frequency::headway_secs, &Frequency::exact_times);
+  }
+};
+
+template <>
+struct SnapshotFields<Transfer>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Transfer::from_stop_id, &Transfer::to_stop_id,
+                           &Transfer::transfer_type, &Transfer::min_transfer_time);
+  }
+};
+
+template <>
+struct SnapshotFields<Pathway>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Pathway::pathway_id, &Pathway::from_stop_id, &Pathway::to_stop_id,
+                           &Pathway::pathway_mode, &Pathway::is_bidirectional, &Pathway::length,
+                           &Pathway::traversal_time, &Pathway::stair_count, &Pathway::max_slope,
+                           &Pathway::min_width, &Pathway::signposted_as,
+                           &Pathway::reversed_signposted_as);
+  }
+};
+
+template <>
+struct SnapshotFields<Level>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Level::level_id, &Level::level_index, &Level::level_name);
+  }
+};
+
+template <>
+struct SnapshotFields<FeedInfo>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&FeedInfo::feed_publisher_name, &FeedInfo::feed_publisher_url,
+                           &FeedInfo::feed_lang, &FeedInfo::feed_start_date,
+                           &FeedInfo::feed_end_date, &FeedInfo::feed_version,
+                           &FeedInfo::feed_contact_email, &FeedInfo::feed_contact_url);
+  }
+};
+
+template <>
+struct SnapshotFields<Translation>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Translation::table_name, &Translation::field_name,
+                           &Translation::language, &Translation::translation,
+                           &Translation::record_id, &Translation::record_sub_id,
+                           &Translation::field_value);
+  }
+};
+
+template <>
+struct SnapshotFields<Attribution>
+{
+  static constexpr auto get()
+  {
+    return std::make_tuple(&Attribution::organization_name, &Attribution::attribution_id,
+                           &Attribution::agency_id, &Attribution::route_id, &Attribution::trip_id,
+                           &Attribution::is_producer, &Attribution::is_operator,
+                           &Attribution::is_authority, &Attribution::attribution_url,
+                           &Attribution::attribution_email, &Attribution::attribution_phone);
+  }
+};
+
+// Checksum of the snapshot payload. Data is hashed by 8-byte words, so the checksum is updated
+// only with the sizes divisible by 8 except the last update.
+class SnapshotChecksum
+{
+public:
+  inline void update(std::string_view data);
+  uint64_t get() const { return hash; }
+
+private:
+  uint64_t hash = 0xcbf29ce484222325ULL;
+};
+
+inline void SnapshotChecksum::update(std::string_view data)
+{
+  static constexpr uint64_t prime = 0x100000001b3ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t))
+  {
+    uint64_t word = 0;
+    std::memcpy(&word, data.data() + i, sizeof(word));
+    hash = (hash ^ word) * prime;
+    hash ^= hash >> 32;
+  }
+  for (; i < data.size(); ++i)
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+}
+
+template <typename Entity>
+const Entity & get_entity(const Entity & entity)
+{
+  return entity;
+}
+
+inline StopTime get_entity(const ColumnarStopTimes::Row & row) { return row.get(); }
+
+inline ShapePoint get_entity(const ColumnarShapes::Row & row) { return row.get(); }
+
+// Entities are the same if all their saved fields are equal.
+template <typename Entity>
+bool is_same_entity(const Entity & lhs, const Entity & rhs)
+{
+  return std::apply([&](auto... fields) { return ((lhs.*fields == rhs.*fields) && ...); },
+                    SnapshotFields<Entity>::get());
+}
+
+// Compares the groups of records with equal keys in the order of the records in the groups.
+template <typename OldContainer, typename NewContainer, typename Key>
+FileDiff get_entities_diff(const std::string & filename, const OldContainer & old_entities,
+                           const NewContainer & new_entities, Key key)
+{
+  using Groups = std::unordered_map<Id, std::vector<size_t>>;
+  auto group = [&key](const auto & entities, std::vector<Id> & keys) {
+    Groups groups;
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+      const auto [it, inserted] = groups.try_emplace(Id(std::invoke(key, get_entity(entities[i]))));
+      if (inserted)
+        keys.push_back(it->first);
+      it->second.push_back(i);
+    }
+    return groups;
+  };
+
+  std::vector<Id> old_keys;
+  std::vector<Id> new_keys;
+  const Groups old_groups = group(old_entities, old_keys);
+  const Groups new_groups = group(new_entities, new_keys);
+
+  FileDiff res;
+  res.filename = filename;
+  for (const Id & id : old_keys)
+  {
+    if (new_groups.find(id) == new_groups.end())
+      res.removed.push_back(id);
+  }
+
+  for (const Id & id : new_keys)
+  {
+    const auto it = old_groups.find(id);
+    if (it == old_groups.end())
+    {
+      res.added.push_back(id);
+      continue;
+    }
+
+    const std::vector<size_t> & old_group = it->second;
+    const std::vector<size_t> & new_group = new_groups.at(id);
+    bool is_same = old_group.size() == new_group.size();
+    for (size_t i = 0; is_same && i < old_group.size(); ++i)
+    {
+      is_same = is_same_entity(get_entity(old_entities[old_group[i]]),
+                               get_entity(new_entities[new_group[i]]));
+    }
+    if (!is_same)
+      res.changed.push_back(id);
+  }
+  return res;
+}
+
+// Writes the snapshot to the file through the buffer.
+class SnapshotWriter
+{
+public:
+  inline explicit SnapshotWriter(std::ofstream & out);
+
+  template <typename Container>
+  void write_section(const Container & container)
+  {
+    write(static_cast<size_t>(container.size()));
+    for (const auto & item : container)
+    {
+      const auto & entity = get_entity(item);
+      std::apply([&](auto... fields) { (write(entity.*fields), ...); },
+                 SnapshotFields<std::decay_t<decltype(entity)>>::get());
+    }
+  }
+
+  // Writes the strings blob and the header. Returns false if writing failed.
+  inline bool finish();
+
+private:
+  template <typename T>
+  void write_value(const T & value)
+  {
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    if (buffer.size() >= buffer_size)
+      flush(false);
+  }
+
+  void write(const std::string & str) { write_value(get_string_index(str)); }
+  void write(const Time & time) { write(time.get_raw_time()); }
+  void write(const Date & date) { write(date.get_raw_date()); }
+  void write(double value) { write_value(value); }
+  void write(bool value) { write_value(static_cast<uint8_t>(value)); }
+  void write(size_t value) { write_value(static_cast<uint64_t>(value)); }
+
+  template <typename Enum, typename = std::enable_if_t<std::is_enum_v<Enum>>>
+  void write(Enum value)
+  {
+    write_value(static_cast<int32_t>(value));
+  }
+
+  inline uint32_t get_string_index(const std::string & str);
+  inline void flush(bool is_last);
+
+  static constexpr size_t buffer_size = 1 << 20;
+
+  std::ofstream & out;
+  std::string buffer;
+  uint64_t written = 0;
+  SnapshotChecksum checksum;
+  std::unordered_map<std::string, uint32_t> strings_index;
+  std::vector<const std::string *> strings;
+};
+
+inline SnapshotWriter::SnapshotWriter(std::ofstream & out) : out(out)
+{
+  buffer.reserve(buffer_size + sizeof(uint64_t));
+  const SnapshotHeader header;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+inline uint32_t SnapshotWriter::get_string_index(const std::string & str)
+{
+  const auto [it, inserted] = strings_index.emplace(str, static_cast<uint32_t>(strings.size()));
+  if (inserted)
+  {
+    if (strings.size() == std::numeric_limits<uint32_t>::max())
+      throw std::length_error("Too many unique strings for the snapshot");
+    strings.push_back(&it->first);
+  }
+  return it->second;
+}
+
+inline void SnapshotWriter::flush(bool is_last)
+{
+  // Keeps the tail not divisible by the checksum word size until the next flush.
+  const size_t size = is_last ? buffer.size() : buffer.size() / sizeof(uint64_t) * sizeof(uint64_t);
+  const std::string_view data(buffer.data(), size);
+  checksum.update(data);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+  written += size;
+  buffer.erase(0, size);
+}
+
+inline bool SnapshotWriter::finish()
+{
+  const uint64_t strings_offset = written + buffer.size();
+  write(static_cast<size_t>(strings.size()));
+  uint64_t offset = 0;
+  for (const auto * str : strings)
+  {
+    offset += str->size();
+    write_value(offset);
+  }
+  for (const auto * str : strings)
+  {
+    buffer += *str;
+    if (buffer.size() >= buffer_size)
+      flush(false);
+  }
+  flush(true);
+
+  SnapshotHeader header;
+  std::copy(std::begin(snapshot_magic), std::end(snapshot_magic), header.magic);
+  header.version = snapshot_version;
+  header.byte_order = snapshot_byte_order;
+  header.payload_size = written;
+  header.strings_offset = strings_offset;
+  header.checksum = checksum.get();
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.flush();
+  return static_cast<bool>(out);
+}
+
+// Reads the snapshot from the memory-mapped file. Throws std::out_of_range for truncated
+// sections and out-of-range enums and InvalidFieldFormat for malformed times and dates.
+class SnapshotReader
+{
+public:
+  inline SnapshotReader(std::string_view payload, size_t strings_offset);
+
+  template <typename Entity, typename Container>
+  void read_section(Container & container)
+  {
+    const size_t count = read_count();
+    container.reserve(container.size() + count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      Entity entity;
+      read_entity(entity);
+      container.push_back(std::move(entity));
+    }
+  }
+
+  template <typename Entity>
+  void read_entity(Entity & entity)
+  {
+    std::apply([&](auto... fields) { (read(entity.*fields), ...); },
+               SnapshotFields<Entity>::get());
+  }
+
+  inline size_t read_count();
+  bool is_finished() const { return position == strings_begin; }
+
+private:
+  template <typename T>
+  T read_value(size_t end)
+  {
+    if (position + sizeof(T) > end)
+      throw std::out_of_range("Snapshot section is truncated");
+    T value;
+    std::memcpy(&value, payload.data() + position, sizeof(T));
+    position += sizeof(T);
+    return value;
+  }
+
+  inline uint32_t read_string_index();
+  void read(std::string & str) { str = strings[read_string_index()]; }
+#if defined(JUST_GTFS_INTERNED_IDS)
+  inline void read(InternedString & str);
+#endif
+  inline void read(Time & time);
+  inline void read(Date & date);
+  void read(double & value) { value = read_value<double>(strings_begin); }
+  void read(bool & value) { value = read_value<uint8_t>(strings_begin) != 0; }
+  void read(size_t & value) { value = static_cast<size_t>(read_value<uint64_t>(strings_begin)); }
+
+  // Enums are stored as int32. The stored value must fit the underlying type of the enum, as every
+  // value of the enum field does, so corrupted snapshots don't produce unrepresentable values.
+  template <typename Enum, typename = std::enable_if_t<std::is_enum_v<Enum>>>
+  void read(Enum & value)
+  {
+    using Underlying = std::underlying_type_t<Enum>;
+    const int32_t stored = read_value<int32_t>(strings_begin);
+    if (stored < static_cast<int32_t>(std::numeric_limits<Underlying>::min()) ||
+        stored > static_cast<int32_t>(std::numeric_limits<Underlying>::max()))
+      throw std::out_of_range("Snapshot enum value is out of range");
+    value = static_cast<Enum>(stored);
+  }
+
+  std::string_view payload;
+  size_t position = 0;
+  size_t strings_begin = 0;
+  std::vector<std::string_view> strings;
+  // Times and dates parsed from the strings with the same index.
+  std::unordered_map<uint32_t, Time> times;
+  std::unordered_map<uint32_t, Date> dates;
+#if defined(JUST_GTFS_INTERNED_IDS)
+  std::vector<InternedString> interned;
+  std::vector<bool> is_interned;
+#endif
+};
+
+inline SnapshotReader::SnapshotReader(std::string_view payload, size_t strings_offset)
+    : payload(payload), position(strings_offset), strings_begin(payload.size())
+{
+  if (strings_offset > payload.size())
+    throw std::out_of_range("Snapshot strings offset is out of range");
+
+  const size_t count = read_count();
+  if (count > (payload.size() - position) / sizeof(uint64_t))
+    throw std::out_of_range("Snapshot strings table is truncated");
+
+  const size_t chars_begin = position + count * sizeof(uint64_t);
+  strings.reserve(count);
+  uint64_t begin = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const uint64_t end = read_value<uint64_t>(chars_begin);
+    if (end < begin || end > payload.size() - chars_begin)
+      throw std::out_of_range("Snapshot string is out of range");
+    strings.emplace_back(payload.data() + chars_begin + begin, end - begin);
+    begin = end;
+  }
+
+  position = 0;
+  strings_begin = strings_offset;
+#if defined(JUST_GTFS_INTERNED_IDS)
+  interned.resize(count);
+  is_interned.resize(count, false);
+#endif
+}
+
+inline size_t SnapshotReader::read_count()
+{
+  return static_cast<size_t>(read_value<uint64_t>(strings_begin));
+}
+
+inline uint32_t SnapshotReader::read_string_index()
+{
+  const auto index = read_value<uint32_t>(strings_begin);
+  if (index >= strings.size())
+    throw std::out_of_range("Snapshot string index is out of range");
+  return index;
+}
+
+#if defined(JUST_GTFS_INTERNED_IDS)
+inline void SnapshotReader::read(InternedString & str)
+{
+  const uint32_t index = read_string_index();
+  if (!is_interned[index])
+  {
+    interned[index] = strings[index];
+    is_interned[index] = true;
+  }
+  str = interned[index];
+}
+#endif
+
+inline void SnapshotReader::read(Time & time)
+{
+  const uint32_t index = read_string_index();
+  auto it = times.find(index);
+  if (it == times.end())
+    it = times.emplace(index, Time(strings[index])).first;
+  time = it->second;
+}
+
+inline void SnapshotReader::read(Date & date)
+{
+  const uint32_t index = read_string_index();
+  auto it = dates.find(index);
+  if (it == dates.end())
+    it = dates.emplace(index, Date(strings[index])).first;
+  date = it->second;
+}
+
+// Positions of the GTFS entities in their container by entity id.
+using IdIndex = EntityMap<Id, size_t>;
+
+// Stop times grouped by id in the compressed sparse row format: positions of the stop times of
+// the i-th group in the stop_times container are stored in permutation from offsets[i] up to
+// offsets[i + 1].
+struct StopTimesGroups
+{
+  StopTimesGroups() = default;
+#if defined(JUST_GTFS_PMR)
+  explicit StopTimesGroups(std::pmr::memory_resource * resource)
+      : groups(resource), offsets(resource), permutation(resource)
+  {
+  }
+#endif
+
+  IdIndex groups;
+  EntityVector<size_t> offsets;
+  EntityVector<size_t> permutation;
+};
+
+// Non-owning view of the group of stop times. It is valid until the stop_times container of the
+// feed is modified.
+class StopTimesRange
+{
+public:
+  class Iterator
+  {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = StopTime;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const StopTime *;
+    using reference = const StopTime &;
+
+    Iterator() = default;
+    Iterator(const StopTimes * stop_times, const size_t * position)
+        : stop_times(stop_times), position(position)
+    {
+    }
+
+    reference operator*() const { return (*stop_times)[*position]; }
+    pointer operator->() const { return &**this; }
+    reference operator[](difference_type n) const { return (*stop_times)[position[n]]; }
+
+    Iterator & operator++()
+    {
+      ++position;
+      return *this;
+    }
+    Iterator operator++(int) { return Iterator(stop_times, position++); }
+    Iterator & operator--()
+    {
+      --position;
+      return *this;
+    }
+    Iterator operator--(int) { return Iterator(stop_times, position--); }
+    Iterator & operator+=(difference_type n)
+    {
+      position += n;
+      return *this;
+    }
+    Iterator & operator-=(difference_type n)
+    {
+      position -= n;
+      return *this;
+    }
+    Iterator operator+(difference_type n) const { return Iterator(stop_times, position + n); }
+    Iterator operator-(difference_type n) const { return Iterator(stop_times, position - n); }
+    difference_type operator-(const Iterator & other) const { return position - other.position; }
+
+    bool operator==(const Iterator & other) const { return position == other.position; }
+    bool operator!=(const Iterator & other) const { return position != other.position; }
+    bool operator<(const Iterator & other) const { return position < other.position; }
+
+  private:
+    const StopTimes * stop_times = nullptr;
+    const size_t * position = nullptr;
+  };
+
+  StopTimesRange() = default;
+  StopTimesRange(const StopTimes & stop_times, const size_t * first, const size_t * last)
+      : stop_times(&stop_times), first(first), last(last)
+  {
+  }
+
+  Iterator begin() const { return Iterator(stop_times, first); }
+  Iterator end() const { return Iterator(stop_times, last); }
+  size_t size() const { return static_cast<size_t>(last - first); }
+  bool empty() const { return first == last; }
+  const StopTime & operator[](size_t i) const { return (*stop_times)[first[i]]; }
+
+private:
+  const StopTimes * stop_times = nullptr;
+  const size_t * first = nullptr;
+  const size_t * last = nullptr;
+};
+
+// Departure of the frequency-based trip: stop times of the trip shifted so that it departs from
+// the first stop at the start time. The view is valid while the stop times range is valid.
+class TripInstance
+{
+public:
+  TripInstance() = default;
+  inline TripInstance(const StopTimesRange & stop_times, size_t start_seconds,
+                      FrequencyTripService exact_times);
+
+  inline const Id & get_trip_id() const;
+  Time get_start_time() const { return Time(start_seconds); }
+  FrequencyTripService get_exact_times() const { return exact_times; }
+  size_t size() const { return stop_times.size(); }
+  bool empty() const { return stop_times.empty(); }
+
+  // Shifted times of the i-th stop. Times absent in stop_times.txt stay not provided.
+  inline Time get_arrival_time(size_t i) const;
+  inline Time get_departure_time(size_t i) const;
+  // Copy of the i-th stop time of the trip with the shifted times.
+  inline StopTime get_stop_time(size_t i) const;
+  const StopTimesRange & get_template_stop_times() const { return stop_times; }
+
+private:
+  inline Time shift(const Time & time) const;
+
+  StopTimesRange stop_times;
+  size_t start_seconds = 0;
+  // Departure from the first stop in stop_times.txt which is moved to the start time.
+  size_t template_start_seconds = 0;
+  FrequencyTripService exact_times = FrequencyTripService::FrequencyBased;
+};
+
+inline TripInstance::TripInstance(const StopTimesRange & stop_times, size_t start_seconds,
+                                  FrequencyTripService exact_times)
+    : stop_times(stop_times), start_seconds(start_seconds), exact_times(exact_times)
+{
+  if (stop_times.empty())
+    return;
+
+  const StopTime & first = stop_times[0];
+  const Time & departure =
+      first.departure_time.is_provided() ? first.departure_time : first.arrival_time;
+  template_start_seconds = departure.get_total_seconds();
+}
+
+inline const Id & TripInstance::get_trip_id() const
+{
+  static const Id empty_id;
+  return stop_times.empty() ? empty_id : stop_times[0].trip_id;
+}
+
+inline Time TripInstance::shift(const Time & time) const
+{
+  if (!time.is_provided())
+    return time;
+
+  // Times preceding the first departure are not moved before the start.
+  const size_t seconds = time.get_total_seconds();
+  return Time(start_seconds + (std::max(seconds, template_start_seconds) - template_start_seconds));
+}
+
+inline Time TripInstance::get_arrival_time(size_t i) const
+{
+  return shift(stop_times[i].arrival_time);
+}
+
+inline Time TripInstance::get_departure_time(size_t i) const
+{
+  return shift(stop_times[i].departure_time);
+}
+
+inline StopTime TripInstance::get_stop_time(size_t i) const
+{
+  StopTime res = stop_times[i];
+  res.arrival_time = shift(res.arrival_time);
+  res.departure_time = shift(res.departure_time);
+  return res;
+}
+
+// Departures of the frequency-based trips in the time window. Each row of frequencies.txt adds
+// the series of departures with its headway which are computed on access: the memory doesn't
+// depend on the count of departures.
+class TripInstances
+{
+public:
+  using Row = TripInstance;
+  using Iterator = ColumnarIterator<TripInstances>;
+
+  // Adds departures start_time + k * headway_secs before end_time of the frequency which are
+  // in [window_start, window_end) seconds. Frequencies with zero headways are skipped.
+  inline void add_frequency(const StopTimesRange & stop_times, const Frequency & frequency,
+                            size_t window_start, size_t window_end);
+
+  size_t size() const { return offsets.back(); }
+  bool empty() const { return size() == 0; }
+  // Departures are ordered by the series in the order of adding them and by time in the series.
+  inline TripInstance operator[](size_t i) const;
+  Iterator begin() const { return Iterator(this, 0); }
+  Iterator end() const { return Iterator(this, size()); }
+
+private:
+  struct Series
+  {
+    StopTimesRange stop_times;
+    size_t first_start = 0;
+    size_t headway = 0;
+    FrequencyTripService exact_times = FrequencyTripService::FrequencyBased;
+  };
+
+  std::vector<Series> series;
+  // Departures of the i-th series are [offsets[i], offsets[i + 1]).
+  std::vector<size_t> offsets = {0};
+};
+
+inline void TripInstances::add_frequency(const StopTimesRange & stop_times,
+                                         const Frequency & frequency, size_t window_start,
+                                         size_t window_end)
+{
+  const size_t start = frequency.start_time.get_total_seconds();
+  const size_t headway = frequency.headway_secs;
+  const size_t end = std::min(frequency.end_time.get_total_seconds(), window_end);
+  if (stop_times.empty() || headway == 0 || end <= start)
+    return;
+
+  // Departures [first, last) are the ones from max(start, window_start) up to end.
+  auto count_before = [&](size_t time) {
+    return time <= start ? 0 : (time - start - 1) / headway + 1;
+  };
+  const size_t first = count_before(std::max(start, window_start));
+  const size_t last = count_before(end);
+  if (first >= last)
+    return;
+
+  series.push_back({stop_times, start + first * headway, headway, frequency.exact_times});
+  offsets.push_back(offsets.back() + (last - first));
+}
+
+inline TripInstance TripInstances::operator[](size_t i) const
+{
+  const auto it = std::upper_bound(offsets.begin(), offsets.end(), i);
+  const size_t index = static_cast<size_t>(it - offsets.begin()) - 1;
+  const Series & item = series[index];
+  return TripInstance(item.stop_times, item.first_start + (i - offsets[index]) * item.headway,
+                      item.exact_times);
+}
+
+// Options for building the routing timetable by Feed::build_timetable().
+struct TimetableOptions
+{
+  // Count of threads building trips and patterns. 0 means std::thread::hardware_concurrency().
+  size_t threads_count = 0;
+  // Frequency-based trips are replaced by their departures in [start_time, end_time) of each
+  // frequency. Otherwise their stop times in stop_times.txt are the single departure.
+  bool expand_frequencies = true;
+};
+
+// Timetable for the routing algorithms such as RAPTOR with dense indexes of stops, routes,
+// services and patterns instead of the ids. Trips of the route visiting the same sequence of
+// stops which don't overtake each other form the pattern. Times are in seconds since the start
+// of the service day as in stop_times.txt.
+struct Timetable
+{
+  struct Pattern
+  {
+    uint32_t route = 0;
+    // Stops of the pattern are pattern_stops[first_stop, first_stop + stops_count).
+    size_t first_stop = 0;
+    size_t stops_count = 0;
+    // Trips of the pattern are [first_trip, first_trip + trips_count) of trip_ids and
+    // trip_services, they are sorted by the departure from the first stop.
+    size_t first_trip = 0;
+    size_t trips_count = 0;
+    // Times of the j-th stop of the i-th trip of the pattern are at
+    // first_time + i * stops_count + j in arrivals and departures.
+    size_t first_time = 0;
+  };
+
+  struct Footpath
+  {
+    uint32_t stop = 0;
+    uint32_t duration = 0;
+  };
+
+  // Id of the i-th stop, route and service and the indexes by ids. Stops and routes are in the
+  // order of the files, services are in the order of their first trips.
+  std::vector<Id> stop_ids;
+  std::vector<Id> route_ids;
+  std::vector<Id> service_ids;
+  IdIndex stops_index;
+  IdIndex routes_index;
+  IdIndex services_index;
+
+  std::vector<Pattern> patterns;
+  std::vector<uint32_t> pattern_stops;
+  // Departures of frequency-based trips have the ids of their trips.
+  std::vector<Id> trip_ids;
+  std::vector<uint32_t> trip_services;
+  std::vector<uint32_t> arrivals;
+  std::vector<uint32_t> departures;
+
+  // Patterns visiting the i-th stop are stop_patterns[stop_patterns_offsets[i],
+  // stop_patterns_offsets[i + 1]) in the increasing order.
+  std::vector<size_t> stop_patterns_offsets;
+  std::vector<uint32_t> stop_patterns;
+  // Footpaths from the i-th stop are footpaths[footpaths_offsets[i], footpaths_offsets[i + 1])
+  // sorted by the target stop.
+  std::vector<size_t> footpaths_offsets;
+  std::vector<Footpath> footpaths;
+};
+
+// Active days of services from calendar and calendar_dates as bitsets. Bits of the i-th service
+// are stored in words from i * words_per_service. Bit j of them is the day first_day + j.
+struct ServiceDays
+{
+  ServiceDays() = default;
+#if defined(JUST_GTFS_PMR)
+  explicit ServiceDays(std::pmr::memory_resource * resource) : services(resource), words(resource)
+  {
+  }
+#endif
+
+  IdIndex services;
+  int32_t first_day = 0;
+  size_t days_count = 0;
+  size_t words_per_service = 0;
+  EntityVector<uint64_t> words;
+};
+
+// Points of shapes grouped by shape_id and sorted by shape_pt_sequence. Fields of the points of
+// the i-th shape are stored in the contiguous arrays from offsets[i] up to offsets[i + 1].
+struct ShapesGroups
+{
+  ShapesGroups() = default;
+#if defined(JUST_GTFS_PMR)
+  explicit ShapesGroups(std::pmr::memory_resource * resource)
+      : groups(resource),
+        shape_ids(resource),
+        offsets(resource),
+        lats(resource),
+        lons(resource),
+        sequences(resource),
+        dist_traveled(resource)
+  {
+  }
+#endif
+
+  IdIndex groups;
+  EntityVector<Id> shape_ids;
+  EntityVector<size_t> offsets;
+  EntityVector<double> lats;
+  EntityVector<double> lons;
+  EntityVector<size_t> sequences;
+  EntityVector<double> dist_traveled;
+};
+
+// Non-owning view of the shape points sorted by shape_pt_sequence. It is valid until the shapes
+// index of the feed is rebuilt or dropped.
+struct ShapePolyline
+{
+  const double * lats = nullptr;
+  const double * lons = nullptr;
+  const size_t * sequences = nullptr;
+  const double * dist_traveled = nullptr;
+  size_t size = 0;
+
+  bool empty() const { return size == 0; }
+};
+
+struct BoundingBox
+{
+  double min_lat = 0.0;
+  double min_lon = 0.0;
+  double max_lat = 0.0;
+  double max_lon = 0.0;
+
+  bool contains(double lat, double lon) const
+  {
+    return lat >= min_lat && lat <= max_lat && lon >= min_lon && lon <= max_lon;
+  }
+  bool intersects(const BoundingBox & other) const
+  {
+    return other.min_lat <= max_lat && other.max_lat >= min_lat && other.min_lon <= max_lon &&
+           other.max_lon >= min_lon;
+  }
+};
+
+// Uniform grid of square cells with the side of cell_size degrees. Each cell keeps the items
+// with the bounding boxes intersecting it. Longitudes are not wrapped around the antimeridian.
+class SpatialGrid
+{
+public:
+  SpatialGrid() = default;
+  explicit SpatialGrid(double cell_size) : cell_size(cell_size) {}
+#if defined(JUST_GTFS_PMR)
+  explicit SpatialGrid(std::pmr::memory_resource * resource) : cells(resource) {}
+  SpatialGrid(double cell_size, std::pmr::memory_resource * resource)
+      : cell_size(cell_size), cells(resource)
+  {
+  }
+#endif
+
+  double get_cell_size() const { return cell_size; }
+  bool empty() const { return cells.empty(); }
+  inline void add(size_t item, const BoundingBox & box);
+
+  // Passes the items of the cells intersecting the box to the handler. Items spanning several
+  // cells are passed several times.
+  template <typename Handler>
+  void for_each_item(const BoundingBox & box, Handler handler) const;
+  // Passes the items of the cells with the Chebyshev distance equal to radius from the cell of
+  // the point. Items in the rings from get_min_radius() up to get_max_radius() cover the whole
+  // grid, the rings outside of it are empty.
+  template <typename Handler>
+  void for_each_item_in_ring(double lat, double lon, int64_t radius, Handler handler) const;
+  inline int64_t get_min_radius(double lat, double lon) const;
+  inline int64_t get_max_radius(double lat, double lon) const;
+
+private:
+  int64_t get_cell(double coordinate) const
+  {
+    return static_cast<int64_t>(std::floor(coordinate / cell_size));
+  }
+  static uint64_t get_key(int64_t lat_cell, int64_t lon_cell)
+  {
+    return (static_cast<uint64_t>(lat_cell) << 32) | static_cast<uint32_t>(lon_cell);
+  }
+  template <typename Handler>
+  void for_each_item_in_cell(int64_t lat_cell, int64_t lon_cell, Handler & handler) const;
+
+  double cell_size = 0.01;
+  EntityMap<uint64_t, EntityVector<size_t>> cells;
+  // Range of the non-empty cells.
+  int64_t min_lat_cell = 0;
+  int64_t max_lat_cell = -1;
+  int64_t min_lon_cell = 0;
+  int64_t max_lon_cell = -1;
+};
+
+inline void SpatialGrid::add(size_t item, const BoundingBox & box)
+{
+  const int64_t first_lat_cell = get_cell(box.min_lat);
+  const int64_t last_lat_cell = get_cell(box.max_lat);
+  const int64_t first_lon_cell = get_cell(box.min_lon);
+  const int64_t last_lon_cell = get_cell(box.max_lon);
+  for (int64_t lat_cell = first_lat_cell; lat_cell <= last_lat_cell; ++lat_cell)
+  {
+    for (int64_t lon_cell = first_lon_cell; lon_cell <= last_lon_cell; ++lon_cell)
+      cells[get_key(lat_cell, lon_cell)].push_back(item);
+  }
+
+  const bool is_first = min_lat_cell > max_lat_cell;
+  min_lat_cell = is_first ? first_lat_cell : std::min(min_lat_cell, first_lat_cell);
+  max_lat_cell = is_first ? last_lat_cell : std::max(max_lat_cell, last_lat_cell);
+  min_lon_cell = is_first ? first_lon_cell : std::min(min_lon_cell, first_lon_cell);
+  max_lon_cell = is_first ? last_lon_cell : std::max(max_lon_cell, last_lon_cell);
+}
+
+template <typename Handler>
+void SpatialGrid::for_each_item_in_cell(int64_t lat_cell, int64_t lon_cell,
+                                        Handler & handler) const
+{
+  const auto it = cells.find(get_key(lat_cell, lon_cell));
+  if (it == cells.end())
+    return;
+  for (const size_t item : it->second)
+    handler(item);
+}
+
+template <typename Handler>
+void SpatialGrid::for_each_item(const BoundingBox & box, Handler handler) const
+{
+  if (empty())
+    return;
+
+  // Boxes larger than the grid are clipped by the range of the non-empty cells.
+  const int64_t first_lat_cell = std::max(get_cell(box.min_lat), min_lat_cell);
+  const int64_t last_lat_cell = std::min(get_cell(box.max_lat), max_lat_cell);
+  const int64_t first_lon_cell = std::max(get_cell(box.min_lon), min_lon_cell);
+  const int64_t last_lon_cell = std::min(get_cell(box.max_lon), max_lon_cell);
+  for (int64_t lat_cell = first_lat_cell; lat_cell <= last_lat_cell; ++lat_cell)
+  {
+    for (int64_t lon_cell = first_lon_cell; lon_cell <= last_lon_cell; ++lon_cell)
+      for_each_item_in_cell(lat_cell, lon_cell, handler);
+  }
+}
+
+template <typename Handler>
+void SpatialGrid::for_each_item_in_ring(double lat, double lon, int64_t radius,
+                                        Handler handler) const
+{
+  const int64_t lat_cell = get_cell(lat);
+  const int64_t lon_cell = get_cell(lon);
+  if (radius == 0)
+  {
+    for_each_item_in_cell(lat_cell, lon_cell, handler);
+    return;
+  }
+
+  // Sides of the ring are clipped by the range of the non-empty cells.
+  const int64_t first_lon_cell = std::max(lon_cell - radius, min_lon_cell);
+  const int64_t last_lon_cell = std::min(lon_cell + radius, max_lon_cell);
+  for (const int64_t side_lat_cell : {lat_cell - radius, lat_cell + radius})
+  {
+    if (side_lat_cell < min_lat_cell || side_lat_cell > max_lat_cell)
+      continue;
+    for (int64_t side_lon_cell = first_lon_cell; side_lon_cell <= last_lon_cell; ++side_lon_cell)
+      for_each_item_in_cell(side_lat_cell, side_lon_cell, handler);
+  }
+
+  const int64_t first_lat_cell = std::max(lat_cell - radius + 1, min_lat_cell);
+  const int64_t last_lat_cell = std::min(lat_cell + radius - 1, max_lat_cell);
+  for (const int64_t side_lon_cell : {lon_cell - radius, lon_cell + radius})
+  {
+    if (side_lon_cell < min_lon_cell || side_lon_cell > max_lon_cell)
+      continue;
+    for (int64_t side_lat_cell = first_lat_cell; side_lat_cell <= last_lat_cell; ++side_lat_cell)
+      for_each_item_in_cell(side_lat_cell, side_lon_cell, handler);
+  }
+}
+
+inline int64_t SpatialGrid::get_min_radius(double lat, double lon) const
+{
+  if (empty())
+    return 0;
+
+  const int64_t lat_cell = get_cell(lat);
+  const int64_t lon_cell = get_cell(lon);
+  return std::max({min_lat_cell - lat_cell, lat_cell - max_lat_cell, min_lon_cell - lon_cell,
+                   lon_cell - max_lon_cell, int64_t(0)});
+}
+
+inline int64_t SpatialGrid::get_max_radius(double lat, double lon) const
+{
+  if (empty())
+    return -1;
+
+  const int64_t lat_cell = get_cell(lat);
+  const int64_t lon_cell = get_cell(lon);
+  return std::max({lat_cell - min_lat_cell, max_lat_cell - lat_cell, lon_cell - min_lon_cell,
+                   max_lon_cell - lon_cell, int64_t(0)});
+}
+
+class Feed
+{
+public:
+  inline Feed() = default;
+  // Path is the directory with the feed files or the zip archive with them. Files absent in the
+  // directory are also read from their gzip (and zstd if JUST_GTFS_USE_ZSTD is defined) copies,
+  // e.g. stop_times.txt.gz.
+  inline explicit Feed(const std::string & gtfs_path,
+                       StorageLayout storage_layout = StorageLayout::Rows);
+  // Feed files are read from the source, e.g. from the archive in memory.
+  inline explicit Feed(std::shared_ptr<FeedSource> feed_source,
+                       StorageLayout storage_layout = StorageLayout::Rows);
+#if defined(JUST_GTFS_PMR)
+  // Entities, their columns and indexes are allocated from the resource, e.g. from the
+  // std::pmr::monotonic_buffer_resource. The resource must outlive the feed. Copies of the feed
+  // use the default resource.
+  inline explicit Feed(std::pmr::memory_resource * resource);
+  inline Feed(const std::string & gtfs_path, StorageLayout storage_layout,
+              std::pmr::memory_resource * resource);
+  inline Feed(std::shared_ptr<FeedSource> feed_source, StorageLayout storage_layout,
+              std::pmr::memory_resource * resource);
+  inline std::pmr::memory_resource * get_memory_resource() const;
+#endif
+
+  inline StorageLayout get_storage_layout() const;
+
+  // Builds hash indexes for searching agencies, stops, routes, trips, calendar items, transfers
+  // and levels by their ids in constant time. Indexes are kept up to date by the add_*() methods.
+  inline void build_indexes();
+  inline bool has_indexes() const;
+
+  // Groups stop times by trip (sorted by stop_sequence) and by stop (sorted by departure_time)
+  // for the get_stop_times_range_for_*() methods. Reading or adding stop times drops the grouping.
+  inline void build_stop_times_index();
+  inline bool has_stop_times_index() const;
+
+  // Merges calendar and calendar_dates into the days on which each service is active between the
+  // first and the last dates of the feed. Reading or adding calendar items or dates drops it.
+  inline void build_service_days_index();
+  inline bool has_service_days_index() const;
+  // Check the service in constant time. build_service_days_index() must be called beforehand.
+  inline bool is_service_active(const Id & service_id, const Date & date) const;
+  inline Trips get_active_trips(const Date & date) const;
+
+  // Departures of the frequency-based trip from its first stop in [start_time, end_time) with the
+  // headways of its frequencies. build_stop_times_index() must be called beforehand since the
+  // departures are computed on access from the stop times of the trip.
+  inline TripInstances get_trip_instances(const Id & trip_id, const Time & start_time,
+                                          const Time & end_time) const;
+  // Departures of all frequency-based trips in the order of frequencies.txt.
+  inline TripInstances get_trip_instances(const Time & start_time, const Time & end_time) const;
+
+  // Groups shape points by shape_id into contiguous arrays sorted by shape_pt_sequence for
+  // get_shape_polyline() and get_shape(). Reading or adding shapes drops the grouping.
+  inline void build_shapes_index();
+  inline bool has_shapes_index() const;
+  // Returns the points without copying. build_shapes_index() must be called beforehand.
+  inline ShapePolyline get_shape_polyline(const Id & shape_id) const;
+
+  // Builds the grid over the shape segments and the stop coordinates with the cells of
+  // cell_size degrees. The shapes index is built too. Reading or adding stops or shapes drops it.
+  inline void build_spatial_index(double cell_size = 0.01);
+  inline bool has_spatial_index() const;
+  // Queries of the grid. build_spatial_index() must be called beforehand.
+  // Ids of shapes with segments intersecting the box in the order of shapes.
+  inline std::vector<Id> get_shapes_in_box(const BoundingBox & box) const;
+  inline Stops get_stops_in_box(const BoundingBox & box) const;
+  // Stop with coordinates nearest to the point or nullopt if there are no such stops.
+  inline std::optional<Stop> get_nearest_stop(double lat, double lon) const;
+
+  inline Result read_feed();
+  inline Result read_feed(const ReadFeedOptions & options);
+  // Reads the files postponed by ReadFeedOptions::lazy_files which are not accessed yet. Returns
+  // the first error of reading the postponed files, including the ones read on access.
+  inline Result read_lazy_files();
+
+  // Collects FileLoadStats of each csv file read after the call and passes them to the hook if
+  // it is set. The hook is called by the reading threads and may run on several threads at the
+  // same time, so it must be thread-safe. It may call get_load_stats(). Copies of the feed share
+  // the collected stats.
+  inline void enable_load_stats(const LoadStatsHook & hook = {});
+  inline void disable_load_stats();
+  // Stats of the files read since enable_load_stats() in the order of finishing the reading.
+  inline std::vector<FileLoadStats> get_load_stats() const;
+
+  // Writes required files and optional files with entities.
+  inline Result write_feed(const std::string & gtfs_path) const;
+  // Writes files in parallel with the same output as the serial writing.
+  inline Result write_feed(const std::string & gtfs_path, const WriteFeedOptions & options) const;
+
+  // Saves all entities to the binary cache file which is loaded faster than the csv files.
+  inline Result save_snapshot(const std::string & path) const;
+  // Replaces all entities with the ones from the snapshot. The feed is not changed on error.
+  // Entities are decoded from the mapped file without parsing the text, but each entity and its
+  // strings are still built, so the load time grows with the count of entities.
+  inline Result load_snapshot(const std::string & path);
+
+  // Re-reads the files changed since they were read. Files in the directory are compared by size
+  // and modification time and then by CRC-32 of the contents if it is taken on the previous
+  // refresh, so the files touched again are not parsed. Files in the archive are compared by
+  // CRC-32 of the entries. Only the files read before are checked and only the built indexes
+  // depending on the re-read files are rebuilt. If the diff is set it gets the differences of the
+  // re-read files. The feed is not changed on error.
+  inline Result refresh(FeedDiff * diff = nullptr);
+  // Differences of the records of all files from this feed to the new one.
+  inline FeedDiff get_diff(const Feed & new_feed) const;
+
+  // Checks that the ids referred by the records exist: trip_id and stop_id of stop times,
+  // route_id, service_id and shape_id of trips, parent_station and level_id of stops and the ids
+  // in the other files. Empty optional references are valid. Checks of the files and chunks of
+  // stop times run on threads_count threads (0 means hardware concurrency). Returns
+  // ERROR_INVALID_REFERENCE with the total count of broken references, the errors get the counts
+  // by fields in the order of the checks.
+  inline Result validate(std::vector<ValidationError> * errors = nullptr,
+                         size_t threads_count = 0) const;
+
+  // Converts trips into the timetable for routing. Stop times of the trips are sorted by
+  // stop_sequence and absent times are interpolated by the count of stops between the provided
+  // ones. Trips with less than 2 stop times are skipped. Footpaths are made of transfers which
+  // are possible with min_transfer_time and of pathways with traversal_time, the ones between
+  // stops absent in stops.txt are skipped. Trips are converted in parallel. Returns
+  // ERROR_INVALID_REFERENCE for the absent routes of trips, trips of stop times and frequencies
+  // and stops of stop times and ERROR_REQUIRED_FIELD_ABSENT for the trips without times at the
+  // first or the last stop. The timetable is not changed on error.
+  inline Result build_timetable(Timetable & timetable, const TimetableOptions & options = {}) const;
+
+  // Appends the entities of the other feed with the ids changed by the policy and the references
+  // to them changed accordingly. Ids of the same kind, e.g. service_id of calendar and
+  // calendar_dates, are changed in the same way. Duplicates of the existing agencies, fare
+  // attributes and stops are skipped together with their translations. Feed info of the other
+  // feed is taken if the feed has none. Files are merged in parallel and the built indexes are
+  // rebuilt. Returns ERROR_DUPLICATE_ID if the changed ids of the other feed exist in the feed
+  // or in the other feed. The feed is not changed on error.
+  inline Result merge(const Feed & other, const MergePolicy & policy = {});
+
+  inline Result read_agencies();
+  inline Result write_agencies(const std::string & gtfs_path) const;
+
+  inline const Agencies & get_agencies() const;
+  inline std::optional<Agency> get_agency(const Id & agency_id) const;
+  // Returns the agency in the feed without copying it or nullptr. As for the other find_*()
+  // methods, the pointer is invalidated by reading or adding entities of the same type.
+  inline const Agency * find_agency(const Id & agency_id) const;
+  // Rvalue overloads of add_*() move the entities into the feed instead of copying them.
+  inline void add_agency(const Agency & agency);
+  inline void add_agency(Agency && agency);
+
+  inline Result read_stops();
+  inline Result write_stops(const std::string & gtfs_path) const;
+
+  inline const Stops & get_stops() const;
+  inline std::optional<Stop> get_stop(const Id & stop_id) const;
+  inline const Stop * find_stop(const Id & stop_id) const;
+  inline void add_stop(const Stop & stop);
+  inline void add_stop(Stop && stop);
+
+  inline Result read_routes();
+  inline Result write_routes(const std::string & gtfs_path) const;
+
+  inline const Routes & get_routes() const;
+  inline std::optional<Route> get_route(const Id & route_id) const;
+  inline const Route * find_route(const Id & route_id) const;
+  inline void add_route(const Route & route);
+  inline void add_route(Route && route);
+
+  inline Result read_trips();
+  inline Result write_trips(const std::string & gtfs_path) const;
+
+  inline const Trips & get_trips() const;
+  inline std::optional<Trip> get_trip(const Id & trip_id) const;
+  inline const Trip * find_trip(const Id & trip_id) const;
+  inline void add_trip(const Trip & trip);
+  inline void add_trip(Trip && trip);
+
+  inline Result read_stop_times();
+  // Splits the file into chunks parsed on threads_count threads (0 means hardware concurrency).
+  inline Result read_stop_times(size_t threads_count);
+  inline Result write_stop_times(const std::string & gtfs_path) const;
+  // Formats chunks of records on threads_count threads (0 means hardware concurrency).
+  inline Result write_stop_times(const std::string & gtfs_path, size_t threads_count) const;
+
+  inline const StopTimes & get_stop_times() const;
+  inline const ColumnarStopTimes & get_columnar_stop_times() const;
+  inline StopTimes get_stop_times_for_stop(const Id & stop_id) const;
+  inline StopTimes get_stop_times_for_trip(const Id & trip_id, bool sort_by_sequence = true) const;
+  // Return stop times without copying. build_stop_times_index() must be called beforehand.
+  inline StopTimesRange get_stop_times_range_for_stop(const Id & stop_id) const;
+  inline StopTimesRange get_stop_times_range_for_trip(const Id & trip_id) const;
+  inline void add_stop_time(const StopTime & stop_time);
+  inline void add_stop_time(StopTime && stop_time);
+  // Passes each record of stop_times.txt to the handler without storing it in the feed. The file
+  // is read line by line into the same StopTime object, so memory doesn't depend on file size.
+  inline Result for_each_stop_time(const std::function<void(const StopTime & stop_time)> & handler);
+
+  inline Result read_calendar();
+  inline Result write_calendar(const std::string & gtfs_path) const;
+
+  inline const Calendar & get_calendar() const;
+  inline std::optional<CalendarItem> get_calendar(const Id & service_id) const;
+  inline const CalendarItem * find_calendar(const Id & service_id) const;
+  inline void add_calendar_item(const CalendarItem & calendar_item);
+  inline void add_calendar_item(CalendarItem && calendar_item);
+
+  inline Result read_calendar_dates();
+  inline Result write_calendar_dates(const std::string & gtfs_path) const;
+
+  inline const CalendarDates & get_calendar_dates() const;
+  inline CalendarDates get_calendar_dates(const Id & service_id, bool sort_by_date = true) const;
+  inline void add_calendar_date(const CalendarDate & calendar_date);
+  inline void add_calendar_date(CalendarDate && calendar_date);
+
+  inline Result read_fare_rules();
+  inline Result write_fare_rules(const std::string & gtfs_path) const;
+
+  inline const FareRules & get_fare_rules() const;
+  inline FareRules get_fare_rules(const Id & fare_id) const;
+  inline void add_fare_rule(const FareRule & fare_rule);
+  inline void add_fare_rule(FareRule && fare_rule);
+
+  inline Result read_fare_attributes();
+  inline Result write_fare_attributes(const std::string & gtfs_path) const;
+
+  inline const FareAttributes & get_fare_attributes() const;
+  inline FareAttributes get_fare_attributes(const Id & fare_id) const;
+  inline void add_fare_attributes(const FareAttributesItem & fare_attributes_item);
+  inline void add_fare_attributes(FareAttributesItem && fare_attributes_item);
+
+  inline Result read_shapes();
+  // Splits the file into chunks parsed on threads_count threads (0 means hardware concurrency).
+  inline Result read_shapes(size_t threads_count);
+  inline Result write_shapes(const std::string & gtfs_path) const;
+  inline Result write_shapes(const std::string & gtfs_path, size_t threads_count) const;
+
+  inline const Shapes & get_shapes() const;
+  inline const ColumnarShapes & get_columnar_shapes() const;
+  inline Shape get_shape(const Id & shape_id, bool sort_by_sequence = true) const;
+  inline void add_shape(const ShapePoint & shape);
+  inline void add_shape(ShapePoint && shape);
+  // Passes each record of shapes.txt to the handler without storing it in the feed.
+  inline Result for_each_shape_point(const std::function<void(const ShapePoint & point)> & handler);
+
+  inline Result read_frequencies();
+  inline Result write_frequencies(const std::string & gtfs_path) const;
+
+  inline const Frequencies & get_frequencies() const;
+  inline Frequencies get_frequencies(const Id & trip_id) const;
+  inline void add_frequency(const Frequency & frequency);
+  inline void add_frequency(Frequency && frequency);
+
+  inline Result read_transfers();
+  inline Result write_transfers(const std::string & gtfs_path) const;
+
+  inline const Transfers & get_transfers() const;
+  inline std::optional<Transfer> get_transfer(const Id & from_stop_id, const Id & to_stop_id) const;
+  inline const Transfer * find_transfer(const Id & from_stop_id, const Id & to_stop_id) const;
+  inline void add_transfer(const Transfer & transfer);
+  inline void add_transfer(Transfer && transfer);
+
+  inline Result read_pathways();
+  inline Result write_pathways(const std::string & gtfs_path) const;
+
+  inline const Pathways & get_pathways() const;
+  inline Pathways get_pathways(const Id & pathway_id) const;
+  inline Pathways get_pathways(const Id & from_stop_id, const Id & to_stop_id) const;
+  inline void add_pathway(const Pathway & pathway);
+  inline void add_pathway(Pathway && pathway);
+
+  inline Result read_levels();
+  inline Result write_levels(const std::string & gtfs_path) const;
+
+  inline const Levels & get_levels() const;
+  inline std::optional<Level> get_level(const Id & level_id) const;
+  inline const Level * find_level(const Id & level_id) const;
+  inline void add_level(const Level & level);
+  inline void add_level(Level && level);
+
+  inline Result read_feed_info();
+  inline Result write_feed_info(const std::string & gtfs_path) const;
+
+  inline const FeedInfo & get_feed_info() const;
+  inline void set_feed_info(const FeedInfo & feed_info);
+  inline void set_feed_info(FeedInfo && feed_info);
+
+  inline Result read_translations();
+  inline Result write_translations(const std::string & gtfs_path) const;
+
+  inline const Translations & get_translations() const;
+  inline Translations get_translations(const Text & table_name) const;
+  inline void add_translation(const Translation & translation);
+  inline void add_translation(Translation && translation);
+
+  inline Result read_attributions();
+  inline Result write_attributions(const std::string & gtfs_path) const;
+
+  inline const Attributions & get_attributions() const;
+  inline void add_attribution(const Attribution & attribution);
+  inline void add_attribution(Attribution && attribution);
+
+private:
+  struct FeedFile
+  {
+    const std::string * name = nullptr;
+    // Readers don't drop the indexes built from the file, see drop_file_indexes().
+    Result (Feed::*read)() = nullptr;
+    bool is_required = false;
+    // Reading of the large files in parallel chunks:
+    Result (Feed::*read_in_chunks)(size_t threads_count) = nullptr;
+    Result (Feed::*write)(const std::string & gtfs_path) const = nullptr;
+    Result (Feed::*write_in_chunks)(const std::string & gtfs_path, size_t threads_count) const =
+        nullptr;
+    // Count of entities written to the file.
+    size_t (*get_entities_count)(const Feed & feed) = nullptr;
+    // Moves the entities of the file to the other feed on refresh.
+    void (*move_entities)(Feed & from, Feed & to) = nullptr;
+    FileDiff (*get_diff)(const Feed & old_feed, const Feed & new_feed) = nullptr;
+  };
+
+  inline static const std::vector<FeedFile> & get_feed_files();
+
+  // Files postponed by ReadFeedOptions::lazy_files. Copies of the feed have their own mutex.
+  struct LazyFiles
+  {
+    LazyFiles() = default;
+    inline LazyFiles(const LazyFiles & other);
+    inline LazyFiles & operator=(const LazyFiles & other);
+
+    mutable std::recursive_mutex mutex;
+    // Checked without locking on each access to the entities.
+    std::atomic<size_t> pending_count{0};
+    std::vector<const FeedFile *> pending;
+    Result result;
+  };
+
+  inline void load_lazy_file(const std::string & file) const;
+  inline void load_lazy_files() const;
+
+  // Fingerprints of the files taken before reading them. Copies of the feed have their own mutex.
+  struct FileFingerprints
+  {
+    FileFingerprints() = default;
+    inline FileFingerprints(const FileFingerprints & other);
+    inline FileFingerprints & operator=(const FileFingerprints & other);
+
+    mutable std::mutex mutex;
+    std::map<std::string, FileFingerprint> files;
+  };
+
+  inline void take_fingerprint(const std::string & filename);
+  inline FileFingerprint get_fingerprint(const std::string & filename, bool compute_crc) const;
+
+  // Indexes built before replacing the entities. Only the dropped ones are rebuilt.
+  struct BuiltIndexes
+  {
+    bool indexes = false;
+    bool stop_times_index = false;
+    bool service_days_index = false;
+    bool shapes_index = false;
+    bool spatial_index = false;
+    double cell_size = 0.0;
+  };
+
+  inline BuiltIndexes get_built_indexes() const;
+  inline void rebuild_indexes(const BuiltIndexes & built);
+  // Builds the ids index of the entities of the file if they have it.
+  inline void build_file_index(const std::string & filename);
+  // Drops the flags of the indexes built from the entities of the file. The flags are dropped by
+  // the thread starting the reading, so the readers of the files in parallel don't write them.
+  inline void drop_file_indexes(const std::string & filename);
+
+  // Calls the function with the container of stop times or shapes of the storage layout.
+  template <typename Function>
+  static auto visit_stop_times(const Feed & feed, Function && function);
+  template <typename Function>
+  static auto visit_shapes(const Feed & feed, Function && function);
+
+  struct LoadStats
+  {
+    std::mutex mutex;
+    LoadStatsHook hook;
+    std::vector<FileLoadStats> files;
+  };
+
+  inline void add_load_stats(const std::string & filename, FileLoadStats & stats,
+                             std::chrono::steady_clock::time_point start, size_t start_memory,
+                             bool has_container) const;
+  inline ColumnIndex get_column_index(const std::string & filename,
+                                      const std::vector<std::string> & columns,
+                                      const std::vector<std::string> & header) const;
+
+  inline void add_to_index(IdIndex & index, const Id & id, size_t position);
+  // Returns the empty container or index allocated from the memory resource of the feed.
+  template <typename Container, typename... Args>
+  Container make_container(Args &&... args) const
+  {
+#if defined(JUST_GTFS_PMR)
+    return Container(std::forward<Args>(args)..., get_memory_resource());
+#else
+    return Container(std::forward<Args>(args)...);
+#endif
+  }
+  inline StopTimesRange get_stop_times_range(const StopTimesGroups & index, const Id & id) const;
+
+  // Sets the directory of the feed or the zip archive as the source of the files.
+  inline void set_path(const std::string & gtfs_path);
+  // Opens the file in the source, in the directory or its compressed copy and reads its header.
+  inline Result open_csv(CsvParser & parser, const std::string & filename) const;
+  inline uintmax_t get_file_size(const std::string & filename) const;
+
+  // Entities container is reserved for the estimated rows count before parsing.
+  inline Result parse_csv(const std::string & filename, const std::vector<std::string> & columns,
+                          const std::function<Result(const ParsedCsvRow & record)> & add_entity,
+                          const std::function<void(size_t rows_count)> & reserve = {});
+
+  template <typename Entity, typename Container>
+  Result parse_csv_in_chunks(const std::string & filename, const std::vector<std::string> & columns,
+                             size_t threads_count,
+                             Result (*parse_entity)(const ParsedCsvRow & row, Entity & entity),
+                             Container & container);
+
+  inline Result write_csv(const std::string & path, const std::string & file,
+                          const std::vector<std::string> & columns,
+                          const std::function<void(CsvWriter & writer)> & write_entities) const;
+
+  template <typename Entity>
+  Result parse_csv_streaming(const std::string & filename, const std::vector<std::string> & columns,
+                             Result (*parse_entity)(const ParsedCsvRow & row, Entity & entity),
+                             const std::function<void(const Entity & entity)> & handler);
+
+  template <typename Container, typename RowWriter>
+  Result write_csv_in_chunks(const std::string & path, const std::string & file,
+                             const std::vector<std::string> & columns, const Container & container,
+                             size_t threads_count, RowWriter write_row) const;
+
+  inline Result parse_stops();
+  inline Result parse_stop_times();
+  inline Result parse_stop_times(size_t threads_count);
+  inline Result parse_calendar();
+  inline Result parse_calendar_dates();
+  inline Result parse_shapes();
+  inline Result parse_shapes(size_t threads_count);
+
+  // Entities of the parsed rows are added without dropping the indexes built from the file.
+  inline void push_stop(Stop && stop);
+  inline void push_stop_time(StopTime && stop_time);
+  inline void push_calendar_item(CalendarItem && calendar_item);
+  inline void push_calendar_date(CalendarDate && calendar_date);
+  inline void push_shape(ShapePoint && shape);
+
+  inline Result add_agency(const ParsedCsvRow & row);
+  inline Result add_route(const ParsedCsvRow & row);
+  inline Result add_shape(const ParsedCsvRow & row);
+  inline static Result parse_shape_point(const ParsedCsvRow & row, ShapePoint & point);
+  inline Result add_trip(const ParsedCsvRow & row);
+  inline Result add_stop(const ParsedCsvRow & row);
+  inline Result add_stop_time(const ParsedCsvRow & row);
+  inline static Result parse_stop_time(const ParsedCsvRow & row, StopTime & stop_time);
+  inline Result add_calendar_item(const ParsedCsvRow & row);
+  inline Result add_calendar_date(const ParsedCsvRow & row);
+  inline Result add_transfer(const ParsedCsvRow & row);
+  inline Result add_frequency(const ParsedCsvRow & row);
+  inline Result add_fare_attributes(const ParsedCsvRow & row);
+  inline Result add_fare_rule(const ParsedCsvRow & row);
+  inline Result add_pathway(const ParsedCsvRow & row);
+  inline Result add_level(const ParsedCsvRow & row);
+  inline Result add_feed_info(const ParsedCsvRow & row);
+  inline Result add_translation(const ParsedCsvRow & row);
+  inline Result add_attribution(const ParsedCsvRow & row);
+
+  inline void write_agencies(CsvWriter & writer) const;
+  inline void write_routes(CsvWriter & writer) const;
+  inline void write_shapes(CsvWriter & writer) const;
+  inline void write_trips(CsvWriter & writer) const;
+  inline void write_stops(CsvWriter & writer) const;
+  inline void write_stop_times(CsvWriter & writer) const;
+  inline void write_calendar(CsvWriter & writer) const;
+  inline void write_calendar_dates(CsvWriter & writer) const;
+  inline void write_transfers(CsvWriter & writer) const;
+  inline void write_frequencies(CsvWriter & writer) const;
+  inline void write_fare_attributes(CsvWriter & writer) const;
+  inline void write_fare_rules(CsvWriter & writer) const;
+  inline void write_pathways(CsvWriter & writer) const;
+  inline void write_levels(CsvWriter & writer) const;
+  inline void write_feed_info(CsvWriter & writer) const;
+  inline void write_translations(CsvWriter & writer) const;
+  inline void write_attributions(CsvWriter & writer) const;
+
+protected:
+  std::string gtfs_directory;
+  // Files are read from the source instead of the directory if it is set.
+  std::shared_ptr<FeedSource> source;
+  StorageLayout storage_layout = StorageLayout::Rows;
+
+  Agencies agencies;
+  Stops stops;
+  Routes routes;
+  Trips trips;
+  StopTimes stop_times;
+  ColumnarStopTimes columnar_stop_times;
+
+  Calendar calendar;
+  CalendarDates calendar_dates;
+  FareRules fare_rules;
+  FareAttributes fare_attributes;
+  Shape shapes;
+  ColumnarShapes columnar_shapes;
+  Frequencies frequencies;
+  Transfers transfers;
+  Pathways pathways;
+  Levels levels;
+  Translations translations;
+  Attributions attributions;
+  FeedInfo feed_info;
+
+  bool indexes_built = false;
+  IdIndex agencies_index;
+  IdIndex stops_index;
+  IdIndex routes_index;
+  IdIndex trips_index;
+  IdIndex calendar_index;
+  // Positions of transfers by from_stop_id and then by to_stop_id.
+  EntityMap<Id, IdIndex> transfers_index;
+  IdIndex levels_index;
+
+  bool stop_times_index_built = false;
+  StopTimesGroups stop_times_by_trip;
+  StopTimesGroups stop_times_by_stop;
+
+  bool service_days_index_built = false;
+  ServiceDays service_days;
+
+  bool shapes_index_built = false;
+  ShapesGroups shapes_groups;
+
+  bool spatial_index_built = false;
+  // Items of the grids are positions of the first points of the segments in shapes_groups and
+  // positions of the stops.
+  SpatialGrid shapes_grid;
+  SpatialGrid stops_grid;
+
+  std::map<std::string, std::vector<std::string>> skipped_columns;
+  mutable LazyFiles lazy_files;
+  FileFingerprints fingerprints;
+  // Stats are collected while it is set.
+  std::shared_ptr<LoadStats> load_stats;
+};
+
+inline Feed::Feed(const std::string & gtfs_path, StorageLayout storage_layout)
+    : storage_layout(storage_layout)
+{
+  set_path(gtfs_path);
+}
+
+inline Feed::Feed(std::shared_ptr<FeedSource> feed_source, StorageLayout storage_layout)
+    : source(std::move(feed_source)), storage_layout(storage_layout)
+{
+}
+
+#if defined(JUST_GTFS_PMR)
+inline Feed::Feed(std::pmr::memory_resource * resource)
+    : agencies(resource),
+      stops(resource),
+      routes(resource),
+      trips(resource),
+      stop_times(resource),
+      columnar_stop_times(resource),
+      calendar(resource),
+      calendar_dates(resource),
+      fare_rules(resource),
+      fare_attributes(resource),
+      shapes(resource),
+      columnar_shapes(resource),
+      frequencies(resource),
+      transfers(resource),
+      pathways(resource),
+      levels(resource),
+      translations(resource),
+      attributions(resource),
+      agencies_index(resource),
+      stops_index(resource),
+      routes_index(resource),
+      trips_index(resource),
+      calendar_index(resource),
+      transfers_index(resource),
+      levels_index(resource),
+      stop_times_by_trip(resource),
+      stop_times_by_stop(resource),
+      service_days(resource),
+      shapes_groups(resource),
+      shapes_grid(resource),
+      stops_grid(resource)
+{
+}
+
+inline Feed::Feed(const std::string & gtfs_path, StorageLayout storage_layout,
+                  std::pmr::memory_resource * resource)
+    : Feed(resource)
+{
+  this->storage_layout = storage_layout;
+  set_path(gtfs_path);
+}
+
+inline Feed::Feed(std::shared_ptr<FeedSource> feed_source, StorageLayout storage_layout,
+                  std::pmr::memory_resource * resource)
+    : Feed(resource)
+{
+  source = std::move(feed_source);
+  this->storage_layout = storage_layout;
+}
+
+inline std::pmr::memory_resource * Feed::get_memory_resource() const
+{
+  return agencies.get_allocator().resource();
+}
+#endif
+
+inline void Feed::set_path(const std::string & gtfs_path)
+{
+  gtfs_directory = add_trailing_slash(gtfs_path);
+  std::error_code ec;
+  if (std::filesystem::is_regular_file(gtfs_path, ec))
+  {
+    gtfs_directory = gtfs_path;
+    source = std::make_shared<ZipArchive>(gtfs_path);
+  }
+}
+
+inline StorageLayout Feed::get_storage_layout() const { return storage_layout; }
+
+// Returns the entity with the id or nullptr. If the id is duplicated the first entity is
+// returned, as in the search without the index.
+template <typename Entity>
+const Entity * find_by_index(const EntityVector<Entity> & container, const IdIndex & index,
+                             const Id & id)
+{
+  const auto it = index.find(id);
+  if (it == index.end())
+    return nullptr;
+  return &container[it->second];
+}
+
+template <typename Entity>
+std::optional<Entity> to_optional(const Entity * entity)
+{
+  if (entity == nullptr)
+    return std::nullopt;
+  return *entity;
+}
+
+template <typename Entity>
+void build_index(IdIndex & index, const EntityVector<Entity> & container, Id Entity::*id)
+{
+  index.clear();
+  index.reserve(container.size());
+  for (size_t i = 0; i < container.size(); ++i)
+    index.emplace(container[i].*id, i);
+}
+
+inline void Feed::build_indexes()
+{
+  load_lazy_files();
+
+  for (const auto & file : get_feed_files())
+    build_file_index(*file.name);
+
+  indexes_built = true;
+}
+
+inline void Feed::build_file_index(const std::string & filename)
+{
+  if (filename == file_agency)
+    build_index(agencies_index, agencies, &Agency::agency_id);
+  else if (filename == file_stops)
+    build_index(stops_index, stops, &Stop::stop_id);
+  else if (filename == file_routes)
+    build_index(routes_index, routes, &Route::route_id);
+  else if (filename == file_trips)
+    build_index(trips_index, trips, &Trip::trip_id);
+  else if (filename == file_calendar)
+    build_index(calendar_index, calendar, &CalendarItem::service_id);
+  else if (filename == file_levels)
+    build_index(levels_index, levels, &Level::level_id);
+  else if (filename == file_transfers)
+  {
+    transfers_index.clear();
+    for (size_t i = 0; i < transfers.size(); ++i)
+      transfers_index[transfers[i].from_stop_id].emplace(transfers[i].to_stop_id, i);
+  }
+}
+
+inline void Feed::drop_file_indexes(const std::string & filename)
+{
+  if (filename == file_stops)
+    spatial_index_built = false;
+  else if (filename == file_stop_times)
+    stop_times_index_built = false;
+  else if (filename == file_calendar || filename == file_calendar_dates)
+    service_days_index_built = false;
+  else if (filename == file_shapes)
+  {
+    shapes_index_built = false;
+    spatial_index_built = false;
+  }
+}
+
+inline Feed::BuiltIndexes Feed::get_built_indexes() const
+{
+  BuiltIndexes res;
+  res.indexes = indexes_built;
+  res.stop_times_index = stop_times_index_built;
+  res.service_days_index = service_days_index_built;
+  res.shapes_index = shapes_index_built;
+  res.spatial_index = spatial_index_built;
+  res.cell_size = stops_grid.get_cell_size();
+  return res;
+}
+
+inline void Feed::rebuild_indexes(const BuiltIndexes & built)
+{
+  if (built.indexes && !indexes_built)
+    build_indexes();
+  if (built.stop_times_index && !stop_times_index_built)
+    build_stop_times_index();
+  if (built.service_days_index && !service_days_index_built)
+    build_service_days_index();
+  if (built.shapes_index && !shapes_index_built)
+    build_shapes_index();
+  if (built.spatial_index && !spatial_index_built)
+    build_spatial_index(built.cell_size);
+}
+
+inline bool Feed::has_indexes() const { return indexes_built; }
+
+inline void Feed::add_to_index(IdIndex & index, const Id & id, size_t position)
+{
+  if (indexes_built)
+    index.emplace(id, position);
+}
+
+// Fills the empty index which is allocated from the memory resource of the feed.
+template <typename Less>
+void group_stop_times(const StopTimes & stop_times, Id StopTime::*id, Less less,
+                      StopTimesGroups & res)
+{
+  std::vector<size_t> group_of_item(stop_times.size());
+  std::vector<size_t> counts;
+  for (size_t i = 0; i < stop_times.size(); ++i)
+  {
+    const auto [it, inserted] = res.groups.emplace(stop_times[i].*id, counts.size());
+    if (inserted)
+      counts.push_back(0);
+    group_of_item[i] = it->second;
+    ++counts[it->second];
+  }
+
+  res.offsets.resize(counts.size() + 1, 0);
+  for (size_t i = 0; i < counts.size(); ++i)
+    res.offsets[i + 1] = res.offsets[i] + counts[i];
+
+  // Positions are placed in the order of the container so that stop times with equal keys keep
+  // their order after the stable sort.
+  std::vector<size_t> filled(res.offsets.begin(), res.offsets.end() - 1);
+  res.permutation.resize(stop_times.size());
+  for (size_t i = 0; i < stop_times.size(); ++i)
+    res.permutation[filled[group_of_item[i]]++] = i;
+
+  for (size_t i = 0; i + 1 < res.offsets.size(); ++i)
+  {
+    std::stable_sort(res.permutation.begin() + res.offsets[i],
+                     res.permutation.begin() + res.offsets[i + 1],
+                     [&](size_t lhs, size_t rhs) {
+                       return less(stop_times[lhs], stop_times[rhs]);
+                     });
+  }
+}
+
+inline void Feed::build_stop_times_index()
+{
+  if (storage_layout == StorageLayout::Columns)
+    throw std::logic_error("Stop times index is not supported for the columnar storage");
+
+  load_lazy_file(file_stop_times);
+
+  auto by_sequence = [](const StopTime & t1, const StopTime & t2) {
+    return t1.stop_sequence < t2.stop_sequence;
+  };
+  auto by_departure = [](const StopTime & t1, const StopTime & t2) {
+    return t1.departure_time.get_total_seconds() < t2.departure_time.get_total_seconds();
+  };
+  StopTimesGroups by_trip = make_container<StopTimesGroups>();
+  StopTimesGroups by_stop = make_container<StopTimesGroups>();
+  group_stop_times(stop_times, &StopTime::trip_id, by_sequence, by_trip);
+  group_stop_times(stop_times, &StopTime::stop_id, by_departure, by_stop);
+  stop_times_by_trip = std::move(by_trip);
+  stop_times_by_stop = std::move(by_stop);
+  stop_times_index_built = true;
+}
+
+inline bool Feed::has_stop_times_index() const { return stop_times_index_built; }
+
+inline void Feed::build_service_days_index()
+{
+  load_lazy_file(file_calendar);
+  load_lazy_file(file_calendar_dates);
+
+  ServiceDays days = make_container<ServiceDays>();
+  bool has_dates = false;
+  int32_t last_day = 0;
+  auto extend_range = [&](const Date & date) {
+    if (!date.is_provided())
+      return;
+    const int32_t day = get_days_since_epoch(date);
+    days.first_day = has_dates ? std::min(days.first_day, day) : day;
+    last_day = has_dates ? std::max(last_day, day) : day;
+    has_dates = true;
+  };
+  for (const auto & item : calendar)
+  {
+    extend_range(item.start_date);
+    extend_range(item.end_date);
+  }
+  for (const auto & calendar_date : calendar_dates)
+    extend_range(calendar_date.date);
+
+  for (const auto & item : calendar)
+    days.services.emplace(item.service_id, days.services.size());
+  for (const auto & calendar_date : calendar_dates)
+    days.services.emplace(calendar_date.service_id, days.services.size());
+
+  days.days_count = has_dates ? static_cast<size_t>(last_day - days.first_day) + 1 : 0;
+  days.words_per_service = (days.days_count + 63) / 64;
+  days.words.assign(days.services.size() * days.words_per_service, 0);
+
+  for (const auto & item : calendar)
+  {
+    if (!item.start_date.is_provided() || !item.end_date.is_provided())
+      continue;
+
+    // Availability by the day of week starting from Monday.
+    const CalendarAvailability week[] = {item.monday, item.tuesday,  item.wednesday, item.thursday,
+                                         item.friday, item.saturday, item.sunday};
+    uint64_t * words = &days.words[days.services.at(item.service_id) * days.words_per_service];
+    const int32_t end_day = get_days_since_epoch(item.end_date);
+    for (int32_t day = get_days_since_epoch(item.start_date); day <= end_day; ++day)
+    {
+      // 1970-01-01 is Thursday.
+      const int32_t day_of_week = ((day % 7) + 10) % 7;
+      if (week[day_of_week] != CalendarAvailability::Available)
+        continue;
+
+      const auto bit = static_cast<size_t>(day - days.first_day);
+      words[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+  }
+
+  // Exceptions override the days of week regardless of the order of files.
+  for (const auto & calendar_date : calendar_dates)
+  {
+    if (!calendar_date.date.is_provided())
+      continue;
+
+    uint64_t * words =
+        &days.words[days.services.at(calendar_date.service_id) * days.words_per_service];
+    const auto bit = static_cast<size_t>(get_days_since_epoch(calendar_date.date) - days.first_day);
+    const uint64_t mask = uint64_t(1) << (bit % 64);
+    if (calendar_date.exception_type == CalendarDateException::Added)
+      words[bit / 64] |= mask;
+    else
+      words[bit / 64] &= ~mask;
+  }
+
+  service_days = std::move(days);
+  service_days_index_built = true;
+}
+
+inline bool Feed::has_service_days_index() const { return service_days_index_built; }
+
+inline bool Feed::is_service_active(const Id & service_id, const Date & date) const
+{
+  if (!service_days_index_built)
+    throw std::logic_error("Service days index is not built");
+
+  if (!date.is_provided())
+    return false;
+
+  const auto it = service_days.services.find(service_id);
+  if (it == service_days.services.end())
+    return false;
+
+  const int64_t bit = int64_t(get_days_since_epoch(date)) - service_days.first_day;
+  if (bit < 0 || bit >= static_cast<int64_t>(service_days.days_count))
+    return false;
+
+  const uint64_t word =
+      service_days.words[it->second * service_days.words_per_service + size_t(bit) / 64];
+  return (word >> (size_t(bit) % 64)) & 1;
+}
+
+inline TripInstances Feed::get_trip_instances(const Id & trip_id, const Time & start_time,
+                                               const Time & end_time) const
+{
+  load_lazy_file(file_frequencies);
+  const StopTimesRange stop_times = get_stop_times_range_for_trip(trip_id);
+  TripInstances res;
+  for (const auto & frequency : frequencies)
+  {
+    if (frequency.trip_id == trip_id)
+    {
+      res.add_frequency(stop_times, frequency, start_time.get_total_seconds(),
+                        end_time.get_total_seconds());
+    }
+  }
+  return res;
+}
+
+inline TripInstances Feed::get_trip_instances(const Time & start_time, const Time & end_time) const
+{
+  load_lazy_file(file_frequencies);
+  TripInstances res;
+  for (const auto & frequency : frequencies)
+  {
+    res.add_frequency(get_stop_times_range_for_trip(frequency.trip_id), frequency,
+                      start_time.get_total_seconds(), end_time.get_total_seconds());
+  }
+  return res;
+}
+
+inline Trips Feed::get_active_trips(const Date & date) const
+{
+  if (!service_days_index_built)
+    throw std::logic_error("Service days index is not built");
+
+  load_lazy_file(file_trips);
+
+  // Each service is checked once for all of its trips.
+  std::vector<bool> is_active(service_days.services.size());
+  for (const auto & [service_id, position] : service_days.services)
+    is_active[position] = is_service_active(service_id, date);
+
+  Trips res;
+  for (const auto & trip : trips)
+  {
+    const auto it = service_days.services.find(trip.service_id);
+    if (it != service_days.services.end() && is_active[it->second])
+      res.push_back(trip);
+  }
+  return res;
+}
+
+// Works with both storage layouts: rows of the columnar shapes have the fields of ShapePoint.
+// Fills the empty index which is allocated from the memory resource of the feed.
+template <typename Container>
+void group_shape_points(const Container & points, ShapesGroups & res)
+{
+  std::vector<size_t> group_of_point(points.size());
+  std::vector<size_t> counts;
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    const auto & point = points[i];
+    const auto [it, inserted] = res.groups.emplace(point.shape_id, counts.size());
+    if (inserted)
+    {
+      counts.push_back(0);
+      res.shape_ids.push_back(point.shape_id);
+    }
+    group_of_point[i] = it->second;
+    ++counts[it->second];
+  }
+
+  res.offsets.resize(counts.size() + 1, 0);
+  for (size_t i = 0; i < counts.size(); ++i)
+    res.offsets[i + 1] = res.offsets[i] + counts[i];
+
+  std::vector<size_t> filled(res.offsets.begin(), res.offsets.end() - 1);
+  std::vector<size_t> permutation(points.size());
+  for (size_t i = 0; i < points.size(); ++i)
+    permutation[filled[group_of_point[i]]++] = i;
+
+  for (size_t i = 0; i + 1 < res.offsets.size(); ++i)
+  {
+    std::stable_sort(permutation.begin() + res.offsets[i],
+                     permutation.begin() + res.offsets[i + 1], [&](size_t lhs, size_t rhs) {
+                       return points[lhs].shape_pt_sequence < points[rhs].shape_pt_sequence;
+                     });
+  }
+
+  res.lats.reserve(points.size());
+  res.lons.reserve(points.size());
+  res.sequences.reserve(points.size());
+  res.dist_traveled.reserve(points.size());
+  for (const size_t i : permutation)
+  {
+    const auto & point = points[i];
+    res.lats.push_back(point.shape_pt_lat);
+    res.lons.push_back(point.shape_pt_lon);
+    res.sequences.push_back(point.shape_pt_sequence);
+    res.dist_traveled.push_back(point.shape_dist_traveled);
+  }
+}
+
+inline void Feed::build_shapes_index()
+{
+  load_lazy_file(file_shapes);
+
+  ShapesGroups groups = make_container<ShapesGroups>();
+  if (storage_layout == StorageLayout::Columns)
+    group_shape_points(columnar_shapes, groups);
+  else
+    group_shape_points(shapes, groups);
+  shapes_groups = std::move(groups);
+  shapes_index_built = true;
+}
+
+inline bool Feed::has_shapes_index() const { return shapes_index_built; }
+
+inline ShapePolyline Feed::get_shape_polyline(const Id & shape_id) const
+{
+  if (!shapes_index_built)
+    throw std::logic_error("Shapes index is not built");
+
+  const auto it = shapes_groups.groups.find(shape_id);
+  if (it == shapes_groups.groups.end())
+    return ShapePolyline();
+
+  const size_t first = shapes_groups.offsets[it->second];
+  ShapePolyline res;
+  res.lats = shapes_groups.lats.data() + first;
+  res.lons = shapes_groups.lons.data() + first;
+  res.sequences = shapes_groups.sequences.data() + first;
+  res.dist_traveled = shapes_groups.dist_traveled.data() + first;
+  res.size = shapes_groups.offsets[it->second + 1] - first;
+  return res;
+}
+
+inline void Feed::build_spatial_index(double cell_size)
+{
+  if (!(cell_size > 0.0))
+    throw std::invalid_argument("Cell size of the spatial index must be positive");
+
+  load_lazy_file(file_stops);
+  if (!shapes_index_built)
+    build_shapes_index();
+
+  shapes_grid = make_container<SpatialGrid>(cell_size);
+  const auto & lats = shapes_groups.lats;
+  const auto & lons = shapes_groups.lons;
+  for (size_t group = 0; group + 1 < shapes_groups.offsets.size(); ++group)
+  {
+    const size_t first = shapes_groups.offsets[group];
+    const size_t last = shapes_groups.offsets[group + 1];
+    // Shape of the single point is added as the segment of zero length.
+    for (size_t i = first; i == first || i + 1 < last; ++i)
+    {
+      const size_t next = std::min(i + 1, last - 1);
+      shapes_grid.add(i, {std::min(lats[i], lats[next]), std::min(lons[i], lons[next]),
+                          std::max(lats[i], lats[next]), std::max(lons[i], lons[next])});
+    }
+  }
+
+  stops_grid = make_container<SpatialGrid>(cell_size);
+  for (size_t i = 0; i < stops.size(); ++i)
+  {
+    if (stops[i].coordinates_present)
+      stops_grid.add(i, {stops[i].stop_lat, stops[i].stop_lon, stops[i].stop_lat,
+                         stops[i].stop_lon});
+  }
+  spatial_index_built = true;
+}
+
+inline bool Feed::has_spatial_index() const { return spatial_index_built; }
+
+inline std::vector<Id> Feed::get_shapes_in_box(const BoundingBox & box) const
+{
+  if (!spatial_index_built)
+    throw std::logic_error("Spatial index is not built");
+
+  const auto & offsets = shapes_groups.offsets;
+  std::vector<bool> is_found(shapes_groups.shape_ids.size());
+  std::vector<size_t> found_groups;
+  shapes_grid.for_each_item(box, [&](size_t i) {
+    const size_t group =
+        static_cast<size_t>(std::upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin()) -
+        1;
+    if (is_found[group])
+      return;
+
+    const size_t next = std::min(i + 1, offsets[group + 1] - 1);
+    const auto & lats = shapes_groups.lats;
+    const auto & lons = shapes_groups.lons;
+    const BoundingBox segment{std::min(lats[i], lats[next]), std::min(lons[i], lons[next]),
+                              std::max(lats[i], lats[next]), std::max(lons[i], lons[next])};
+    if (!box.intersects(segment))
+      return;
+
+    is_found[group] = true;
+    found_groups.push_back(group);
+  });
+
+  std::sort(found_groups.begin(), found_groups.end());
+  std::vector<Id> res;
+  res.reserve(found_groups.size());
+  for (const size_t group : found_groups)
+    res.push_back(shapes_groups.shape_ids[group]);
+  return res;
+}
+
+inline Stops Feed::get_stops_in_box(const BoundingBox & box) const
+{
+  if (!spatial_index_built)
+    throw std::logic_error("Spatial index is not built");
+
+  std::vector<size_t> positions;
+  stops_grid.for_each_item(box, [&](size_t i) {
+    if (box.contains(stops[i].stop_lat, stops[i].stop_lon))
+      positions.push_back(i);
+  });
+
+  std::sort(positions.begin(), positions.end());
+  Stops res;
+  res.reserve(positions.size());
+  for (const size_t i : positions)
+    res.push_back(stops[i]);
+  return res;
+}
+
+inline std::optional<Stop> Feed::get_nearest_stop(double lat, double lon) const
+{
+  if (!spatial_index_built)
+    throw std::logic_error("Spatial index is not built");
+
+  // Distances are compared in degrees of latitude on the equirectangular projection around the
+  // point. It is precise enough for the distances covered by the grid cells.
+  const double lon_scale = std::cos(lat * 3.14159265358979323846 / 180.0);
+  std::optional<size_t> nearest;
+  double min_distance = 0.0;
+  // Rings between the point far from the grid and the grid are skipped.
+  const int64_t max_radius = stops_grid.get_max_radius(lat, lon);
+  for (int64_t radius = stops_grid.get_min_radius(lat, lon); radius <= max_radius; ++radius)
+  {
+    stops_grid.for_each_item_in_ring(lat, lon, radius, [&](size_t i) {
+      const double d_lat = stops[i].stop_lat - lat;
+      const double d_lon = (stops[i].stop_lon - lon) * lon_scale;
+      const double distance = std::sqrt(d_lat * d_lat + d_lon * d_lon);
+      // Stops with the equal distance are resolved in favor of the first one in stops.
+      if (!nearest || distance < min_distance || (distance == min_distance && i < *nearest))
+      {
+        nearest = i;
+        min_distance = distance;
+      }
+    });
+
+    // Stops outside of the rings are at least radius cells away from the point.
+    if (nearest && min_distance <= static_cast<double>(radius) * stops_grid.get_cell_size() *
+                                       std::min(lon_scale, 1.0))
+    {
+      break;
+    }
+  }
+
+  if (!nearest)
+    return std::nullopt;
+  return stops[*nearest];
+}
+
+inline StopTimesRange Feed::get_stop_times_range(const StopTimesGroups & index, const Id & id) const
+{
+  if (!stop_times_index_built)
+    throw std::logic_error("Stop times index is not built");
+
+  const auto it = index.groups.find(id);
+  if (it == index.groups.end())
+    return StopTimesRange();
+
+  const size_t * positions = index.permutation.data();
+  return StopTimesRange(stop_times, positions + index.offsets[it->second],
+                        positions + index.offsets[it->second + 1]);
+}
+
+inline bool ErrorParsingOptionalFile(const Result & res)
+{
+  return res != ResultCode::OK && res != ResultCode::ERROR_FILE_ABSENT;
+}
+
+template <typename Function>
+auto Feed::visit_stop_times(const Feed & feed, Function && function)
+{
+  if (feed.storage_layout == StorageLayout::Columns)
+    return function(feed.columnar_stop_times);
+  return function(feed.stop_times);
+}
+
+template <typename Function>
+auto Feed::visit_shapes(const Feed & feed, Function && function)
+{
+  if (feed.storage_layout == StorageLayout::Columns)
+    return function(feed.columnar_shapes);
+  return function(feed.shapes);
+}
+
+// Feed info without the required fields is not written and is the absent record in diffs.
+inline bool is_empty_feed_info(const FeedInfo & info)
+{
+  return info.feed_publisher_name.empty() && info.feed_publisher_url.empty() &&
+         info.feed_lang.empty();
+}
+
+// Entities are moved without copying: the feed getting them uses the same memory resource.
+template <typename Container>
+void move_container(Container & from, Container & to)
+{
+  to = std::move(from);
+  from.clear();
+}
+
+inline const std::vector<Feed::FeedFile> & Feed::get_feed_files()
+{
+  static const std::vector<FeedFile> files = {
+      // Required files:
+      {&file_agency, &Feed::read_agencies, true, nullptr, &Feed::write_agencies, nullptr,
+       [](const Feed & feed) { return feed.agencies.size(); },
+       [](Feed & from, Feed & to) { move_container(from.agencies, to.agencies); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_agency, old_feed.agencies, new_feed.agencies,
+                                  &Agency::agency_id);
+       }},
+      {&file_stops, &Feed::parse_stops, true, nullptr, &Feed::write_stops, nullptr,
+       [](const Feed & feed) { return feed.stops.size(); },
+       [](Feed & from, Feed & to) { move_container(from.stops, to.stops); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_stops, old_feed.stops, new_feed.stops, &Stop::stop_id);
+       }},
+      {&file_routes, &Feed::read_routes, true, nullptr, &Feed::write_routes, nullptr,
+       [](const Feed & feed) { return feed.routes.size(); },
+       [](Feed & from, Feed & to) { move_container(from.routes, to.routes); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_routes, old_feed.routes, new_feed.routes,
+                                  &Route::route_id);
+       }},
+      {&file_trips, &Feed::read_trips, true, nullptr, &Feed::write_trips, nullptr,
+       [](const Feed & feed) { return feed.trips.size(); },
+       [](Feed & from, Feed & to) { move_container(from.trips, to.trips); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_trips, old_feed.trips, new_feed.trips, &Trip::trip_id);
+       }},
+      {&file_stop_times, &Feed::parse_stop_times, true, &Feed::parse_stop_times,
+       &Feed::write_stop_times, &Feed::write_stop_times,
+       [](const Feed & feed) { return feed.stop_times.size() + feed.columnar_stop_times.size(); },
+       [](Feed & from, Feed & to) {
+         move_container(from.stop_times, to.stop_times);
+         move_container(from.columnar_stop_times, to.columnar_stop_times);
+       },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return visit_stop_times(old_feed, [&](const auto & old_stop_times) {
+           return visit_stop_times(new_feed, [&](const auto & new_stop_times) {
+             return get_entities_diff(file_stop_times, old_stop_times, new_stop_times,
+                                      &StopTime::trip_id);
+           });
+         });
+       }},
+
+      // Conditionally required files:
+      {&file_calendar, &Feed::parse_calendar, false, nullptr, &Feed::write_calendar, nullptr,
+       [](const Feed & feed) { return feed.calendar.size(); },
+       [](Feed & from, Feed & to) { move_container(from.calendar, to.calendar); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_calendar, old_feed.calendar, new_feed.calendar,
+                                  &CalendarItem::service_id);
+       }},
+      {&file_calendar_dates, &Feed::parse_calendar_dates, false, nullptr,
+       &Feed::write_calendar_dates, nullptr,
+       [](const Feed & feed) { return feed.calendar_dates.size(); },
+       [](Feed & from, Feed & to) { move_container(from.calendar_dates, to.calendar_dates); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_calendar_dates, old_feed.calendar_dates,
+                                  new_feed.calendar_dates, &CalendarDate::service_id);
+       }},
+
+      // Optional files:
+      {&file_shapes, &Feed::parse_shapes, false, &Feed::parse_shapes, &Feed::write_shapes,
+       &Feed::write_shapes,
+       [](const Feed & feed) { return feed.shapes.size() + feed.columnar_shapes.size(); },
+       [](Feed & from, Feed & to) {
+         move_container(from.shapes, to.shapes);
+         move_container(from.columnar_shapes, to.columnar_shapes);
+       },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return visit_shapes(old_feed, [&](const auto & old_shapes) {
+           return visit_shapes(new_feed, [&](const auto & new_shapes) {
+             return get_entities_diff(file_shapes, old_shapes, new_shapes, &ShapePoint::shape_id);
+           });
+         });
+       }},
+      {&file_transfers, &Feed::read_transfers, false, nullptr, &Feed::write_transfers, nullptr,
+       [](const Feed & feed) { return feed.transfers.size(); },
+       [](Feed & from, Feed & to) { move_container(from.transfers, to.transfers); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_transfers, old_feed.transfers, new_feed.transfers,
+                                  &Transfer::from_stop_id);
+       }},
+      {&file_frequencies, &Feed::read_frequencies, false, nullptr, &Feed::write_frequencies,
+       nullptr, [](const Feed & feed) { return feed.frequencies.size(); },
+       [](Feed & from, Feed & to) { move_container(from.frequencies, to.frequencies); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_frequencies, old_feed.frequencies, new_feed.frequencies,
+                                  &Frequency::trip_id);
+       }},
+      {&file_fare_attributes, &Feed::read_fare_attributes, false, nullptr,
+       &Feed::write_fare_attributes, nullptr,
+       [](const Feed & feed) { return feed.fare_attributes.size(); },
+       [](Feed & from, Feed & to) { move_container(from.fare_attributes, to.fare_attributes); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_fare_attributes, old_feed.fare_attributes,
+                                  new_feed.fare_attributes, &FareAttributesItem::fare_id);
+       }},
+      {&file_fare_rules, &Feed::read_fare_rules, false, nullptr, &Feed::write_fare_rules, nullptr,
+       [](const Feed & feed) { return feed.fare_rules.size(); },
+       [](Feed & from, Feed & to) { move_container(from.fare_rules, to.fare_rules); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_fare_rules, old_feed.fare_rules, new_feed.fare_rules,
+                                  &FareRule::fare_id);
+       }},
+      {&file_pathways, &Feed::read_pathways, false, nullptr, &Feed::write_pathways, nullptr,
+       [](const Feed & feed) { return feed.pathways.size(); },
+       [](Feed & from, Feed & to) { move_container(from.pathways, to.pathways); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_pathways, old_feed.pathways, new_feed.pathways,
+                                  &Pathway::pathway_id);
+       }},
+      {&file_levels, &Feed::read_levels, false, nullptr, &Feed::write_levels, nullptr,
+       [](const Feed & feed) { return feed.levels.size(); },
+       [](Feed & from, Feed & to) { move_container(from.levels, to.levels); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_levels, old_feed.levels, new_feed.levels,
+                                  &Level::level_id);
+       }},
+      {&file_attributions, &Feed::read_attributions, false, nullptr, &Feed::write_attributions,
+       nullptr, [](const Feed & feed) { return feed.attributions.size(); },
+       [](Feed & from, Feed & to) { move_container(from.attributions, to.attributions); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_attributions, old_feed.attributions,
+                                  new_feed.attributions, &Attribution::attribution_id);
+       }},
+      {&file_feed_info, &Feed::read_feed_info, false, nullptr, &Feed::write_feed_info, nullptr,
+       [](const Feed & feed) { return is_empty_feed_info(feed.feed_info) ? size_t(0) : size_t(1); },
+       [](Feed & from, Feed & to) {
+         to.feed_info = std::move(from.feed_info);
+         from.feed_info = FeedInfo();
+       },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         auto get_records = [](const Feed & feed) {
+           return is_empty_feed_info(feed.feed_info) ? std::vector<FeedInfo>()
+                                                     : std::vector<FeedInfo>{feed.feed_info};
+         };
+         return get_entities_diff(file_feed_info, get_records(old_feed), get_records(new_feed),
+                                  [](const FeedInfo &) { return Id(); });
+       }},
+      {&file_translations, &Feed::read_translations, false, nullptr, &Feed::write_translations,
+       nullptr, [](const Feed & feed) { return feed.translations.size(); },
+       [](Feed & from, Feed & to) { move_container(from.translations, to.translations); },
+       [](const Feed & old_feed, const Feed & new_feed) {
+         return get_entities_diff(file_translations, old_feed.translations,
+                                  new_feed.translations, &Translation::table_name);
+       }}};
+  return files;
+}
+
+inline Result Feed::read_feed()
 {
-  // Required:
-  Id route_id;
-  Id service_id;
-  Id trip_id;
+  for (const auto & file : get_feed_files())
+  {
+    drop_file_indexes(*file.name);
+    const Result res = (this->*file.read)();
+    if (file.is_required ? res != ResultCode::OK : ErrorParsingOptionalFile(res))
+      return res;
+  }
 
-  // Optional:
-  Text trip_headsign;
-  Text trip_short_name;
-  TripDirectionId direction_id = TripDirectionId::DefaultDirection;
-  Id block_id;
-  Id shape_id;
-  TripAccess wheelchair_accessible = TripAccess::NoInfo;
-  TripAccess bikes_allowed = TripAccess::NoInfo;
-};
+  return ResultCode::OK;
+}
 
-// Required dataset file
-struct StopTime
+inline Result Feed::read_feed(const ReadFeedOptions & options)
 {
-  // Required:
-  Id trip_id;
-  Id stop_id;
-  size_t stop_sequence = 0;
+  const auto & files = get_feed_files();
+  skipped_columns = options.skipped_columns;
 
-  // Conditionally required:
-  Time arrival_time;
+  auto contains = [](const std::vector<std::string> & names, const std::string & name) {
+    return std::find(names.begin(), names.end(), name) != names.end();
+  };
 
-  Time departure_time;
+  std::vector<size_t> read_files;
+  {
+    std::lock_guard<std::recursive_mutex> lock(lazy_files.mutex);
+    lazy_files.pending.clear();
+    lazy_files.result = ResultCode::OK;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+      if (contains(options.skipped_files, *files[i].name))
+        continue;
 
-  // Optional:
-  Text stop_headsign;
-  StopTimeBoarding pickup_type = StopTimeBoarding::RegularlyScheduled;
-  StopTimeBoarding drop_off_type = StopTimeBoarding::RegularlyScheduled;
+      if (contains(options.lazy_files, *files[i].name))
+        lazy_files.pending.push_back(&files[i]);
+      else
+        read_files.push_back(i);
+    }
+    lazy_files.pending_count = lazy_files.pending.size();
+  }
 
-  double shape_dist_traveled = 0.0;
-  StopTimePoint timepoint = StopTimePoint::Exact;
-};
+  // The largest files are read first so they don't delay the whole reading in the end.
+  std::vector<std::pair<uintmax_t, size_t>> sizes;
+  for (size_t i : read_files)
+    sizes.emplace_back(get_file_size(*files[i].name), i);
+  std::stable_sort(sizes.begin(), sizes.end(),
+                   [](const auto & lhs, const auto & rhs) { return lhs.first > rhs.first; });
+
+  // Indexes are dropped before reading the files in parallel, so the readers don't write the flags.
+  for (size_t i : read_files)
+    drop_file_indexes(*files[i].name);
+
+  std::vector<Result> results(files.size());
+  run_in_parallel(sizes.size(), options.threads_count, [&](size_t i) {
+    const FeedFile & file = files[sizes[i].second];
+    results[sizes[i].second] = file.read_in_chunks != nullptr
+                                   ? (this->*file.read_in_chunks)(options.threads_count)
+                                   : (this->*file.read)();
+  });
 
-// Conditionally required dataset file:
-struct CalendarItem
+  // Results are checked in the same order as in the serial reading.
+  for (size_t i = 0; i < files.size(); ++i)
+  {
+    const Result & res = results[i];
+    if (files[i].is_required ? res != ResultCode::OK : ErrorParsingOptionalFile(res))
+      return res;
+  }
+
+  return ResultCode::OK;
+}
+
+inline Result Feed::read_lazy_files()
 {
-  // Required:
-  Id service_id;
+  load_lazy_files();
 
-  CalendarAvailability monday = CalendarAvailability::NotAvailable;
-  CalendarAvailability tuesday = CalendarAvailability::NotAvailable;
-  CalendarAvailability wednesday = CalendarAvailability::NotAvailable;
-  CalendarAvailability thursday = CalendarAvailability::NotAvailable;
-  CalendarAvailability friday = CalendarAvailability::NotAvailable;
-  CalendarAvailability saturday = CalendarAvailability::NotAvailable;
-  CalendarAvailability sunday = CalendarAvailability::NotAvailable;
+  std::lock_guard<std::recursive_mutex> lock(lazy_files.mutex);
+  return lazy_files.result;
+}
 
-  Date start_date;
-  Date end_date;
-};
+inline void Feed::enable_load_stats(const LoadStatsHook & hook)
+{
+  load_stats = std::make_shared<LoadStats>();
+  load_stats->hook = hook;
+}
 
-// Conditionally required dataset file
-struct CalendarDate
+inline void Feed::disable_load_stats() { load_stats.reset(); }
+
+inline std::vector<FileLoadStats> Feed::get_load_stats() const
 {
-  // Required:
-  Id service_id;
-  Date date;
-  CalendarDateException exception_type = CalendarDateException::Added;
-};
+  if (!load_stats)
+    return {};
 
-// Optional dataset file
-struct FareAttributesItem
+  std::lock_guard<std::mutex> lock(load_stats->mutex);
+  return load_stats->files;
+}
+
+inline void Feed::add_load_stats(const std::string & filename, FileLoadStats & stats,
+                                 std::chrono::steady_clock::time_point start, size_t start_memory,
+                                 bool has_container) const
 {
-  // Required:
-  Id fare_id;
-  double price = 0.0;
-  CurrencyCode currency_type;
-  FarePayment payment_method = FarePayment::BeforeBoarding;
-  FareTransfers transfers = FareTransfers::Unlimited;
+  stats.filename = filename;
+  stats.bytes_read = get_file_size(filename);
 
-  // Conditionally required:
-  Id agency_id;
+  if (has_container)
+  {
+    for (const auto & file : get_feed_files())
+    {
+      if (*file.name == filename)
+        stats.container_size = file.get_entities_count(*this);
+    }
+  }
+  stats.total_seconds = get_seconds_since(start);
+  const size_t memory = get_memory_usage();
+  stats.memory_growth = memory > start_memory ? memory - start_memory : 0;
 
-  // Optional:
-  size_t transfer_duration = 0;  // Length of time in seconds before a transfer expires
-};
+  {
+    std::lock_guard<std::mutex> lock(load_stats->mutex);
+    load_stats->files.push_back(stats);
+  }
+  // The hook is called without the lock, so it may get the stats and doesn't stall other readers.
+  if (load_stats->hook)
+    load_stats->hook(stats);
+}
 
-inline bool operator==(const FareAttributesItem & lhs, const FareAttributesItem & rhs)
+inline Feed::LazyFiles::LazyFiles(const LazyFiles & other) { *this = other; }
+
+inline Feed::LazyFiles & Feed::LazyFiles::operator=(const LazyFiles & other)
 {
-  return std::tie(lhs.fare_id, lhs.price, lhs.currency_type, lhs.payment_method, lhs.transfers,
-                  lhs.agency_id, lhs.transfer_duration) ==
-         std::tie(rhs.fare_id, rhs.price, rhs.currency_type, rhs.payment_method, rhs.transfers,
-                  rhs.agency_id, rhs.transfer_duration);
+  if (this == &other)
+    return *this;
+
+  std::scoped_lock lock(mutex, other.mutex);
+  pending = other.pending;
+  pending_count = pending.size();
+  result = other.result;
+  return *this;
 }
 
-// Optional dataset file
-struct FareRule
+inline void Feed::load_lazy_file(const std::string & file) const
 {
-  // Required:
-  Id fare_id;
+  if (lazy_files.pending_count == 0)
+    return;
 
-  // Optional:
-  Id route_id;
-  Id origin_id;
-  Id destination_id;
-  Id contains_id;
-};
+  std::lock_guard<std::recursive_mutex> lock(lazy_files.mutex);
+  const auto it = std::find_if(lazy_files.pending.begin(), lazy_files.pending.end(),
+                               [&file](const FeedFile * pending) { return *pending->name == file; });
+  if (it == lazy_files.pending.end())
+    return;
 
-// Optional dataset file
-struct ShapePoint
-{
-  // Required:
-  Id shape_id;
-  double shape_pt_lat = 0.0;
-  double shape_pt_lon = 0.0;
-  size_t shape_pt_sequence = 0;
+  const FeedFile & feed_file = **it;
+  lazy_files.pending.erase(it);
 
-  // Optional:
-  double shape_dist_traveled = 0;
-};
+  // Entities are not a part of the observable state until they are read, so the postponed reading
+  // is allowed on access from the const methods.
+  Feed & feed = const_cast<Feed &>(*this);
+  feed.drop_file_indexes(*feed_file.name);
+  const Result res = (feed.*feed_file.read)();
+  const bool is_error =
+      feed_file.is_required ? res != ResultCode::OK : ErrorParsingOptionalFile(res);
+  if (is_error && lazy_files.result == ResultCode::OK)
+    lazy_files.result = res;
 
-// Optional dataset file
-struct Frequency
+  // The file stays counted until it is read, so the other threads wait for it on the mutex
+  // instead of accessing the entities being read.
+  lazy_files.pending_count = lazy_files.pending.size();
+}
+
+inline void Feed::load_lazy_files() const
 {
-  // Required:
-  Id trip_id;
-  Time start_time;
-  Time end_time;
-  size_t headway_secs = 0;
+  if (lazy_files.pending_count == 0)
+    return;
 
-  // Optional:
-  FrequencyTripService exact_times = FrequencyTripService::FrequencyBased;
-};
+  std::lock_guard<std::recursive_mutex> lock(lazy_files.mutex);
+  while (!lazy_files.pending.empty())
+    load_lazy_file(*lazy_files.pending.front()->name);
+}
 
-// Optional dataset file
-struct Transfer
+inline ColumnIndex Feed::get_column_index(const std::string & filename,
+                                          const std::vector<std::string> & columns,
+                                          const std::vector<std::string> & header) const
 {
-  // Required:
-  Id from_stop_id;
-  Id to_stop_id;
-  TransferType transfer_type = TransferType::Recommended;
-
-  // Optional:
-  size_t min_transfer_time = 0;
-};
+  ColumnIndex column_index(columns, header);
+  const auto it = skipped_columns.find(filename);
+  if (it != skipped_columns.end())
+    column_index.skip_columns(it->second);
+  return column_index;
+}
 
-// Optional dataset file for the GTFS-Pathways extension
-struct Pathway
+inline Result Feed::write_feed(const std::string & gtfs_path) const
 {
-  // Required:
-  Id pathway_id;
-  Id from_stop_id;
-  Id to_stop_id;
-  PathwayMode pathway_mode = PathwayMode::Walkway;
-  PathwayDirection is_bidirectional = PathwayDirection::Unidirectional;
+  if (gtfs_path.empty())
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Empty output path for writing feed"};
 
-  // Optional fields:
-  // Horizontal length in meters of the pathway from the origin location
-  double length = 0.0;
-  // Average time in seconds needed to walk through the pathway from the origin location
-  size_t traversal_time = 0;
-  // Number of stairs of the pathway
-  size_t stair_count = 0;
-  // Maximum slope ratio of the pathway
-  double max_slope = 0.0;
-  // Minimum width of the pathway in meters
-  double min_width = 0.0;
-  // Text from physical signage visible to transit riders
-  Text signposted_as;
-  // Same as signposted_as, but when the pathways is used backward
-  Text reversed_signposted_as;
-};
+  load_lazy_files();
 
-// Optional dataset file
-struct Level
-{
-  // Required:
-  Id level_id;
+  for (const auto & file : get_feed_files())
+  {
+    if (!file.is_required && file.get_entities_count(*this) == 0)
+      continue;
 
-  // Numeric index of the level that indicates relative position of this level in relation to other
-  // levels (levels with higher indices are assumed to be located above levels with lower indices).
-  // Ground level should have index 0, with levels above ground indicated by positive indices and
-  // levels below ground by negative indices
-  double level_index = 0.0;
+    const Result res = (this->*file.write)(gtfs_path);
+    if (res != ResultCode::OK)
+      return res;
+  }
 
-  // Optional:
-  Text level_name;
-};
+  return ResultCode::OK;
+}
 
-// Optional dataset file
-struct FeedInfo
+inline Result Feed::write_feed(const std::string & gtfs_path,
+                               const WriteFeedOptions & options) const
 {
-  // Required:
-  Text feed_publisher_name;
-  Text feed_publisher_url;
-  LanguageCode feed_lang;
+  if (gtfs_path.empty())
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Empty output path for writing feed"};
 
-  // Optional:
-  Date feed_start_date;
-  Date feed_end_date;
-  Text feed_version;
-  Text feed_contact_email;
-  Text feed_contact_url;
-};
+  load_lazy_files();
 
-// Optional dataset file
-struct Translation
-{
-  // Required:
-  Text table_name;
-  Text field_name;
-  LanguageCode language;
-  Text translation;
+  const auto & files = get_feed_files();
 
-  // Conditionally required:
-  Id record_id;
-  Id record_sub_id;
-  Text field_value;
-};
+  // The largest files are written first so they don't delay the whole writing in the end.
+  std::vector<std::pair<size_t, size_t>> sizes;
+  for (size_t i = 0; i < files.size(); ++i)
+  {
+    const size_t count = files[i].get_entities_count(*this);
+    if (files[i].is_required || count != 0)
+      sizes.emplace_back(count, i);
+  }
+  std::stable_sort(sizes.begin(), sizes.end(),
+                   [](const auto & lhs, const auto & rhs) { return lhs.first > rhs.first; });
+
+  std::vector<Result> results(files.size());
+  run_in_parallel(sizes.size(), options.threads_count, [&](size_t i) {
+    const FeedFile & file = files[sizes[i].second];
+    results[sizes[i].second] = file.write_in_chunks != nullptr
+                                   ? (this->*file.write_in_chunks)(gtfs_path, options.threads_count)
+                                   : (this->*file.write)(gtfs_path);
+  });
 
-// Optional dataset file
-struct Attribution
-{
-  // Required:
-  Text organization_name;
+  // Results are checked in the same order as in the serial writing.
+  for (const auto & res : results)
+  {
+    if (res != ResultCode::OK)
+      return res;
+  }
 
-  // Optional:
-  Id attribution_id;  // Useful for translations
-  Id agency_id;
-  Id route_id;
-  Id trip_id;
+  return ResultCode::OK;
+}
 
-  AttributionRole is_producer = AttributionRole::No;
-  AttributionRole is_operator = AttributionRole::No;
-  AttributionRole is_authority = AttributionRole::No;
+inline Result Feed::save_snapshot(const std::string & path) const
+{
+  load_lazy_files();
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out.is_open())
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not open path for writing " + path};
+
+  SnapshotWriter writer(out);
+  writer.write_section(agencies);
+  writer.write_section(stops);
+  writer.write_section(routes);
+  writer.write_section(trips);
+  if (storage_layout == StorageLayout::Columns)
+    writer.write_section(columnar_stop_times);
+  else
+    writer.write_section(stop_times);
+  writer.write_section(calendar);
+  writer.write_section(calendar_dates);
+  writer.write_section(fare_rules);
+  writer.write_section(fare_attributes);
+  if (storage_layout == StorageLayout::Columns)
+    writer.write_section(columnar_shapes);
+  else
+    writer.write_section(shapes);
+  writer.write_section(frequencies);
+  writer.write_section(transfers);
+  writer.write_section(pathways);
+  writer.write_section(levels);
+  writer.write_section(translations);
+  writer.write_section(attributions);
+  writer.write_section(std::vector<FeedInfo>{feed_info});
+
+  if (!writer.finish())
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not write snapshot " + path};
+  return ResultCode::OK;
+}
 
-  Text attribution_url;
-  Text attribution_email;
-  Text attribution_phone;
-};
+inline Result Feed::load_snapshot(const std::string & path)
+{
+  MappedFile file;
+  if (!file.open(path))
+    return {ResultCode::ERROR_FILE_ABSENT, "Could not open snapshot " + path};
 
-// Main classes for working with GTFS feeds
-using Agencies = std::vector<Agency>;
-using Stops = std::vector<Stop>;
-using Routes = std::vector<Route>;
-using Trips = std::vector<Trip>;
-using StopTimes = std::vector<StopTime>;
-using Calendar = std::vector<CalendarItem>;
-using CalendarDates = std::vector<CalendarDate>;
-
-using FareRules = std::vector<FareRule>;
-using FareAttributes = std::vector<FareAttributesItem>;
-using Shapes = std::vector<ShapePoint>;
-using Shape = std::vector<ShapePoint>;
-using Frequencies = std::vector<Frequency>;
-using Transfers = std::vector<Transfer>;
-using Pathways = std::vector<Pathway>;
-using Levels = std::vector<Level>;
-// FeedInfo is a unique object and doesn't need a container.
-using Translations = std::vector<Translation>;
-using Attributions = std::vector<Attribution>;
+  const std::string_view data = file.get_data();
+  SnapshotHeader header;
+  if (data.size() < sizeof(header))
+    return {ResultCode::ERROR_INVALID_SNAPSHOT, "Snapshot header is truncated " + path};
+  std::memcpy(&header, data.data(), sizeof(header));
 
-using ParsedCsvRow = std::map<std::string, std::string>;
+  if (!std::equal(std::begin(snapshot_magic), std::end(snapshot_magic), header.magic))
+    return {ResultCode::ERROR_INVALID_SNAPSHOT, "File is not a snapshot " + path};
+  if (header.version != snapshot_version || header.byte_order != snapshot_byte_order)
+  {
+    return {ResultCode::ERROR_INVALID_SNAPSHOT,
+            "Unsupported snapshot version " + std::to_string(header.version) + " " + path};
+  }
 
-class Feed
-{
-public:
-  inline Feed() = default;
-  inline explicit Feed(const std::string & gtfs_path);
+  const std::string_view payload = data.substr(sizeof(header));
+  if (header.payload_size != payload.size())
+    return {ResultCode::ERROR_INVALID_SNAPSHOT, "Snapshot size mismatch " + path};
+
+  SnapshotChecksum checksum;
+  checksum.update(payload);
+  if (checksum.get() != header.checksum)
+    return {ResultCode::ERROR_INVALID_SNAPSHOT, "Snapshot checksum mismatch " + path};
+
+#if defined(JUST_GTFS_PMR)
+  Feed loaded(gtfs_directory, storage_layout, get_memory_resource());
+#else
+  Feed loaded(gtfs_directory, storage_layout);
+#endif
+  loaded.source = source;
+  try
+  {
+    SnapshotReader reader(payload, static_cast<size_t>(header.strings_offset));
+    reader.read_section<Agency>(loaded.agencies);
+    reader.read_section<Stop>(loaded.stops);
+    reader.read_section<Route>(loaded.routes);
+    reader.read_section<Trip>(loaded.trips);
+    if (storage_layout == StorageLayout::Columns)
+      reader.read_section<StopTime>(loaded.columnar_stop_times);
+    else
+      reader.read_section<StopTime>(loaded.stop_times);
+    reader.read_section<CalendarItem>(loaded.calendar);
+    reader.read_section<CalendarDate>(loaded.calendar_dates);
+    reader.read_section<FareRule>(loaded.fare_rules);
+    reader.read_section<FareAttributesItem>(loaded.fare_attributes);
+    if (storage_layout == StorageLayout::Columns)
+      reader.read_section<ShapePoint>(loaded.columnar_shapes);
+    else
+      reader.read_section<ShapePoint>(loaded.shapes);
+    reader.read_section<Frequency>(loaded.frequencies);
+    reader.read_section<Transfer>(loaded.transfers);
+    reader.read_section<Pathway>(loaded.pathways);
+    reader.read_section<Level>(loaded.levels);
+    reader.read_section<Translation>(loaded.translations);
+    reader.read_section<Attribution>(loaded.attributions);
+
+    if (reader.read_count() != 1)
+      return {ResultCode::ERROR_INVALID_SNAPSHOT, "Snapshot feed info is invalid " + path};
+    reader.read_entity(loaded.feed_info);
+
+    if (!reader.is_finished())
+      return {ResultCode::ERROR_INVALID_SNAPSHOT, "Snapshot has unexpected data " + path};
+  }
+  catch (const std::exception & ex)
+  {
+    return {ResultCode::ERROR_INVALID_SNAPSHOT, std::string(ex.what()) + " in " + path};
+  }
 
-  inline Result read_feed();
-  inline Result write_feed(const std::string & gtfs_path) const;
+  const BuiltIndexes built = get_built_indexes();
+  loaded.load_stats = load_stats;
+  *this = std::move(loaded);
+  rebuild_indexes(built);
 
-  inline Result read_agencies();
-  inline Result write_agencies(const std::string & gtfs_path) const;
+  return ResultCode::OK;
+}
 
-  inline const Agencies & get_agencies() const;
-  inline std::optional<Agency> get_agency(const Id & agency_id) const;
-  inline void add_agency(const Agency & agency);
+inline Feed::FileFingerprints::FileFingerprints(const FileFingerprints & other)
+{
+  *this = other;
+}
 
-  inline Result read_stops();
-  inline Result write_stops(const std::string & gtfs_path) const;
+inline Feed::FileFingerprints & Feed::FileFingerprints::operator=(const FileFingerprints & other)
+{
+  if (this == &other)
+    return *this;
 
-  inline const Stops & get_stops() const;
-  inline std::optional<Stop> get_stop(const Id & stop_id) const;
-  inline void add_stop(const Stop & stop);
+  std::scoped_lock lock(mutex, other.mutex);
+  files = other.files;
+  return *this;
+}
 
-  inline Result read_routes();
-  inline Result write_routes(const std::string & gtfs_path) const;
+inline FileFingerprint Feed::get_fingerprint(const std::string & filename, bool compute_crc) const
+{
+  FileFingerprint res;
+  if (source)
+  {
+    std::unique_ptr<InputStream> stream;
+    res.exists = source->open(filename, stream) == ResultCode::OK;
+    if (!res.exists)
+      return res;
 
-  inline const Routes & get_routes() const;
-  inline std::optional<Route> get_route(const Id & route_id) const;
-  inline void add_route(const Route & route);
+    res.size = source->get_file_size(filename);
+    res.crc = source->get_file_crc32(filename);
+    if (!res.crc && compute_crc)
+      res.crc = get_stream_crc32(*stream);
+    return res;
+  }
 
-  inline Result read_trips();
-  inline Result write_trips(const std::string & gtfs_path) const;
+  // Compressed copies are checked in the order of opening them.
+  const std::string path = gtfs_directory + filename;
+  std::vector<std::string> paths = {path, path + ".gz"};
+#ifdef JUST_GTFS_USE_ZSTD
+  paths.push_back(path + ".zst");
+#endif
+  std::error_code ec;
+  for (const std::string & file_path : paths)
+  {
+    if (!std::filesystem::exists(file_path, ec))
+      continue;
 
-  inline const Trips & get_trips() const;
-  inline std::optional<Trip> get_trip(const Id & trip_id) const;
-  inline void add_trip(const Trip & trip);
+    res.exists = true;
+    res.size = std::filesystem::file_size(file_path, ec);
+    res.modification_time = std::filesystem::last_write_time(file_path, ec);
+    FileStream stream;
+    if (compute_crc && stream.open(file_path))
+      res.crc = get_stream_crc32(stream);
+    return res;
+  }
+  return res;
+}
 
-  inline Result read_stop_times();
-  inline Result write_stop_times(const std::string & gtfs_path) const;
+inline void Feed::take_fingerprint(const std::string & filename)
+{
+  FileFingerprint fingerprint = get_fingerprint(filename, false);
+  std::lock_guard<std::mutex> lock(fingerprints.mutex);
+  fingerprints.files[filename] = std::move(fingerprint);
+}
 
-  inline const StopTimes & get_stop_times() const;
-  inline StopTimes get_stop_times_for_stop(const Id & stop_id) const;
-  inline StopTimes get_stop_times_for_trip(const Id & trip_id, bool sort_by_sequence = true) const;
-  inline void add_stop_time(const StopTime & stop_time);
+inline Result Feed::refresh(FeedDiff * diff)
+{
+  load_lazy_files();
+  if (diff)
+    diff->clear();
 
-  inline Result read_calendar();
-  inline Result write_calendar(const std::string & gtfs_path) const;
+  // The directory of the archive is read once, so the archive is reopened to see the changes.
+  if (source && !gtfs_directory.empty())
+    source = std::make_shared<ZipArchive>(gtfs_directory);
 
-  inline const Calendar & get_calendar() const;
-  inline std::optional<CalendarItem> get_calendar(const Id & service_id) const;
-  inline void add_calendar_item(const CalendarItem & calendar_item);
+  std::map<std::string, FileFingerprint> known;
+  {
+    std::lock_guard<std::mutex> lock(fingerprints.mutex);
+    known = fingerprints.files;
+  }
 
-  inline Result read_calendar_dates();
-  inline Result write_calendar_dates(const std::string & gtfs_path) const;
+  // Files without the modification times are the same only if their checksums are equal.
+  auto is_same_version = [this](const FileFingerprint & lhs, const FileFingerprint & rhs) {
+    if (lhs.exists != rhs.exists || !lhs.exists)
+      return lhs.exists == rhs.exists;
+    if (lhs.size != rhs.size)
+      return false;
+    if (lhs.crc && rhs.crc)
+      return *lhs.crc == *rhs.crc;
+    return !source && lhs.modification_time == rhs.modification_time;
+  };
+
+  std::map<std::string, FileFingerprint> updated = known;
+  std::vector<const FeedFile *> changed_files;
+  for (const auto & file : get_feed_files())
+  {
+    const auto it = known.find(*file.name);
+    if (it == known.end())
+      continue;
 
-  inline const CalendarDates & get_calendar_dates() const;
-  inline CalendarDates get_calendar_dates(const Id & service_id, bool sort_by_date = true) const;
-  inline void add_calendar_date(const CalendarDate & calendar_date);
+    FileFingerprint current = get_fingerprint(*file.name, false);
+    if (is_same_version(it->second, current))
+      continue;
 
-  inline Result read_fare_rules();
-  inline Result write_fare_rules(const std::string & gtfs_path) const;
+    if (current.exists && !current.crc)
+      current = get_fingerprint(*file.name, true);
+    if (!is_same_version(it->second, current))
+      changed_files.push_back(&file);
+    updated[*file.name] = std::move(current);
+  }
 
-  inline const FareRules & get_fare_rules() const;
-  inline FareRules get_fare_rules(const Id & fare_id) const;
-  inline void add_fare_rule(const FareRule & fare_rule);
+  const BuiltIndexes built = get_built_indexes();
+  // Ids indexes are built after reading the files instead of adding the entities to them.
+  indexes_built = false;
+
+#if defined(JUST_GTFS_PMR)
+  Feed previous(get_memory_resource());
+#else
+  Feed previous;
+#endif
+  Result res = ResultCode::OK;
+  size_t moved_count = 0;
+  for (const FeedFile * file : changed_files)
+  {
+    file->move_entities(*this, previous);
+    ++moved_count;
+    drop_file_indexes(*file->name);
+    res = file->read_in_chunks ? (this->*file->read_in_chunks)(0) : (this->*file->read)();
+    if (file->is_required ? res != ResultCode::OK : ErrorParsingOptionalFile(res))
+      break;
+    res = ResultCode::OK;
+  }
 
-  inline Result read_fare_attributes();
-  inline Result write_fare_attributes(const std::string & gtfs_path) const;
+  if (res != ResultCode::OK)
+  {
+    for (size_t i = 0; i < moved_count; ++i)
+      changed_files[i]->move_entities(previous, *this);
+    updated = std::move(known);
+  }
+  else if (diff)
+  {
+    for (const FeedFile * file : changed_files)
+    {
+      FileDiff file_diff = file->get_diff(previous, *this);
+      if (!file_diff.empty())
+        diff->push_back(std::move(file_diff));
+    }
+  }
 
-  inline const FareAttributes & get_fare_attributes() const;
-  inline FareAttributes get_fare_attributes(const Id & fare_id) const;
-  inline void add_fare_attributes(const FareAttributesItem & fare_attributes_item);
+  if (built.indexes)
+  {
+    for (const FeedFile * file : changed_files)
+      build_file_index(*file->name);
+    indexes_built = true;
+  }
+  rebuild_indexes(built);
 
-  inline Result read_shapes();
-  inline Result write_shapes(const std::string & gtfs_path) const;
+  std::lock_guard<std::mutex> lock(fingerprints.mutex);
+  fingerprints.files = std::move(updated);
+  return res;
+}
 
-  inline const Shapes & get_shapes() const;
-  inline Shape get_shape(const Id & shape_id, bool sort_by_sequence = true) const;
-  inline void add_shape(const ShapePoint & shape);
+inline FeedDiff Feed::get_diff(const Feed & new_feed) const
+{
+  load_lazy_files();
+  new_feed.load_lazy_files();
 
-  inline Result read_frequencies();
-  inline Result write_frequencies(const std::string & gtfs_path) const;
+  FeedDiff res;
+  for (const auto & file : get_feed_files())
+  {
+    FileDiff file_diff = file.get_diff(*this, new_feed);
+    if (!file_diff.empty())
+      res.push_back(std::move(file_diff));
+  }
+  return res;
+}
 
-  inline const Frequencies & get_frequencies() const;
-  inline Frequencies get_frequencies(const Id & trip_id) const;
-  inline void add_frequency(const Frequency & frequency);
+inline Result Feed::validate(std::vector<ValidationError> * errors, size_t threads_count) const
+{
+  load_lazy_files();
+  if (errors)
+    errors->clear();
+
+  using IdSet = std::unordered_set<Id>;
+  auto collect = [](const auto & entities, auto key, IdSet & ids) {
+    ids.reserve(ids.size() + entities.size());
+    for (const auto & entity : entities)
+      ids.insert(std::invoke(key, entity));
+  };
+  const auto same_id = [](const Id & id) -> const Id & { return id; };
+
+  // Ids of the referenced files are collected in parallel before checking the references.
+  IdSet agency_ids;
+  IdSet stop_ids;
+  IdSet route_ids;
+  IdSet trip_ids;
+  IdSet service_ids;
+  IdSet shape_ids;
+  IdSet level_ids;
+  IdSet fare_ids;
+  const std::vector<std::function<void()>> collectors = {
+      [&]() { collect(agencies, &Agency::agency_id, agency_ids); },
+      [&]() { collect(stops, &Stop::stop_id, stop_ids); },
+      [&]() { collect(routes, &Route::route_id, route_ids); },
+      [&]() { collect(trips, &Trip::trip_id, trip_ids); },
+      [&]() {
+        collect(calendar, &CalendarItem::service_id, service_ids);
+        collect(calendar_dates, &CalendarDate::service_id, service_ids);
+      },
+      [&]() {
+        if (storage_layout == StorageLayout::Columns)
+          collect(columnar_shapes.get_shape_ids(), same_id, shape_ids);
+        else
+          collect(shapes, &ShapePoint::shape_id, shape_ids);
+      },
+      [&]() { collect(levels, &Level::level_id, level_ids); },
+      [&]() { collect(fare_attributes, &FareAttributesItem::fare_id, fare_ids); }};
+  run_in_parallel(collectors.size(), threads_count, [&](size_t i) { collectors[i](); });
+
+  struct Check
+  {
+    const std::string * filename = nullptr;
+    std::string field;
+    const std::string * referenced_filename = nullptr;
+    const IdSet * ids = nullptr;
+    bool is_optional = false;
+    size_t records_count = 0;
+    std::function<const Id &(size_t i)> get_id;
+  };
+
+  std::vector<Check> checks;
+  auto add_check = [&checks](const std::string & filename, const std::string & field,
+                             const std::string & referenced_filename, const IdSet & ids,
+                             bool is_optional, const auto & entities, auto key) {
+    checks.push_back({&filename, field, &referenced_filename, &ids, is_optional, entities.size(),
+                      [&entities, key](size_t i) -> const Id & {
+                        return std::invoke(key, entities[i]);
+                      }});
+  };
+
+  add_check(file_routes, "agency_id", file_agency, agency_ids, true, routes, &Route::agency_id);
+  add_check(file_trips, "route_id", file_routes, route_ids, false, trips, &Trip::route_id);
+  add_check(file_trips, "service_id", file_calendar, service_ids, false, trips,
+            &Trip::service_id);
+  add_check(file_trips, "shape_id", file_shapes, shape_ids, true, trips, &Trip::shape_id);
+  if (storage_layout == StorageLayout::Columns)
+  {
+    add_check(file_stop_times, "trip_id", file_trips, trip_ids, false,
+              columnar_stop_times.get_trip_ids(), same_id);
+    add_check(file_stop_times, "stop_id", file_stops, stop_ids, false,
+              columnar_stop_times.get_stop_ids(), same_id);
+  }
+  else
+  {
+    add_check(file_stop_times, "trip_id", file_trips, trip_ids, false, stop_times,
+              &StopTime::trip_id);
+    add_check(file_stop_times, "stop_id", file_stops, stop_ids, false, stop_times,
+              &StopTime::stop_id);
+  }
+  add_check(file_stops, "parent_station", file_stops, stop_ids, true, stops,
+            &Stop::parent_station);
+  add_check(file_stops, "level_id", file_levels, level_ids, true, stops, &Stop::level_id);
+  add_check(file_frequencies, "trip_id", file_trips, trip_ids, false, frequencies,
+            &Frequency::trip_id);
+  add_check(file_transfers, "from_stop_id", file_stops, stop_ids, false, transfers,
+            &Transfer::from_stop_id);
+  add_check(file_transfers, "to_stop_id", file_stops, stop_ids, false, transfers,
+            &Transfer::to_stop_id);
+  add_check(file_pathways, "from_stop_id", file_stops, stop_ids, false, pathways,
+            &Pathway::from_stop_id);
+  add_check(file_pathways, "to_stop_id", file_stops, stop_ids, false, pathways,
+            &Pathway::to_stop_id);
+  add_check(file_fare_attributes, "agency_id", file_agency, agency_ids, true, fare_attributes,
+            &FareAttributesItem::agency_id);
+  add_check(file_fare_rules, "fare_id", file_fare_attributes, fare_ids, false, fare_rules,
+            &FareRule::fare_id);
+  add_check(file_fare_rules, "route_id", file_routes, route_ids, true, fare_rules,
+            &FareRule::route_id);
+  add_check(file_attributions, "agency_id", file_agency, agency_ids, true, attributions,
+            &Attribution::agency_id);
+  add_check(file_attributions, "route_id", file_routes, route_ids, true, attributions,
+            &Attribution::route_id);
+  add_check(file_attributions, "trip_id", file_trips, trip_ids, true, attributions,
+            &Attribution::trip_id);
+
+  // Large files are checked in chunks. Chunks are ordered as the records of the checked files.
+  static constexpr size_t chunk_size = 1 << 16;
+  struct Chunk
+  {
+    size_t check = 0;
+    size_t begin = 0;
+    size_t end = 0;
+    size_t broken_count = 0;
+    size_t first_broken = 0;
+  };
+
+  std::vector<Chunk> chunks;
+  for (size_t i = 0; i < checks.size(); ++i)
+  {
+    for (size_t begin = 0; begin < checks[i].records_count; begin += chunk_size)
+      chunks.push_back({i, begin, std::min(begin + chunk_size, checks[i].records_count)});
+  }
 
-  inline Result read_transfers();
-  inline Result write_transfers(const std::string & gtfs_path) const;
+  run_in_parallel(chunks.size(), threads_count, [&](size_t i) {
+    Chunk & chunk = chunks[i];
+    const Check & check = checks[chunk.check];
+    for (size_t record = chunk.begin; record < chunk.end; ++record)
+    {
+      const Id & id = check.get_id(record);
+      if ((check.is_optional && id.empty()) || check.ids->find(id) != check.ids->end())
+        continue;
+      if (chunk.broken_count++ == 0)
+        chunk.first_broken = record;
+    }
+  });
 
-  inline const Transfers & get_transfers() const;
-  inline std::optional<Transfer> get_transfer(const Id & from_stop_id, const Id & to_stop_id) const;
-  inline void add_transfer(const Transfer & transfer);
+  std::vector<ValidationError> found;
+  size_t found_check = checks.size();
+  size_t total_count = 0;
+  for (const Chunk & chunk : chunks)
+  {
+    if (chunk.broken_count == 0)
+      continue;
 
-  inline Result read_pathways();
-  inline Result write_pathways(const std::string & gtfs_path) const;
+    const Check & check = checks[chunk.check];
+    if (found_check != chunk.check)
+    {
+      found_check = chunk.check;
+      found.push_back({*check.filename, check.field, *check.referenced_filename, 0,
+                       check.get_id(chunk.first_broken)});
+    }
+    found.back().records_count += chunk.broken_count;
+    total_count += chunk.broken_count;
+  }
 
-  inline const Pathways & get_pathways() const;
-  inline Pathways get_pathways(const Id & pathway_id) const;
-  inline Pathways get_pathways(const Id & from_stop_id, const Id & to_stop_id) const;
-  inline void add_pathway(const Pathway & pathway);
+  if (found.empty())
+    return ResultCode::OK;
 
-  inline Result read_levels();
-  inline Result write_levels(const std::string & gtfs_path) const;
+  const ValidationError & first = found.front();
+  Result res = {ResultCode::ERROR_INVALID_REFERENCE,
+                std::to_string(total_count) + " references to absent ids, e.g. " + first.field +
+                    " " + std::string(first.first_absent_id) + " in " + first.filename +
+                    " is absent in " + first.referenced_filename};
+  if (errors)
+    *errors = std::move(found);
+  return res;
+}
 
-  inline const Levels & get_levels() const;
-  inline std::optional<Level> get_level(const Id & level_id) const;
-  inline void add_level(const Level & level);
+inline Result Feed::build_timetable(Timetable & timetable, const TimetableOptions & options) const
+{
+  load_lazy_files();
 
-  inline Result read_feed_info();
-  inline Result write_feed_info(const std::string & gtfs_path) const;
+  Timetable res;
+  auto add_ids = [](const auto & entities, auto key, std::vector<Id> & ids, IdIndex & index) {
+    for (const auto & entity : entities)
+    {
+      const Id & id = std::invoke(key, entity);
+      if (index.emplace(id, ids.size()).second)
+        ids.push_back(id);
+    }
+  };
+  add_ids(stops, &Stop::stop_id, res.stop_ids, res.stops_index);
+  add_ids(routes, &Route::route_id, res.route_ids, res.routes_index);
+  add_ids(trips, &Trip::service_id, res.service_ids, res.services_index);
+
+  auto absent = [](const std::string & field, const Id & id, const std::string & filename,
+                   const std::string & referenced_filename) -> Result {
+    return {ResultCode::ERROR_INVALID_REFERENCE,
+            field + " " + std::string(id) + " in " + filename + " is absent in " +
+                referenced_filename};
+  };
+
+  // Trips are referred by their positions in trips.
+  IdIndex trip_positions;
+  std::vector<uint32_t> trip_routes(trips.size());
+  for (size_t i = 0; i < trips.size(); ++i)
+  {
+    const auto route = res.routes_index.find(trips[i].route_id);
+    if (route == res.routes_index.end())
+      return absent("route_id", trips[i].route_id, file_trips, file_routes);
+    trip_routes[i] = static_cast<uint32_t>(route->second);
+    trip_positions.emplace(trips[i].trip_id, i);
+  }
 
-  inline FeedInfo get_feed_info() const;
-  inline void set_feed_info(const FeedInfo & feed_info);
+  std::vector<std::vector<const Frequency *>> trip_frequencies;
+  if (options.expand_frequencies)
+  {
+    trip_frequencies.resize(trips.size());
+    for (const auto & frequency : frequencies)
+    {
+      const auto trip = trip_positions.find(frequency.trip_id);
+      if (trip == trip_positions.end())
+        return absent("trip_id", frequency.trip_id, file_frequencies, file_trips);
+      trip_frequencies[trip->second].push_back(&frequency);
+    }
+  }
 
-  inline Result read_translations();
-  inline Result write_translations(const std::string & gtfs_path) const;
+  struct TripTimes
+  {
+    std::vector<uint32_t> stops;
+    std::vector<uint32_t> arrivals;
+    std::vector<uint32_t> departures;
+  };
+  std::vector<TripTimes> trip_times(trips.size());
+  static constexpr uint32_t no_time = std::numeric_limits<uint32_t>::max();
+
+  const Result stop_times_res = visit_stop_times(*this, [&](const auto & container) -> Result {
+    // Trips of the stop times are found in parallel chunks and then the positions of the stop
+    // times are grouped by trips with the counting sort.
+    static constexpr size_t chunk_size = 1 << 16;
+    const size_t count = container.size();
+    const size_t chunks_count = (count + chunk_size - 1) / chunk_size;
+    std::vector<size_t> stop_time_trips(count);
+    std::vector<size_t> first_absent(chunks_count, count);
+    run_in_parallel(chunks_count, options.threads_count, [&](size_t chunk) {
+      for (size_t i = chunk * chunk_size; i < std::min(count, (chunk + 1) * chunk_size); ++i)
+      {
+        const auto trip = trip_positions.find(container[i].trip_id);
+        if (trip == trip_positions.end())
+        {
+          first_absent[chunk] = i;
+          return;
+        }
+        stop_time_trips[i] = trip->second;
+      }
+    });
+    for (const size_t i : first_absent)
+    {
+      if (i != count)
+        return absent("trip_id", container[i].trip_id, file_stop_times, file_trips);
+    }
 
-  inline const Translations & get_translations() const;
-  inline Translations get_translations(const Text & table_name) const;
-  inline void add_translation(const Translation & translation);
+    std::vector<size_t> offsets(trips.size() + 1);
+    for (const size_t trip : stop_time_trips)
+      ++offsets[trip + 1];
+    for (size_t i = 1; i < offsets.size(); ++i)
+      offsets[i] += offsets[i - 1];
+    std::vector<size_t> positions(count);
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < count; ++i)
+      positions[next[stop_time_trips[i]]++] = i;
+
+    auto convert_trip = [&](size_t trip) -> Result {
+      const auto begin = positions.begin() + offsets[trip];
+      const auto end = positions.begin() + offsets[trip + 1];
+      const size_t size = static_cast<size_t>(end - begin);
+      if (size < 2)
+        return ResultCode::OK;
+
+      std::stable_sort(begin, end, [&container](size_t a, size_t b) {
+        return container[a].stop_sequence < container[b].stop_sequence;
+      });
 
-  inline Result read_attributions();
-  inline Result write_attributions(const std::string & gtfs_path) const;
+      TripTimes & times = trip_times[trip];
+      times.stops.resize(size);
+      times.arrivals.assign(size, no_time);
+      times.departures.assign(size, no_time);
+      for (size_t i = 0; i < size; ++i)
+      {
+        const auto & stop_time = container[begin[i]];
+        const auto stop = res.stops_index.find(stop_time.stop_id);
+        if (stop == res.stops_index.end())
+          return absent("stop_id", stop_time.stop_id, file_stop_times, file_stops);
+
+        times.stops[i] = static_cast<uint32_t>(stop->second);
+        if (stop_time.arrival_time.is_provided())
+          times.arrivals[i] = static_cast<uint32_t>(stop_time.arrival_time.get_total_seconds());
+        if (stop_time.departure_time.is_provided())
+        {
+          times.departures[i] =
+              static_cast<uint32_t>(stop_time.departure_time.get_total_seconds());
+        }
+        // The stop with one of the times is arrived at and departed from at the same time.
+        if (times.arrivals[i] == no_time)
+          times.arrivals[i] = times.departures[i];
+        if (times.departures[i] == no_time)
+          times.departures[i] = times.arrivals[i];
+      }
 
-  inline const Attributions & get_attributions() const;
-  inline void add_attribution(const Attribution & attribution);
+      if (times.departures.front() == no_time || times.arrivals.back() == no_time)
+      {
+        return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT,
+                "Trip " + std::string(trips[trip].trip_id) +
+                    " has no times at the first or the last stop in " + file_stop_times};
+      }
 
-private:
-  inline Result parse_csv(const std::string & filename,
-                          const std::function<Result(const ParsedCsvRow & record)> & add_entity);
+      // Stops without times are placed evenly between the neighbouring stops with times.
+      size_t previous = 0;
+      for (size_t i = 1; i < size; ++i)
+      {
+        if (times.arrivals[i] == no_time)
+          continue;
+
+        const uint64_t from = times.departures[previous];
+        const uint64_t to = std::max<uint64_t>(times.arrivals[i], from);
+        for (size_t j = previous + 1; j < i; ++j)
+        {
+          const uint64_t time = from + (to - from) * (j - previous) / (i - previous);
+          times.arrivals[j] = times.departures[j] = static_cast<uint32_t>(time);
+        }
+        previous = i;
+      }
+      return ResultCode::OK;
+    };
+
+    // Trips are converted in parallel chunks, the first error in the order of trips is returned.
+    static constexpr size_t trips_chunk_size = 1 << 10;
+    const size_t trips_chunks_count = (trips.size() + trips_chunk_size - 1) / trips_chunk_size;
+    std::vector<Result> results(trips_chunks_count);
+    run_in_parallel(trips_chunks_count, options.threads_count, [&](size_t chunk) {
+      const size_t end = std::min(trips.size(), (chunk + 1) * trips_chunk_size);
+      for (size_t trip = chunk * trips_chunk_size; trip < end; ++trip)
+      {
+        results[chunk] = convert_trip(trip);
+        if (results[chunk] != ResultCode::OK)
+          return;
+      }
+    });
+    for (Result & chunk_res : results)
+    {
+      if (chunk_res != ResultCode::OK)
+        return std::move(chunk_res);
+    }
+    return ResultCode::OK;
+  });
+  if (stop_times_res != ResultCode::OK)
+    return stop_times_res;
 
-  inline Result write_csv(const std::string & path, const std::string & file,
-                          const std::function<void(std::ofstream & out)> & write_header,
-                          const std::function<void(std::ofstream & out)> & write_entities) const;
+  // Departure of the trip with the times from stop_times.txt or the departure of the
+  // frequency-based trip at the start seconds.
+  struct Departure
+  {
+    size_t trip = 0;
+    bool is_shifted = false;
+    uint32_t start = 0;
+  };
+  // Times preceding the first departure of the shifted trip are not moved before the start as
+  // in TripInstance.
+  auto get_time = [&trip_times](const Departure & departure, bool is_arrival, size_t i) {
+    const TripTimes & times = trip_times[departure.trip];
+    const uint32_t time = is_arrival ? times.arrivals[i] : times.departures[i];
+    if (!departure.is_shifted)
+      return time;
+    const uint32_t first = times.departures.front();
+    return departure.start + (std::max(time, first) - first);
+  };
+
+  // Departures are grouped by the route and the sequence of stops in the order of trips.
+  std::unordered_map<std::string, size_t> groups_index;
+  std::vector<std::vector<Departure>> groups;
+  std::string key;
+  for (size_t trip = 0; trip < trips.size(); ++trip)
+  {
+    const TripTimes & times = trip_times[trip];
+    if (times.stops.empty())
+      continue;
 
-  inline Result add_agency(const ParsedCsvRow & row);
-  inline Result add_route(const ParsedCsvRow & row);
-  inline Result add_shape(const ParsedCsvRow & row);
-  inline Result add_trip(const ParsedCsvRow & row);
-  inline Result add_stop(const ParsedCsvRow & row);
-  inline Result add_stop_time(const ParsedCsvRow & row);
-  inline Result add_calendar_item(const ParsedCsvRow & row);
-  inline Result add_calendar_date(const ParsedCsvRow & row);
-  inline Result add_transfer(const ParsedCsvRow & row);
-  inline Result add_frequency(const ParsedCsvRow & row);
-  inline Result add_fare_attributes(const ParsedCsvRow & row);
-  inline Result add_fare_rule(const ParsedCsvRow & row);
-  inline Result add_pathway(const ParsedCsvRow & row);
-  inline Result add_level(const ParsedCsvRow & row);
-  inline Result add_feed_info(const ParsedCsvRow & row);
-  inline Result add_translation(const ParsedCsvRow & row);
-  inline Result add_attribution(const ParsedCsvRow & row);
+    key.assign(reinterpret_cast<const char *>(&trip_routes[trip]), sizeof(uint32_t));
+    key.append(reinterpret_cast<const char *>(times.stops.data()),
+               times.stops.size() * sizeof(uint32_t));
+    const auto [group, inserted] = groups_index.emplace(key, groups.size());
+    if (inserted)
+      groups.emplace_back();
 
-  inline void write_agencies(std::ofstream & out) const;
-  inline void write_routes(std::ofstream & out) const;
-  inline void write_shapes(std::ofstream & out) const;
-  inline void write_trips(std::ofstream & out) const;
-  inline void write_stops(std::ofstream & out) const;
-  inline void write_stop_times(std::ofstream & out) const;
-  inline void write_calendar(std::ofstream & out) const;
-  inline void write_calendar_dates(std::ofstream & out) const;
-  inline void write_transfers(std::ofstream & out) const;
-  inline void write_frequencies(std::ofstream & out) const;
-  inline void write_fare_attributes(std::ofstream & out) const;
-  inline void write_fare_rules(std::ofstream & out) const;
-  inline void write_pathways(std::ofstream & out) const;
-  inline void write_levels(std::ofstream & out) const;
-  inline void write_feed_info(std::ofstream & out) const;
-  inline void write_translations(std::ofstream & out) const;
-  inline void write_attributions(std::ofstream & out) const;
+    std::vector<Departure> & departures = groups[group->second];
+    if (trip_frequencies.empty() || trip_frequencies[trip].empty())
+    {
+      departures.push_back({trip, false, 0});
+      continue;
+    }
+    for (const Frequency * frequency : trip_frequencies[trip])
+    {
+      const size_t end = frequency->end_time.get_total_seconds();
+      const size_t headway = frequency->headway_secs;
+      for (size_t start = frequency->start_time.get_total_seconds(); headway != 0 && start < end;
+           start += headway)
+      {
+        departures.push_back({trip, true, static_cast<uint32_t>(start)});
+      }
+    }
+  }
 
-protected:
-  std::string gtfs_directory;
+  // Departures of each group are sorted by the time at the first stop and split into patterns
+  // without overtaking: the departure is added to the first pattern whose last departure is
+  // not later at any stop.
+  std::vector<std::vector<std::vector<Departure>>> groups_patterns(groups.size());
+  run_in_parallel(groups.size(), options.threads_count, [&](size_t i) {
+    std::vector<Departure> & departures = groups[i];
+    std::stable_sort(departures.begin(), departures.end(),
+                     [&get_time](const Departure & a, const Departure & b) {
+                       return get_time(a, false, 0) < get_time(b, false, 0);
+                     });
+
+    auto & patterns = groups_patterns[i];
+    for (const Departure & departure : departures)
+    {
+      const size_t size = trip_times[departure.trip].stops.size();
+      auto is_not_later = [&](const std::vector<Departure> & pattern) {
+        for (size_t j = 0; j < size; ++j)
+        {
+          if (get_time(pattern.back(), true, j) > get_time(departure, true, j) ||
+              get_time(pattern.back(), false, j) > get_time(departure, false, j))
+          {
+            return false;
+          }
+        }
+        return true;
+      };
+      const auto pattern = std::find_if(patterns.begin(), patterns.end(), is_not_later);
+      if (pattern == patterns.end())
+        patterns.emplace_back(1, departure);
+      else
+        pattern->push_back(departure);
+    }
+  });
 
-  Agencies agencies;
-  Stops stops;
-  Routes routes;
-  Trips trips;
-  StopTimes stop_times;
+  std::vector<const std::vector<Departure> *> patterns_departures;
+  size_t trips_count = 0;
+  size_t times_count = 0;
+  for (const auto & patterns : groups_patterns)
+  {
+    for (const auto & departures : patterns)
+    {
+      const TripTimes & times = trip_times[departures.front().trip];
+      Timetable::Pattern pattern;
+      pattern.route = trip_routes[departures.front().trip];
+      pattern.first_stop = res.pattern_stops.size();
+      pattern.stops_count = times.stops.size();
+      pattern.first_trip = trips_count;
+      pattern.trips_count = departures.size();
+      pattern.first_time = times_count;
+      res.pattern_stops.insert(res.pattern_stops.end(), times.stops.begin(), times.stops.end());
+      trips_count += departures.size();
+      times_count += departures.size() * times.stops.size();
+      res.patterns.push_back(pattern);
+      patterns_departures.push_back(&departures);
+    }
+  }
 
-  Calendar calendar;
-  CalendarDates calendar_dates;
-  FareRules fare_rules;
-  FareAttributes fare_attributes;
-  Shape shapes;
-  Frequencies frequencies;
-  Transfers transfers;
-  Pathways pathways;
-  Levels levels;
-  Translations translations;
-  Attributions attributions;
-  FeedInfo feed_info;
-};
+  res.trip_ids.resize(trips_count);
+  res.trip_services.resize(trips_count);
+  res.arrivals.resize(times_count);
+  res.departures.resize(times_count);
+  run_in_parallel(res.patterns.size(), options.threads_count, [&](size_t i) {
+    const Timetable::Pattern & pattern = res.patterns[i];
+    const std::vector<Departure> & departures = *patterns_departures[i];
+    for (size_t k = 0; k < departures.size(); ++k)
+    {
+      const Trip & trip = trips[departures[k].trip];
+      res.trip_ids[pattern.first_trip + k] = trip.trip_id;
+      res.trip_services[pattern.first_trip + k] =
+          static_cast<uint32_t>(res.services_index.find(trip.service_id)->second);
 
-inline Feed::Feed(const std::string & gtfs_path) : gtfs_directory(add_trailing_slash(gtfs_path)) {}
+      const size_t first_time = pattern.first_time + k * pattern.stops_count;
+      for (size_t j = 0; j < pattern.stops_count; ++j)
+      {
+        res.arrivals[first_time + j] = get_time(departures[k], true, j);
+        res.departures[first_time + j] = get_time(departures[k], false, j);
+      }
+    }
+  });
 
-inline bool ErrorParsingOptionalFile(const Result & res)
-{
-  return res != ResultCode::OK && res != ResultCode::ERROR_FILE_ABSENT;
+  // Patterns are added to the stops in the increasing order, the pattern visiting the stop
+  // several times is added to it once.
+  std::vector<size_t> last_pattern(res.stop_ids.size(), res.patterns.size());
+  auto for_each_visit = [&](const auto & function) {
+    std::fill(last_pattern.begin(), last_pattern.end(), res.patterns.size());
+    for (size_t i = 0; i < res.patterns.size(); ++i)
+    {
+      const Timetable::Pattern & pattern = res.patterns[i];
+      for (size_t j = pattern.first_stop; j < pattern.first_stop + pattern.stops_count; ++j)
+      {
+        const uint32_t stop = res.pattern_stops[j];
+        if (last_pattern[stop] == i)
+          continue;
+        last_pattern[stop] = i;
+        function(stop, i);
+      }
+    }
+  };
+  res.stop_patterns_offsets.assign(res.stop_ids.size() + 1, 0);
+  for_each_visit([&](uint32_t stop, size_t) { ++res.stop_patterns_offsets[stop + 1]; });
+  for (size_t i = 1; i < res.stop_patterns_offsets.size(); ++i)
+    res.stop_patterns_offsets[i] += res.stop_patterns_offsets[i - 1];
+  res.stop_patterns.resize(res.stop_patterns_offsets.back());
+  std::vector<size_t> next(res.stop_patterns_offsets.begin(), res.stop_patterns_offsets.end() - 1);
+  for_each_visit([&](uint32_t stop, size_t pattern) {
+    res.stop_patterns[next[stop]++] = static_cast<uint32_t>(pattern);
+  });
+
+  // The shortest of the footpaths between the same stops is kept.
+  std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> footpaths;
+  auto add_footpath = [&](const Id & from_stop_id, const Id & to_stop_id, size_t duration) {
+    const auto from = res.stops_index.find(from_stop_id);
+    const auto to = res.stops_index.find(to_stop_id);
+    if (from == res.stops_index.end() || to == res.stops_index.end())
+      return;
+    footpaths.emplace_back(static_cast<uint32_t>(from->second), static_cast<uint32_t>(to->second),
+                           static_cast<uint32_t>(duration));
+  };
+  for (const auto & transfer : transfers)
+  {
+    if (transfer.transfer_type != TransferType::NotPossible)
+      add_footpath(transfer.from_stop_id, transfer.to_stop_id, transfer.min_transfer_time);
+  }
+  for (const auto & pathway : pathways)
+  {
+    add_footpath(pathway.from_stop_id, pathway.to_stop_id, pathway.traversal_time);
+    if (pathway.is_bidirectional == PathwayDirection::Bidirectional)
+      add_footpath(pathway.to_stop_id, pathway.from_stop_id, pathway.traversal_time);
+  }
+  std::sort(footpaths.begin(), footpaths.end());
+  footpaths.erase(std::unique(footpaths.begin(), footpaths.end(),
+                              [](const auto & a, const auto & b) {
+                                return std::get<0>(a) == std::get<0>(b) &&
+                                       std::get<1>(a) == std::get<1>(b);
+                              }),
+                  footpaths.end());
+
+  res.footpaths_offsets.assign(res.stop_ids.size() + 1, 0);
+  for (const auto & [from, to, duration] : footpaths)
+  {
+    ++res.footpaths_offsets[from + 1];
+    res.footpaths.push_back({to, duration});
+  }
+  for (size_t i = 1; i < res.footpaths_offsets.size(); ++i)
+    res.footpaths_offsets[i] += res.footpaths_offsets[i - 1];
+
+  timetable = std::move(res);
+  return ResultCode::OK;
 }
 
-inline Result Feed::read_feed()
+// Ids of the other entities equal to the entities with the same keys after taking their ids and
+// adapting them, e.g. changing their references as in the merged feed.
+template <typename Container, typename Key, typename Adapt>
+std::unordered_map<Id, Id> get_duplicates(const Container & entities,
+                                          const Container & other_entities,
+                                          Id Container::value_type::*id, Key key, Adapt adapt)
 {
-  // Read required files:
-  if (auto res = read_agencies(); res != ResultCode::OK)
-    return res;
+  using KeyType = std::decay_t<std::invoke_result_t<Key, const typename Container::value_type &>>;
+  std::unordered_multimap<KeyType, size_t> candidates;
+  candidates.reserve(entities.size());
+  for (size_t i = 0; i < entities.size(); ++i)
+    candidates.emplace(std::invoke(key, entities[i]), i);
 
-  if (auto res = read_stops(); res != ResultCode::OK)
-    return res;
+  std::unordered_map<Id, Id> res;
+  for (const auto & other_entity : other_entities)
+  {
+    auto entity = adapt(other_entity);
+    // The first of the equal entities is taken regardless of the order of the candidates.
+    size_t found = entities.size();
+    const auto [begin, end] = candidates.equal_range(std::invoke(key, entity));
+    for (auto it = begin; it != end; ++it)
+    {
+      entity.*id = entities[it->second].*id;
+      if (it->second < found && entity == entities[it->second])
+        found = it->second;
+    }
+    if (found != entities.size())
+      res.emplace(other_entity.*id, entities[found].*id);
+  }
+  return res;
+}
 
-  if (auto res = read_routes(); res != ResultCode::OK)
-    return res;
+// Ids of the other stops with the names and location types of the stops and the coordinates
+// differing by at most tolerance degrees.
+inline std::unordered_map<Id, Id> get_duplicate_stops(const Stops & stops,
+                                                      const Stops & other_stops,
+                                                      double tolerance)
+{
+  // Stops are put into the cells of the tolerance size, so the duplicates of the stop are in
+  // its cell and the neighbouring ones. Cells with the same hashes share the candidates.
+  const double cell_size = std::max(tolerance, 1e-9);
+  auto get_cell = [cell_size](double coordinate) {
+    return static_cast<int64_t>(std::floor(coordinate / cell_size));
+  };
+  auto get_cell_hash = [](int64_t lat_cell, int64_t lon_cell) {
+    return static_cast<uint64_t>(lat_cell) * 0x9e3779b97f4a7c15 ^ static_cast<uint64_t>(lon_cell);
+  };
+
+  std::unordered_multimap<uint64_t, size_t> cells;
+  cells.reserve(stops.size());
+  for (size_t i = 0; i < stops.size(); ++i)
+  {
+    if (stops[i].coordinates_present)
+      cells.emplace(get_cell_hash(get_cell(stops[i].stop_lat), get_cell(stops[i].stop_lon)), i);
+  }
 
-  if (auto res = read_trips(); res != ResultCode::OK)
-    return res;
+  std::unordered_map<Id, Id> res;
+  for (const auto & other_stop : other_stops)
+  {
+    if (!other_stop.coordinates_present)
+      continue;
 
-  if (auto res = read_stop_times(); res != ResultCode::OK)
-    return res;
+    size_t found = stops.size();
+    const int64_t lat_cell = get_cell(other_stop.stop_lat);
+    const int64_t lon_cell = get_cell(other_stop.stop_lon);
+    for (int64_t lat = lat_cell - 1; lat <= lat_cell + 1; ++lat)
+    {
+      for (int64_t lon = lon_cell - 1; lon <= lon_cell + 1; ++lon)
+      {
+        const auto [begin, end] = cells.equal_range(get_cell_hash(lat, lon));
+        for (auto it = begin; it != end; ++it)
+        {
+          const Stop & stop = stops[it->second];
+          if (it->second < found && stop.stop_name == other_stop.stop_name &&
+              stop.location_type == other_stop.location_type &&
+              std::abs(stop.stop_lat - other_stop.stop_lat) <= tolerance &&
+              std::abs(stop.stop_lon - other_stop.stop_lon) <= tolerance)
+          {
+            found = it->second;
+          }
+        }
+      }
+    }
+    if (found != stops.size())
+      res.emplace(other_stop.stop_id, stops[found].stop_id);
+  }
+  return res;
+}
 
-  // Read conditionally required files:
-  if (auto res = read_calendar(); ErrorParsingOptionalFile(res))
-    return res;
+inline Result Feed::merge(const Feed & other, const MergePolicy & policy)
+{
+  if (&other == this)
+    return merge(Feed(other), policy);
 
-  if (auto res = read_calendar_dates(); ErrorParsingOptionalFile(res))
-    return res;
+  load_lazy_files();
+  other.load_lazy_files();
 
-  // Read optional files:
-  if (auto res = read_shapes(); ErrorParsingOptionalFile(res))
-    return res;
+  using IdSet = std::unordered_set<Id>;
+  using IdHandler = std::function<void(const Id & id)>;
+  using IdCollector = std::function<void(const Feed & feed, const IdHandler & handler)>;
+  struct IdMapping
+  {
+    IdMapping(const std::string & field, const std::string & filename, IdCollector for_each_id)
+        : field(field), filename(&filename), for_each_id(std::move(for_each_id))
+    {
+    }
 
-  if (auto res = read_transfers(); ErrorParsingOptionalFile(res))
-    return res;
+    std::string field;
+    const std::string * filename = nullptr;
+    IdCollector for_each_id;
+    // Ids of this feed and distinct ids of the other feed in the order of the records.
+    IdSet ids;
+    std::vector<Id> other_ids;
+    // Changed ids of the other feed and the ones of them replaced by the existing duplicates.
+    std::unordered_map<Id, Id> new_ids;
+    IdSet duplicates;
+  };
+
+  auto ids_of = [](auto entities, auto id) -> IdCollector {
+    return [entities, id](const Feed & feed, const IdHandler & handler) {
+      for (const auto & entity : feed.*entities)
+        handler(entity.*id);
+    };
+  };
+  IdMapping agency_ids("agency_id", file_agency, ids_of(&Feed::agencies, &Agency::agency_id));
+  IdMapping stop_ids("stop_id", file_stops, ids_of(&Feed::stops, &Stop::stop_id));
+  IdMapping zone_ids("zone_id", file_stops, ids_of(&Feed::stops, &Stop::zone_id));
+  IdMapping route_ids("route_id", file_routes, ids_of(&Feed::routes, &Route::route_id));
+  IdMapping trip_ids("trip_id", file_trips, ids_of(&Feed::trips, &Trip::trip_id));
+  IdMapping block_ids("block_id", file_trips, ids_of(&Feed::trips, &Trip::block_id));
+  IdMapping service_ids("service_id", file_calendar,
+                        [&ids_of](const Feed & feed, const IdHandler & handler) {
+                          ids_of(&Feed::calendar, &CalendarItem::service_id)(feed, handler);
+                          ids_of(&Feed::calendar_dates, &CalendarDate::service_id)(feed, handler);
+                          ids_of(&Feed::trips, &Trip::service_id)(feed, handler);
+                        });
+  IdMapping shape_ids("shape_id", file_shapes, [](const Feed & feed, const IdHandler & handler) {
+    visit_shapes(feed, [&handler](const auto & shapes) {
+      for (const auto & point : shapes)
+        handler(point.shape_id);
+    });
+  });
+  IdMapping fare_ids("fare_id", file_fare_attributes,
+                     ids_of(&Feed::fare_attributes, &FareAttributesItem::fare_id));
+  IdMapping level_ids("level_id", file_levels, ids_of(&Feed::levels, &Level::level_id));
+  IdMapping pathway_ids("pathway_id", file_pathways,
+                        ids_of(&Feed::pathways, &Pathway::pathway_id));
+  IdMapping attribution_ids("attribution_id", file_attributions,
+                            ids_of(&Feed::attributions, &Attribution::attribution_id));
+  const std::vector<IdMapping *> mappings = {
+      &agency_ids, &stop_ids, &zone_ids, &route_ids, &trip_ids, &block_ids, &service_ids,
+      &shape_ids, &fare_ids, &level_ids, &pathway_ids, &attribution_ids};
+
+  auto map_id = [&policy](const IdMapping & mapping, Id & id) {
+    if (id.empty())
+      return;
+    const auto it = mapping.new_ids.find(id);
+    if (it != mapping.new_ids.end())
+      id = it->second;
+    else if (policy.id_collision == IdCollision::Prefix)
+      id = Id(policy.prefix + std::string(id));
+  };
+
+  // Ids of both feeds and duplicates of the agencies and stops are collected in parallel.
+  std::vector<std::function<void()>> collectors;
+  for (IdMapping * mapping : mappings)
+  {
+    collectors.push_back([this, mapping]() {
+      mapping->for_each_id(*this, [mapping](const Id & id) {
+        if (!id.empty())
+          mapping->ids.insert(id);
+      });
+    });
+    collectors.push_back([&other, mapping]() {
+      IdSet found;
+      mapping->for_each_id(other, [mapping, &found](const Id & id) {
+        if (!id.empty() && found.insert(id).second)
+          mapping->other_ids.push_back(id);
+      });
+    });
+  }
+  if (policy.deduplicate_agencies)
+  {
+    collectors.push_back([&]() {
+      agency_ids.new_ids = get_duplicates(agencies, other.agencies, &Agency::agency_id,
+                                          &Agency::agency_name,
+                                          [](const Agency & agency) { return agency; });
+    });
+  }
+  if (policy.stop_tolerance >= 0.0)
+  {
+    collectors.push_back([&]() {
+      stop_ids.new_ids = get_duplicate_stops(stops, other.stops, policy.stop_tolerance);
+    });
+  }
+  run_in_parallel(collectors.size(), policy.threads_count, [&](size_t i) { collectors[i](); });
 
-  if (auto res = read_frequencies(); ErrorParsingOptionalFile(res))
-    return res;
+  auto resolve = [&policy](IdMapping & mapping) -> Result {
+    for (const auto & [id, new_id] : mapping.new_ids)
+      mapping.duplicates.insert(id);
 
-  if (auto res = read_fare_attributes(); ErrorParsingOptionalFile(res))
-    return res;
+    IdSet new_ids;
+    for (const Id & id : mapping.other_ids)
+    {
+      if (mapping.duplicates.count(id) != 0)
+        continue;
 
-  if (auto res = read_fare_rules(); ErrorParsingOptionalFile(res))
-    return res;
+      const bool exists = mapping.ids.count(id) != 0;
+      Id new_id = id;
+      if (policy.id_collision == IdCollision::Prefix ||
+          (policy.id_collision == IdCollision::PrefixColliding && exists))
+      {
+        new_id = Id(policy.prefix + std::string(id));
+      }
+      if (mapping.ids.count(new_id) != 0 || !new_ids.insert(new_id).second)
+      {
+        return {ResultCode::ERROR_DUPLICATE_ID, mapping.field + " " + std::string(new_id) +
+                                                    " of the merged feed already exists in " +
+                                                    *mapping.filename};
+      }
+      if (new_id != id)
+        mapping.new_ids.emplace(id, new_id);
+    }
+    return ResultCode::OK;
+  };
 
-  if (auto res = read_pathways(); ErrorParsingOptionalFile(res))
-    return res;
+  // Fare attributes are compared after changing the ids of their agencies.
+  std::vector<Result> results(mappings.size());
+  run_in_parallel(mappings.size(), policy.threads_count, [&](size_t i) {
+    if (mappings[i] != &fare_ids)
+      results[i] = resolve(*mappings[i]);
+  });
+  if (policy.deduplicate_fare_attributes)
+  {
+    fare_ids.new_ids = get_duplicates(fare_attributes, other.fare_attributes,
+                                      &FareAttributesItem::fare_id, &FareAttributesItem::price,
+                                      [&](FareAttributesItem item) {
+                                        map_id(agency_ids, item.agency_id);
+                                        return item;
+                                      });
+  }
+  results.push_back(resolve(fare_ids));
+  for (const Result & res : results)
+  {
+    if (res != ResultCode::OK)
+      return res;
+  }
 
-  if (auto res = read_levels(); ErrorParsingOptionalFile(res))
-    return res;
+  auto append = [](auto & entities, const auto & other_entities, const auto & adapt) {
+    entities.reserve(entities.size() + other_entities.size());
+    for (const auto & other_entity : other_entities)
+    {
+      auto entity = get_entity(other_entity);
+      if (adapt(entity))
+        entities.push_back(std::move(entity));
+    }
+  };
+
+  // Each file is appended by its own task. Indexes are dropped beforehand and rebuilt at the end.
+  const BuiltIndexes built = get_built_indexes();
+  indexes_built = false;
+  stop_times_index_built = false;
+  service_days_index_built = false;
+  shapes_index_built = false;
+  spatial_index_built = false;
+
+  const std::vector<std::function<void()>> appenders = {
+      [&]() {
+        append(agencies, other.agencies, [&](Agency & agency) {
+          if (agency_ids.duplicates.count(agency.agency_id) != 0)
+            return false;
+          map_id(agency_ids, agency.agency_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(stops, other.stops, [&](Stop & stop) {
+          if (stop_ids.duplicates.count(stop.stop_id) != 0)
+            return false;
+          map_id(stop_ids, stop.stop_id);
+          map_id(zone_ids, stop.zone_id);
+          map_id(stop_ids, stop.parent_station);
+          map_id(level_ids, stop.level_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(routes, other.routes, [&](Route & route) {
+          map_id(route_ids, route.route_id);
+          map_id(agency_ids, route.agency_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(trips, other.trips, [&](Trip & trip) {
+          map_id(route_ids, trip.route_id);
+          map_id(service_ids, trip.service_id);
+          map_id(trip_ids, trip.trip_id);
+          map_id(block_ids, trip.block_id);
+          map_id(shape_ids, trip.shape_id);
+          return true;
+        });
+      },
+      [&]() {
+        auto adapt = [&](StopTime & stop_time) {
+          map_id(trip_ids, stop_time.trip_id);
+          map_id(stop_ids, stop_time.stop_id);
+          return true;
+        };
+        visit_stop_times(other, [&](const auto & other_stop_times) {
+          if (storage_layout == StorageLayout::Columns)
+            append(columnar_stop_times, other_stop_times, adapt);
+          else
+            append(stop_times, other_stop_times, adapt);
+        });
+      },
+      [&]() {
+        append(calendar, other.calendar, [&](CalendarItem & item) {
+          map_id(service_ids, item.service_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(calendar_dates, other.calendar_dates, [&](CalendarDate & date) {
+          map_id(service_ids, date.service_id);
+          return true;
+        });
+      },
+      [&]() {
+        auto adapt = [&](ShapePoint & point) {
+          map_id(shape_ids, point.shape_id);
+          return true;
+        };
+        visit_shapes(other, [&](const auto & other_shapes) {
+          if (storage_layout == StorageLayout::Columns)
+            append(columnar_shapes, other_shapes, adapt);
+          else
+            append(shapes, other_shapes, adapt);
+        });
+      },
+      [&]() {
+        append(transfers, other.transfers, [&](Transfer & transfer) {
+          map_id(stop_ids, transfer.from_stop_id);
+          map_id(stop_ids, transfer.to_stop_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(frequencies, other.frequencies, [&](Frequency & frequency) {
+          map_id(trip_ids, frequency.trip_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(fare_attributes, other.fare_attributes, [&](FareAttributesItem & item) {
+          if (fare_ids.duplicates.count(item.fare_id) != 0)
+            return false;
+          map_id(fare_ids, item.fare_id);
+          map_id(agency_ids, item.agency_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(fare_rules, other.fare_rules, [&](FareRule & rule) {
+          map_id(fare_ids, rule.fare_id);
+          map_id(route_ids, rule.route_id);
+          map_id(zone_ids, rule.origin_id);
+          map_id(zone_ids, rule.destination_id);
+          map_id(zone_ids, rule.contains_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(pathways, other.pathways, [&](Pathway & pathway) {
+          map_id(pathway_ids, pathway.pathway_id);
+          map_id(stop_ids, pathway.from_stop_id);
+          map_id(stop_ids, pathway.to_stop_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(levels, other.levels, [&](Level & level) {
+          map_id(level_ids, level.level_id);
+          return true;
+        });
+      },
+      [&]() {
+        append(attributions, other.attributions, [&](Attribution & attribution) {
+          map_id(attribution_ids, attribution.attribution_id);
+          map_id(agency_ids, attribution.agency_id);
+          map_id(route_ids, attribution.route_id);
+          map_id(trip_ids, attribution.trip_id);
+          return true;
+        });
+      },
+      [&]() {
+        if (is_empty_feed_info(feed_info))
+          feed_info = other.feed_info;
+      },
+      [&]() {
+        const std::map<std::string, const IdMapping *> tables = {
+            {"agency", &agency_ids}, {"stops", &stop_ids}, {"routes", &route_ids},
+            {"trips", &trip_ids}, {"stop_times", &trip_ids}, {"pathways", &pathway_ids},
+            {"levels", &level_ids}, {"attributions", &attribution_ids}};
+        append(translations, other.translations, [&](Translation & translation) {
+          const auto table = tables.find(translation.table_name);
+          if (table == tables.end())
+            return true;
+          if (table->second->duplicates.count(translation.record_id) != 0)
+            return false;
+          map_id(*table->second, translation.record_id);
+          return true;
+        });
+      }};
+  run_in_parallel(appenders.size(), policy.threads_count, [&](size_t i) { appenders[i](); });
+
+  rebuild_indexes(built);
+  return ResultCode::OK;
+}
 
-  if (auto res = read_attributions(); ErrorParsingOptionalFile(res))
-    return res;
+// Numbers are parsed with std::from_chars. As std::stoi and std::stod they skip leading spaces
+// and plus sign and ignore the rest of the value after the number. Errors have the same codes as
+// the exceptions of std::stoi and std::stod caught in the add_*() methods and the same messages.
+inline std::string_view skip_number_prefix(std::string_view value)
+{
+  const size_t begin = value.find_first_not_of(" \t\n\v\f\r");
+  if (begin == std::string_view::npos)
+    return {};
 
-  if (auto res = read_feed_info(); ErrorParsingOptionalFile(res))
-    return res;
+  value.remove_prefix(begin);
+  if (value.size() > 1 && value[0] == '+' && value[1] != '-' && value[1] != '+')
+    value.remove_prefix(1);
+  return value;
+}
 
-  if (auto res = read_translations(); ErrorParsingOptionalFile(res))
-    return res;
+inline Result parse_integer(std::string_view value, int & number)
+{
+  value = skip_number_prefix(value);
+  const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+  if (ec == std::errc::invalid_argument)
+    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, "stoi"};
+  if (ec == std::errc::result_out_of_range)
+    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, "stoi"};
+  return ResultCode::OK;
+}
 
+inline Result parse_fractional(std::string_view value, double & number)
+{
+#if defined(__cpp_lib_to_chars)
+  value = skip_number_prefix(value);
+  const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+  if (ec == std::errc::invalid_argument)
+    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, "stod"};
+  if (ec == std::errc::result_out_of_range)
+    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, "stod"};
+#else
+  try
+  {
+    number = std::stod(std::string(value));
+  }
+  catch (const std::out_of_range & ex)
+  {
+    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
+  }
+  catch (const std::invalid_argument & ex)
+  {
+    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
+  }
+#endif
   return ResultCode::OK;
 }
 
-inline Result Feed::write_feed(const std::string & gtfs_path) const
+// Parses the value of the column to the field. The value of the optional field may be empty.
+template <class T, typename Column>
+inline Result read_field(T & field, const ParsedCsvRow & container, Column column,
+                         bool is_optional = true)
 {
-  if (gtfs_path.empty())
-    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Empty output path for writing feed"};
-  // TODO Write feed to csv files
-  return {};
+  const std::string_view value = container.get(column);
+  if (value.empty() && is_optional)
+    return ResultCode::OK;
+
+  int number = 0;
+  Result res = parse_integer(value, number);
+  if (res == ResultCode::OK)
+    field = static_cast<T>(number);
+  return res;
 }
 
-inline std::string get_value_or_default(const ParsedCsvRow & container, const std::string & key,
-                                        const std::string & default_value = "")
+template <typename Column>
+inline Result read_fractional(double & field, const ParsedCsvRow & container, Column column,
+                              bool is_optional = true)
 {
-  const auto it = container.find(key);
-  if (it == container.end())
-    return default_value;
+  const std::string_view value = container.get(column);
+  if (value.empty() && is_optional)
+    return ResultCode::OK;
+  return parse_fractional(value, field);
+}
 
-  return it->second;
+// Parses the value of the column which must be present in the record.
+template <class T, typename Column>
+inline Result read_required(T & field, const ParsedCsvRow & container, Column column)
+{
+  std::string_view value;
+  Result res = container.get_required(column, value);
+  if (res != ResultCode::OK)
+    return res;
+
+  if constexpr (std::is_same_v<T, Time> || std::is_same_v<T, Date>)
+  {
+    return field.parse(value);
+  }
+  else if constexpr (std::is_floating_point_v<T>)
+  {
+    return parse_fractional(value, field);
+  }
+  else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+  {
+    int number = 0;
+    res = parse_integer(value, number);
+    if (res == ResultCode::OK)
+      field = static_cast<T>(number);
+    return res;
+  }
+  else
+  {
+    field = value;
+    return res;
+  }
+}
+
+// Throws the exception of std::stoi or std::stod for the error of parsing.
+inline void throw_parsing_error(const Result & res)
+{
+  if (res == ResultCode::ERROR_REQUIRED_FIELD_ABSENT)
+    throw std::out_of_range(res.message);
+  throw std::invalid_argument(res.message);
 }
 
-template <class T>
-inline void set_field(T & field, const ParsedCsvRow & container, const std::string & key,
+template <class T, typename Column>
+inline void set_field(T & field, const ParsedCsvRow & container, Column column,
                       bool is_optional = true)
 {
-  const std::string key_str = get_value_or_default(container, key);
-  if (!key_str.empty() || !is_optional)
-    field = static_cast<T>(std::stoi(key_str));
+  const Result res = read_field(field, container, column, is_optional);
+  if (res != ResultCode::OK)
+    throw_parsing_error(res);
 }
 
-inline bool set_fractional(double & field, const ParsedCsvRow & container, const std::string & key,
+template <typename Column>
+inline bool set_fractional(double & field, const ParsedCsvRow & container, Column column,
                            bool is_optional = true)
 {
-  const std::string key_str = get_value_or_default(container, key);
-  if (!key_str.empty() || !is_optional)
-  {
-    field = std::stod(key_str);
-    return true;
-  }
-  return false;
+  if (container.get(column).empty() && is_optional)
+    return false;
+
+  const Result res = read_fractional(field, container, column, is_optional);
+  if (res != ResultCode::OK)
+    throw_parsing_error(res);
+  return true;
 }
 
 // Throw if not valid WGS84 decimal degrees.
-inline void check_coordinates(double latitude, double longitude)
+inline Result validate_coordinates(double latitude, double longitude)
 {
   if (latitude < -90.0 || latitude > 90.0)
-    throw std::out_of_range("Latitude");
+    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, "Latitude"};
 
   if (longitude < -180.0 || longitude > 180.0)
-    throw std::out_of_range("Longitude");
+    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, "Longitude"};
+
+  return ResultCode::OK;
+}
+
+inline void check_coordinates(double latitude, double longitude)
+{
+  const Result res = validate_coordinates(latitude, longitude);
+  if (res != ResultCode::OK)
+    throw std::out_of_range(res.message);
 }
 
 inline Result Feed::add_agency(const ParsedCsvRow & row)
@@ -1499,57 +8610,46 @@ inline Result Feed::add_agency(const ParsedCsvRow & row)
   Agency agency;
 
   // Conditionally required id:
-  agency.agency_id = get_value_or_default(row, "agency_id");
+  agency.agency_id = row.get(AgencyColumn::agency_id);
 
   // Required fields:
-  try
-  {
-    agency.agency_name = row.at("agency_name");
-    agency.agency_url = row.at("agency_url");
-    agency.agency_timezone = row.at("agency_timezone");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      (res = read_required(agency.agency_name, row, AgencyColumn::agency_name)) == ResultCode::OK &&
+      (res = read_required(agency.agency_url, row, AgencyColumn::agency_url)) == ResultCode::OK &&
+      (res = read_required(agency.agency_timezone, row, AgencyColumn::agency_timezone)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
   // Optional fields:
-  agency.agency_lang = get_value_or_default(row, "agency_lang");
-  agency.agency_phone = get_value_or_default(row, "agency_phone");
-  agency.agency_fare_url = get_value_or_default(row, "agency_fare_url");
-  agency.agency_email = get_value_or_default(row, "agency_email");
+  agency.agency_lang = row.get(AgencyColumn::agency_lang);
+  agency.agency_phone = row.get(AgencyColumn::agency_phone);
+  agency.agency_fare_url = row.get(AgencyColumn::agency_fare_url);
+  agency.agency_email = row.get(AgencyColumn::agency_email);
 
-  agencies.emplace_back(agency);
+  add_agency(std::move(agency));
   return ResultCode::OK;
 }
-
 inline Result Feed::add_route(const ParsedCsvRow & row)
 {
   Route route;
-
-  try
-  {
-    // Required fields:
-    route.route_id = row.at("route_id");
-    set_field(route.route_type, row, "route_type", false);
-
-    // Optional:
-    set_field(route.route_sort_order, row, "route_sort_order");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(route.route_id, row, RouteColumn::route_id)) == ResultCode::OK &&
+      (res = read_required(route.route_type, row, RouteColumn::route_type)) == ResultCode::OK &&
+      // Optional:
+      (res = read_field(route.route_sort_order, row, RouteColumn::route_sort_order)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
   // Conditionally required:
-  route.agency_id = get_value_or_default(row, "agency_id");
+  route.agency_id = row.get(RouteColumn::agency_id);
 
-  route.route_short_name = get_value_or_default(row, "route_short_name");
-  route.route_long_name = get_value_or_default(row, "route_long_name");
+  route.route_short_name = row.get(RouteColumn::route_short_name);
+  route.route_long_name = row.get(RouteColumn::route_long_name);
 
   if (route.route_short_name.empty() && route.route_long_name.empty())
   {
@@ -1557,121 +8657,111 @@ inline Result Feed::add_route(const ParsedCsvRow & row)
             "'route_short_name' or 'route_long_name' must be specified"};
   }
 
-  route.route_color = get_value_or_default(row, "route_color");
-  route.route_text_color = get_value_or_default(row, "route_text_color");
-  route.route_desc = get_value_or_default(row, "route_desc");
-  route.route_url = get_value_or_default(row, "route_url");
+  route.route_color = row.get(RouteColumn::route_color);
+  route.route_text_color = row.get(RouteColumn::route_text_color);
+  route.route_desc = row.get(RouteColumn::route_desc);
+  route.route_url = row.get(RouteColumn::route_url);
 
-  routes.emplace_back(route);
+  add_route(std::move(route));
 
   return ResultCode::OK;
 }
-
 inline Result Feed::add_shape(const ParsedCsvRow & row)
 {
   ShapePoint point;
-  try
-  {
-    // Required:
-    point.shape_id = row.at("shape_id");
-    point.shape_pt_sequence = std::stoi(row.at("shape_pt_sequence"));
+  Result res = parse_shape_point(row, point);
+  if (res != ResultCode::OK)
+    return res;
 
-    point.shape_pt_lon = std::stod(row.at("shape_pt_lon"));
-    point.shape_pt_lat = std::stod(row.at("shape_pt_lat"));
-    check_coordinates(point.shape_pt_lat, point.shape_pt_lon);
+  push_shape(std::move(point));
+  return ResultCode::OK;
+}
 
-    // Optional:
-    set_fractional(point.shape_dist_traveled, row, "shape_dist_traveled");
-    if (point.shape_dist_traveled < 0.0)
-      throw std::invalid_argument("Invalid shape_dist_traveled");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+inline Result Feed::parse_shape_point(const ParsedCsvRow & row, ShapePoint & point)
+{
+  // Fields are parsed without exceptions, so invalid records are handled as fast as valid ones.
+  Result res;
+  const bool is_parsed =
+      // Required:
+      (res = read_required(point.shape_id, row, ShapeColumn::shape_id)) == ResultCode::OK &&
+      (res = read_required(point.shape_pt_sequence, row, ShapeColumn::shape_pt_sequence)) ==
+          ResultCode::OK &&
+      (res = read_required(point.shape_pt_lon, row, ShapeColumn::shape_pt_lon)) == ResultCode::OK &&
+      (res = read_required(point.shape_pt_lat, row, ShapeColumn::shape_pt_lat)) == ResultCode::OK &&
+      (res = validate_coordinates(point.shape_pt_lat, point.shape_pt_lon)) == ResultCode::OK &&
+      // Optional:
+      (res = read_fractional(point.shape_dist_traveled, row, ShapeColumn::shape_dist_traveled)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
+
+  if (point.shape_dist_traveled < 0.0)
+    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, "Invalid shape_dist_traveled"};
 
-  shapes.emplace_back(point);
   return ResultCode::OK;
 }
 
 inline Result Feed::add_trip(const ParsedCsvRow & row)
 {
   Trip trip;
-  try
-  {
-    // Required:
-    trip.route_id = row.at("route_id");
-    trip.service_id = row.at("service_id");
-    trip.trip_id = row.at("trip_id");
-
-    // Optional:
-    set_field(trip.direction_id, row, "direction_id");
-    set_field(trip.wheelchair_accessible, row, "wheelchair_accessible");
-    set_field(trip.bikes_allowed, row, "bikes_allowed");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required:
+      (res = read_required(trip.route_id, row, TripColumn::route_id)) == ResultCode::OK &&
+      (res = read_required(trip.service_id, row, TripColumn::service_id)) == ResultCode::OK &&
+      (res = read_required(trip.trip_id, row, TripColumn::trip_id)) == ResultCode::OK &&
+      // Optional:
+      (res = read_field(trip.direction_id, row, TripColumn::direction_id)) == ResultCode::OK &&
+      (res = read_field(trip.wheelchair_accessible, row, TripColumn::wheelchair_accessible)) ==
+          ResultCode::OK &&
+      (res = read_field(trip.bikes_allowed, row, TripColumn::bikes_allowed)) == ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
   // Optional:
-  trip.shape_id = get_value_or_default(row, "shape_id");
-  trip.trip_headsign = get_value_or_default(row, "trip_headsign");
-  trip.trip_short_name = get_value_or_default(row, "trip_short_name");
-  trip.block_id = get_value_or_default(row, "block_id");
+  trip.shape_id = row.get(TripColumn::shape_id);
+  trip.trip_headsign = row.get(TripColumn::trip_headsign);
+  trip.trip_short_name = row.get(TripColumn::trip_short_name);
+  trip.block_id = row.get(TripColumn::block_id);
 
-  trips.emplace_back(trip);
+  add_trip(std::move(trip));
   return ResultCode::OK;
 }
 
 inline Result Feed::add_stop(const ParsedCsvRow & row)
 {
   Stop stop;
+  Result res;
+  const bool is_parsed =
+      (res = read_required(stop.stop_id, row, StopColumn::stop_id)) == ResultCode::OK &&
+      // Optional:
+      (res = read_fractional(stop.stop_lon, row, StopColumn::stop_lon)) == ResultCode::OK &&
+      (res = read_fractional(stop.stop_lat, row, StopColumn::stop_lat)) == ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-  try
-  {
-    stop.stop_id = row.at("stop_id");
-
-    // Optional:
-    bool const set_lon = set_fractional(stop.stop_lon, row, "stop_lon");
-    bool const set_lat = set_fractional(stop.stop_lat, row, "stop_lat");
-
-    if (!set_lon || !set_lat)
-      stop.coordinates_present = false;
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  if (row.get(StopColumn::stop_lon).empty() || row.get(StopColumn::stop_lat).empty())
+    stop.coordinates_present = false;
 
   // Conditionally required:
-  stop.stop_name = get_value_or_default(row, "stop_name");
-  stop.parent_station = get_value_or_default(row, "parent_station");
-  stop.zone_id = get_value_or_default(row, "zone_id");
+  stop.stop_name = row.get(StopColumn::stop_name);
+  stop.parent_station = row.get(StopColumn::parent_station);
+  stop.zone_id = row.get(StopColumn::zone_id);
 
   // Optional:
-  stop.stop_code = get_value_or_default(row, "stop_code");
-  stop.stop_desc = get_value_or_default(row, "stop_desc");
-  stop.stop_url = get_value_or_default(row, "stop_url");
-  set_field(stop.location_type, row, "location_type");
-  stop.stop_timezone = get_value_or_default(row, "stop_timezone");
-  stop.wheelchair_boarding = get_value_or_default(row, "wheelchair_boarding");
-  stop.level_id = get_value_or_default(row, "level_id");
-  stop.platform_code = get_value_or_default(row, "platform_code");
+  stop.stop_code = row.get(StopColumn::stop_code);
+  stop.stop_desc = row.get(StopColumn::stop_desc);
+  stop.stop_url = row.get(StopColumn::stop_url);
+  res = read_field(stop.location_type, row, StopColumn::location_type);
+  if (res != ResultCode::OK)
+    return res;
+
+  stop.stop_timezone = row.get(StopColumn::stop_timezone);
+  stop.wheelchair_boarding = row.get(StopColumn::wheelchair_boarding);
+  stop.level_id = row.get(StopColumn::level_id);
+  stop.platform_code = row.get(StopColumn::platform_code);
 
-  stops.emplace_back(stop);
+  push_stop(std::move(stop));
 
   return ResultCode::OK;
 }
@@ -1679,604 +8769,930 @@ inline Result Feed::add_stop(const ParsedCsvRow & row)
 inline Result Feed::add_stop_time(const ParsedCsvRow & row)
 {
   StopTime stop_time;
+  Result res = parse_stop_time(row, stop_time);
+  if (res != ResultCode::OK)
+    return res;
 
-  try
-  {
-    // Required:
-    stop_time.trip_id = row.at("trip_id");
-    stop_time.stop_id = row.at("stop_id");
-    stop_time.stop_sequence = std::stoi(row.at("stop_sequence"));
-
-    // Conditionally required:
-    stop_time.departure_time = Time(row.at("departure_time"));
-    stop_time.arrival_time = Time(row.at("arrival_time"));
+  push_stop_time(std::move(stop_time));
+  return ResultCode::OK;
+}
 
-    // Optional:
-    set_field(stop_time.pickup_type, row, "pickup_type");
-    set_field(stop_time.drop_off_type, row, "drop_off_type");
+inline Result Feed::parse_stop_time(const ParsedCsvRow & row, StopTime & stop_time)
+{
+  // Fields are parsed without exceptions, so invalid records are handled as fast as valid ones.
+  Result res;
+  const bool is_parsed =
+      // Required:
+      (res = read_required(stop_time.trip_id, row, StopTimeColumn::trip_id)) == ResultCode::OK &&
+      (res = read_required(stop_time.stop_id, row, StopTimeColumn::stop_id)) == ResultCode::OK &&
+      (res = read_required(stop_time.stop_sequence, row, StopTimeColumn::stop_sequence)) ==
+          ResultCode::OK &&
+      // Conditionally required:
+      (res = read_required(stop_time.departure_time, row, StopTimeColumn::departure_time)) ==
+          ResultCode::OK &&
+      (res = read_required(stop_time.arrival_time, row, StopTimeColumn::arrival_time)) ==
+          ResultCode::OK &&
+      // Optional:
+      (res = read_field(stop_time.pickup_type, row, StopTimeColumn::pickup_type)) ==
+          ResultCode::OK &&
+      (res = read_field(stop_time.drop_off_type, row, StopTimeColumn::drop_off_type)) ==
+          ResultCode::OK &&
+      (res = read_fractional(stop_time.shape_dist_traveled, row,
+                             StopTimeColumn::shape_dist_traveled)) == ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-    set_fractional(stop_time.shape_dist_traveled, row, "shape_dist_traveled");
-    if (stop_time.shape_dist_traveled < 0.0)
-      throw std::invalid_argument("Invalid shape_dist_traveled");
+  if (stop_time.shape_dist_traveled < 0.0)
+    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, "Invalid shape_dist_traveled"};
 
-    set_field(stop_time.timepoint, row, "timepoint");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  res = read_field(stop_time.timepoint, row, StopTimeColumn::timepoint);
+  if (res != ResultCode::OK)
+    return res;
 
   // Optional fields:
-  stop_time.stop_headsign = get_value_or_default(row, "stop_headsign");
-
-  stop_times.emplace_back(stop_time);
+  stop_time.stop_headsign = row.get(StopTimeColumn::stop_headsign);
   return ResultCode::OK;
 }
 
 inline Result Feed::add_calendar_item(const ParsedCsvRow & row)
 {
   CalendarItem calendar_item;
-  try
-  {
-    // Required fields:
-    calendar_item.service_id = row.at("service_id");
-
-    set_field(calendar_item.monday, row, "monday", false);
-    set_field(calendar_item.tuesday, row, "tuesday", false);
-    set_field(calendar_item.wednesday, row, "wednesday", false);
-    set_field(calendar_item.thursday, row, "thursday", false);
-    set_field(calendar_item.friday, row, "friday", false);
-    set_field(calendar_item.saturday, row, "saturday", false);
-    set_field(calendar_item.sunday, row, "sunday", false);
-
-    calendar_item.start_date = Date(row.at("start_date"));
-    calendar_item.end_date = Date(row.at("end_date"));
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(calendar_item.service_id, row, CalendarColumn::service_id)) ==
+          ResultCode::OK &&
+      (res = read_required(calendar_item.monday, row, CalendarColumn::monday)) == ResultCode::OK &&
+      (res = read_required(calendar_item.tuesday, row, CalendarColumn::tuesday)) ==
+          ResultCode::OK &&
+      (res = read_required(calendar_item.wednesday, row, CalendarColumn::wednesday)) ==
+          ResultCode::OK &&
+      (res = read_required(calendar_item.thursday, row, CalendarColumn::thursday)) ==
+          ResultCode::OK &&
+      (res = read_required(calendar_item.friday, row, CalendarColumn::friday)) == ResultCode::OK &&
+      (res = read_required(calendar_item.saturday, row, CalendarColumn::saturday)) ==
+          ResultCode::OK &&
+      (res = read_required(calendar_item.sunday, row, CalendarColumn::sunday)) == ResultCode::OK &&
+      (res = read_required(calendar_item.start_date, row, CalendarColumn::start_date)) ==
+          ResultCode::OK &&
+      (res = read_required(calendar_item.end_date, row, CalendarColumn::end_date)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-  calendar.emplace_back(calendar_item);
+  push_calendar_item(std::move(calendar_item));
   return ResultCode::OK;
 }
-
 inline Result Feed::add_calendar_date(const ParsedCsvRow & row)
 {
   CalendarDate calendar_date;
-  try
-  {
-    // Required fields:
-    calendar_date.service_id = row.at("service_id");
-
-    set_field(calendar_date.exception_type, row, "exception_type", false);
-    calendar_date.date = Date(row.at("date"));
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(calendar_date.service_id, row, CalendarDateColumn::service_id)) ==
+          ResultCode::OK &&
+      (res = read_required(calendar_date.exception_type, row,
+                           CalendarDateColumn::exception_type)) == ResultCode::OK &&
+      (res = read_required(calendar_date.date, row, CalendarDateColumn::date)) == ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-  calendar_dates.emplace_back(calendar_date);
+  push_calendar_date(std::move(calendar_date));
   return ResultCode::OK;
 }
-
 inline Result Feed::add_transfer(const ParsedCsvRow & row)
 {
   Transfer transfer;
-  try
-  {
-    // Required fields:
-    transfer.from_stop_id = row.at("from_stop_id");
-    transfer.to_stop_id = row.at("to_stop_id");
-    set_field(transfer.transfer_type, row, "transfer_type", false);
-
-    // Optional:
-    set_field(transfer.min_transfer_time, row, "min_transfer_time");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(transfer.from_stop_id, row, TransferColumn::from_stop_id)) ==
+          ResultCode::OK &&
+      (res = read_required(transfer.to_stop_id, row, TransferColumn::to_stop_id)) ==
+          ResultCode::OK &&
+      (res = read_required(transfer.transfer_type, row, TransferColumn::transfer_type)) ==
+          ResultCode::OK &&
+      // Optional:
+      (res = read_field(transfer.min_transfer_time, row, TransferColumn::min_transfer_time)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-  transfers.emplace_back(transfer);
+  add_transfer(std::move(transfer));
   return ResultCode::OK;
 }
-
 inline Result Feed::add_frequency(const ParsedCsvRow & row)
 {
   Frequency frequency;
-  try
-  {
-    // Required fields:
-    frequency.trip_id = row.at("trip_id");
-    frequency.start_time = Time(row.at("start_time"));
-    frequency.end_time = Time(row.at("end_time"));
-    set_field(frequency.headway_secs, row, "headway_secs", false);
-
-    // Optional:
-    set_field(frequency.exact_times, row, "exact_times");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(frequency.trip_id, row, FrequencyColumn::trip_id)) == ResultCode::OK &&
+      (res = read_required(frequency.start_time, row, FrequencyColumn::start_time)) ==
+          ResultCode::OK &&
+      (res = read_required(frequency.end_time, row, FrequencyColumn::end_time)) ==
+          ResultCode::OK &&
+      (res = read_required(frequency.headway_secs, row, FrequencyColumn::headway_secs)) ==
+          ResultCode::OK &&
+      // Optional:
+      (res = read_field(frequency.exact_times, row, FrequencyColumn::exact_times)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-  frequencies.emplace_back(frequency);
+  add_frequency(std::move(frequency));
   return ResultCode::OK;
 }
-
 inline Result Feed::add_fare_attributes(const ParsedCsvRow & row)
 {
   FareAttributesItem item;
-  try
-  {
-    // Required fields:
-    item.fare_id = row.at("fare_id");
-    set_fractional(item.price, row, "price", false);
-
-    item.currency_type = row.at("currency_type");
-    set_field(item.payment_method, row, "payment_method", false);
-    set_field(item.transfers, row, "transfers");
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(item.fare_id, row, FareAttributesColumn::fare_id)) == ResultCode::OK &&
+      (res = read_required(item.price, row, FareAttributesColumn::price)) == ResultCode::OK &&
+      (res = read_required(item.currency_type, row, FareAttributesColumn::currency_type)) ==
+          ResultCode::OK &&
+      (res = read_required(item.payment_method, row, FareAttributesColumn::payment_method)) ==
+          ResultCode::OK &&
+      (res = read_field(item.transfers, row, FareAttributesColumn::transfers)) == ResultCode::OK &&
+      // Conditionally optional:
+      (res = read_field(item.transfer_duration, row, FareAttributesColumn::transfer_duration)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-    // Conditionally optional:
-    item.agency_id = get_value_or_default(row, "agency_id");
-    set_field(item.transfer_duration, row, "transfer_duration");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  item.agency_id = row.get(FareAttributesColumn::agency_id);
 
-  fare_attributes.emplace_back(item);
+  add_fare_attributes(std::move(item));
   return ResultCode::OK;
 }
-
 inline Result Feed::add_fare_rule(const ParsedCsvRow & row)
 {
   FareRule fare_rule;
-  try
-  {
-    // Required fields:
-    fare_rule.fare_id = row.at("fare_id");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+
+  // Required fields:
+  Result res = read_required(fare_rule.fare_id, row, FareRuleColumn::fare_id);
+  if (res != ResultCode::OK)
+    return res;
 
   // Optional fields:
-  fare_rule.route_id = get_value_or_default(row, "route_id");
-  fare_rule.origin_id = get_value_or_default(row, "origin_id");
-  fare_rule.destination_id = get_value_or_default(row, "destination_id");
-  fare_rule.contains_id = get_value_or_default(row, "contains_id");
+  fare_rule.route_id = row.get(FareRuleColumn::route_id);
+  fare_rule.origin_id = row.get(FareRuleColumn::origin_id);
+  fare_rule.destination_id = row.get(FareRuleColumn::destination_id);
+  fare_rule.contains_id = row.get(FareRuleColumn::contains_id);
 
-  fare_rules.emplace_back(fare_rule);
+  add_fare_rule(std::move(fare_rule));
 
   return ResultCode::OK;
 }
-
 inline Result Feed::add_pathway(const ParsedCsvRow & row)
 {
   Pathway path;
-  try
-  {
-    // Required fields:
-    path.pathway_id = row.at("pathway_id");
-    path.from_stop_id = row.at("from_stop_id");
-    path.to_stop_id = row.at("to_stop_id");
-    set_field(path.pathway_mode, row, "pathway_mode", false);
-    set_field(path.is_bidirectional, row, "is_bidirectional", false);
-
-    // Optional fields:
-    set_fractional(path.length, row, "length");
-    set_field(path.traversal_time, row, "traversal_time");
-    set_field(path.stair_count, row, "stair_count");
-    set_fractional(path.max_slope, row, "max_slope");
-    set_fractional(path.min_width, row, "min_width");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(path.pathway_id, row, PathwayColumn::pathway_id)) == ResultCode::OK &&
+      (res = read_required(path.from_stop_id, row, PathwayColumn::from_stop_id)) ==
+          ResultCode::OK &&
+      (res = read_required(path.to_stop_id, row, PathwayColumn::to_stop_id)) == ResultCode::OK &&
+      (res = read_required(path.pathway_mode, row, PathwayColumn::pathway_mode)) ==
+          ResultCode::OK &&
+      (res = read_required(path.is_bidirectional, row, PathwayColumn::is_bidirectional)) ==
+          ResultCode::OK &&
+      // Optional fields:
+      (res = read_fractional(path.length, row, PathwayColumn::length)) == ResultCode::OK &&
+      (res = read_field(path.traversal_time, row, PathwayColumn::traversal_time)) ==
+          ResultCode::OK &&
+      (res = read_field(path.stair_count, row, PathwayColumn::stair_count)) == ResultCode::OK &&
+      (res = read_fractional(path.max_slope, row, PathwayColumn::max_slope)) == ResultCode::OK &&
+      (res = read_fractional(path.min_width, row, PathwayColumn::min_width)) == ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-  path.signposted_as = get_value_or_default(row, "signposted_as");
-  path.reversed_signposted_as = get_value_or_default(row, "reversed_signposted_as");
+  path.signposted_as = row.get(PathwayColumn::signposted_as);
+  path.reversed_signposted_as = row.get(PathwayColumn::reversed_signposted_as);
 
-  pathways.emplace_back(path);
+  add_pathway(std::move(path));
   return ResultCode::OK;
 }
-
 inline Result Feed::add_level(const ParsedCsvRow & row)
 {
   Level level;
-  try
-  {
-    // Required fields:
-    level.level_id = row.at("level_id");
-
-    set_fractional(level.level_index, row, "level_index", false);
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(level.level_id, row, LevelColumn::level_id)) == ResultCode::OK &&
+      (res = read_required(level.level_index, row, LevelColumn::level_index)) == ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
   // Optional field:
-  level.level_name = get_value_or_default(row, "level_name");
+  level.level_name = row.get(LevelColumn::level_name);
 
-  levels.emplace_back(level);
+  add_level(std::move(level));
 
   return ResultCode::OK;
 }
-
 inline Result Feed::add_feed_info(const ParsedCsvRow & row)
 {
-  try
-  {
-    // Required fields:
-    feed_info.feed_publisher_name = row.at("feed_publisher_name");
-    feed_info.feed_publisher_url = row.at("feed_publisher_url");
-    feed_info.feed_lang = row.at("feed_lang");
-
-    // Optional fields:
-    feed_info.feed_start_date = Date(get_value_or_default(row, "feed_start_date"));
-    feed_info.feed_end_date = Date(get_value_or_default(row, "feed_end_date"));
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(feed_info.feed_publisher_name, row,
+                           FeedInfoColumn::feed_publisher_name)) == ResultCode::OK &&
+      (res = read_required(feed_info.feed_publisher_url, row,
+                           FeedInfoColumn::feed_publisher_url)) == ResultCode::OK &&
+      (res = read_required(feed_info.feed_lang, row, FeedInfoColumn::feed_lang)) ==
+          ResultCode::OK &&
+      // Optional fields:
+      (res = feed_info.feed_start_date.parse(row.get(FeedInfoColumn::feed_start_date))) ==
+          ResultCode::OK &&
+      (res = feed_info.feed_end_date.parse(row.get(FeedInfoColumn::feed_end_date))) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
   // Optional fields:
-  feed_info.feed_version = get_value_or_default(row, "feed_version");
-  feed_info.feed_contact_email = get_value_or_default(row, "feed_contact_email");
-  feed_info.feed_contact_url = get_value_or_default(row, "feed_contact_url");
+  feed_info.feed_version = row.get(FeedInfoColumn::feed_version);
+  feed_info.feed_contact_email = row.get(FeedInfoColumn::feed_contact_email);
+  feed_info.feed_contact_url = row.get(FeedInfoColumn::feed_contact_url);
 
   return ResultCode::OK;
 }
-
 inline Result Feed::add_translation(const ParsedCsvRow & row)
 {
   static const std::vector<Text> available_tables{"agency",     "stops",    "routes", "trips",
                                                   "stop_times", "pathways", "levels"};
   Translation translation;
 
-  try
-  {
-    // Required fields:
-    translation.table_name = row.at("table_name");
-    if (std::find(available_tables.begin(), available_tables.end(), translation.table_name) ==
-        available_tables.end())
-    {
-      throw InvalidFieldFormat("Field table_name of translations doesn't have required value");
-    }
-
-    translation.field_name = row.at("field_name");
-    translation.language = row.at("language");
-    translation.translation = row.at("translation");
+  // Required fields:
+  Result res = read_required(translation.table_name, row, TranslationColumn::table_name);
+  if (res != ResultCode::OK)
+    return res;
 
-    // Conditionally required:
-    translation.record_id = get_value_or_default(row, "record_id");
-    translation.record_sub_id = get_value_or_default(row, "record_sub_id");
-  }
-  catch (const std::out_of_range & ex)
-  {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
-  }
-  catch (const std::invalid_argument & ex)
-  {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
-  }
-  catch (const InvalidFieldFormat & ex)
+  if (std::find(available_tables.begin(), available_tables.end(), translation.table_name) ==
+      available_tables.end())
   {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
+    return invalid_field_format("Field table_name of translations doesn't have required value");
   }
 
+  const bool is_parsed =
+      (res = read_required(translation.field_name, row, TranslationColumn::field_name)) ==
+          ResultCode::OK &&
+      (res = read_required(translation.language, row, TranslationColumn::language)) ==
+          ResultCode::OK &&
+      (res = read_required(translation.translation, row, TranslationColumn::translation)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
+
   // Conditionally required:
-  translation.field_value = get_value_or_default(row, "field_value");
+  translation.record_id = row.get(TranslationColumn::record_id);
+  translation.record_sub_id = row.get(TranslationColumn::record_sub_id);
+  translation.field_value = row.get(TranslationColumn::field_value);
 
-  translations.emplace_back(translation);
+  add_translation(std::move(translation));
 
   return ResultCode::OK;
 }
-
 inline Result Feed::add_attribution(const ParsedCsvRow & row)
 {
   Attribution attribution;
+  Result res;
+  const bool is_parsed =
+      // Required fields:
+      (res = read_required(attribution.organization_name, row,
+                           AttributionColumn::organization_name)) == ResultCode::OK &&
+      // Optional fields:
+      (res = read_field(attribution.is_producer, row, AttributionColumn::is_producer)) ==
+          ResultCode::OK &&
+      (res = read_field(attribution.is_operator, row, AttributionColumn::is_operator)) ==
+          ResultCode::OK &&
+      (res = read_field(attribution.is_authority, row, AttributionColumn::is_authority)) ==
+          ResultCode::OK;
+  if (!is_parsed)
+    return res;
 
-  try
-  {
-    // Required fields:
-    attribution.organization_name = row.at("organization_name");
+  // Optional fields:
+  attribution.attribution_id = row.get(AttributionColumn::attribution_id);
+  attribution.agency_id = row.get(AttributionColumn::agency_id);
+  attribution.route_id = row.get(AttributionColumn::route_id);
+  attribution.trip_id = row.get(AttributionColumn::trip_id);
 
-    // Optional fields:
-    attribution.attribution_id = get_value_or_default(row, "attribution_id");
-    attribution.agency_id = get_value_or_default(row, "agency_id");
-    attribution.route_id = get_value_or_default(row, "route_id");
-    attribution.trip_id = get_value_or_default(row, "trip_id");
+  attribution.attribution_url = row.get(AttributionColumn::attribution_url);
+  attribution.attribution_email = row.get(AttributionColumn::attribution_email);
+  attribution.attribution_phone = row.get(AttributionColumn::attribution_phone);
 
-    set_field(attribution.is_producer, row, "is_producer");
-    set_field(attribution.is_operator, row, "is_operator");
-    set_field(attribution.is_authority, row, "is_authority");
+  add_attribution(std::move(attribution));
+
+  return ResultCode::OK;
+}
+inline Result Feed::write_csv(const std::string & path, const std::string & file,
+                              const std::vector<std::string> & columns,
+                              const std::function<void(CsvWriter & writer)> & write_entities) const
+{
+  const std::string filepath = add_trailing_slash(path) + file;
+  std::ofstream out(filepath);
+  if (!out.is_open())
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not open path for writing " + filepath};
 
-    attribution.attribution_url = get_value_or_default(row, "attribution_url");
-    attribution.attribution_email = get_value_or_default(row, "attribution_email");
-    attribution.trip_id = get_value_or_default(row, "attribution_phone");
-  }
-  catch (const std::out_of_range & ex)
   {
-    return {ResultCode::ERROR_REQUIRED_FIELD_ABSENT, ex.what()};
+    CsvWriter writer(out);
+    writer.write_all(columns);
+    writer.end_record();
+    write_entities(writer);
   }
-  catch (const std::invalid_argument & ex)
+
+  if (!out)
+    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not write " + filepath};
+  return ResultCode::OK;
+}
+
+inline Result Feed::open_csv(CsvParser & parser, const std::string & filename) const
+{
+  std::unique_ptr<InputStream> stream;
+  if (source)
   {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
+    Result res = source->open(filename, stream);
+    if (res != ResultCode::OK)
+      return res;
   }
-  catch (const InvalidFieldFormat & ex)
+  else
   {
-    return {ResultCode::ERROR_INVALID_FIELD_FORMAT, ex.what()};
+    std::error_code ec;
+    if (!std::filesystem::exists(gtfs_directory + filename, ec))
+      stream = open_compressed_file(gtfs_directory + filename);
   }
 
-  attributions.emplace_back(attribution);
-
-  return ResultCode::OK;
+  // Decompression runs on its own thread while the rows are parsed.
+  if (stream)
+    parser.assign_input(std::make_unique<PipelinedStream>(std::move(stream)));
+  return parser.read_header(filename);
 }
 
-inline Result Feed::write_csv(const std::string & path, const std::string & file,
-                              const std::function<void(std::ofstream & out)> & write_header,
-                              const std::function<void(std::ofstream & out)> & write_entities) const
+inline uintmax_t Feed::get_file_size(const std::string & filename) const
 {
-  const std::string filepath = add_trailing_slash(path) + file;
-  std::ofstream out(filepath);
-  if (!out.is_open())
-    return {ResultCode::ERROR_INVALID_GTFS_PATH, "Could not open path for writing " + filepath};
+  if (source)
+    return source->get_file_size(filename);
 
-  write_header(out);
-  write_entities(out);
-  return ResultCode::OK;
+  std::error_code ec;
+  const uintmax_t size = std::filesystem::file_size(gtfs_directory + filename, ec);
+  return ec ? 0 : size;
 }
 
 inline Result Feed::parse_csv(const std::string & filename,
-                              const std::function<Result(const ParsedCsvRow & record)> & add_entity)
+                              const std::vector<std::string> & columns,
+                              const std::function<Result(const ParsedCsvRow & record)> & add_entity,
+                              const std::function<void(size_t rows_count)> & reserve)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const size_t start_memory = load_stats ? get_memory_usage() : 0;
+  take_fingerprint(filename);
+  CsvParser parser(gtfs_directory, CsvParserMode::MemoryMapped);
+  auto res_header = open_csv(parser, filename);
+  if (res_header.code != ResultCode::OK)
+    return res_header;
+
+  FileLoadStats stats;
+  if (load_stats)
+    stats.io_seconds = get_seconds_since(start);
+
+  if (reserve)
+    reserve(estimate_rows_count(parser.get_unread_data()));
+
+  const ColumnIndex column_index =
+      get_column_index(filename, columns, parser.get_field_sequence());
+  CsvRowView values;
+  const ParsedCsvRow record(column_index, values);
+
+  auto add_row = [&](const ParsedCsvRow & row) {
+    Result res = add_entity(row);
+    if (res != ResultCode::OK)
+      res.message += " while adding item from " + filename;
+    return res;
+  };
+  const Result res = load_stats ? read_csv_rows<true>(parser, values, record, stats, add_row)
+                                : read_csv_rows<false>(parser, values, record, stats, add_row);
+  if (load_stats)
+    add_load_stats(filename, stats, start, start_memory, true);
+  if (res != ResultCode::OK)
+    return res;
+
+  return {ResultCode::OK, {"Parsed " + filename}};
+}
+
+template <typename Entity, typename Container>
+Result Feed::parse_csv_in_chunks(const std::string & filename,
+                                 const std::vector<std::string> & columns, size_t threads_count,
+                                 Result (*parse_entity)(const ParsedCsvRow & row, Entity & entity),
+                                 Container & container)
 {
-  CsvParser parser(gtfs_directory);
-  auto res_header = parser.read_header(filename);
+  const auto start = std::chrono::steady_clock::now();
+  const size_t start_memory = load_stats ? get_memory_usage() : 0;
+  take_fingerprint(filename);
+  CsvParser parser(gtfs_directory, CsvParserMode::MemoryMapped);
+  auto res_header = open_csv(parser, filename);
   if (res_header.code != ResultCode::OK)
     return res_header;
 
-  ParsedCsvRow record;
-  Result res_row;
-  while ((res_row = parser.read_row(record)) != ResultCode::END_OF_FILE)
-  {
-    if (res_row != ResultCode::OK)
-      return res_row;
+  FileLoadStats stats;
+  if (load_stats)
+    stats.io_seconds = get_seconds_since(start);
 
-    if (record.empty())
-      continue;
+  const ColumnIndex column_index =
+      get_column_index(filename, columns, parser.get_field_sequence());
 
-    Result res = add_entity(record);
+  auto parse_row = [&](const ParsedCsvRow & row, Container & entities) {
+    Entity entity;
+    Result res = parse_entity(row, entity);
     if (res != ResultCode::OK)
     {
       res.message += " while adding item from " + filename;
       return res;
     }
+    entities.push_back(std::move(entity));
+    return res;
+  };
+
+  // Several chunks per thread help to balance the load if some chunks are parsed slower.
+  static constexpr size_t chunks_per_thread = 4;
+  static constexpr size_t min_chunk_size = 1 << 16;
+  threads_count = get_threads_count(threads_count);
+  const std::string_view data = parser.get_unread_data();
+  const size_t chunks_count =
+      std::min(threads_count * chunks_per_thread, data.size() / min_chunk_size + 1);
+
+  // Compressed input is not split into chunks: it is parsed while being decompressed. A single
+  // thread or chunk is parsed serially too, without copying the chunk into the container.
+  if (parser.has_input() || threads_count == 1 || chunks_count == 1)
+  {
+    if (!parser.has_input())
+      container.reserve(container.size() + estimate_rows_count(data));
+
+    CsvRowView values;
+    const ParsedCsvRow record(column_index, values);
+    auto add_row = [&](const ParsedCsvRow & row) { return parse_row(row, container); };
+    const Result res = load_stats ? read_csv_rows<true>(parser, values, record, stats, add_row)
+                                  : read_csv_rows<false>(parser, values, record, stats, add_row);
+    if (load_stats)
+      add_load_stats(filename, stats, start, start_memory, true);
+    if (res != ResultCode::OK)
+      return res;
+
+    return {ResultCode::OK, {"Parsed " + filename}};
+  }
+
+  const std::vector<std::string_view> chunks = split_into_chunks(data, chunks_count);
+
+  std::vector<Container> entities;
+  entities.reserve(chunks.size());
+  for (size_t i = 0; i < chunks.size(); ++i)
+    entities.push_back(make_container<Container>());
+  std::vector<Result> results(chunks.size());
+  std::vector<FileLoadStats> chunks_stats(chunks.size());
+
+  run_in_parallel(chunks.size(), threads_count, [&](size_t i) {
+    CsvParser chunk_parser;
+    chunk_parser.assign_data(chunks[i]);
+    entities[i].reserve(estimate_rows_count(chunks[i]));
+
+    CsvRowView values;
+    const ParsedCsvRow record(column_index, values);
+    auto add_row = [&](const ParsedCsvRow & row) { return parse_row(row, entities[i]); };
+    FileLoadStats & chunk_stats = chunks_stats[i];
+    results[i] = load_stats
+                     ? read_csv_rows<true>(chunk_parser, values, record, chunk_stats, add_row)
+                     : read_csv_rows<false>(chunk_parser, values, record, chunk_stats, add_row);
+  });
+
+  // Entities are added in the file order up to the first error, as while parsing serially. The
+  // empty container takes the first chunk without copying and is reserved after that. Chunks are
+  // freed after appending, so they don't stay in memory along with the whole container.
+  size_t total_count = container.size();
+  for (const auto & chunk_entities : entities)
+    total_count += chunk_entities.size();
+  if (!container.empty())
+    container.reserve(total_count);
+
+  Result res = ResultCode::OK;
+  for (size_t i = 0; i < chunks.size() && res == ResultCode::OK; ++i)
+  {
+    append_rows(container, std::move(entities[i]));
+    if (i == 0)
+      container.reserve(total_count);
+    res = results[i];
+
+    stats.rows_parsed += chunks_stats[i].rows_parsed;
+    stats.rows_skipped += chunks_stats[i].rows_skipped;
+    stats.io_seconds += chunks_stats[i].io_seconds;
+    stats.split_seconds += chunks_stats[i].split_seconds;
+    stats.add_seconds += chunks_stats[i].add_seconds;
   }
 
+  if (load_stats)
+    add_load_stats(filename, stats, start, start_memory, true);
+  if (res != ResultCode::OK)
+    return res;
+
+  return {ResultCode::OK, {"Parsed " + filename}};
+}
+
+template <typename Entity>
+Result Feed::parse_csv_streaming(const std::string & filename,
+                                 const std::vector<std::string> & columns,
+                                 Result (*parse_entity)(const ParsedCsvRow & row, Entity & entity),
+                                 const std::function<void(const Entity & entity)> & handler)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const size_t start_memory = load_stats ? get_memory_usage() : 0;
+  CsvParser parser(gtfs_directory, CsvParserMode::Stream);
+  auto res_header = open_csv(parser, filename);
+  if (res_header.code != ResultCode::OK)
+    return res_header;
+
+  FileLoadStats stats;
+  if (load_stats)
+    stats.io_seconds = get_seconds_since(start);
+
+  const ColumnIndex column_index =
+      get_column_index(filename, columns, parser.get_field_sequence());
+  CsvRowView values;
+  const ParsedCsvRow record(column_index, values);
+
+  // Optional fields absent in the row are reset to the defaults. Copying the empty strings keeps
+  // the allocated buffers of the entity for the next rows.
+  const Entity default_entity;
+  Entity entity;
+
+  auto add_row = [&](const ParsedCsvRow & row) {
+    entity = default_entity;
+    Result res = parse_entity(row, entity);
+    if (res != ResultCode::OK)
+    {
+      res.message += " while reading item from " + filename;
+      return res;
+    }
+    handler(entity);
+    return res;
+  };
+  const Result res = load_stats ? read_csv_rows<true>(parser, values, record, stats, add_row)
+                                : read_csv_rows<false>(parser, values, record, stats, add_row);
+  if (load_stats)
+    add_load_stats(filename, stats, start, start_memory, false);
+  if (res != ResultCode::OK)
+    return res;
+
   return {ResultCode::OK, {"Parsed " + filename}};
 }
 
+template <typename Container, typename RowWriter>
+Result Feed::write_csv_in_chunks(const std::string & path, const std::string & file,
+                                 const std::vector<std::string> & columns,
+                                 const Container & container, size_t threads_count,
+                                 RowWriter write_row) const
+{
+  // Chunks are formatted in batches and written in order, so only one batch is kept in memory.
+  static constexpr size_t chunk_size = 1 << 14;
+  static constexpr size_t chunks_per_thread = 4;
+  threads_count = get_threads_count(threads_count);
+  const size_t chunks_count = (container.size() + chunk_size - 1) / chunk_size;
+  const size_t batch_size = threads_count * chunks_per_thread;
+
+  auto container_writer = [&](CsvWriter & writer) {
+    if (threads_count == 1)
+    {
+      for (size_t i = 0; i < container.size(); ++i)
+        write_row(writer, container[i]);
+      return;
+    }
+
+    for (size_t batch_begin = 0; batch_begin < chunks_count; batch_begin += batch_size)
+    {
+      const size_t batch_end = std::min(chunks_count, batch_begin + batch_size);
+      std::vector<CsvWriter> chunks(batch_end - batch_begin);
+      run_in_parallel(chunks.size(), threads_count, [&](size_t i) {
+        const size_t begin = (batch_begin + i) * chunk_size;
+        const size_t end = std::min(container.size(), begin + chunk_size);
+        for (size_t j = begin; j < end; ++j)
+          write_row(chunks[i], container[j]);
+      });
+
+      for (const auto & chunk : chunks)
+        writer.write_block(chunk.get_buffer());
+    }
+  };
+
+  return write_csv(path, file, columns, container_writer);
+}
+
 inline Result Feed::read_agencies()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_agency(record); };
-  return parse_csv(file_agency, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->agencies, rows_count); };
+  return parse_csv(file_agency, agency_columns, handler, reserve);
 }
 
 inline Result Feed::write_agencies(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_agencies(out); };
-  return write_csv(gtfs_path, file_agency, write_agency_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_agencies(writer); };
+  return write_csv(gtfs_path, file_agency, agency_columns, container_writer);
+}
+
+inline const Agencies & Feed::get_agencies() const
+{
+  load_lazy_file(file_agency);
+  return agencies;
+}
+
+inline std::optional<Agency> Feed::get_agency(const Id & agency_id) const
+{
+  return to_optional(find_agency(agency_id));
 }
 
-inline const Agencies & Feed::get_agencies() const { return agencies; }
-
-inline std::optional<Agency> Feed::get_agency(const Id & agency_id) const
+inline const Agency * Feed::find_agency(const Id & agency_id) const
 {
+  load_lazy_file(file_agency);
+
   // agency id is required when the dataset contains data for multiple agencies,
   // otherwise it is optional:
   if (agency_id.empty() && agencies.size() == 1)
-    return agencies[0];
+    return &agencies[0];
+
+  if (indexes_built)
+    return find_by_index(agencies, agencies_index, agency_id);
 
   const auto it =
       std::find_if(agencies.begin(), agencies.end(),
                    [&agency_id](const Agency & agency) { return agency.agency_id == agency_id; });
 
   if (it == agencies.end())
-    return std::nullopt;
+    return nullptr;
 
-  return *it;
+  return &*it;
 }
 
-inline void Feed::add_agency(const Agency & agency) { agencies.emplace_back(agency); }
+inline void Feed::add_agency(const Agency & agency) { add_agency(Agency(agency)); }
+
+inline void Feed::add_agency(Agency && agency)
+{
+  agencies.emplace_back(std::move(agency));
+  add_to_index(agencies_index, agencies.back().agency_id, agencies.size() - 1);
+}
 
 inline Result Feed::read_stops()
+{
+  drop_file_indexes(file_stops);
+  return parse_stops();
+}
+
+inline Result Feed::parse_stops()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_stop(record); };
-  return parse_csv(file_stops, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->stops, rows_count); };
+  return parse_csv(file_stops, stops_columns, handler, reserve);
 }
 
 inline Result Feed::write_stops(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_stops(out); };
-  return write_csv(gtfs_path, file_stops, write_stops_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_stops(writer); };
+  return write_csv(gtfs_path, file_stops, stops_columns, container_writer);
 }
 
-inline const Stops & Feed::get_stops() const { return stops; }
+inline const Stops & Feed::get_stops() const
+{
+  load_lazy_file(file_stops);
+  return stops;
+}
 
 inline std::optional<Stop> Feed::get_stop(const Id & stop_id) const
 {
+  return to_optional(find_stop(stop_id));
+}
+
+inline const Stop * Feed::find_stop(const Id & stop_id) const
+{
+  load_lazy_file(file_stops);
+
+  if (indexes_built)
+    return find_by_index(stops, stops_index, stop_id);
+
   const auto it = std::find_if(stops.begin(), stops.end(),
                                [&stop_id](const Stop & stop) { return stop.stop_id == stop_id; });
 
   if (it == stops.end())
-    return std::nullopt;
+    return nullptr;
 
-  return *it;
+  return &*it;
+}
+
+inline void Feed::add_stop(const Stop & stop) { add_stop(Stop(stop)); }
+
+inline void Feed::add_stop(Stop && stop)
+{
+  push_stop(std::move(stop));
+  spatial_index_built = false;
 }
 
-inline void Feed::add_stop(const Stop & stop) { stops.emplace_back(stop); }
+inline void Feed::push_stop(Stop && stop)
+{
+  stops.emplace_back(std::move(stop));
+  add_to_index(stops_index, stops.back().stop_id, stops.size() - 1);
+}
 
 inline Result Feed::read_routes()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_route(record); };
-  return parse_csv(file_routes, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->routes, rows_count); };
+  return parse_csv(file_routes, routes_columns, handler, reserve);
 }
 
 inline Result Feed::write_routes(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_routes(out); };
-  return write_csv(gtfs_path, file_routes, write_routes_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_routes(writer); };
+  return write_csv(gtfs_path, file_routes, routes_columns, container_writer);
 }
 
-inline const Routes & Feed::get_routes() const { return routes; }
+inline const Routes & Feed::get_routes() const
+{
+  load_lazy_file(file_routes);
+  return routes;
+}
 
 inline std::optional<Route> Feed::get_route(const Id & route_id) const
 {
+  return to_optional(find_route(route_id));
+}
+
+inline const Route * Feed::find_route(const Id & route_id) const
+{
+  load_lazy_file(file_routes);
+
+  if (indexes_built)
+    return find_by_index(routes, routes_index, route_id);
+
   const auto it = std::find_if(routes.begin(), routes.end(), [&route_id](const Route & route) {
     return route.route_id == route_id;
   });
 
   if (it == routes.end())
-    return std::nullopt;
+    return nullptr;
 
-  return *it;
+  return &*it;
 }
 
-inline void Feed::add_route(const Route & route) { routes.emplace_back(route); }
+inline void Feed::add_route(const Route & route) { add_route(Route(route)); }
+
+inline void Feed::add_route(Route && route)
+{
+  routes.emplace_back(std::move(route));
+  add_to_index(routes_index, routes.back().route_id, routes.size() - 1);
+}
 
 inline Result Feed::read_trips()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_trip(record); };
-  return parse_csv(file_trips, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->trips, rows_count); };
+  return parse_csv(file_trips, trips_columns, handler, reserve);
 }
 
 inline Result Feed::write_trips(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_trips(out); };
-  return write_csv(gtfs_path, file_trips, write_trips_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_trips(writer); };
+  return write_csv(gtfs_path, file_trips, trips_columns, container_writer);
 }
 
-inline const Trips & Feed::get_trips() const { return trips; }
+inline const Trips & Feed::get_trips() const
+{
+  load_lazy_file(file_trips);
+  return trips;
+}
 
 inline std::optional<Trip> Feed::get_trip(const Id & trip_id) const
 {
+  return to_optional(find_trip(trip_id));
+}
+
+inline const Trip * Feed::find_trip(const Id & trip_id) const
+{
+  load_lazy_file(file_trips);
+
+  if (indexes_built)
+    return find_by_index(trips, trips_index, trip_id);
+
   const auto it = std::find_if(trips.begin(), trips.end(),
                                [&trip_id](const Trip & trip) { return trip.trip_id == trip_id; });
 
   if (it == trips.end())
-    return std::nullopt;
+    return nullptr;
 
-  return *it;
+  return &*it;
 }
 
-inline void Feed::add_trip(const Trip & trip) { trips.emplace_back(trip); }
+inline void Feed::add_trip(const Trip & trip) { add_trip(Trip(trip)); }
+
+inline void Feed::add_trip(Trip && trip)
+{
+  trips.emplace_back(std::move(trip));
+  add_to_index(trips_index, trips.back().trip_id, trips.size() - 1);
+}
 
 inline Result Feed::read_stop_times()
+{
+  drop_file_indexes(file_stop_times);
+  return parse_stop_times();
+}
+
+inline Result Feed::parse_stop_times()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_stop_time(record); };
-  return parse_csv(file_stop_times, handler);
+  auto reserve = [this](size_t rows_count) {
+    if (storage_layout == StorageLayout::Columns)
+      reserve_rows(this->columnar_stop_times, rows_count);
+    else
+      reserve_rows(this->stop_times, rows_count);
+  };
+  return parse_csv(file_stop_times, stop_times_columns, handler, reserve);
+}
+
+inline Result Feed::read_stop_times(size_t threads_count)
+{
+  drop_file_indexes(file_stop_times);
+  return parse_stop_times(threads_count);
+}
+
+inline Result Feed::parse_stop_times(size_t threads_count)
+{
+  if (storage_layout == StorageLayout::Columns)
+  {
+    return parse_csv_in_chunks(file_stop_times, stop_times_columns, threads_count,
+                               &Feed::parse_stop_time, columnar_stop_times);
+  }
+  return parse_csv_in_chunks(file_stop_times, stop_times_columns, threads_count,
+                             &Feed::parse_stop_time, stop_times);
+}
+
+inline Result Feed::for_each_stop_time(
+    const std::function<void(const StopTime & stop_time)> & handler)
+{
+  return parse_csv_streaming(file_stop_times, stop_times_columns, &Feed::parse_stop_time, handler);
 }
 
 inline Result Feed::write_stop_times(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_stop_times(out); };
-  return write_csv(gtfs_path, file_stop_times, write_stop_times_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_stop_times(writer); };
+  return write_csv(gtfs_path, file_stop_times, stop_times_columns, container_writer);
+}
+
+inline Result Feed::write_stop_times(const std::string & gtfs_path, size_t threads_count) const
+{
+  auto row_writer = [](CsvWriter & writer, const auto & stop_time) {
+    write_stop_time(writer, stop_time);
+  };
+  if (storage_layout == StorageLayout::Columns)
+  {
+    return write_csv_in_chunks(gtfs_path, file_stop_times, stop_times_columns,
+                               columnar_stop_times, threads_count, row_writer);
+  }
+  return write_csv_in_chunks(gtfs_path, file_stop_times, stop_times_columns, stop_times,
+                             threads_count, row_writer);
+}
+
+inline const StopTimes & Feed::get_stop_times() const
+{
+  load_lazy_file(file_stop_times);
+  return stop_times;
+}
+
+inline const ColumnarStopTimes & Feed::get_columnar_stop_times() const
+{
+  load_lazy_file(file_stop_times);
+  return columnar_stop_times;
 }
 
-inline const StopTimes & Feed::get_stop_times() const { return stop_times; }
+// Copies the items of the columnar container with the id in the column.
+template <typename Container, typename Entity>
+void copy_rows_with_id(const Container & container, const EntityVector<Id> & ids, const Id & id,
+                       EntityVector<Entity> & res)
+{
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    if (ids[i] == id)
+      res.emplace_back(container.get(i));
+  }
+}
 
 inline StopTimes Feed::get_stop_times_for_stop(const Id & stop_id) const
 {
+  load_lazy_file(file_stop_times);
+
   StopTimes res;
+  if (storage_layout == StorageLayout::Columns)
+  {
+    copy_rows_with_id(columnar_stop_times, columnar_stop_times.get_stop_ids(), stop_id, res);
+    return res;
+  }
+
   for (const auto & stop_time : stop_times)
   {
     if (stop_time.stop_id == stop_id)
@@ -2287,12 +9703,28 @@ inline StopTimes Feed::get_stop_times_for_stop(const Id & stop_id) const
 
 inline StopTimes Feed::get_stop_times_for_trip(const Id & trip_id, bool sort_by_sequence) const
 {
+  load_lazy_file(file_stop_times);
+
+  if (sort_by_sequence && stop_times_index_built)
+  {
+    const StopTimesRange range = get_stop_times_range_for_trip(trip_id);
+    return StopTimes(range.begin(), range.end());
+  }
+
   StopTimes res;
-  for (const auto & stop_time : stop_times)
+  if (storage_layout == StorageLayout::Columns)
   {
-    if (stop_time.trip_id == trip_id)
-      res.emplace_back(stop_time);
+    copy_rows_with_id(columnar_stop_times, columnar_stop_times.get_trip_ids(), trip_id, res);
+  }
+  else
+  {
+    for (const auto & stop_time : stop_times)
+    {
+      if (stop_time.trip_id == trip_id)
+        res.emplace_back(stop_time);
+    }
   }
+
   if (sort_by_sequence)
   {
     std::sort(res.begin(), res.end(), [](const StopTime & t1, const StopTime & t2) {
@@ -2302,56 +9734,126 @@ inline StopTimes Feed::get_stop_times_for_trip(const Id & trip_id, bool sort_by_
   return res;
 }
 
-inline void Feed::add_stop_time(const StopTime & stop_time) { stop_times.emplace_back(stop_time); }
+inline StopTimesRange Feed::get_stop_times_range_for_stop(const Id & stop_id) const
+{
+  return get_stop_times_range(stop_times_by_stop, stop_id);
+}
+
+inline StopTimesRange Feed::get_stop_times_range_for_trip(const Id & trip_id) const
+{
+  return get_stop_times_range(stop_times_by_trip, trip_id);
+}
+
+inline void Feed::add_stop_time(const StopTime & stop_time) { add_stop_time(StopTime(stop_time)); }
+
+inline void Feed::add_stop_time(StopTime && stop_time)
+{
+  push_stop_time(std::move(stop_time));
+  stop_times_index_built = false;
+}
+
+inline void Feed::push_stop_time(StopTime && stop_time)
+{
+  if (storage_layout == StorageLayout::Columns)
+    columnar_stop_times.push_back(std::move(stop_time));
+  else
+    stop_times.emplace_back(std::move(stop_time));
+}
 
 inline Result Feed::read_calendar()
+{
+  drop_file_indexes(file_calendar);
+  return parse_calendar();
+}
+
+inline Result Feed::parse_calendar()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_calendar_item(record); };
-  return parse_csv(file_calendar, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->calendar, rows_count); };
+  return parse_csv(file_calendar, calendar_columns, handler, reserve);
 }
 
 inline Result Feed::write_calendar(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_calendar(out); };
-  return write_csv(gtfs_path, file_calendar, write_calendar_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_calendar(writer); };
+  return write_csv(gtfs_path, file_calendar, calendar_columns, container_writer);
 }
 
-inline const Calendar & Feed::get_calendar() const { return calendar; }
+inline const Calendar & Feed::get_calendar() const
+{
+  load_lazy_file(file_calendar);
+  return calendar;
+}
 
 inline std::optional<CalendarItem> Feed::get_calendar(const Id & service_id) const
 {
+  return to_optional(find_calendar(service_id));
+}
+
+inline const CalendarItem * Feed::find_calendar(const Id & service_id) const
+{
+  load_lazy_file(file_calendar);
+
+  if (indexes_built)
+    return find_by_index(calendar, calendar_index, service_id);
+
   const auto it = std::find_if(calendar.begin(), calendar.end(),
                                [&service_id](const CalendarItem & calendar_item) {
                                  return calendar_item.service_id == service_id;
                                });
 
   if (it == calendar.end())
-    return std::nullopt;
+    return nullptr;
 
-  return *it;
+  return &*it;
 }
 
 inline void Feed::add_calendar_item(const CalendarItem & calendar_item)
 {
-  calendar.emplace_back(calendar_item);
+  add_calendar_item(CalendarItem(calendar_item));
+}
+
+inline void Feed::add_calendar_item(CalendarItem && calendar_item)
+{
+  push_calendar_item(std::move(calendar_item));
+  service_days_index_built = false;
+}
+
+inline void Feed::push_calendar_item(CalendarItem && calendar_item)
+{
+  calendar.emplace_back(std::move(calendar_item));
+  add_to_index(calendar_index, calendar.back().service_id, calendar.size() - 1);
 }
 
 inline Result Feed::read_calendar_dates()
+{
+  drop_file_indexes(file_calendar_dates);
+  return parse_calendar_dates();
+}
+
+inline Result Feed::parse_calendar_dates()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_calendar_date(record); };
-  return parse_csv(file_calendar_dates, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->calendar_dates, rows_count); };
+  return parse_csv(file_calendar_dates, calendar_dates_columns, handler, reserve);
 }
 
 inline Result Feed::write_calendar_dates(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_calendar_dates(out); };
-  return write_csv(gtfs_path, file_calendar_dates, write_calendar_dates_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_calendar_dates(writer); };
+  return write_csv(gtfs_path, file_calendar_dates, calendar_dates_columns, container_writer);
 }
 
-inline const CalendarDates & Feed::get_calendar_dates() const { return calendar_dates; }
+inline const CalendarDates & Feed::get_calendar_dates() const
+{
+  load_lazy_file(file_calendar_dates);
+  return calendar_dates;
+}
 
 inline CalendarDates Feed::get_calendar_dates(const Id & service_id, bool sort_by_date) const
 {
+  load_lazy_file(file_calendar_dates);
+
   CalendarDates res;
   for (const auto & calendar_date : calendar_dates)
   {
@@ -2371,25 +9873,43 @@ inline CalendarDates Feed::get_calendar_dates(const Id & service_id, bool sort_b
 
 inline void Feed::add_calendar_date(const CalendarDate & calendar_date)
 {
-  calendar_dates.emplace_back(calendar_date);
+  add_calendar_date(CalendarDate(calendar_date));
+}
+
+inline void Feed::add_calendar_date(CalendarDate && calendar_date)
+{
+  push_calendar_date(std::move(calendar_date));
+  service_days_index_built = false;
+}
+
+inline void Feed::push_calendar_date(CalendarDate && calendar_date)
+{
+  calendar_dates.emplace_back(std::move(calendar_date));
 }
 
 inline Result Feed::read_fare_rules()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_fare_rule(record); };
-  return parse_csv(file_fare_rules, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->fare_rules, rows_count); };
+  return parse_csv(file_fare_rules, fare_rules_columns, handler, reserve);
 }
 
 inline Result Feed::write_fare_rules(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_fare_rules(out); };
-  return write_csv(gtfs_path, file_fare_rules, write_fare_rules_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_fare_rules(writer); };
+  return write_csv(gtfs_path, file_fare_rules, fare_rules_columns, container_writer);
 }
 
-inline const FareRules & Feed::get_fare_rules() const { return fare_rules; }
+inline const FareRules & Feed::get_fare_rules() const
+{
+  load_lazy_file(file_fare_rules);
+  return fare_rules;
+}
 
 inline FareRules Feed::get_fare_rules(const Id & fare_id) const
 {
+  load_lazy_file(file_fare_rules);
+
   FareRules res;
   for (const auto & fare_rule : fare_rules)
   {
@@ -2400,24 +9920,36 @@ inline FareRules Feed::get_fare_rules(const Id & fare_id) const
   return res;
 }
 
-inline void Feed::add_fare_rule(const FareRule & fare_rule) { fare_rules.emplace_back(fare_rule); }
+inline void Feed::add_fare_rule(const FareRule & fare_rule) { add_fare_rule(FareRule(fare_rule)); }
+
+inline void Feed::add_fare_rule(FareRule && fare_rule)
+{
+  fare_rules.emplace_back(std::move(fare_rule));
+}
 
 inline Result Feed::read_fare_attributes()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_fare_attributes(record); };
-  return parse_csv(file_fare_attributes, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->fare_attributes, rows_count); };
+  return parse_csv(file_fare_attributes, fare_attributes_columns, handler, reserve);
 }
 
 inline Result Feed::write_fare_attributes(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_fare_attributes(out); };
-  return write_csv(gtfs_path, file_fare_attributes, write_fare_attributes_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_fare_attributes(writer); };
+  return write_csv(gtfs_path, file_fare_attributes, fare_attributes_columns, container_writer);
 }
 
-inline const FareAttributes & Feed::get_fare_attributes() const { return fare_attributes; }
+inline const FareAttributes & Feed::get_fare_attributes() const
+{
+  load_lazy_file(file_fare_attributes);
+  return fare_attributes;
+}
 
 FareAttributes Feed::get_fare_attributes(const Id & fare_id) const
 {
+  load_lazy_file(file_fare_attributes);
+
   FareAttributes res;
   for (const auto & attributes : fare_attributes)
   {
@@ -2430,30 +9962,124 @@ FareAttributes Feed::get_fare_attributes(const Id & fare_id) const
 
 inline void Feed::add_fare_attributes(const FareAttributesItem & fare_attributes_item)
 {
-  fare_attributes.emplace_back(fare_attributes_item);
+  add_fare_attributes(FareAttributesItem(fare_attributes_item));
+}
+
+inline void Feed::add_fare_attributes(FareAttributesItem && fare_attributes_item)
+{
+  fare_attributes.emplace_back(std::move(fare_attributes_item));
 }
 
 inline Result Feed::read_shapes()
+{
+  drop_file_indexes(file_shapes);
+  return parse_shapes();
+}
+
+inline Result Feed::parse_shapes()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_shape(record); };
-  return parse_csv(file_shapes, handler);
+  auto reserve = [this](size_t rows_count) {
+    if (storage_layout == StorageLayout::Columns)
+      reserve_rows(this->columnar_shapes, rows_count);
+    else
+      reserve_rows(this->shapes, rows_count);
+  };
+  return parse_csv(file_shapes, shapes_columns, handler, reserve);
+}
+
+inline Result Feed::read_shapes(size_t threads_count)
+{
+  drop_file_indexes(file_shapes);
+  return parse_shapes(threads_count);
+}
+
+inline Result Feed::parse_shapes(size_t threads_count)
+{
+  if (storage_layout == StorageLayout::Columns)
+  {
+    return parse_csv_in_chunks(file_shapes, shapes_columns, threads_count,
+                               &Feed::parse_shape_point, columnar_shapes);
+  }
+  return parse_csv_in_chunks(file_shapes, shapes_columns, threads_count, &Feed::parse_shape_point,
+                             shapes);
+}
+
+inline Result Feed::for_each_shape_point(
+    const std::function<void(const ShapePoint & point)> & handler)
+{
+  return parse_csv_streaming(file_shapes, shapes_columns, &Feed::parse_shape_point, handler);
 }
 
 inline Result Feed::write_shapes(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_shapes(out); };
-  return write_csv(gtfs_path, file_shapes, write_shapes_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_shapes(writer); };
+  return write_csv(gtfs_path, file_shapes, shapes_columns, container_writer);
+}
+
+inline Result Feed::write_shapes(const std::string & gtfs_path, size_t threads_count) const
+{
+  auto row_writer = [](CsvWriter & writer, const auto & point) {
+    write_shape_point(writer, point);
+  };
+  if (storage_layout == StorageLayout::Columns)
+  {
+    return write_csv_in_chunks(gtfs_path, file_shapes, shapes_columns, columnar_shapes,
+                               threads_count, row_writer);
+  }
+  return write_csv_in_chunks(gtfs_path, file_shapes, shapes_columns, shapes, threads_count,
+                             row_writer);
+}
+
+inline const Shapes & Feed::get_shapes() const
+{
+  load_lazy_file(file_shapes);
+  return shapes;
 }
 
-inline const Shapes & Feed::get_shapes() const { return shapes; }
+inline const ColumnarShapes & Feed::get_columnar_shapes() const
+{
+  load_lazy_file(file_shapes);
+  return columnar_shapes;
+}
 
 inline Shape Feed::get_shape(const Id & shape_id, bool sort_by_sequence) const
 {
+  load_lazy_file(file_shapes);
+
   Shape res;
-  for (const auto & shape : shapes)
+  if (sort_by_sequence && shapes_index_built)
+  {
+    const auto it = shapes_groups.groups.find(shape_id);
+    if (it == shapes_groups.groups.end())
+      return res;
+
+    const size_t first = shapes_groups.offsets[it->second];
+    const size_t last = shapes_groups.offsets[it->second + 1];
+    res.resize(last - first);
+    for (size_t i = first; i < last; ++i)
+    {
+      ShapePoint & point = res[i - first];
+      point.shape_id = shape_id;
+      point.shape_pt_lat = shapes_groups.lats[i];
+      point.shape_pt_lon = shapes_groups.lons[i];
+      point.shape_pt_sequence = shapes_groups.sequences[i];
+      point.shape_dist_traveled = shapes_groups.dist_traveled[i];
+    }
+    return res;
+  }
+
+  if (storage_layout == StorageLayout::Columns)
+  {
+    copy_rows_with_id(columnar_shapes, columnar_shapes.get_shape_ids(), shape_id, res);
+  }
+  else
   {
-    if (shape.shape_id == shape_id)
-      res.emplace_back(shape);
+    for (const auto & shape : shapes)
+    {
+      if (shape.shape_id == shape_id)
+        res.emplace_back(shape);
+    }
   }
   if (sort_by_sequence)
   {
@@ -2464,24 +10090,46 @@ inline Shape Feed::get_shape(const Id & shape_id, bool sort_by_sequence) const
   return res;
 }
 
-inline void Feed::add_shape(const ShapePoint & shape) { shapes.emplace_back(shape); }
+inline void Feed::add_shape(const ShapePoint & shape) { add_shape(ShapePoint(shape)); }
+
+inline void Feed::add_shape(ShapePoint && shape)
+{
+  push_shape(std::move(shape));
+  shapes_index_built = false;
+  spatial_index_built = false;
+}
+
+inline void Feed::push_shape(ShapePoint && shape)
+{
+  if (storage_layout == StorageLayout::Columns)
+    columnar_shapes.push_back(std::move(shape));
+  else
+    shapes.emplace_back(std::move(shape));
+}
 
 inline Result Feed::read_frequencies()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_frequency(record); };
-  return parse_csv(file_frequencies, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->frequencies, rows_count); };
+  return parse_csv(file_frequencies, frequencies_columns, handler, reserve);
 }
 
 inline Result Feed::write_frequencies(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_frequencies(out); };
-  return write_csv(gtfs_path, file_frequencies, write_frequencies_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_frequencies(writer); };
+  return write_csv(gtfs_path, file_frequencies, frequencies_columns, container_writer);
 }
 
-inline const Frequencies & Feed::get_frequencies() const { return frequencies; }
+inline const Frequencies & Feed::get_frequencies() const
+{
+  load_lazy_file(file_frequencies);
+  return frequencies;
+}
 
 inline Frequencies Feed::get_frequencies(const Id & trip_id) const
 {
+  load_lazy_file(file_frequencies);
+
   Frequencies res;
   for (const auto & frequency : frequencies)
   {
@@ -2491,54 +10139,99 @@ inline Frequencies Feed::get_frequencies(const Id & trip_id) const
   return res;
 }
 
-inline void Feed::add_frequency(const Frequency & frequency) { frequencies.emplace_back(frequency); }
+inline void Feed::add_frequency(const Frequency & frequency)
+{
+  add_frequency(Frequency(frequency));
+}
+
+inline void Feed::add_frequency(Frequency && frequency)
+{
+  frequencies.emplace_back(std::move(frequency));
+}
 
 inline Result Feed::read_transfers()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_transfer(record); };
-  return parse_csv(file_transfers, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->transfers, rows_count); };
+  return parse_csv(file_transfers, transfers_columns, handler, reserve);
 }
 
 inline Result Feed::write_transfers(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_transfers(out); };
-  return write_csv(gtfs_path, file_transfers, write_transfers_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_transfers(writer); };
+  return write_csv(gtfs_path, file_transfers, transfers_columns, container_writer);
 }
 
-inline const Transfers & Feed::get_transfers() const { return transfers; }
+inline const Transfers & Feed::get_transfers() const
+{
+  load_lazy_file(file_transfers);
+  return transfers;
+}
 
 inline std::optional<Transfer> Feed::get_transfer(const Id & from_stop_id,
                                                   const Id & to_stop_id) const
 {
+  return to_optional(find_transfer(from_stop_id, to_stop_id));
+}
+
+inline const Transfer * Feed::find_transfer(const Id & from_stop_id, const Id & to_stop_id) const
+{
+  load_lazy_file(file_transfers);
+
+  if (indexes_built)
+  {
+    const auto it = transfers_index.find(from_stop_id);
+    if (it == transfers_index.end())
+      return nullptr;
+    return find_by_index(transfers, it->second, to_stop_id);
+  }
+
   const auto it = std::find_if(
       transfers.begin(), transfers.end(), [&from_stop_id, &to_stop_id](const Transfer & transfer) {
         return transfer.from_stop_id == from_stop_id && transfer.to_stop_id == to_stop_id;
       });
 
   if (it == transfers.end())
-    return std::nullopt;
+    return nullptr;
 
-  return *it;
+  return &*it;
 }
 
-inline void Feed::add_transfer(const Transfer & transfer) { transfers.emplace_back(transfer); }
+inline void Feed::add_transfer(const Transfer & transfer) { add_transfer(Transfer(transfer)); }
+
+inline void Feed::add_transfer(Transfer && transfer)
+{
+  transfers.emplace_back(std::move(transfer));
+  if (indexes_built)
+  {
+    const Transfer & added = transfers.back();
+    transfers_index[added.from_stop_id].emplace(added.to_stop_id, transfers.size() - 1);
+  }
+}
 
 inline Result Feed::read_pathways()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_pathway(record); };
-  return parse_csv(file_pathways, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->pathways, rows_count); };
+  return parse_csv(file_pathways, pathways_columns, handler, reserve);
 }
 
 inline Result Feed::write_pathways(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_pathways(out); };
-  return write_csv(gtfs_path, file_pathways, write_pathways_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_pathways(writer); };
+  return write_csv(gtfs_path, file_pathways, pathways_columns, container_writer);
 }
 
-inline const Pathways & Feed::get_pathways() const { return pathways; }
+inline const Pathways & Feed::get_pathways() const
+{
+  load_lazy_file(file_pathways);
+  return pathways;
+}
 
 inline Pathways Feed::get_pathways(const Id & pathway_id) const
 {
+  load_lazy_file(file_pathways);
+
   Pathways res;
   for (const auto & path : pathways)
   {
@@ -2550,6 +10243,8 @@ inline Pathways Feed::get_pathways(const Id & pathway_id) const
 
 inline Pathways Feed::get_pathways(const Id & from_stop_id, const Id & to_stop_id) const
 {
+  load_lazy_file(file_pathways);
+
   Pathways res;
   for (const auto & path : pathways)
   {
@@ -2559,68 +10254,104 @@ inline Pathways Feed::get_pathways(const Id & from_stop_id, const Id & to_stop_i
   return res;
 }
 
-inline void Feed::add_pathway(const Pathway & pathway) { pathways.emplace_back(pathway); }
+inline void Feed::add_pathway(const Pathway & pathway) { add_pathway(Pathway(pathway)); }
+
+inline void Feed::add_pathway(Pathway && pathway) { pathways.emplace_back(std::move(pathway)); }
 
 inline Result Feed::read_levels()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_level(record); };
-  return parse_csv(file_levels, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->levels, rows_count); };
+  return parse_csv(file_levels, levels_columns, handler, reserve);
 }
 
 inline Result Feed::write_levels(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_levels(out); };
-  return write_csv(gtfs_path, file_levels, write_levels_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_levels(writer); };
+  return write_csv(gtfs_path, file_levels, levels_columns, container_writer);
 }
 
-inline const Levels & Feed::get_levels() const { return levels; }
+inline const Levels & Feed::get_levels() const
+{
+  load_lazy_file(file_levels);
+  return levels;
+}
 
 inline std::optional<Level> Feed::get_level(const Id & level_id) const
 {
+  return to_optional(find_level(level_id));
+}
+
+inline const Level * Feed::find_level(const Id & level_id) const
+{
+  load_lazy_file(file_levels);
+
+  if (indexes_built)
+    return find_by_index(levels, levels_index, level_id);
+
   const auto it = std::find_if(levels.begin(), levels.end(), [&level_id](const Level & level) {
     return level.level_id == level_id;
   });
 
   if (it == levels.end())
-    return std::nullopt;
+    return nullptr;
 
-  return *it;
+  return &*it;
 }
 
-inline void Feed::add_level(const Level & level) { levels.emplace_back(level); }
+inline void Feed::add_level(const Level & level) { add_level(Level(level)); }
+
+inline void Feed::add_level(Level && level)
+{
+  levels.emplace_back(std::move(level));
+  add_to_index(levels_index, levels.back().level_id, levels.size() - 1);
+}
 
 inline Result Feed::read_feed_info()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_feed_info(record); };
-  return parse_csv(file_feed_info, handler);
+  return parse_csv(file_feed_info, feed_info_columns, handler);
 }
 
 inline Result Feed::write_feed_info(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_feed_info(out); };
-  return write_csv(gtfs_path, file_feed_info, write_feed_info_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_feed_info(writer); };
+  return write_csv(gtfs_path, file_feed_info, feed_info_columns, container_writer);
+}
+
+inline const FeedInfo & Feed::get_feed_info() const
+{
+  load_lazy_file(file_feed_info);
+  return feed_info;
 }
 
-inline FeedInfo Feed::get_feed_info() const { return feed_info; }
+inline void Feed::set_feed_info(const FeedInfo & info) { set_feed_info(FeedInfo(info)); }
 
-inline void Feed::set_feed_info(const FeedInfo & info) { feed_info = info; }
+inline void Feed::set_feed_info(FeedInfo && info) { feed_info = std::move(info); }
 
 inline Result Feed::read_translations()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_translation(record); };
-  return parse_csv(file_translations, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->translations, rows_count); };
+  return parse_csv(file_translations, translations_columns, handler, reserve);
 }
 
 inline Result Feed::write_translations(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_translations(out); };
-  return write_csv(gtfs_path, file_translations, write_translations_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_translations(writer); };
+  return write_csv(gtfs_path, file_translations, translations_columns, container_writer);
 }
 
-inline const Translations & Feed::get_translations() const { return translations; }
+inline const Translations & Feed::get_translations() const
+{
+  load_lazy_file(file_translations);
+  return translations;
+}
 
 inline Translations Feed::get_translations(const Text & table_name) const
 {
+  load_lazy_file(file_translations);
+
   Translations res;
   for (const auto & translation : translations)
   {
@@ -2632,249 +10363,330 @@ inline Translations Feed::get_translations(const Text & table_name) const
 
 inline void Feed::add_translation(const Translation & translation)
 {
-  translations.emplace_back(translation);
+  add_translation(Translation(translation));
+}
+
+inline void Feed::add_translation(Translation && translation)
+{
+  translations.emplace_back(std::move(translation));
 }
 
 inline Result Feed::read_attributions()
 {
   auto handler = [this](const ParsedCsvRow & record) { return this->add_attribution(record); };
-  return parse_csv(file_attributions, handler);
+  auto reserve = [this](size_t rows_count) { reserve_rows(this->attributions, rows_count); };
+  return parse_csv(file_attributions, attributions_columns, handler, reserve);
 }
 
 inline Result Feed::write_attributions(const std::string & gtfs_path) const
 {
-  auto container_writer = [this](std::ofstream & out) { return this->write_attributions(out); };
-  return write_csv(gtfs_path, file_attributions, write_attributions_header, container_writer);
+  auto container_writer = [this](CsvWriter & writer) { this->write_attributions(writer); };
+  return write_csv(gtfs_path, file_attributions, attributions_columns, container_writer);
 }
 
-inline const Attributions & Feed::get_attributions() const { return attributions; }
+inline const Attributions & Feed::get_attributions() const
+{
+  load_lazy_file(file_attributions);
+  return attributions;
+}
 
 inline void Feed::add_attribution(const Attribution & attribution)
 {
-  attributions.emplace_back(attribution);
+  add_attribution(Attribution(attribution));
+}
+
+inline void Feed::add_attribution(Attribution && attribution)
+{
+  attributions.emplace_back(std::move(attribution));
 }
 
-inline void Feed::write_agencies(std::ofstream & out) const
+inline void Feed::write_agencies(CsvWriter & writer) const
 {
   for (const auto & agency : agencies)
   {
-    std::vector<std::string> fields{wrap(agency.agency_id),  wrap(agency.agency_name),
-                                    wrap(agency.agency_url), agency.agency_timezone,
-                                    agency.agency_lang,      wrap(agency.agency_phone),
-                                    agency.agency_fare_url,  agency.agency_email};
-    write_joined(out, std::move(fields));
+    writer.write(agency.agency_id);
+    writer.write(agency.agency_name);
+    writer.write(agency.agency_url);
+    writer.write_raw(agency.agency_timezone);
+    writer.write_raw(agency.agency_lang);
+    writer.write(agency.agency_phone);
+    writer.write_raw(agency.agency_fare_url);
+    writer.write_raw(agency.agency_email);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_routes(std::ofstream & out) const
+inline void Feed::write_routes(CsvWriter & writer) const
 {
   for (const auto & route : routes)
   {
-    std::vector<std::string> fields{wrap(route.route_id),
-                                    wrap(route.agency_id),
-                                    wrap(route.route_short_name),
-                                    wrap(route.route_long_name),
-                                    wrap(route.route_desc),
-                                    wrap(route.route_type),
-                                    route.route_url,
-                                    route.route_color,
-                                    route.route_text_color,
-                                    wrap(route.route_sort_order),
-                                    "" /* continuous_pickup */,
-                                    "" /* continuous_drop_off */};
+    writer.write(route.route_id);
+    writer.write(route.agency_id);
+    writer.write(route.route_short_name);
+    writer.write(route.route_long_name);
+    writer.write(route.route_desc);
+    writer.write(route.route_type);
+    writer.write_raw(route.route_url);
+    writer.write_raw(route.route_color);
+    writer.write_raw(route.route_text_color);
+    writer.write(route.route_sort_order);
+    writer.write_raw("");  // continuous_pickup
+    writer.write_raw("");  // continuous_drop_off
     // TODO: handle new route fields.
-    write_joined(out, std::move(fields));
+    writer.end_record();
   }
 }
 
-inline void Feed::write_shapes(std::ofstream & out) const
+template <typename ShapePointRow>
+void write_shape_point(CsvWriter & writer, const ShapePointRow & shape)
+{
+  writer.write(shape.shape_id);
+  writer.write(shape.shape_pt_lat);
+  writer.write(shape.shape_pt_lon);
+  writer.write(shape.shape_pt_sequence);
+  writer.write(shape.shape_dist_traveled);
+  writer.end_record();
+}
+
+inline void Feed::write_shapes(CsvWriter & writer) const
 {
   for (const auto & shape : shapes)
-  {
-    std::vector<std::string> fields{wrap(shape.shape_id), wrap(shape.shape_pt_lat),
-                                    wrap(shape.shape_pt_lon), wrap(shape.shape_pt_sequence),
-                                    wrap(shape.shape_dist_traveled)};
-    write_joined(out, std::move(fields));
-  }
+    write_shape_point(writer, shape);
+  for (const auto & shape : columnar_shapes)
+    write_shape_point(writer, shape);
 }
 
-inline void Feed::write_trips(std::ofstream & out) const
+inline void Feed::write_trips(CsvWriter & writer) const
 {
   for (const auto & trip : trips)
   {
-    std::vector<std::string> fields{
-        wrap(trip.route_id),      wrap(trip.service_id),      wrap(trip.trip_id),
-        wrap(trip.trip_headsign), wrap(trip.trip_short_name), wrap(trip.direction_id),
-        wrap(trip.block_id),      wrap(trip.shape_id),        wrap(trip.wheelchair_accessible),
-        wrap(trip.bikes_allowed)};
-    write_joined(out, std::move(fields));
+    writer.write(trip.route_id);
+    writer.write(trip.service_id);
+    writer.write(trip.trip_id);
+    writer.write(trip.trip_headsign);
+    writer.write(trip.trip_short_name);
+    writer.write(trip.direction_id);
+    writer.write(trip.block_id);
+    writer.write(trip.shape_id);
+    writer.write(trip.wheelchair_accessible);
+    writer.write(trip.bikes_allowed);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_stops(std::ofstream & out) const
+inline void Feed::write_stops(CsvWriter & writer) const
 {
   for (const auto & stop : stops)
   {
-    std::vector<std::string> fields{
-        wrap(stop.stop_id),        wrap(stop.stop_code),    wrap(stop.stop_name),
-        wrap(stop.stop_desc),      wrap(stop.stop_lat),     wrap(stop.stop_lon),
-        wrap(stop.zone_id),        stop.stop_url,           wrap(stop.location_type),
-        wrap(stop.parent_station), stop.stop_timezone,      wrap(stop.wheelchair_boarding),
-        wrap(stop.level_id),       wrap(stop.platform_code)};
-    write_joined(out, std::move(fields));
+    writer.write(stop.stop_id);
+    writer.write(stop.stop_code);
+    writer.write(stop.stop_name);
+    writer.write(stop.stop_desc);
+    writer.write(stop.stop_lat);
+    writer.write(stop.stop_lon);
+    writer.write(stop.zone_id);
+    writer.write_raw(stop.stop_url);
+    writer.write(stop.location_type);
+    writer.write(stop.parent_station);
+    writer.write_raw(stop.stop_timezone);
+    writer.write(stop.wheelchair_boarding);
+    writer.write(stop.level_id);
+    writer.write(stop.platform_code);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_stop_times(std::ofstream & out) const
+template <typename StopTimeRow>
+void write_stop_time(CsvWriter & writer, const StopTimeRow & stop_time)
+{
+  writer.write(stop_time.trip_id);
+  writer.write_raw(stop_time.arrival_time.get_raw_time());
+  writer.write_raw(stop_time.departure_time.get_raw_time());
+  writer.write(stop_time.stop_id);
+  writer.write(stop_time.stop_sequence);
+  writer.write(stop_time.stop_headsign);
+  writer.write(stop_time.pickup_type);
+  writer.write(stop_time.drop_off_type);
+  writer.write_raw("");  // continuous_pickup
+  writer.write_raw("");  // continuous_drop_off
+  writer.write(stop_time.shape_dist_traveled);
+  writer.write(stop_time.timepoint);
+  // TODO: handle new stop_times fields.
+  writer.end_record();
+}
+
+inline void Feed::write_stop_times(CsvWriter & writer) const
 {
   for (const auto & stop_time : stop_times)
-  {
-    std::vector<std::string> fields{wrap(stop_time.trip_id),
-                                    stop_time.arrival_time.get_raw_time(),
-                                    stop_time.departure_time.get_raw_time(),
-                                    wrap(stop_time.stop_id),
-                                    wrap(stop_time.stop_sequence),
-                                    wrap(stop_time.stop_headsign),
-                                    wrap(stop_time.pickup_type),
-                                    wrap(stop_time.drop_off_type),
-                                    "" /* continuous_pickup */,
-                                    "" /* continuous_drop_off */,
-                                    wrap(stop_time.shape_dist_traveled),
-                                    wrap(stop_time.timepoint)};
-    // TODO: handle new stop_times fields.
-    write_joined(out, std::move(fields));
-  }
+    write_stop_time(writer, stop_time);
+  for (const auto & stop_time : columnar_stop_times)
+    write_stop_time(writer, stop_time);
 }
 
-inline void Feed::write_calendar(std::ofstream & out) const
+inline void Feed::write_calendar(CsvWriter & writer) const
 {
   for (const auto & item : calendar)
   {
-    std::vector<std::string> fields{
-        wrap(item.service_id),       wrap(item.monday),   wrap(item.tuesday),
-        wrap(item.wednesday),        wrap(item.thursday), wrap(item.friday),
-        wrap(item.saturday),         wrap(item.sunday),   item.start_date.get_raw_date(),
-        item.end_date.get_raw_date()};
-    write_joined(out, std::move(fields));
+    writer.write(item.service_id);
+    writer.write(item.monday);
+    writer.write(item.tuesday);
+    writer.write(item.wednesday);
+    writer.write(item.thursday);
+    writer.write(item.friday);
+    writer.write(item.saturday);
+    writer.write(item.sunday);
+    writer.write_raw(item.start_date.get_raw_date());
+    writer.write_raw(item.end_date.get_raw_date());
+    writer.end_record();
   }
 }
 
-inline void Feed::write_calendar_dates(std::ofstream & out) const
+inline void Feed::write_calendar_dates(CsvWriter & writer) const
 {
   for (const auto & date : calendar_dates)
   {
-    std::vector<std::string> fields{wrap(date.service_id), date.date.get_raw_date(),
-                                    wrap(date.exception_type)};
-    write_joined(out, std::move(fields));
+    writer.write(date.service_id);
+    writer.write_raw(date.date.get_raw_date());
+    writer.write(date.exception_type);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_transfers(std::ofstream & out) const
+inline void Feed::write_transfers(CsvWriter & writer) const
 {
   for (const auto & transfer : transfers)
   {
-    std::vector<std::string> fields{wrap(transfer.from_stop_id), wrap(transfer.to_stop_id),
-                                    wrap(transfer.transfer_type), wrap(transfer.min_transfer_time)};
-    write_joined(out, std::move(fields));
+    writer.write(transfer.from_stop_id);
+    writer.write(transfer.to_stop_id);
+    writer.write(transfer.transfer_type);
+    writer.write(transfer.min_transfer_time);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_frequencies(std::ofstream & out) const
+inline void Feed::write_frequencies(CsvWriter & writer) const
 {
   for (const auto & frequency : frequencies)
   {
-    std::vector<std::string> fields{wrap(frequency.trip_id), frequency.start_time.get_raw_time(),
-                                    frequency.end_time.get_raw_time(), wrap(frequency.headway_secs),
-                                    wrap(frequency.exact_times)};
-    write_joined(out, std::move(fields));
+    writer.write(frequency.trip_id);
+    writer.write_raw(frequency.start_time.get_raw_time());
+    writer.write_raw(frequency.end_time.get_raw_time());
+    writer.write(frequency.headway_secs);
+    writer.write(frequency.exact_times);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_fare_attributes(std::ofstream & out) const
+inline void Feed::write_fare_attributes(CsvWriter & writer) const
 {
   for (const auto & attribute : fare_attributes)
   {
-    std::vector<std::string> fields{
-        wrap(attribute.fare_id), wrap(attribute.price), attribute.currency_type,
-        wrap(attribute.payment_method),
-        // Here we handle GTFS specification corner case: "The fact that this field can be left
-        // empty is an exception to the requirement that a Required field must not be empty.":
-        attribute.transfers == FareTransfers::Unlimited ? "" : wrap(attribute.transfers),
-        wrap(attribute.agency_id), wrap(attribute.transfer_duration)};
-    write_joined(out, std::move(fields));
+    writer.write(attribute.fare_id);
+    writer.write(attribute.price);
+    writer.write_raw(attribute.currency_type);
+    writer.write(attribute.payment_method);
+    // Here we handle GTFS specification corner case: "The fact that this field can be left
+    // empty is an exception to the requirement that a Required field must not be empty.":
+    if (attribute.transfers == FareTransfers::Unlimited)
+      writer.write_raw("");
+    else
+      writer.write(attribute.transfers);
+    writer.write(attribute.agency_id);
+    writer.write(attribute.transfer_duration);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_fare_rules(std::ofstream & out) const
+inline void Feed::write_fare_rules(CsvWriter & writer) const
 {
   for (const auto & rule : fare_rules)
   {
-    std::vector<std::string> fields{wrap(rule.fare_id), wrap(rule.route_id), wrap(rule.origin_id),
-                                    wrap(rule.destination_id), wrap(rule.contains_id)};
-    write_joined(out, std::move(fields));
+    writer.write(rule.fare_id);
+    writer.write(rule.route_id);
+    writer.write(rule.origin_id);
+    writer.write(rule.destination_id);
+    writer.write(rule.contains_id);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_pathways(std::ofstream & out) const
+inline void Feed::write_pathways(CsvWriter & writer) const
 {
   for (const auto & path : pathways)
   {
-    std::vector<std::string> fields{
-        wrap(path.pathway_id),     wrap(path.from_stop_id),     wrap(path.to_stop_id),
-        wrap(path.pathway_mode),   wrap(path.is_bidirectional), wrap(path.length),
-        wrap(path.traversal_time), wrap(path.stair_count),      wrap(path.max_slope),
-        wrap(path.min_width),      wrap(path.signposted_as),    wrap(path.reversed_signposted_as)};
-    write_joined(out, std::move(fields));
+    writer.write(path.pathway_id);
+    writer.write(path.from_stop_id);
+    writer.write(path.to_stop_id);
+    writer.write(path.pathway_mode);
+    writer.write(path.is_bidirectional);
+    writer.write(path.length);
+    writer.write(path.traversal_time);
+    writer.write(path.stair_count);
+    writer.write(path.max_slope);
+    writer.write(path.min_width);
+    writer.write(path.signposted_as);
+    writer.write(path.reversed_signposted_as);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_levels(std::ofstream & out) const
+inline void Feed::write_levels(CsvWriter & writer) const
 {
   for (const auto & level : levels)
   {
-    std::vector<std::string> fields{wrap(level.level_id), wrap(level.level_index),
-                                    wrap(level.level_name)};
-    write_joined(out, std::move(fields));
+    writer.write(level.level_id);
+    writer.write(level.level_index);
+    writer.write(level.level_name);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_feed_info(std::ofstream & out) const
+inline void Feed::write_feed_info(CsvWriter & writer) const
 {
-  std::vector<std::string> fields{wrap(feed_info.feed_publisher_name),
-                                  feed_info.feed_publisher_url,
-                                  feed_info.feed_lang,
-                                  "" /* default_lang */,
-                                  feed_info.feed_start_date.get_raw_date(),
-                                  feed_info.feed_end_date.get_raw_date(),
-                                  wrap(feed_info.feed_version),
-                                  feed_info.feed_contact_email,
-                                  feed_info.feed_contact_url};
+  writer.write(feed_info.feed_publisher_name);
+  writer.write_raw(feed_info.feed_publisher_url);
+  writer.write_raw(feed_info.feed_lang);
+  writer.write_raw("");  // default_lang
+  writer.write_raw(feed_info.feed_start_date.get_raw_date());
+  writer.write_raw(feed_info.feed_end_date.get_raw_date());
+  writer.write(feed_info.feed_version);
+  writer.write_raw(feed_info.feed_contact_email);
+  writer.write_raw(feed_info.feed_contact_url);
   // TODO: handle new field_info field.
-  write_joined(out, std::move(fields));
+  writer.end_record();
 }
 
-inline void Feed::write_translations(std::ofstream & out) const
+inline void Feed::write_translations(CsvWriter & writer) const
 {
   for (const auto & translation : translations)
   {
-    std::vector<std::string> fields{translation.table_name,       translation.field_name,
-                                    translation.language,         wrap(translation.translation),
-                                    wrap(translation.record_id),  wrap(translation.record_sub_id),
-                                    wrap(translation.field_value)};
-    write_joined(out, std::move(fields));
+    writer.write_raw(translation.table_name);
+    writer.write_raw(translation.field_name);
+    writer.write_raw(translation.language);
+    writer.write(translation.translation);
+    writer.write(translation.record_id);
+    writer.write(translation.record_sub_id);
+    writer.write(translation.field_value);
+    writer.end_record();
   }
 }
 
-inline void Feed::write_attributions(std::ofstream & out) const
+inline void Feed::write_attributions(CsvWriter & writer) const
 {
   for (const auto & attr : attributions)
   {
-    std::vector<std::string> fields{
-        wrap(attr.attribution_id), wrap(attr.agency_id),         wrap(attr.route_id),
-        wrap(attr.trip_id),        wrap(attr.organization_name), wrap(attr.is_producer),
-        wrap(attr.is_operator),    wrap(attr.is_authority),      attr.attribution_url,
-        attr.attribution_email,    attr.attribution_phone};
-    write_joined(out, std::move(fields));
+    writer.write(attr.attribution_id);
+    writer.write(attr.agency_id);
+    writer.write(attr.route_id);
+    writer.write(attr.trip_id);
+    writer.write(attr.organization_name);
+    writer.write(attr.is_producer);
+    writer.write(attr.is_operator);
+    writer.write(attr.is_authority);
+    writer.write_raw(attr.attribution_url);
+    writer.write_raw(attr.attribution_email);
+    writer.write_raw(attr.attribution_phone);
+    writer.end_record();
   }
 }
 }  // namespace gtfs
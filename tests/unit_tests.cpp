@@ -47,12 +47,60 @@ TEST_CASE("Time from integers 2")
   CHECK_EQ(stop_time.get_total_seconds(), 3 * 60 * 60);
 }
 
+TEST_CASE("Time from seconds")
+{
+  Time stop_time(size_t(26 * 60 * 60 + 2 * 60 + 5));
+  CHECK_EQ(stop_time.get_hh_mm_ss(), std::make_tuple(26, 2, 5));
+  CHECK_EQ(stop_time.get_raw_time(), "26:02:05");
+  CHECK_EQ(stop_time.get_total_seconds(), 26 * 60 * 60 + 2 * 60 + 5);
+}
+
+#if defined(JUST_GTFS_COMPACT_STOP_TIMES)
+TEST_CASE("Compact time")
+{
+  CHECK_EQ(sizeof(Time), 4);
+  CHECK_LE(sizeof(StopTime), 64);
+
+  CHECK_EQ(Time("6:05:00").get_raw_time(), "6:05:00");
+  CHECK_EQ(Time("06:05:00").get_raw_time(), "06:05:00");
+  CHECK_EQ(Time("106:05:00").get_raw_time(), "106:05:00");
+  CHECK_EQ(Time("106:05:00").get_total_seconds(), 106 * 60 * 60 + 5 * 60);
+  CHECK_EQ(Time().get_raw_time(), "");
+
+  Time late_time("25:10:00");
+  CHECK(late_time.limit_hours_to_24max());
+  CHECK_EQ(late_time.get_raw_time(), "01:10:00");
+
+  CHECK_THROWS_AS(Time(Time::max_hours + 1, 0, 0), const InvalidFieldFormat &);
+}
+#endif
+
 TEST_CASE("Invalid time format")
 {
   CHECK_THROWS_AS(Time("12/10/00"), const InvalidFieldFormat &);
   CHECK_THROWS_AS(Time("12:100:00"), const InvalidFieldFormat &);
   CHECK_THROWS_AS(Time("12:10:100"), const InvalidFieldFormat &);
   CHECK_THROWS_AS(Time("12:10/10"), const InvalidFieldFormat &);
+  CHECK_THROWS_AS(Time("1a:10:10"), const InvalidFieldFormat &);
+  CHECK_THROWS_AS(Time("-1:10:10"), const InvalidFieldFormat &);
+  CHECK_THROWS_AS(Time("x12:10:10"), const InvalidFieldFormat &);
+  CHECK_THROWS_AS(Time("12:1 :10"), const InvalidFieldFormat &);
+}
+
+TEST_CASE("Time from string view")
+{
+  const std::string_view record = "STBA,6:20:00,106:05:09";
+  const Time short_time(record.substr(5, 7));
+  CHECK_EQ(short_time.get_hh_mm_ss(), std::make_tuple(6, 20, 0));
+  CHECK_EQ(short_time.get_raw_time(), "6:20:00");
+
+  const Time long_time(record.substr(13));
+  CHECK_EQ(long_time.get_hh_mm_ss(), std::make_tuple(106, 5, 9));
+  CHECK_EQ(long_time.get_total_seconds(), 106 * 60 * 60 + 5 * 60 + 9);
+  CHECK_EQ(long_time.get_raw_time(), "106:05:09");
+
+  CHECK_EQ(Time(7, 3, 5).get_raw_time(), "07:03:05");
+  CHECK_EQ(Time(size_t(100 * 60 * 60 + 59)).get_raw_time(), "100:00:59");
 }
 
 TEST_CASE("Time not provided")
@@ -87,6 +135,8 @@ TEST_CASE("Invalid date format")
   CHECK_THROWS_AS(Date("1999314"), const InvalidFieldFormat &);
   CHECK_THROWS_AS(Date("20081414"), const InvalidFieldFormat &);
   CHECK_THROWS_AS(Date("20170432"), const InvalidFieldFormat &);
+  CHECK_THROWS_AS(Date("2017O401"), const InvalidFieldFormat &);
+  CHECK_THROWS_AS(Date("2017-4-1"), const InvalidFieldFormat &);
 
   // Count of days in february (leap year):
   CHECK_THROWS_AS(Date("20200230"), const InvalidFieldFormat &);
@@ -133,6 +183,14 @@ TEST_CASE("Date from integers")
   CHECK(date.is_provided());
 }
 
+TEST_CASE("Date from string view")
+{
+  const std::string_view record = "FULLW,20070604,2";
+  const Date date(record.substr(6, 8));
+  CHECK_EQ(date.get_yyyy_mm_dd(), std::make_tuple(2007, 6, 4));
+  CHECK_EQ(date.get_raw_date(), "20070604");
+}
+
 TEST_SUITE_END();
 
 TEST_SUITE_BEGIN("Csv parsing");
@@ -220,6 +278,275 @@ TEST_CASE("Read quoted values with quotes at end")
   CHECK_EQ(res[0], "");
   CHECK_EQ(res[1], "Text and \"Name\"");
 }
+
+TEST_CASE("Record views")
+{
+  CsvRowView fields;
+  CsvTokenStorage storage;
+  const std::string record = "STBA, \"6:00:00\",\"Say \"\"hi\"\"\",\tA\tB ,\r";
+  CsvParser::split_record(record, fields, storage);
+  REQUIRE_EQ(fields.size(), 5);
+  CHECK_EQ(fields[0], "STBA");
+  CHECK_EQ(fields[1], "6:00:00");
+  CHECK_EQ(fields[2], "Say \"hi\"");
+  CHECK_EQ(fields[3], "AB");
+  CHECK(fields[4].empty());
+
+  // Not escaped values refer to the record itself:
+  CHECK_EQ(fields[0].data(), record.data());
+  CHECK_EQ(fields[1].data(), record.data() + 7);
+}
+
+TEST_CASE("Long records")
+{
+  // Special characters are found at every position of the vector-sized blocks:
+  for (size_t len = 0; len < 70; ++len)
+  {
+    const std::string value(len, 'x');
+    const std::string record = value + "," + value + "\t,\"" + value + ",\"\"" + value + "\" \r";
+    const auto res = CsvParser::split_record(record);
+    REQUIRE_EQ(res.size(), 3);
+    CHECK_EQ(res[0], value);
+    CHECK_EQ(res[1], value);
+    CHECK_EQ(res[2], value + ",\"" + value);
+  }
+
+  const std::string long_value(100, 'y');
+  const auto res = CsvParser::split_record(long_value + "\ty\r");
+  REQUIRE_EQ(res.size(), 1);
+  CHECK_EQ(res[0], long_value + "y");
+}
+
+TEST_CASE("Rows count estimate")
+{
+  CHECK_EQ(estimate_rows_count(""), 1);
+  CHECK_EQ(estimate_rows_count("a,b\nc,d\n"), 3);
+
+  std::string data;
+  const size_t rows_count = 20000;
+  for (size_t i = 0; i < rows_count; ++i)
+    data += "trip_" + std::to_string(i) + ",06:00:00,06:00:00,stop_" + std::to_string(i % 7) + "\n";
+  const size_t estimate = estimate_rows_count(data);
+  CHECK_GE(estimate, rows_count);
+  CHECK_LE(estimate, rows_count + rows_count / 8);
+
+#if defined(__unix__) || defined(__APPLE__)
+  CHECK_GT(get_peak_memory_usage(), data.size());
+  CHECK_GT(get_memory_usage(), data.size());
+#endif
+}
+
+TEST_CASE("Parsing numbers without exceptions")
+{
+  int number = 0;
+  CHECK_EQ(parse_integer(" +12abc", number), ResultCode::OK);
+  CHECK_EQ(number, 12);
+  CHECK_EQ(parse_integer("-7", number), ResultCode::OK);
+  CHECK_EQ(number, -7);
+
+  const Result empty_res = parse_integer("", number);
+  CHECK_EQ(empty_res.code, ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  CHECK_EQ(empty_res.message, "stoi");
+  CHECK_EQ(parse_integer("+-1", number), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  CHECK_EQ(parse_integer("99999999999", number), ResultCode::ERROR_REQUIRED_FIELD_ABSENT);
+
+  double fractional = 0.0;
+  CHECK_EQ(parse_fractional("1.5e3 m", fractional), ResultCode::OK);
+  CHECK_EQ(fractional, 1500.0);
+  CHECK_EQ(parse_fractional("-79.6906570431", fractional), ResultCode::OK);
+  CHECK_EQ(fractional, -79.6906570431);
+  CHECK_EQ(parse_fractional("east", fractional), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+
+  Time time;
+  const Result time_res = time.parse("6:0:00");
+  CHECK_EQ(time_res.code, ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  CHECK_EQ(time_res.message, std::string(InvalidFieldFormat(
+                                 "Time is not in [[H]H]H:MM:SS format: 6:0:00").what()));
+  REQUIRE_EQ(time.parse("6:10:00"), ResultCode::OK);
+  CHECK_EQ(time, Time(6, 10, 0));
+
+  Date date;
+  CHECK_EQ(date.parse("20210229"), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  REQUIRE_EQ(date.parse("20200229"), ResultCode::OK);
+  CHECK_EQ(date, Date(2020, 2, 29));
+}
+
+TEST_CASE("Errors of parsing stop times")
+{
+  auto read_stop_time = [](const std::string & record) {
+    {
+      std::ofstream out("data/output_feed/stop_times.txt");
+      out << "trip_id,arrival_time,departure_time,stop_id,stop_sequence,shape_dist_traveled\n"
+          << record << "\n";
+    }
+    Feed feed("data/output_feed");
+    return feed.read_stop_times();
+  };
+
+  CHECK_EQ(read_stop_time("T1,6:00:00,6:00:00,S1,1,0.5"), ResultCode::OK);
+
+  const Result sequence_res = read_stop_time("T1,6:00:00,6:00:00,S1,first,");
+  CHECK_EQ(sequence_res.code, ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  CHECK_EQ(sequence_res.message, "stoi while adding item from stop_times.txt");
+
+  const Result stop_res = read_stop_time("T1,6:00:00,6:00:00");
+  CHECK_EQ(stop_res.code, ResultCode::ERROR_REQUIRED_FIELD_ABSENT);
+  CHECK_EQ(stop_res.message, "Required field stop_id is absent while adding item from "
+                             "stop_times.txt");
+
+  CHECK_EQ(read_stop_time("T1,6:00:00,6:0:00,S1,1,"), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  CHECK_EQ(read_stop_time("T1,6:00:00,6:00:00,S1,1,-1"), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+}
+
+TEST_CASE("Errors of parsing other files")
+{
+  std::filesystem::create_directories("data/output_feed/parsing_errors");
+  auto write_file = [](const std::string & filename, const std::string & contents) {
+    std::ofstream("data/output_feed/parsing_errors/" + filename) << contents;
+  };
+  Feed feed("data/output_feed/parsing_errors");
+
+  write_file(file_calendar_dates, "service_id,date,exception_type\nS1,20200101,1\nS1,2020,1\n");
+  const Result date_res = feed.read_calendar_dates();
+  CHECK_EQ(date_res.code, ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  CHECK_EQ(date_res.message,
+           std::string(InvalidFieldFormat("Date is not in YYYY:MM::DD format: 2020").what()) +
+               " while adding item from calendar_dates.txt");
+  CHECK_EQ(feed.get_calendar_dates().size(), 1);
+
+  write_file(file_calendar_dates, "service_id,date\nS1,20200101\n");
+  const Result exception_res = feed.read_calendar_dates();
+  CHECK_EQ(exception_res.code, ResultCode::ERROR_REQUIRED_FIELD_ABSENT);
+  CHECK_EQ(exception_res.message, "Required field exception_type is absent while adding item "
+                                  "from calendar_dates.txt");
+
+  write_file(file_frequencies, "trip_id,start_time,end_time,headway_secs\nT1,6:00:00,7:0:00,60\n");
+  CHECK_EQ(feed.read_frequencies(), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  write_file(file_routes, "route_id,route_short_name,route_type\nR1,1,bus\n");
+  CHECK_EQ(feed.read_routes(), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  write_file(file_levels, "level_id,level_index\nL1,first\n");
+  CHECK_EQ(feed.read_levels(), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  write_file(file_translations,
+             "table_name,field_name,language,translation\ncalendar,service_id,en,x\n");
+  CHECK_EQ(feed.read_translations(), ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  write_file(file_agency, "agency_name,agency_url\nAgency,http://agency.org\n");
+  CHECK_EQ(feed.read_agencies(), ResultCode::ERROR_REQUIRED_FIELD_ABSENT);
+}
+
+TEST_CASE("Memory-mapped and stream modes")
+{
+  CsvParser stream_parser("data/sample_feed/", CsvParserMode::Stream);
+  CsvParser mapped_parser("data/sample_feed/", CsvParserMode::MemoryMapped);
+  REQUIRE_EQ(stream_parser.read_header(file_stop_times), ResultCode::OK);
+  REQUIRE_EQ(mapped_parser.read_header(file_stop_times), ResultCode::OK);
+  CHECK_EQ(stream_parser.get_field_sequence(), mapped_parser.get_field_sequence());
+
+  std::map<std::string, std::string> stream_row;
+  std::map<std::string, std::string> mapped_row;
+  size_t rows_count = 0;
+  while (stream_parser.read_row(stream_row) != ResultCode::END_OF_FILE)
+  {
+    REQUIRE_EQ(mapped_parser.read_row(mapped_row), ResultCode::OK);
+    CHECK_EQ(stream_row, mapped_row);
+    ++rows_count;
+  }
+  CHECK_EQ(mapped_parser.read_row(mapped_row), ResultCode::END_OF_FILE);
+  CHECK_EQ(rows_count, 28);
+
+  CsvParser absent_file_parser("data/sample_feed/", CsvParserMode::MemoryMapped);
+  CHECK_EQ(absent_file_parser.read_header("absent.txt"), ResultCode::ERROR_FILE_ABSENT);
+}
+
+TEST_CASE("Columns of parsed row")
+{
+  const std::vector<std::string> header = {"level_name", "level_id", "level_name"};
+  const ColumnIndex index(levels_columns, header);
+  CHECK_EQ(index.get_position(static_cast<size_t>(LevelColumn::level_id)), 1);
+  CHECK_EQ(index.get_position(static_cast<size_t>(LevelColumn::level_index)), ColumnIndex::absent);
+  // The last of the duplicated columns is used:
+  CHECK_EQ(index.get_position(static_cast<size_t>(LevelColumn::level_name)), 2);
+
+  CsvRowView values = {"Vestibul", "L1"};
+  const ParsedCsvRow row(index, values);
+  CHECK_EQ(row.at(LevelColumn::level_id), "L1");
+  CHECK(!row.has(LevelColumn::level_name));
+  CHECK(row.get(LevelColumn::level_name).empty());
+  CHECK_THROWS_AS(row.at(LevelColumn::level_index), const std::out_of_range &);
+}
+
+TEST_CASE("Csv writer")
+{
+  std::ostringstream out;
+  {
+    CsvWriter writer(out);
+    writer.write(std::string("plain"));
+    writer.write(std::string("with,comma"));
+    writer.write(std::string("with \"quotes\""));
+    writer.write(std::string(""));
+    writer.write(-79.6906570431);
+    writer.write(size_t(42));
+    writer.write(StopTimeBoarding::Phone);
+    writer.write_raw("a,b");
+    writer.end_record();
+    writer.write(std::string("next"));
+    writer.end_record();
+  }
+  CHECK_EQ(out.str(),
+           "plain,\"with,comma\",\"with \"\"quotes\"\"\",,-79.690657,42,2,a,b\nnext\n");
+
+  // Fields are formatted the same way as by wrap().
+  for (const std::string text : {"a\"b", "\"", ",\"\",", "no quotes"})
+  {
+    std::ostringstream field;
+    {
+      CsvWriter writer(field);
+      writer.write(text);
+    }
+    CHECK_EQ(field.str(), wrap(text));
+  }
+  for (const double value : {0.0, -0.5, 1.0 / 3, 1e10, 43.5176524709})
+  {
+    std::ostringstream field;
+    {
+      CsvWriter writer(field);
+      writer.write(value);
+    }
+    CHECK_EQ(field.str(), wrap(value));
+  }
+}
+
+#if defined(JUST_GTFS_INTERNED_IDS)
+TEST_CASE("Interned ids")
+{
+  const Id id_1 = std::string("interned_id");
+  const Id id_2 = std::string_view("interned_id");
+  CHECK_EQ(id_1, id_2);
+  CHECK_EQ(&id_1.str(), &id_2.str());
+  CHECK_EQ(id_1, "interned_id");
+  CHECK_NE(id_1, Id("other_interned_id"));
+  CHECK(Id().empty());
+  CHECK_EQ(Id(""), Id());
+
+  const size_t pool_size = StringPool::instance().size();
+  const Id id_3 = "interned_id";
+  CHECK_EQ(id_3, id_1);
+  CHECK_EQ(StringPool::instance().size(), pool_size);
+
+  CHECK(Id("a") < Id("b"));
+  CHECK_FALSE(Id("b") < Id("a"));
+  CHECK_EQ(sizeof(Id), 4);
+
+  // Re-reading the feed reuses the pooled ids.
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  const size_t feed_pool_size = StringPool::instance().size();
+  Feed reread_feed("data/sample_feed");
+  REQUIRE_EQ(reread_feed.read_feed(), ResultCode::OK);
+  CHECK_EQ(StringPool::instance().size(), feed_pool_size);
+  CHECK_EQ(reread_feed.get_stops().front().stop_id, feed.get_stops().front().stop_id);
+}
+#endif
+
 TEST_SUITE_END();
 
 TEST_SUITE_BEGIN("Read & write");
@@ -318,6 +645,749 @@ TEST_CASE("Read GTFS feed")
   CHECK_EQ(feed.get_translations().size(), 1);
 }
 
+TEST_CASE("Read GTFS feed in parallel")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+
+  for (size_t threads_count : {0, 1, 4})
+  {
+    Feed parallel_feed("data/sample_feed");
+    REQUIRE_EQ(parallel_feed.read_feed(ReadFeedOptions{threads_count}), ResultCode::OK);
+
+    CHECK_EQ(parallel_feed.get_agencies(), feed.get_agencies());
+    CHECK_EQ(parallel_feed.get_routes().size(), feed.get_routes().size());
+    CHECK_EQ(parallel_feed.get_trips().size(), feed.get_trips().size());
+    CHECK_EQ(parallel_feed.get_shapes().size(), feed.get_shapes().size());
+    CHECK_EQ(parallel_feed.get_stops().size(), feed.get_stops().size());
+    CHECK_EQ(parallel_feed.get_stop_times().size(), feed.get_stop_times().size());
+    CHECK_EQ(parallel_feed.get_stop_times()[5].stop_id, feed.get_stop_times()[5].stop_id);
+    CHECK_EQ(parallel_feed.get_frequencies().size(), feed.get_frequencies().size());
+    CHECK_EQ(parallel_feed.get_fare_attributes(), feed.get_fare_attributes());
+    CHECK_EQ(parallel_feed.get_translations().size(), feed.get_translations().size());
+    CHECK_EQ(parallel_feed.get_feed_info().feed_publisher_name,
+             feed.get_feed_info().feed_publisher_name);
+  }
+
+  // Errors are reported the same way as while reading files one after another:
+  Feed absent_feed("data/non_existing_dir");
+  const Result serial_res = absent_feed.read_feed();
+  const Result parallel_res = absent_feed.read_feed(ReadFeedOptions{4});
+  CHECK_EQ(parallel_res.code, serial_res.code);
+  CHECK_EQ(parallel_res.message, serial_res.message);
+}
+
+TEST_CASE("Read GTFS feed with skipped and lazy files")
+{
+  ReadFeedOptions options;
+  options.skipped_files = {file_translations, file_pathways};
+  options.lazy_files = {file_shapes, file_frequencies};
+  options.skipped_columns = {{file_trips, {"trip_headsign", "block_id"}}};
+
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(options), ResultCode::OK);
+  CHECK(feed.get_translations().empty());
+  CHECK(feed.get_pathways().empty());
+  CHECK_EQ(feed.get_stops().size(), 9);
+
+  REQUIRE_EQ(feed.get_trips().size(), 11);
+  CHECK_EQ(feed.get_trips()[0].trip_id, "AB1");
+  CHECK(feed.get_trips()[0].trip_headsign.empty());
+  CHECK(feed.get_trips()[0].block_id.empty());
+
+  // The copy reads the postponed files on its own:
+  const Feed feed_copy = feed;
+  CHECK_EQ(feed.get_shapes().size(), 8);
+  CHECK_EQ(feed.get_shape("10237").size(), 4);
+  CHECK_EQ(feed_copy.get_frequencies().size(), 11);
+  CHECK_EQ(feed.read_lazy_files(), ResultCode::OK);
+  CHECK_EQ(feed.get_frequencies().size(), 11);
+  CHECK_EQ(feed_copy.get_shapes().size(), 8);
+
+  Feed fares_feed("data/sample_feed");
+  options.lazy_files = {file_fare_attributes};
+  REQUIRE_EQ(fares_feed.read_feed(options), ResultCode::OK);
+  CHECK_EQ(fares_feed.get_fare_attributes("x").size(), 1);
+
+  // Required columns can't be skipped:
+  Feed invalid_feed("data/sample_feed");
+  options.skipped_columns = {{file_trips, {"trip_id"}}};
+  CHECK_EQ(invalid_feed.read_feed(options), ResultCode::ERROR_REQUIRED_FIELD_ABSENT);
+
+  // Errors of the postponed files are reported on reading them:
+  Feed absent_feed("data/non_existing_dir");
+  options.skipped_files.clear();
+  options.lazy_files = {file_stops};
+  CHECK_EQ(absent_feed.read_feed(options), ResultCode::ERROR_FILE_ABSENT);
+  CHECK(absent_feed.get_stops().empty());
+  CHECK_EQ(absent_feed.read_lazy_files(), ResultCode::ERROR_FILE_ABSENT);
+
+  // Threads accessing the postponed file wait for it to be read:
+  ReadFeedOptions lazy_options;
+  lazy_options.lazy_files = {file_stops};
+  for (size_t i = 0; i < 20; ++i)
+  {
+    Feed lazy_feed("data/sample_feed");
+    REQUIRE_EQ(lazy_feed.read_feed(lazy_options), ResultCode::OK);
+    std::vector<size_t> sizes(4);
+    std::vector<std::thread> threads;
+    for (size_t j = 0; j < sizes.size(); ++j)
+      threads.emplace_back([&lazy_feed, &sizes, j]() { sizes[j] = lazy_feed.get_stops().size(); });
+    for (auto & thread : threads)
+      thread.join();
+    CHECK_EQ(sizes, std::vector<size_t>({9, 9, 9, 9}));
+  }
+}
+
+TEST_CASE("Load stats")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_stops(), ResultCode::OK);
+  CHECK(feed.get_load_stats().empty());
+
+  std::vector<std::string> hook_files;
+  feed.enable_load_stats(
+      [&hook_files](const FileLoadStats & stats) { hook_files.push_back(stats.filename); });
+  REQUIRE_EQ(feed.read_feed(ReadFeedOptions(1)), ResultCode::OK);
+  size_t shape_points_count = 0;
+  REQUIRE_EQ(feed.for_each_shape_point([&](const ShapePoint &) { ++shape_points_count; }),
+             ResultCode::OK);
+
+  const auto stats = feed.get_load_stats();
+  REQUIRE_EQ(stats.size(), 18);
+  CHECK_EQ(hook_files.size(), stats.size());
+  for (size_t i = 0; i < stats.size(); ++i)
+  {
+    CHECK_EQ(stats[i].filename, hook_files[i]);
+    CHECK_GT(stats[i].bytes_read, 0);
+    CHECK_GE(stats[i].total_seconds, stats[i].split_seconds);
+    CHECK_GE(stats[i].io_seconds, 0.0);
+  }
+
+  auto find_stats = [&stats](const std::string & filename) {
+    return *std::find_if(stats.begin(), stats.end(),
+                         [&](const FileLoadStats & item) { return item.filename == filename; });
+  };
+  const FileLoadStats stop_times_stats = find_stats(file_stop_times);
+  CHECK_EQ(stop_times_stats.rows_parsed, 28);
+  CHECK_EQ(stop_times_stats.rows_skipped, 0);
+  CHECK_EQ(stop_times_stats.container_size, 28);
+  CHECK_EQ(stop_times_stats.bytes_read,
+           std::filesystem::file_size("data/sample_feed/" + file_stop_times));
+  // Stops read before enabling the stats are in the container too:
+  CHECK_EQ(find_stats(file_stops).container_size, 18);
+  CHECK_EQ(stats.back().filename, file_shapes);
+  CHECK_EQ(stats.back().rows_parsed, shape_points_count);
+  CHECK_EQ(stats.back().container_size, 0);
+
+  // Rows without fields are skipped:
+  std::filesystem::create_directories("data/output_feed/load_stats");
+  std::ofstream("data/output_feed/load_stats/levels.txt") << "level_id,level_index\nL1,0\n\r\nL2,0";
+  Feed skipping_feed("data/output_feed/load_stats");
+  skipping_feed.enable_load_stats();
+  REQUIRE_EQ(skipping_feed.read_levels(), ResultCode::OK);
+  REQUIRE_EQ(skipping_feed.get_load_stats().size(), 1);
+  CHECK_EQ(skipping_feed.get_load_stats()[0].rows_parsed, 2);
+  CHECK_EQ(skipping_feed.get_load_stats()[0].rows_skipped, 1);
+
+#if defined(__linux__) || defined(__APPLE__)
+  // Memory growth is measured for the single file after reading others.
+  {
+    std::ofstream stops("data/output_feed/load_stats/stops.txt");
+    stops << "stop_id,stop_name,stop_lat,stop_lon\n";
+    for (size_t i = 0; i < 200000; ++i)
+      stops << "stop_" << i << ",Stop,55.0,37.0\n";
+  }
+  REQUIRE_EQ(skipping_feed.read_stops(), ResultCode::OK);
+  const auto stops_stats = skipping_feed.get_load_stats().back();
+  CHECK_EQ(stops_stats.filename, file_stops);
+  CHECK_GT(stops_stats.memory_growth, stops_stats.container_size * sizeof(Stop) / 2);
+  CHECK_LE(stops_stats.memory_growth, get_memory_usage());
+#endif
+
+  // The hook called by parallel readers may get the stats collected so far:
+  Feed parallel_feed("data/sample_feed");
+  std::mutex hook_mutex;
+  std::vector<size_t> seen_counts;
+  parallel_feed.enable_load_stats([&](const FileLoadStats &) {
+    const size_t count = parallel_feed.get_load_stats().size();
+    std::lock_guard<std::mutex> lock(hook_mutex);
+    seen_counts.push_back(count);
+  });
+  REQUIRE_EQ(parallel_feed.read_feed(ReadFeedOptions(4)), ResultCode::OK);
+  CHECK_EQ(seen_counts.size(), parallel_feed.get_load_stats().size());
+  CHECK_GE(*std::min_element(seen_counts.begin(), seen_counts.end()), 1);
+
+  feed.disable_load_stats();
+  REQUIRE_EQ(feed.read_stops(), ResultCode::OK);
+  CHECK(feed.get_load_stats().empty());
+}
+
+// Returns the contents in blocks of the given size and fails after the first block if the size is
+// 0.
+class BlocksStream : public InputStream
+{
+public:
+  BlocksStream(std::string contents, size_t block_size)
+      : contents(std::move(contents)), block_size(block_size)
+  {
+  }
+
+  Result read(std::string & block) override
+  {
+    if (block_size == 0 && position > 0)
+      return {ResultCode::ERROR_INVALID_ARCHIVE, "Broken stream"};
+
+    block = contents.substr(position, std::max<size_t>(block_size, 1));
+    position += block.size();
+    return ResultCode::OK;
+  }
+
+private:
+  std::string contents;
+  size_t block_size = 0;
+  size_t position = 0;
+};
+
+class BlocksSource : public FeedSource
+{
+public:
+  explicit BlocksSource(size_t block_size) : block_size(block_size) {}
+
+  Result open(const std::string & filename, std::unique_ptr<InputStream> & stream) const override
+  {
+    if (filename != file_levels)
+      return {ResultCode::ERROR_FILE_ABSENT, "File " + filename + " could not be opened"};
+
+    stream = std::make_unique<BlocksStream>(
+        "level_id,level_index,level_name\nL0,0,\"Ground, floor\"\r\nL1,-1,Underground\nL2,1,",
+        block_size);
+    return ResultCode::OK;
+  }
+
+private:
+  size_t block_size = 0;
+};
+
+TEST_CASE("Zip archives and compressed files")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+
+  // Files are in the directory of the archive, some of them are stored without compression:
+  for (size_t threads_count : {1, 4})
+  {
+    Feed zip_feed("data/sample_feed.zip");
+    REQUIRE_EQ(zip_feed.read_feed(ReadFeedOptions{threads_count}), ResultCode::OK);
+
+    CHECK_EQ(zip_feed.get_agencies(), feed.get_agencies());
+    CHECK_EQ(zip_feed.get_levels().size(), feed.get_levels().size());
+    CHECK_EQ(zip_feed.get_shapes().size(), feed.get_shapes().size());
+    CHECK_EQ(zip_feed.get_stops().size(), feed.get_stops().size());
+    REQUIRE_EQ(zip_feed.get_stop_times().size(), feed.get_stop_times().size());
+    CHECK_EQ(zip_feed.get_stop_times().back().stop_id, feed.get_stop_times().back().stop_id);
+    CHECK_EQ(zip_feed.get_fare_attributes(), feed.get_fare_attributes());
+    CHECK_EQ(zip_feed.get_translations().size(), feed.get_translations().size());
+  }
+
+  // Gzip file of several members, one of them is stored without compression:
+  Feed compressed_feed("data/compressed_feed");
+  REQUIRE_EQ(compressed_feed.read_stops(), ResultCode::OK);
+  REQUIRE_EQ(compressed_feed.get_stops().size(), feed.get_stops().size());
+  CHECK_EQ(compressed_feed.get_stops().back().stop_id, feed.get_stops().back().stop_id);
+  CHECK_EQ(compressed_feed.read_agencies(), ResultCode::ERROR_FILE_ABSENT);
+
+  REQUIRE_EQ(compressed_feed.read_shapes(), ResultCode::OK);
+  CHECK_EQ(compressed_feed.get_shapes().size(), 8000);
+  const Shape shape = compressed_feed.get_shape("15");
+  REQUIRE_EQ(shape.size(), 500);
+  CHECK_EQ(shape.back().shape_pt_lat, 55.0499);
+  CHECK_EQ(shape.back().shape_dist_traveled, 4990);
+
+  // Lines are split between the blocks of the source:
+  for (size_t block_size : {1, 3, 1000})
+  {
+    Feed source_feed(std::make_shared<BlocksSource>(block_size));
+    REQUIRE_EQ(source_feed.read_levels(), ResultCode::OK);
+    const auto & levels = source_feed.get_levels();
+    REQUIRE_EQ(levels.size(), 3);
+    CHECK_EQ(levels[0].level_name, "Ground, floor");
+    CHECK_EQ(levels[1].level_index, -1);
+    CHECK_EQ(levels[2].level_id, "L2");
+    CHECK_EQ(source_feed.read_stops(), ResultCode::ERROR_FILE_ABSENT);
+  }
+  Feed broken_feed(std::make_shared<BlocksSource>(0));
+  CHECK_EQ(broken_feed.read_levels(), ResultCode::ERROR_INVALID_ARCHIVE);
+
+  // Corrupted archives and truncated files:
+  std::filesystem::create_directories("data/output_feed/compressed");
+  std::ofstream("data/output_feed/compressed/feed.zip") << "agency_id,agency_name\n";
+  Feed invalid_zip_feed("data/output_feed/compressed/feed.zip");
+  CHECK_EQ(invalid_zip_feed.read_agencies(), ResultCode::ERROR_INVALID_ARCHIVE);
+
+  std::ifstream gzip_file("data/compressed_feed/shapes.txt.gz", std::ios::binary);
+  std::string gzip_data((std::istreambuf_iterator<char>(gzip_file)),
+                        std::istreambuf_iterator<char>());
+  std::ofstream("data/output_feed/compressed/shapes.txt.gz", std::ios::binary)
+      << gzip_data.substr(0, gzip_data.size() / 2);
+  Feed truncated_feed("data/output_feed/compressed");
+  CHECK_EQ(truncated_feed.read_shapes(), ResultCode::ERROR_INVALID_ARCHIVE);
+}
+
+TEST_CASE("Binary snapshot")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  const std::string snapshot_path = "data/output_feed/feed.snapshot";
+  REQUIRE_EQ(feed.save_snapshot(snapshot_path), ResultCode::OK);
+
+  Feed loaded_feed;
+  loaded_feed.build_indexes();
+  REQUIRE_EQ(loaded_feed.load_snapshot(snapshot_path), ResultCode::OK);
+  CHECK(loaded_feed.has_indexes());
+
+  CHECK_EQ(loaded_feed.get_agencies(), feed.get_agencies());
+  CHECK_EQ(loaded_feed.get_fare_attributes(), feed.get_fare_attributes());
+  REQUIRE_EQ(loaded_feed.get_stops().size(), feed.get_stops().size());
+  CHECK_EQ(loaded_feed.get_stop("FUR_CREEK_RES").value().stop_lat,
+           feed.get_stop("FUR_CREEK_RES").value().stop_lat);
+  CHECK_EQ(loaded_feed.get_routes().size(), feed.get_routes().size());
+  CHECK_EQ(loaded_feed.get_trips().size(), feed.get_trips().size());
+  CHECK_EQ(loaded_feed.get_calendar_dates().size(), feed.get_calendar_dates().size());
+  CHECK_EQ(loaded_feed.get_calendar("WE").value().end_date,
+           feed.get_calendar("WE").value().end_date);
+  CHECK_EQ(loaded_feed.get_shapes().size(), feed.get_shapes().size());
+  CHECK_EQ(loaded_feed.get_frequencies().size(), feed.get_frequencies().size());
+  CHECK_EQ(loaded_feed.get_transfers().size(), feed.get_transfers().size());
+  CHECK_EQ(loaded_feed.get_pathways().size(), feed.get_pathways().size());
+  CHECK_EQ(loaded_feed.get_levels().size(), feed.get_levels().size());
+  CHECK_EQ(loaded_feed.get_translations().size(), feed.get_translations().size());
+  CHECK_EQ(loaded_feed.get_attributions().size(), feed.get_attributions().size());
+  CHECK_EQ(loaded_feed.get_feed_info().feed_publisher_name,
+           feed.get_feed_info().feed_publisher_name);
+
+  const auto & stop_times = feed.get_stop_times();
+  const auto & loaded_stop_times = loaded_feed.get_stop_times();
+  REQUIRE_EQ(loaded_stop_times.size(), stop_times.size());
+  for (size_t i = 0; i < stop_times.size(); ++i)
+  {
+    CHECK_EQ(loaded_stop_times[i].trip_id, stop_times[i].trip_id);
+    CHECK_EQ(loaded_stop_times[i].arrival_time, stop_times[i].arrival_time);
+    CHECK_EQ(loaded_stop_times[i].departure_time.get_raw_time(),
+             stop_times[i].departure_time.get_raw_time());
+    CHECK_EQ(loaded_stop_times[i].shape_dist_traveled, stop_times[i].shape_dist_traveled);
+    CHECK_EQ(loaded_stop_times[i].timepoint, stop_times[i].timepoint);
+  }
+
+  Feed columnar_feed("data/sample_feed", StorageLayout::Columns);
+  REQUIRE_EQ(columnar_feed.load_snapshot(snapshot_path), ResultCode::OK);
+  CHECK_EQ(columnar_feed.get_columnar_stop_times().size(), stop_times.size());
+  CHECK_EQ(columnar_feed.get_columnar_shapes().size(), feed.get_shapes().size());
+
+  // Snapshot of the columnar feed is the same as of the feed with rows.
+  const std::string columnar_snapshot_path = "data/output_feed/columnar_feed.snapshot";
+  REQUIRE_EQ(columnar_feed.save_snapshot(columnar_snapshot_path), ResultCode::OK);
+  CHECK_EQ(std::filesystem::file_size(columnar_snapshot_path),
+           std::filesystem::file_size(snapshot_path));
+
+  CHECK_EQ(loaded_feed.load_snapshot("data/output_feed/absent.snapshot"),
+           ResultCode::ERROR_FILE_ABSENT);
+  CHECK_EQ(loaded_feed.load_snapshot("data/sample_feed/stops.txt"),
+           ResultCode::ERROR_INVALID_SNAPSHOT);
+
+  // Corrupted snapshot is rejected and the feed stays unchanged.
+  std::fstream corrupted(snapshot_path, std::ios::in | std::ios::out | std::ios::binary);
+  corrupted.seekp(100);
+  corrupted.put('#');
+  corrupted.close();
+  const Result res = loaded_feed.load_snapshot(snapshot_path);
+  CHECK_EQ(res, ResultCode::ERROR_INVALID_SNAPSHOT);
+  CHECK_EQ(loaded_feed.get_stop_times().size(), stop_times.size());
+
+  // Enum value not fitting its type is rejected even if the checksum matches.
+  Feed transfer_feed;
+  Transfer transfer;
+  transfer.from_stop_id = "A";
+  transfer.to_stop_id = "B";
+  transfer.transfer_type = TransferType::Timed;
+  transfer_feed.add_transfer(transfer);
+  REQUIRE_EQ(transfer_feed.save_snapshot(snapshot_path), ResultCode::OK);
+
+  std::string data(std::filesystem::file_size(snapshot_path), '\0');
+  std::ifstream(snapshot_path, std::ios::binary).read(data.data(), data.size());
+  // Transfer type follows 11 empty sections, the transfers count and two stop ids.
+  const size_t transfer_type_offset = sizeof(SnapshotHeader) + 12 * sizeof(uint64_t) + 8;
+  int32_t transfer_type = 0;
+  std::memcpy(&transfer_type, data.data() + transfer_type_offset, sizeof(transfer_type));
+  REQUIRE_EQ(transfer_type, 1);
+  transfer_type = 1000;
+  std::memcpy(data.data() + transfer_type_offset, &transfer_type, sizeof(transfer_type));
+
+  SnapshotHeader header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  SnapshotChecksum checksum;
+  checksum.update(std::string_view(data).substr(sizeof(header)));
+  header.checksum = checksum.get();
+  std::memcpy(data.data(), &header, sizeof(header));
+  std::ofstream(snapshot_path, std::ios::binary).write(data.data(), data.size());
+
+  Feed enum_feed;
+  CHECK_EQ(enum_feed.load_snapshot(snapshot_path), ResultCode::ERROR_INVALID_SNAPSHOT);
+  CHECK(enum_feed.get_transfers().empty());
+}
+
+TEST_CASE("Lookups by indexes")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  CHECK_FALSE(feed.has_indexes());
+
+  Feed indexed_feed("data/sample_feed");
+  REQUIRE_EQ(indexed_feed.read_feed(), ResultCode::OK);
+  indexed_feed.build_indexes();
+  CHECK(indexed_feed.has_indexes());
+
+  for (const auto & stop : feed.get_stops())
+    CHECK_EQ(indexed_feed.get_stop(stop.stop_id).value().stop_name, stop.stop_name);
+  for (const auto & trip : feed.get_trips())
+    CHECK_EQ(indexed_feed.get_trip(trip.trip_id).value().route_id, trip.route_id);
+  for (const auto & route : feed.get_routes())
+    CHECK_EQ(indexed_feed.get_route(route.route_id).value().route_type, route.route_type);
+
+  CHECK_EQ(indexed_feed.get_agency("DTA").value().agency_name,
+           feed.get_agency("DTA").value().agency_name);
+  CHECK_EQ(indexed_feed.get_calendar("WE").value().start_date,
+           feed.get_calendar("WE").value().start_date);
+  CHECK_EQ(indexed_feed.get_transfer("314", "11").value().transfer_type, TransferType::Timed);
+  CHECK_FALSE(indexed_feed.get_stop("missing_stop"));
+  CHECK_FALSE(indexed_feed.get_transfer("314", "missing_stop"));
+
+  Stop stop;
+  stop.stop_id = "added_stop";
+  stop.stop_name = "Added stop";
+  indexed_feed.add_stop(stop);
+  REQUIRE(indexed_feed.get_stop("added_stop"));
+  CHECK_EQ(indexed_feed.get_stop("added_stop").value().stop_name, "Added stop");
+
+  // The first of the duplicated ids is found as in the search without indexes.
+  stop.stop_name = "Duplicated stop";
+  indexed_feed.add_stop(stop);
+  CHECK_EQ(indexed_feed.get_stop("added_stop").value().stop_name, "Added stop");
+}
+
+TEST_CASE("Lookups by pointers and moved entities")
+{
+  for (const bool with_indexes : {false, true})
+  {
+    Feed feed("data/sample_feed");
+    REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+    if (with_indexes)
+      feed.build_indexes();
+
+    const Stop * stop = feed.find_stop("BEATTY_AIRPORT");
+    REQUIRE(stop);
+    CHECK_EQ(stop, &feed.get_stops()[1]);
+    CHECK_EQ(feed.find_agency("DTA")->agency_name, feed.get_agency("DTA").value().agency_name);
+    CHECK_EQ(feed.find_route("BFC")->route_short_name, "20");
+    CHECK_EQ(feed.find_trip("AB2")->service_id, "FULLW");
+    CHECK_EQ(feed.find_calendar("WE")->service_id, "WE");
+    CHECK_EQ(feed.find_transfer("314", "11")->transfer_type, TransferType::Timed);
+    CHECK(feed.find_level("U321L1"));
+    CHECK_FALSE(feed.find_stop("missing_stop"));
+    CHECK_FALSE(feed.find_transfer("314", "missing_stop"));
+    CHECK_EQ(&feed.get_feed_info(), &feed.get_feed_info());
+
+    Trip trip;
+    trip.trip_id = "moved_trip";
+    trip.trip_headsign = std::string(64, 'h');
+    feed.add_trip(std::move(trip));
+    REQUIRE(feed.find_trip("moved_trip"));
+    CHECK_EQ(feed.find_trip("moved_trip")->trip_headsign, std::string(64, 'h'));
+
+    Transfer transfer;
+    transfer.from_stop_id = "moved_stop_1";
+    transfer.to_stop_id = "moved_stop_2";
+    feed.add_transfer(std::move(transfer));
+    CHECK(feed.find_transfer("moved_stop_1", "moved_stop_2"));
+  }
+
+  for (const auto layout : {StorageLayout::Rows, StorageLayout::Columns})
+  {
+    Feed feed(std::string{}, layout);
+    StopTime stop_time;
+    stop_time.trip_id = "T1";
+    stop_time.stop_id = "S1";
+    stop_time.arrival_time = Time(8, 0, 0);
+    feed.add_stop_time(std::move(stop_time));
+
+    ShapePoint point;
+    point.shape_id = "SH1";
+    feed.add_shape(std::move(point));
+
+    if (layout == StorageLayout::Rows)
+    {
+      REQUIRE_EQ(feed.get_stop_times().size(), 1);
+      CHECK_EQ(feed.get_stop_times()[0].stop_id, "S1");
+      CHECK_EQ(feed.get_shapes()[0].shape_id, "SH1");
+    }
+    else
+    {
+      REQUIRE_EQ(feed.get_columnar_stop_times().size(), 1);
+      CHECK_EQ(feed.get_columnar_stop_times()[0].arrival_time.get_total_seconds(), 8 * 3600);
+      CHECK_EQ(feed.get_columnar_shapes()[0].shape_id, "SH1");
+    }
+  }
+}
+
+#if defined(JUST_GTFS_PMR)
+// Counts the bytes allocated by the arena from the upstream resource.
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+  size_t allocated = 0;
+
+private:
+  void * do_allocate(size_t bytes, size_t alignment) override
+  {
+    allocated += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void * p, size_t bytes, size_t alignment) override
+  {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+  {
+    return this == &other;
+  }
+};
+
+TEST_CASE("Feed in the memory resource")
+{
+  Feed default_feed("data/sample_feed");
+  REQUIRE_EQ(default_feed.read_feed(), ResultCode::OK);
+  CHECK_EQ(default_feed.get_memory_resource(), std::pmr::get_default_resource());
+
+  CountingResource counting;
+  std::pmr::monotonic_buffer_resource arena(&counting);
+  Feed feed("data/sample_feed", StorageLayout::Rows, &arena);
+  CHECK_EQ(feed.get_memory_resource(), &arena);
+  REQUIRE_EQ(feed.read_feed(ReadFeedOptions{2}), ResultCode::OK);
+  feed.build_indexes();
+  CHECK_GT(counting.allocated, 0);
+  CHECK_EQ(feed.get_stop_times().get_allocator().resource(), &arena);
+
+  CHECK_EQ(feed.get_agencies(), default_feed.get_agencies());
+  CHECK_EQ(feed.get_stops().size(), default_feed.get_stops().size());
+  CHECK_EQ(feed.get_stop_times().size(), default_feed.get_stop_times().size());
+  CHECK_EQ(feed.find_stop("BEATTY_AIRPORT")->stop_name,
+           default_feed.find_stop("BEATTY_AIRPORT")->stop_name);
+
+  // Loaded snapshot is placed in the same resource:
+  const std::string snapshot_path = "data/output_feed/pmr_feed.snapshot";
+  REQUIRE_EQ(default_feed.save_snapshot(snapshot_path), ResultCode::OK);
+  Feed loaded_feed("data/sample_feed", StorageLayout::Rows, &arena);
+  const size_t allocated = counting.allocated;
+  REQUIRE_EQ(loaded_feed.load_snapshot(snapshot_path), ResultCode::OK);
+  CHECK_GT(counting.allocated, allocated);
+  CHECK_EQ(loaded_feed.get_memory_resource(), &arena);
+  CHECK_EQ(loaded_feed.get_trips().size(), default_feed.get_trips().size());
+
+  Feed columnar_feed("data/sample_feed", StorageLayout::Columns, &arena);
+  REQUIRE_EQ(columnar_feed.read_stop_times(), ResultCode::OK);
+  CHECK_EQ(columnar_feed.get_columnar_stop_times().size(), default_feed.get_stop_times().size());
+  CHECK_EQ(columnar_feed.get_columnar_stop_times().get_trip_ids().get_allocator().resource(),
+           &arena);
+
+  // Indexes are allocated from the resource of the feed too:
+  CountingResource default_resource;
+  std::pmr::memory_resource * previous_resource = std::pmr::set_default_resource(&default_resource);
+  {
+    Feed indexed_feed("data/sample_feed", StorageLayout::Rows, &arena);
+    REQUIRE_EQ(indexed_feed.read_feed(ReadFeedOptions{2}), ResultCode::OK);
+    indexed_feed.build_indexes();
+    indexed_feed.build_stop_times_index();
+    indexed_feed.build_service_days_index();
+    indexed_feed.build_shapes_index();
+    indexed_feed.build_spatial_index();
+    CHECK_EQ(indexed_feed.get_stop_times_range_for_trip("STBA").size(), 2);
+    CHECK(indexed_feed.is_service_active("FULLW", Date(2007, 6, 5)));
+    CHECK(indexed_feed.get_nearest_stop(36.6, -116.8).has_value());
+  }
+  std::pmr::set_default_resource(previous_resource);
+  CHECK_EQ(default_resource.allocated, 0);
+}
+#endif
+
+TEST_CASE("Refresh of changed files and feed diffs")
+{
+  const std::string path = "data/output_feed/refresh/";
+  std::filesystem::remove_all(path);
+  std::filesystem::create_directories(path);
+  for (const auto & entry : std::filesystem::directory_iterator("data/sample_feed"))
+    std::filesystem::copy_file(entry.path(), path + entry.path().filename().string());
+
+  Feed feed(path);
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  feed.build_indexes();
+  feed.build_stop_times_index();
+  feed.build_service_days_index();
+  const Feed original_feed = feed;
+
+  feed.enable_load_stats();
+  FeedDiff diff;
+  REQUIRE_EQ(feed.refresh(&diff), ResultCode::OK);
+  CHECK(diff.empty());
+  CHECK(feed.get_load_stats().empty());
+
+  // Checksum of the touched file is compared with the one taken on the previous refresh, so the
+  // file is parsed again only if it is touched for the first time.
+  const auto touch = [](const std::string & file) {
+    std::filesystem::last_write_time(file, std::filesystem::last_write_time(file) +
+                                               std::chrono::seconds(10));
+  };
+  touch(path + file_calendar_dates);
+  REQUIRE_EQ(feed.refresh(&diff), ResultCode::OK);
+  CHECK(diff.empty());
+  CHECK_EQ(feed.get_load_stats().size(), 1);
+
+  feed.enable_load_stats();
+  touch(path + file_calendar_dates);
+  REQUIRE_EQ(feed.refresh(&diff), ResultCode::OK);
+  CHECK(diff.empty());
+  CHECK(feed.get_load_stats().empty());
+
+  std::ofstream(path + file_stops, std::ios::app)
+      << "\nNEW_STOP,New stop,,36.9,-116.7,,";
+  std::ofstream(path + file_calendar_dates)
+      << "service_id,date,exception_type\nFULLW,20070604,2\nWE,20070605,1";
+  touch(path + file_stops);
+  touch(path + file_calendar_dates);
+  REQUIRE_EQ(feed.refresh(&diff), ResultCode::OK);
+
+  const auto stats = feed.get_load_stats();
+  REQUIRE_EQ(stats.size(), 2);
+  CHECK_EQ(stats[0].filename, file_stops);
+  CHECK_EQ(stats[1].filename, file_calendar_dates);
+
+  REQUIRE_EQ(diff.size(), 2);
+  CHECK_EQ(diff[0].filename, file_stops);
+  CHECK_EQ(diff[0].added, std::vector<Id>{"NEW_STOP"});
+  CHECK(diff[0].removed.empty());
+  // The last stop had no line break, so its zone_id and stop_url are not changed.
+  CHECK(diff[0].changed.empty());
+  CHECK_EQ(diff[1].filename, file_calendar_dates);
+  CHECK_EQ(diff[1].added, std::vector<Id>{"WE"});
+  CHECK(diff[1].changed.empty());
+
+  // Indexes depending on the re-read files are rebuilt, the rest are kept.
+  CHECK_EQ(feed.get_stops().size(), original_feed.get_stops().size() + 1);
+  CHECK(feed.has_indexes());
+  REQUIRE(feed.find_stop("NEW_STOP"));
+  CHECK_EQ(feed.find_stop("NEW_STOP")->stop_name, "New stop");
+  CHECK(feed.has_stop_times_index());
+  CHECK(feed.has_service_days_index());
+  CHECK(feed.is_service_active("WE", Date(2007, 6, 5)));
+
+  const FeedDiff feed_diff = original_feed.get_diff(feed);
+  REQUIRE_EQ(feed_diff.size(), 2);
+  CHECK_EQ(feed_diff[0].added, diff[0].added);
+  CHECK_EQ(feed_diff[1].added, diff[1].added);
+  CHECK(feed.get_diff(feed).empty());
+
+  const FeedDiff reverse_diff = feed.get_diff(original_feed);
+  REQUIRE_EQ(reverse_diff.size(), 2);
+  CHECK_EQ(reverse_diff[0].removed, std::vector<Id>{"NEW_STOP"});
+
+  // Records of the trip are compared together.
+  Feed changed_feed = original_feed;
+  StopTime stop_time = changed_feed.get_stop_times()[0];
+  stop_time.stop_sequence = 100;
+  changed_feed.add_stop_time(stop_time);
+  const FeedDiff stop_times_diff = original_feed.get_diff(changed_feed);
+  REQUIRE_EQ(stop_times_diff.size(), 1);
+  CHECK_EQ(stop_times_diff[0].filename, file_stop_times);
+  CHECK_EQ(stop_times_diff[0].changed, std::vector<Id>{stop_time.trip_id});
+
+  // The feed is not changed if the re-read file is invalid.
+  std::ofstream(path + file_trips) << "route_id,service_id\nAB,FULLW";
+  touch(path + file_trips);
+  CHECK_NE(feed.refresh(&diff), ResultCode::OK);
+  CHECK_EQ(feed.get_trips().size(), original_feed.get_trips().size());
+  CHECK(feed.find_trip("AB1"));
+  CHECK(original_feed.get_diff(feed).size() == 2);
+
+  Feed zip_feed("data/sample_feed.zip");
+  REQUIRE_EQ(zip_feed.read_feed(), ResultCode::OK);
+  zip_feed.enable_load_stats();
+  REQUIRE_EQ(zip_feed.refresh(), ResultCode::OK);
+  CHECK(zip_feed.get_load_stats().empty());
+  CHECK(feed.has_stop_times_index());
+}
+
+TEST_CASE("Validation of references")
+{
+  // Transfers and pathways of the sample feed refer to the stops absent in it.
+  Feed sample_feed("data/sample_feed");
+  REQUIRE_EQ(sample_feed.read_feed(), ResultCode::OK);
+  std::vector<ValidationError> errors;
+  CHECK_EQ(sample_feed.validate(&errors), ResultCode::ERROR_INVALID_REFERENCE);
+  REQUIRE_EQ(errors.size(), 4);
+  CHECK_EQ(errors[0].filename, file_transfers);
+  CHECK_EQ(errors[0].records_count, 4);
+  CHECK_EQ(errors[2].filename, file_pathways);
+  CHECK_EQ(errors[2].first_absent_id, "1073S");
+
+  ReadFeedOptions options;
+  options.skipped_files = {file_transfers, file_pathways};
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(options), ResultCode::OK);
+  CHECK_EQ(feed.validate(&errors), ResultCode::OK);
+  CHECK(errors.empty());
+
+  StopTime stop_time = feed.get_stop_times()[0];
+  stop_time.stop_id = "ABSENT_STOP";
+  feed.add_stop_time(stop_time);
+  stop_time.trip_id = "ABSENT_TRIP";
+  feed.add_stop_time(stop_time);
+  Trip trip = feed.get_trips()[0];
+  trip.route_id = "ABSENT_ROUTE";
+  trip.shape_id = "ABSENT_SHAPE";
+  feed.add_trip(trip);
+  Stop stop = feed.get_stops()[0];
+  stop.stop_id = "NEW_STOP";
+  stop.parent_station = feed.get_stops()[1].stop_id;
+  feed.add_stop(stop);
+
+  for (size_t threads_count : {1, 4})
+  {
+    const Result res = feed.validate(&errors, threads_count);
+    CHECK_EQ(res, ResultCode::ERROR_INVALID_REFERENCE);
+    CHECK_EQ(res.message, "5 references to absent ids, e.g. route_id ABSENT_ROUTE in trips.txt is "
+                          "absent in routes.txt");
+    REQUIRE_EQ(errors.size(), 4);
+    CHECK_EQ(errors[0].field, "route_id");
+    CHECK_EQ(errors[1].field, "shape_id");
+    CHECK_EQ(errors[1].first_absent_id, "ABSENT_SHAPE");
+    CHECK_EQ(errors[2].filename, file_stop_times);
+    CHECK_EQ(errors[2].field, "trip_id");
+    CHECK_EQ(errors[2].records_count, 1);
+    CHECK_EQ(errors[3].field, "stop_id");
+    CHECK_EQ(errors[3].referenced_filename, file_stops);
+    CHECK_EQ(errors[3].records_count, 2);
+    CHECK_EQ(errors[3].first_absent_id, "ABSENT_STOP");
+  }
+
+  Feed columnar_feed("data/sample_feed", StorageLayout::Columns);
+  REQUIRE_EQ(columnar_feed.read_feed(options), ResultCode::OK);
+  CHECK_EQ(columnar_feed.validate(), ResultCode::OK);
+  columnar_feed.add_stop_time(stop_time);
+  CHECK_EQ(columnar_feed.validate(&errors), ResultCode::ERROR_INVALID_REFERENCE);
+  REQUIRE_EQ(errors.size(), 2);
+  CHECK_EQ(errors[0].first_absent_id, "ABSENT_TRIP");
+  CHECK_EQ(errors[1].first_absent_id, "ABSENT_STOP");
+}
+
 TEST_CASE("Agency")
 {
   Feed feed("data/sample_feed");
@@ -423,6 +1493,150 @@ TEST_CASE("StopTimes")
   CHECK_EQ(feed.get_stop_times_for_trip("STBA").size(), 2);
 }
 
+TEST_CASE("StopTimes in parallel chunks")
+{
+  const size_t rows_count = 30000;
+  {
+    std::ofstream out("data/output_feed/stop_times.txt");
+    out << "trip_id,arrival_time,departure_time,stop_id,stop_sequence,stop_headsign\n";
+    for (size_t i = 0; i < rows_count; ++i)
+    {
+      const Time time(static_cast<uint16_t>(i / 3600), static_cast<uint16_t>(i / 60 % 60),
+                      static_cast<uint16_t>(i % 60));
+      out << "trip_" << i / 10 << "," << time.get_raw_time() << "," << time.get_raw_time()
+          << ",stop_" << i % 100 << "," << i % 10 << ",\"Head, sign\"\r\n";
+    }
+  }
+
+  Feed feed("data/output_feed");
+  REQUIRE_EQ(feed.read_stop_times(), ResultCode::OK);
+  Feed parallel_feed("data/output_feed");
+  REQUIRE_EQ(parallel_feed.read_stop_times(4), ResultCode::OK);
+
+  const auto & stop_times = feed.get_stop_times();
+  const auto & parallel_stop_times = parallel_feed.get_stop_times();
+  REQUIRE_EQ(stop_times.size(), rows_count);
+  REQUIRE_EQ(parallel_stop_times.size(), rows_count);
+  // The container is reserved by the estimated rows count:
+  CHECK_LE(stop_times.capacity(), rows_count + rows_count / 4);
+  // Chunks are appended to the container reserved for all rows:
+  CHECK_EQ(parallel_stop_times.capacity(), rows_count);
+  // Single thread parses the file serially:
+  Feed single_thread_feed("data/output_feed");
+  REQUIRE_EQ(single_thread_feed.read_stop_times(1), ResultCode::OK);
+  CHECK_EQ(single_thread_feed.get_stop_times().capacity(), stop_times.capacity());
+  for (size_t i = 0; i < rows_count; ++i)
+  {
+    REQUIRE_EQ(parallel_stop_times[i].trip_id, stop_times[i].trip_id);
+    REQUIRE_EQ(parallel_stop_times[i].stop_id, stop_times[i].stop_id);
+    REQUIRE_EQ(parallel_stop_times[i].stop_sequence, stop_times[i].stop_sequence);
+    REQUIRE_EQ(parallel_stop_times[i].arrival_time, stop_times[i].arrival_time);
+    REQUIRE_EQ(parallel_stop_times[i].stop_headsign, "Head, sign");
+  }
+
+  // The first invalid record in the file is reported:
+  {
+    std::ofstream out("data/output_feed/stop_times.txt", std::ios::app);
+    out << "trip_x,10:00:00,10:00:00,stop_x,wrong_sequence\n";
+    out << "trip_y,10:00:00,10:00:00\n";
+  }
+  Feed invalid_feed("data/output_feed");
+  const Result res = invalid_feed.read_stop_times();
+  Feed invalid_parallel_feed("data/output_feed");
+  const Result parallel_res = invalid_parallel_feed.read_stop_times(4);
+  CHECK_EQ(res.code, ResultCode::ERROR_INVALID_FIELD_FORMAT);
+  CHECK_EQ(parallel_res.code, res.code);
+  CHECK_EQ(parallel_res.message, res.message);
+  CHECK_EQ(invalid_parallel_feed.get_stop_times().size(), rows_count);
+}
+
+TEST_CASE("StopTimes index")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  CHECK_FALSE(feed.has_stop_times_index());
+  CHECK_THROWS_AS(feed.get_stop_times_range_for_trip("STBA"), const std::logic_error &);
+
+  Feed indexed_feed("data/sample_feed");
+  REQUIRE_EQ(indexed_feed.read_feed(), ResultCode::OK);
+  indexed_feed.build_stop_times_index();
+  REQUIRE(indexed_feed.has_stop_times_index());
+
+  for (const auto & trip : feed.get_trips())
+  {
+    const StopTimes expected = feed.get_stop_times_for_trip(trip.trip_id);
+    const StopTimesRange range = indexed_feed.get_stop_times_range_for_trip(trip.trip_id);
+    REQUIRE_EQ(range.size(), expected.size());
+    CHECK(std::equal(range.begin(), range.end(), expected.begin(),
+                     [](const StopTime & t1, const StopTime & t2) {
+                       return t1.stop_id == t2.stop_id && t1.stop_sequence == t2.stop_sequence;
+                     }));
+    CHECK_EQ(indexed_feed.get_stop_times_for_trip(trip.trip_id).size(), expected.size());
+  }
+
+  for (const auto & stop : feed.get_stops())
+  {
+    const StopTimesRange range = indexed_feed.get_stop_times_range_for_stop(stop.stop_id);
+    CHECK_EQ(range.size(), feed.get_stop_times_for_stop(stop.stop_id).size());
+    CHECK(std::is_sorted(range.begin(), range.end(), [](const StopTime & t1, const StopTime & t2) {
+      return t1.departure_time.get_total_seconds() < t2.departure_time.get_total_seconds();
+    }));
+    for (const auto & stop_time : range)
+      CHECK_EQ(stop_time.stop_id, stop.stop_id);
+  }
+
+  CHECK(indexed_feed.get_stop_times_range_for_trip("missing_trip").empty());
+
+  indexed_feed.add_stop_time(StopTime());
+  CHECK_FALSE(indexed_feed.has_stop_times_index());
+}
+
+TEST_CASE("Streaming stop times and shapes")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_stop_times(), ResultCode::OK);
+  REQUIRE_EQ(feed.read_shapes(), ResultCode::OK);
+
+  Feed streaming_feed("data/sample_feed");
+  size_t stop_times_count = 0;
+  const auto & stop_times = feed.get_stop_times();
+  auto stop_times_handler = [&](const StopTime & stop_time) {
+    REQUIRE(stop_times_count < stop_times.size());
+    const auto & expected = stop_times[stop_times_count++];
+    CHECK_EQ(stop_time.trip_id, expected.trip_id);
+    CHECK_EQ(stop_time.stop_id, expected.stop_id);
+    CHECK_EQ(stop_time.stop_sequence, expected.stop_sequence);
+    CHECK_EQ(stop_time.arrival_time, expected.arrival_time);
+    CHECK_EQ(stop_time.departure_time, expected.departure_time);
+    CHECK_EQ(stop_time.stop_headsign, expected.stop_headsign);
+    CHECK_EQ(stop_time.pickup_type, expected.pickup_type);
+    CHECK_EQ(stop_time.drop_off_type, expected.drop_off_type);
+    CHECK_EQ(stop_time.shape_dist_traveled, expected.shape_dist_traveled);
+    CHECK_EQ(stop_time.timepoint, expected.timepoint);
+  };
+  REQUIRE_EQ(streaming_feed.for_each_stop_time(stop_times_handler), ResultCode::OK);
+  CHECK_EQ(stop_times_count, stop_times.size());
+  CHECK(streaming_feed.get_stop_times().empty());
+
+  size_t shapes_count = 0;
+  const auto & shapes = feed.get_shapes();
+  auto shapes_handler = [&](const ShapePoint & point) {
+    REQUIRE(shapes_count < shapes.size());
+    const auto & expected = shapes[shapes_count++];
+    CHECK_EQ(point.shape_id, expected.shape_id);
+    CHECK_EQ(point.shape_pt_sequence, expected.shape_pt_sequence);
+    CHECK_EQ(point.shape_pt_lat, expected.shape_pt_lat);
+    CHECK_EQ(point.shape_pt_lon, expected.shape_pt_lon);
+    CHECK_EQ(point.shape_dist_traveled, expected.shape_dist_traveled);
+  };
+  REQUIRE_EQ(streaming_feed.for_each_shape_point(shapes_handler), ResultCode::OK);
+  CHECK_EQ(shapes_count, shapes.size());
+  CHECK(streaming_feed.get_shapes().empty());
+
+  Feed missing_feed("data/missing_feed");
+  CHECK_EQ(missing_feed.for_each_stop_time(stop_times_handler), ResultCode::ERROR_FILE_ABSENT);
+}
+
 TEST_CASE("Shapes")
 {
   Feed feed("data/sample_feed");
@@ -438,6 +1652,159 @@ TEST_CASE("Shapes")
 
   const auto & shape = feed.get_shape("10237");
   CHECK_EQ(shape.size(), 4);
+
+  Feed parallel_feed("data/sample_feed");
+  REQUIRE_EQ(parallel_feed.read_shapes(2), ResultCode::OK);
+  REQUIRE_EQ(parallel_feed.get_shapes().size(), 8);
+  CHECK_EQ(parallel_feed.get_shapes()[7].shape_pt_sequence, shapes[7].shape_pt_sequence);
+}
+
+TEST_CASE("Shapes and spatial index")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  CHECK_THROWS_AS(feed.get_shape_polyline("10237"), const std::logic_error &);
+  CHECK_THROWS_AS(feed.get_nearest_stop(36.9, -116.8), const std::logic_error &);
+
+  ShapePoint point;
+  point.shape_id = "10237";
+  point.shape_pt_lat = 43.5176;
+  point.shape_pt_lon = -79.6906;
+  point.shape_pt_sequence = 50016;
+  feed.add_shape(point);
+
+  feed.build_shapes_index();
+  REQUIRE(feed.has_shapes_index());
+  CHECK(feed.get_shape_polyline("missing_shape").empty());
+
+  const ShapePolyline polyline = feed.get_shape_polyline("10237");
+  REQUIRE_EQ(polyline.size, 5);
+  CHECK_EQ(polyline.sequences[0], 50016);
+  CHECK_EQ(polyline.lats[0], 43.5176);
+  CHECK_EQ(polyline.sequences[4], 50020);
+  CHECK_EQ(polyline.lons[4], -79.6906278048);
+  CHECK_EQ(polyline.dist_traveled[4], 12669);
+
+  const Shape shape = feed.get_shape("10237");
+  REQUIRE_EQ(shape.size(), 5);
+  CHECK_EQ(shape[0].shape_pt_sequence, 50016);
+  CHECK_EQ(shape[0].shape_id, "10237");
+  CHECK_EQ(feed.get_shape("10237", false)[0].shape_pt_sequence, 50017);
+
+  feed.build_spatial_index();
+  REQUIRE(feed.has_spatial_index());
+
+  const auto shape_ids = feed.get_shapes_in_box({43.0, -80.0, 44.0, -79.0});
+  REQUIRE_EQ(shape_ids.size(), 2);
+  CHECK_EQ(shape_ids[0], "10237");
+  CHECK_EQ(shape_ids[1], "10243");
+  CHECK_EQ(feed.get_shapes_in_box({43.6446, -79.5252, 43.6447, -79.5251}),
+           std::vector<Id>{"10243"});
+  CHECK(feed.get_shapes_in_box({43.6, -79.6, 43.62, -79.58}).empty());
+
+  const auto stops = feed.get_stops_in_box({36.9, -116.8, 37.0, -116.7});
+  REQUIRE_EQ(stops.size(), 5);
+  CHECK_EQ(stops[0].stop_id, "STAGECOACH");
+  CHECK_EQ(stops[4].stop_id, "EMSI");
+
+  const auto nearest_stop = feed.get_nearest_stop(36.9149, -116.7683);
+  REQUIRE(nearest_stop.has_value());
+  CHECK_EQ(nearest_stop->stop_id, "NADAV");
+  CHECK_EQ(feed.get_nearest_stop(36.0, -117.0)->stop_id, "FUR_CREEK_RES");
+  CHECK_EQ(feed.get_nearest_stop(40.0, -116.76)->stop_id, "STAGECOACH");
+  // Points far from the grid skip the empty rings between them and the grid:
+  CHECK_EQ(feed.get_nearest_stop(36.6, 170.0)->stop_id, "AMV");
+  CHECK_EQ(feed.get_nearest_stop(-80.0, -116.8)->stop_id, "FUR_CREEK_RES");
+
+  feed.add_stop(Stop());
+  CHECK_FALSE(feed.has_spatial_index());
+  CHECK(feed.has_shapes_index());
+  feed.add_shape(point);
+  CHECK_FALSE(feed.has_shapes_index());
+
+  Feed columnar_feed("data/sample_feed", StorageLayout::Columns);
+  REQUIRE_EQ(columnar_feed.read_feed(), ResultCode::OK);
+  columnar_feed.build_spatial_index(0.001);
+  REQUIRE(columnar_feed.has_shapes_index());
+  CHECK_EQ(columnar_feed.get_shape_polyline("10243").size, 4);
+  CHECK_EQ(columnar_feed.get_shape("10243")[3].shape_pt_sequence, 10004);
+  CHECK_EQ(columnar_feed.get_shapes_in_box({43.0, -80.0, 44.0, -79.0}).size(), 2);
+  CHECK_EQ(columnar_feed.get_nearest_stop(36.9149, -116.7683)->stop_id, "NADAV");
+}
+
+TEST_CASE("Reading files drops the indexes built from them")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  auto build_all = [&feed]() {
+    feed.build_stop_times_index();
+    feed.build_service_days_index();
+    feed.build_spatial_index();
+  };
+
+  build_all();
+  REQUIRE_EQ(feed.read_calendar_dates(), ResultCode::OK);
+  CHECK_FALSE(feed.has_service_days_index());
+  CHECK(feed.has_stop_times_index());
+  CHECK(feed.has_spatial_index());
+
+  build_all();
+  REQUIRE_EQ(feed.read_stops(), ResultCode::OK);
+  CHECK_FALSE(feed.has_spatial_index());
+  CHECK(feed.has_shapes_index());
+
+  build_all();
+  ReadFeedOptions options(4);
+  options.skipped_files = {file_calendar, file_calendar_dates};
+  REQUIRE_EQ(feed.read_feed(options), ResultCode::OK);
+  CHECK_FALSE(feed.has_stop_times_index());
+  CHECK_FALSE(feed.has_shapes_index());
+  CHECK_FALSE(feed.has_spatial_index());
+  CHECK(feed.has_service_days_index());
+}
+
+TEST_CASE("Columnar stop times and shapes")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+
+  Feed columnar_feed("data/sample_feed", StorageLayout::Columns);
+  REQUIRE_EQ(columnar_feed.read_feed(), ResultCode::OK);
+  CHECK(columnar_feed.get_stop_times().empty());
+  CHECK(columnar_feed.get_shapes().empty());
+
+  const auto & stop_times = feed.get_stop_times();
+  const auto & columnar_stop_times = columnar_feed.get_columnar_stop_times();
+  REQUIRE_EQ(columnar_stop_times.size(), stop_times.size());
+  for (size_t i = 0; i < stop_times.size(); ++i)
+  {
+    CHECK_EQ(columnar_stop_times.get_trip_ids()[i], stop_times[i].trip_id);
+    CHECK_EQ(columnar_stop_times.get_departure_times()[i], stop_times[i].departure_time);
+    CHECK_EQ(columnar_stop_times[i].stop_id, stop_times[i].stop_id);
+    CHECK_EQ(columnar_stop_times.get(i).stop_sequence, stop_times[i].stop_sequence);
+  }
+  size_t rows_count = 0;
+  for (const auto & row : columnar_stop_times)
+    rows_count += row.trip_id.empty() ? 0 : 1;
+  CHECK_EQ(rows_count, stop_times.size());
+  CHECK_EQ(columnar_feed.get_stop_times_for_trip("STBA").size(),
+           feed.get_stop_times_for_trip("STBA").size());
+  CHECK_EQ(columnar_feed.get_stop_times_for_stop("STAGECOACH").size(),
+           feed.get_stop_times_for_stop("STAGECOACH").size());
+  CHECK_THROWS_AS(columnar_feed.build_stop_times_index(), const std::logic_error &);
+
+  const auto & columnar_shapes = columnar_feed.get_columnar_shapes();
+  REQUIRE_EQ(columnar_shapes.size(), feed.get_shapes().size());
+  CHECK_EQ(columnar_shapes.get_shape_pt_lats()[0], feed.get_shapes()[0].shape_pt_lat);
+  CHECK_EQ(columnar_feed.get_shape("10237").size(), 4);
+
+  Feed parallel_feed("data/sample_feed", StorageLayout::Columns);
+  REQUIRE_EQ(parallel_feed.read_stop_times(4), ResultCode::OK);
+  REQUIRE_EQ(parallel_feed.read_shapes(2), ResultCode::OK);
+  CHECK_EQ(parallel_feed.get_columnar_stop_times().get_stop_ids(),
+           columnar_stop_times.get_stop_ids());
+  CHECK_EQ(parallel_feed.get_columnar_shapes().get_shape_pt_sequences(),
+           columnar_shapes.get_shape_pt_sequences());
 }
 
 TEST_CASE("Calendar")
@@ -472,6 +1839,48 @@ TEST_CASE("Calendar dates")
   CHECK_EQ(calendar_dates_for_service.size(), 1);
 }
 
+TEST_CASE("Service days index")
+{
+  CHECK_EQ(get_days_since_epoch(Date(1970, 1, 1)), 0);
+  CHECK_EQ(get_days_since_epoch(Date(2000, 3, 1)), 11017);
+  CHECK_EQ(get_days_since_epoch(Date(1969, 12, 31)), -1);
+
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  CHECK_FALSE(feed.has_service_days_index());
+  CHECK_THROWS_AS(feed.is_service_active("FULLW", Date(2007, 6, 5)), const std::logic_error &);
+
+  feed.build_service_days_index();
+  REQUIRE(feed.has_service_days_index());
+
+  // Tuesday, Saturday and Monday with the removed service:
+  CHECK(feed.is_service_active("FULLW", Date(2007, 6, 5)));
+  CHECK_FALSE(feed.is_service_active("WE", Date(2007, 6, 5)));
+  CHECK(feed.is_service_active("WE", Date(2007, 6, 9)));
+  CHECK_FALSE(feed.is_service_active("FULLW", Date(2007, 6, 4)));
+  CHECK(feed.is_service_active("FULLW", Date(2010, 12, 31)));
+  CHECK_FALSE(feed.is_service_active("FULLW", Date(2011, 1, 1)));
+  CHECK_FALSE(feed.is_service_active("FULLW", Date()));
+  CHECK_FALSE(feed.is_service_active("missing_service", Date(2007, 6, 5)));
+
+  CHECK_EQ(feed.get_active_trips(Date(2007, 6, 5)).size(), 7);
+  CHECK_EQ(feed.get_active_trips(Date(2007, 6, 9)).size(), 11);
+  CHECK(feed.get_active_trips(Date(2007, 6, 4)).empty());
+  CHECK(feed.get_active_trips(Date(2006, 6, 4)).empty());
+
+  // Service which is defined only by the exceptions:
+  CalendarDate calendar_date;
+  calendar_date.service_id = "EXTRA";
+  calendar_date.date = Date(2012, 1, 1);
+  feed.add_calendar_date(calendar_date);
+  CHECK_FALSE(feed.has_service_days_index());
+
+  feed.build_service_days_index();
+  CHECK(feed.is_service_active("EXTRA", Date(2012, 1, 1)));
+  CHECK_FALSE(feed.is_service_active("EXTRA", Date(2011, 12, 31)));
+  CHECK_FALSE(feed.is_service_active("WE", Date(2011, 12, 31)));
+}
+
 TEST_CASE("Frequencies")
 {
   Feed feed("data/sample_feed");
@@ -488,6 +1897,244 @@ TEST_CASE("Frequencies")
   CHECK_EQ(frequencies_for_trip.size(), 5);
 }
 
+TEST_CASE("Frequency-based trip instances")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  CHECK_THROWS_AS(feed.get_trip_instances("CITY1", Time(7, 30, 0), Time(8, 30, 0)),
+                  const std::logic_error &);
+  feed.build_stop_times_index();
+
+  // Departures of two frequencies with headways of 30 and 10 minutes are in the window.
+  const TripInstances instances = feed.get_trip_instances("CITY1", Time(7, 30, 0), Time(8, 30, 0));
+  REQUIRE_EQ(instances.size(), 4);
+  CHECK_EQ(instances[0].get_start_time(), Time(7, 30, 0));
+  CHECK_EQ(instances[0].get_trip_id(), "CITY1");
+  CHECK_EQ(instances[0].size(), 5);
+  CHECK_EQ(instances[0].get_arrival_time(1), Time(7, 35, 0));
+  CHECK_EQ(instances[0].get_departure_time(1), Time(7, 37, 0));
+  CHECK_EQ(instances[1].get_start_time(), Time(8, 0, 0));
+
+  const StopTime last_stop = instances[3].get_stop_time(4);
+  CHECK_EQ(last_stop.stop_id, "EMSI");
+  CHECK_EQ(last_stop.departure_time, Time(8, 48, 0));
+  CHECK_EQ(instances[3].get_template_stop_times()[4].departure_time, Time(6, 28, 0));
+
+  std::vector<size_t> starts;
+  for (const TripInstance & instance : instances)
+    starts.push_back(instance.get_start_time().get_total_seconds());
+  CHECK_EQ(starts, std::vector<size_t>({27000, 28800, 29400, 30000}));
+
+  // End times are exclusive: the service ending at 22:00:00 doesn't depart at 22:00:00.
+  CHECK_EQ(feed.get_trip_instances("CITY1", Time(0, 0, 0), Time(24, 0, 0)).size(),
+           4 + 12 + 12 + 18 + 6);
+  CHECK(feed.get_trip_instances("AB1", Time(0, 0, 0), Time(24, 0, 0)).empty());
+
+  const TripInstances all_instances = feed.get_trip_instances(Time(6, 0, 0), Time(6, 1, 0));
+  REQUIRE_EQ(all_instances.size(), 3);
+  CHECK_EQ(all_instances[0].get_trip_id(), "STBA");
+  CHECK_EQ(all_instances[1].get_trip_id(), "CITY1");
+  CHECK_EQ(all_instances[2].get_trip_id(), "CITY2");
+  CHECK_EQ(all_instances[0].get_departure_time(1), Time(6, 20, 0));
+}
+
+TEST_CASE("Routing timetable")
+{
+  for (const auto layout : {StorageLayout::Rows, StorageLayout::Columns})
+  {
+    Feed feed("data/sample_feed", layout);
+    REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+
+    TimetableOptions options;
+    options.expand_frequencies = false;
+    Timetable timetable;
+    REQUIRE_EQ(feed.build_timetable(timetable, options), ResultCode::OK);
+    REQUIRE_EQ(timetable.stop_ids.size(), 9);
+    CHECK_EQ(timetable.stop_ids[1], "BEATTY_AIRPORT");
+    CHECK_EQ(timetable.stops_index.at("AMV"), 8);
+    CHECK_EQ(timetable.service_ids, std::vector<Id>({"FULLW", "WE"}));
+
+    // Trips AAMV1 and AAMV3 share the pattern, AAMV2 and AAMV4 share the reversed one.
+    REQUIRE_EQ(timetable.patterns.size(), 9);
+    const Timetable::Pattern & pattern = timetable.patterns[7];
+    CHECK_EQ(timetable.route_ids[pattern.route], "AAMV");
+    CHECK_EQ(pattern.stops_count, 2);
+    CHECK_EQ(timetable.pattern_stops[pattern.first_stop + 1], 8);
+    REQUIRE_EQ(pattern.trips_count, 2);
+    CHECK_EQ(timetable.trip_ids[pattern.first_trip], "AAMV1");
+    CHECK_EQ(timetable.trip_ids[pattern.first_trip + 1], "AAMV3");
+    CHECK_EQ(timetable.trip_services[pattern.first_trip], 1);
+    CHECK_EQ(std::vector<uint32_t>(timetable.departures.begin() + pattern.first_time,
+                                   timetable.departures.begin() + pattern.first_time + 4),
+             std::vector<uint32_t>({28800, 32400, 46800, 50400}));
+
+    const size_t airport = 1;
+    CHECK_EQ(std::vector<uint32_t>(
+                 timetable.stop_patterns.begin() + timetable.stop_patterns_offsets[airport],
+                 timetable.stop_patterns.begin() + timetable.stop_patterns_offsets[airport + 1]),
+             std::vector<uint32_t>({0, 1, 2, 7, 8}));
+    // Transfers and pathways of the sample feed refer to absent stops.
+    CHECK(timetable.footpaths.empty());
+    CHECK_EQ(timetable.footpaths_offsets.size(), 10);
+
+    // Frequency-based trips are replaced by their departures.
+    REQUIRE_EQ(feed.build_timetable(timetable), ResultCode::OK);
+    REQUIRE_EQ(timetable.patterns.size(), 9);
+    CHECK_EQ(timetable.patterns[2].trips_count, 32);
+    const Timetable::Pattern & city = timetable.patterns[3];
+    REQUIRE_EQ(city.trips_count, 4 + 12 + 12 + 18 + 6);
+    CHECK_EQ(timetable.trip_ids[city.first_trip + 2], "CITY1");
+    CHECK_EQ(timetable.departures[city.first_time + 2 * city.stops_count],
+             Time(7, 0, 0).get_total_seconds());
+    CHECK_EQ(timetable.arrivals[city.first_time + 2 * city.stops_count + 1],
+             Time(7, 5, 0).get_total_seconds());
+  }
+
+  Feed feed;
+  for (const char * stop_id : {"S1", "S2", "S3"})
+  {
+    Stop stop;
+    stop.stop_id = stop_id;
+    feed.add_stop(stop);
+  }
+  Route route;
+  route.route_id = "R1";
+  feed.add_route(route);
+  auto add_trip = [&feed](const Id & trip_id, std::vector<Time> times) {
+    Trip trip;
+    trip.route_id = "R1";
+    trip.service_id = "WD";
+    trip.trip_id = trip_id;
+    feed.add_trip(trip);
+    for (size_t i = 0; i < times.size(); ++i)
+    {
+      StopTime stop_time;
+      stop_time.trip_id = trip_id;
+      stop_time.stop_id = "S" + std::to_string(i + 1);
+      stop_time.stop_sequence = 3 - i;
+      stop_time.arrival_time = times[i];
+      stop_time.departure_time = times[i];
+      feed.add_stop_time(stop_time);
+    }
+  };
+  // T1 has no time at the middle stop. T2 departs later and overtakes it.
+  add_trip("T1", {Time(8, 20, 0), Time(), Time(8, 0, 0)});
+  add_trip("T2", {Time(8, 15, 0), Time(8, 10, 0), Time(8, 5, 0)});
+
+  Transfer transfer;
+  transfer.from_stop_id = "S1";
+  transfer.to_stop_id = "S3";
+  transfer.transfer_type = TransferType::MinimumTime;
+  transfer.min_transfer_time = 120;
+  feed.add_transfer(transfer);
+  transfer.transfer_type = TransferType::NotPossible;
+  transfer.to_stop_id = "S2";
+  feed.add_transfer(transfer);
+  Pathway pathway;
+  pathway.from_stop_id = "S3";
+  pathway.to_stop_id = "S1";
+  pathway.is_bidirectional = PathwayDirection::Bidirectional;
+  pathway.traversal_time = 60;
+  feed.add_pathway(pathway);
+
+  Timetable timetable;
+  REQUIRE_EQ(feed.build_timetable(timetable), ResultCode::OK);
+  REQUIRE_EQ(timetable.patterns.size(), 2);
+  CHECK_EQ(timetable.pattern_stops, std::vector<uint32_t>({2, 1, 0, 2, 1, 0}));
+  CHECK_EQ(timetable.trip_ids, std::vector<Id>({"T1", "T2"}));
+  CHECK_EQ(timetable.arrivals[1], Time(8, 10, 0).get_total_seconds());
+  CHECK_EQ(timetable.stop_patterns, std::vector<uint32_t>({0, 1, 0, 1, 0, 1}));
+
+  // The shortest of the footpaths from S1 to S3 is kept.
+  CHECK_EQ(timetable.footpaths_offsets, std::vector<size_t>({0, 1, 1, 2}));
+  REQUIRE_EQ(timetable.footpaths.size(), 2);
+  CHECK_EQ(timetable.footpaths[0].stop, 2);
+  CHECK_EQ(timetable.footpaths[0].duration, 60);
+  CHECK_EQ(timetable.footpaths[1].stop, 0);
+
+  StopTime stop_time;
+  stop_time.trip_id = "T1";
+  stop_time.stop_id = "S4";
+  feed.add_stop_time(stop_time);
+  CHECK_EQ(feed.build_timetable(timetable), ResultCode::ERROR_INVALID_REFERENCE);
+  CHECK_EQ(timetable.patterns.size(), 2);
+}
+
+TEST_CASE("Merge of feeds")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+  feed.build_indexes();
+  Feed other("data/sample_feed", StorageLayout::Columns);
+  REQUIRE_EQ(other.read_feed(), ResultCode::OK);
+
+  MergePolicy policy;
+  policy.id_collision = IdCollision::Fail;
+  CHECK_EQ(feed.merge(other, policy), ResultCode::ERROR_DUPLICATE_ID);
+  CHECK_EQ(feed.get_routes().size(), 5);
+  CHECK_EQ(feed.get_stop_times().size(), 28);
+
+  // Agencies, stops and fare attributes are the same, the other ids collide and get the prefix.
+  policy.id_collision = IdCollision::PrefixColliding;
+  policy.prefix = "b:";
+  REQUIRE_EQ(feed.merge(other, policy), ResultCode::OK);
+  CHECK_EQ(feed.get_agencies().size(), 1);
+  CHECK_EQ(feed.get_stops().size(), 9);
+  CHECK_EQ(feed.get_fare_attributes().size(), 3);
+  CHECK_EQ(feed.get_routes().size(), 10);
+  CHECK_EQ(feed.get_stop_times().size(), 56);
+  CHECK_EQ(feed.get_calendar_dates().size(), 2);
+  CHECK_EQ(feed.get_feed_info().feed_publisher_name, "Test Solutions, Inc.");
+
+  const Trip * trip = feed.find_trip("b:AB1");
+  REQUIRE(trip);
+  CHECK_EQ(trip->route_id, "b:AB");
+  CHECK_EQ(trip->service_id, "b:FULLW");
+  CHECK_EQ(trip->block_id, "b:1");
+  CHECK_EQ(feed.find_route("b:AB")->agency_id, "DTA");
+  CHECK_EQ(feed.get_stop_times()[28].trip_id, "b:STBA");
+  CHECK_EQ(feed.get_stop_times()[28].stop_id, "STAGECOACH");
+  CHECK_EQ(feed.get_fare_rules()[4].fare_id, "p");
+  CHECK_EQ(feed.get_fare_rules()[4].route_id, "b:AB");
+  CHECK_EQ(feed.get_frequencies()[11].trip_id, "b:STBA");
+  CHECK(feed.find_calendar("b:WE"));
+
+  // All ids get the prefix, stops are duplicates only within the tolerance.
+  Feed shifted;
+  Stop stop = other.get_stops()[0];
+  stop.stop_lat += 0.001;
+  shifted.add_stop(stop);
+  stop = other.get_stops()[1];
+  stop.stop_lat += 0.00001;
+  shifted.add_stop(stop);
+  Translation translation;
+  translation.table_name = "stops";
+  translation.field_name = "stop_name";
+  translation.language = "en";
+  for (const Stop & shifted_stop : shifted.get_stops())
+  {
+    translation.record_id = shifted_stop.stop_id;
+    shifted.add_translation(translation);
+  }
+
+  policy.id_collision = IdCollision::Prefix;
+  policy.prefix = "c:";
+  policy.stop_tolerance = 0.0001;
+  REQUIRE_EQ(feed.merge(shifted, policy), ResultCode::OK);
+  REQUIRE_EQ(feed.get_stops().size(), 10);
+  CHECK_EQ(feed.get_stops()[9].stop_id, "c:FUR_CREEK_RES");
+  CHECK(feed.find_stop("c:FUR_CREEK_RES"));
+  // The translation of the duplicate is skipped.
+  REQUIRE_EQ(feed.get_translations().size(), 3);
+  CHECK_EQ(feed.get_translations()[2].record_id, "c:FUR_CREEK_RES");
+
+  policy.stop_tolerance = -1.0;
+  REQUIRE_EQ(feed.merge(shifted, policy), ResultCode::ERROR_DUPLICATE_ID);
+  policy.prefix = "d:";
+  REQUIRE_EQ(feed.merge(shifted, policy), ResultCode::OK);
+  CHECK_EQ(feed.get_stops().size(), 12);
+}
+
 TEST_CASE("Fare attributes")
 {
   Feed feed("data/sample_feed");
@@ -657,4 +2304,56 @@ TEST_CASE("Agencies create & save")
   REQUIRE_EQ(feed_for_testing.read_agencies(), ResultCode::OK);
   CHECK_EQ(feed_for_writing.get_agencies(), feed_for_testing.get_agencies());
 }
+
+std::string read_file_contents(const std::filesystem::path & path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("Feed write & read in parallel")
+{
+  Feed feed("data/sample_feed");
+  REQUIRE_EQ(feed.read_feed(), ResultCode::OK);
+
+  // Enough stop times for several chunks:
+  for (size_t i = 0; i < 40000; ++i)
+  {
+    StopTime stop_time;
+    stop_time.trip_id = "trip_" + std::to_string(i / 20);
+    stop_time.stop_id = "stop_" + std::to_string(i % 300);
+    stop_time.stop_sequence = i % 20;
+    stop_time.arrival_time = Time(static_cast<uint16_t>(i % 30), 0, 0);
+    stop_time.departure_time = stop_time.arrival_time;
+    stop_time.shape_dist_traveled = static_cast<double>(i) / 3;
+    feed.add_stop_time(stop_time);
+  }
+
+  const std::filesystem::path serial_path = "data/output_feed/serial";
+  const std::filesystem::path parallel_path = "data/output_feed/parallel";
+  std::filesystem::create_directories(serial_path);
+  std::filesystem::create_directories(parallel_path);
+
+  REQUIRE_EQ(feed.write_feed(serial_path.string()), ResultCode::OK);
+  REQUIRE_EQ(feed.write_feed(parallel_path.string(), WriteFeedOptions{4}), ResultCode::OK);
+
+  size_t files_count = 0;
+  for (const auto & entry : std::filesystem::directory_iterator(serial_path))
+  {
+    ++files_count;
+    const auto parallel_file = parallel_path / entry.path().filename();
+    REQUIRE(std::filesystem::exists(parallel_file));
+    CHECK_EQ(read_file_contents(entry.path()), read_file_contents(parallel_file));
+  }
+  CHECK_EQ(files_count, 17);
+
+  Feed written_feed(parallel_path.string());
+  REQUIRE_EQ(written_feed.read_feed(), ResultCode::OK);
+  CHECK_EQ(written_feed.get_stop_times().size(), feed.get_stop_times().size());
+  CHECK_EQ(written_feed.get_agencies(), feed.get_agencies());
+
+  CHECK_EQ(feed.write_feed(""), ResultCode::ERROR_INVALID_GTFS_PATH);
+  CHECK_EQ(feed.write_feed("data/non_existing_dir", WriteFeedOptions{4}),
+           ResultCode::ERROR_INVALID_GTFS_PATH);
+}
 TEST_SUITE_END();